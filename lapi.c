@@ -426,6 +426,11 @@ LUA_API const char *lua_tolstring (lua_State *L, int idx, size_t *len) {
     luaC_checkGC(L);
     o = index2value(L, idx);  /* previous call may reallocate the stack */
   }
+  else if (isview(tsvalue(o))) {  /* no '\0' at the end? */
+    luaS_copyview(L, tsvalue(o));
+    advancegc(L, tsvalue(o)->u.lnglen);
+    o = index2value(L, idx);  /* previous call may reallocate the stack */
+  }
   lua_unlock(L);
   if (len != NULL)
     return getlstr(tsvalue(o), *len);
@@ -563,6 +568,31 @@ LUA_API const char *lua_pushextlstring (lua_State *L,
 }
 
 
+/*
+** Pushes the part of the string at index 'idx' with 'len' bytes from
+** position 'start' (0-based). Long parts may be views into the string
+** (see 'luaS_sub').
+*/
+LUA_API void lua_pushsubstring (lua_State *L, int idx, size_t start,
+                                                       size_t len) {
+  const TValue *o;
+  TString *ts, *res;
+  lua_lock(L);
+  o = index2value(L, idx);
+  api_check(L, ttisstring(o), "string expected");
+  ts = tsvalue(o);
+  api_check(L, start <= tsslen(ts) && len <= tsslen(ts) - start,
+               "substring out of bounds");
+  res = luaS_sub(L, ts, start, len);
+  setsvalue2s(L, L->top.p, res);
+  api_incr_top(L);
+  if (!isview(res))  /* a copy? */
+    advancegc(L, len);
+  luaC_checkGC(L);
+  lua_unlock(L);
+}
+
+
 LUA_API const char *lua_pushstring (lua_State *L, const char *s) {
   lua_lock(L);
   if (s == NULL)
@@ -790,7 +820,7 @@ LUA_API void lua_createtable (lua_State *L, unsigned narray, unsigned nrec) {
   sethvalue2s(L, L->top.p, t);
   api_incr_top(L);
   if (narray > 0 || nrec > 0)
-    luaH_resize(L, t, narray, nrec);
+    luaH_presize(L, t, narray, nrec);
   luaC_checkGC(L);
   lua_unlock(L);
 }
@@ -1273,6 +1303,165 @@ LUA_API int lua_next (lua_State *L, int idx) {
 }
 
 
+LUA_API void lua_setiterator (lua_State *L, int what, lua_CFunction f) {
+  lua_lock(L);
+  api_check(L, 0 <= what && what < LUA_NUMITERS, "invalid iterator");
+  G(L)->iterators[what] = f;
+  lua_unlock(L);
+}
+
+
+LUA_API void lua_compacttable (lua_State *L, int idx) {
+  Table *t;
+  lua_lock(L);
+  t = gettable(L, idx);
+  luaH_compact(L, t);
+  luaC_checkGC(L);
+  lua_unlock(L);
+}
+
+
+LUA_API void lua_cleartable (lua_State *L, int idx) {
+  Table *t;
+  lua_lock(L);
+  t = gettable(L, idx);
+  luaH_clear(L, t);
+  lua_unlock(L);
+}
+
+
+LUA_API void lua_clonetable (lua_State *L, int idx) {
+  Table *src, *t;
+  lua_lock(L);
+  src = gettable(L, idx);
+  t = luaH_new(L);
+  sethvalue2s(L, L->top.p, t);
+  api_incr_top(L);
+  luaH_clone(L, t, src);
+  luaC_checkGC(L);
+  lua_unlock(L);
+}
+
+
+LUA_API void lua_copytable (lua_State *L, int fromidx, int toidx) {
+  Table *src, *t;
+  lua_lock(L);
+  src = gettable(L, fromidx);
+  t = gettable(L, toidx);
+  luaH_copy(L, t, src);
+  luaC_checkGC(L);
+  lua_unlock(L);
+}
+
+
+/*
+** Sort the elements 1..n of the table at index 'idx' in place, in
+** ascending order, if they are all integers, all floats, or all
+** strings. Returns 0, doing nothing, for other elements.
+*/
+LUA_API int lua_sortarray (lua_State *L, int idx, lua_Integer n) {
+  const TValue *o;
+  int res = 0;
+  lua_lock(L);
+  o = index2value(L, idx);
+  if (ttistable(o) && l_castS2U(n) <= UINT_MAX)
+    res = luaH_sort(L, hvalue(o), cast_uint(n));
+  lua_unlock(L);
+  return res;
+}
+
+
+/*
+** Get the sizes of the table at index 'idx': its array size, its
+** number of nodes, and how many of them are in use (each may be
+** NULL). Returns the number of bytes allocated for the table.
+*/
+LUA_API size_t lua_tablesize (lua_State *L, int idx, unsigned *asize,
+                              unsigned *nnodes, unsigned *nused) {
+  Table *t;
+  size_t bytes;
+  lua_lock(L);
+  t = gettable(L, idx);
+  bytes = cast_sizet(luaH_memsize(t));
+  if (asize != NULL)
+    *asize = luaH_realasize(t);
+  if (nnodes != NULL || nused != NULL) {
+    unsigned int nn, nu;
+    luaH_nodeuse(t, &nn, &nu);
+    if (nnodes != NULL) *nnodes = nn;
+    if (nused != NULL) *nused = nu;
+  }
+  lua_unlock(L);
+  return bytes;
+}
+
+
+/*
+** Get the source of the function that created the table at index
+** 'idx', and in '*line' the line where it did that. Returns NULL if
+** that is not known.
+*/
+LUA_API const char *lua_tablesite (lua_State *L, int idx, int *line) {
+  const char *source = NULL;
+  Table *t;
+  lua_lock(L);
+  t = gettable(L, idx);
+#if LUA_USE_TABLESITES
+  if (t->site != NULL) {
+    source = (t->site->source) ? getstr(t->site->source) : "=?";
+    *line = luaG_getfuncline(t->site, t->sitepc);
+  }
+#else
+  UNUSED(t); UNUSED(line);
+#endif
+  lua_unlock(L);
+  return source;
+}
+
+
+/*
+** Push a sequence with the (at most) 'n' live tables with more bytes
+** allocated, largest first. Returns the length of that sequence. 'n'
+** is first limited to the number of tables, so that a large 'n' does
+** not allocate a large sequence.
+*/
+LUA_API unsigned lua_largesttables (lua_State *L, unsigned n) {
+  Table *res;
+  TValue v;
+  unsigned i;
+  lua_lock(L);
+  i = luaH_numtables(L);
+  if (n > i)
+    n = i;
+  res = luaH_new(L);
+  sethvalue2s(L, L->top.p, res);
+  api_incr_top(L);
+  luaH_resize(L, res, n, 0);
+  setbfvalue(&v);
+  for (i = 1; i <= n; i++)  /* fill the array part (see 'luaH_largest') */
+    luaH_setint(L, res, i, &v);
+  luaC_checkGC(L);
+  n = luaH_largest(L, res, n);
+  lua_unlock(L);
+  return n;
+}
+
+
+/*
+** Get statistics of the string table: its size (in '*size'), and the
+** largest and the total number of entries visited by searches that
+** find each string in it. Returns the number of strings in the table.
+*/
+LUA_API int lua_stringtable (lua_State *L, int *size, int *maxprobe,
+                                           size_t *totalprobe) {
+  int n;
+  lua_lock(L);
+  n = luaS_strtabstats(G(L), size, maxprobe, totalprobe);
+  lua_unlock(L);
+  return n;
+}
+
+
 LUA_API void lua_toclose (lua_State *L, int idx) {
   int nresults;
   StkId o;
@@ -35,6 +35,10 @@ typedef struct luaL_Buffer luaL_Buffer;
 #define LUA_PRELOAD_TABLE	"_PRELOAD"
 
 
+/* key, in the registry, for the cache of compiled patterns */
+#define LUA_PATTCACHE_TABLE	"_PATTCACHE"
+
+
 typedef struct luaL_Reg {
   const char *name;
   lua_CFunction func;
@@ -251,6 +255,33 @@ typedef struct luaL_Stream {
 
 /* }====================================================== */
 
+
+
+/*
+** {======================================================
+** String buffers for the string library
+** =======================================================
+*/
+
+/*
+** A string buffer is a userdata with metatable 'LUA_BUFFERHANDLE' and
+** structure 'luaL_StringBuffer'. Its contents are the 'n' characters
+** at 'b'. After the buffer hands its storage over to a string, 'b'
+** points to the contents of that string (kept as the first user value
+** of the userdata) and 'size' is zero until the buffer changes again.
+*/
+
+#define LUA_BUFFERHANDLE	"string.buffer"
+
+
+typedef struct luaL_StringBuffer {
+  char *b;  /* contents (NULL for a buffer without storage) */
+  size_t size;  /* size of the storage owned by the buffer */
+  size_t n;  /* number of characters in buffer */
+} luaL_StringBuffer;
+
+/* }====================================================== */
+
 /*
 ** {==================================================================
 ** "Abstraction Layer" for basic report of messages and errors
@@ -551,6 +551,9 @@ LUAMOD_API int luaopen_base (lua_State *L) {
   /* set global _VERSION */
   lua_pushliteral(L, LUA_VERSION);
   lua_setfield(L, -2, "_VERSION");
+  /* let generic 'for' loops run 'next' and 'ipairs' inline */
+  lua_setiterator(L, LUA_ITERNEXT, luaB_next);
+  lua_setiterator(L, LUA_ITERIPAIRS, ipairsaux);
   return 1;
 }
 
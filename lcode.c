@@ -1837,6 +1837,498 @@ static int finaltarget (Instruction *code, int i) {
 }
 
 
+/*
+** {======================================================================
+** Peephole optimizer
+** =======================================================================
+*/
+
+/*
+** By default, 'luaK_finish' runs a peephole optimizer over the code of
+** each function. Define LUA_USE_PEEPHOLE as 0 to turn that off.
+*/
+#if !defined(LUA_USE_PEEPHOLE)
+#define LUA_USE_PEEPHOLE	1
+#endif
+
+
+#if LUA_USE_PEEPHOLE
+
+/* flags for each instruction */
+#define PH_REACH	1  /* instruction can be executed */
+#define PH_LABEL	2  /* instruction is the target of some jump */
+#define PH_REMOVE	4  /* instruction will be removed */
+#define PH_RETARGET	8  /* instruction will get a new register A */
+
+
+/* no known value in a register */
+#define NOVALUE		(~(Instruction)0)
+
+/* register holds a copy of register 'r' */
+#define copyof(r)	CREATE_ABCk(OP_MOVE, 0, r, 0, 0)
+
+
+/*
+** Fill 'succ' with the instructions that can run after the one at
+** 'pc' and return how many they are. For a FORPREP, the (maybe
+** unreachable) FORLOOP also counts, as both must stay paired.
+*/
+static int successors (const Instruction *code, int pc, int *succ) {
+  Instruction i = code[pc];
+  OpCode op = GET_OPCODE(i);
+  switch (op) {
+    case OP_JMP:
+      succ[0] = pc + 1 + GETARG_sJ(i);
+      return 1;
+    case OP_RETURN: case OP_RETURN0: case OP_RETURN1:
+      return 0;
+    case OP_FORPREP:
+      succ[0] = pc + 1;
+      succ[1] = pc + GETARG_Bx(i) + 1;  /* FORLOOP */
+      succ[2] = pc + GETARG_Bx(i) + 2;  /* loop exit */
+      return 3;
+    case OP_TFORPREP:
+      succ[0] = pc + 1 + GETARG_Bx(i);  /* TFORCALL */
+      return 1;
+    case OP_FORLOOP: case OP_TFORLOOP:
+      succ[0] = pc + 1;
+      succ[1] = pc + 1 - GETARG_Bx(i);
+      return 2;
+    default:
+      succ[0] = pc + 1;
+      if (testTMode(op) || op == OP_LFALSESKIP) {  /* may skip next? */
+        succ[1] = pc + 2;
+        return 2;
+      }
+      return 1;
+  }
+}
+
+
+/*
+** Mark reachable instructions and jump targets, walking the code from
+** its entry point. ('stack' has space for one entry per instruction,
+** as each instruction is pushed at most once.)
+*/
+static void markreachable (const Instruction *code, lu_byte *flags,
+                           int *stack) {
+  int top = 0;
+  flags[0] |= PH_REACH;
+  stack[top++] = 0;
+  while (top > 0) {
+    int pc = stack[--top];
+    int succ[3];
+    int ns = successors(code, pc, succ);
+    while (ns-- > 0) {
+      int t = succ[ns];
+      if (t != pc + 1)
+        flags[t] |= PH_LABEL;
+      if (!(flags[t] & PH_REACH)) {
+        flags[t] |= PH_REACH;
+        stack[top++] = t;
+      }
+    }
+  }
+}
+
+
+/*
+** Compute the line of each instruction from the line information.
+*/
+static void getlines (const Proto *f, int n, int *lines) {
+  int line = f->linedefined;
+  int a = 0;  /* index in 'abslineinfo' */
+  int pc;
+  for (pc = 0; pc < n; pc++) {
+    if (f->lineinfo[pc] != ABSLINEINFO)
+      line += f->lineinfo[pc];
+    else {
+      lua_assert(f->abslineinfo[a].pc == pc);
+      line = f->abslineinfo[a++].line;
+    }
+    lines[pc] = line;
+  }
+}
+
+
+/*
+** Number of active local variables (that is, of registers holding
+** them) at instruction 'pc'.
+*/
+static int nactiveat (const Proto *f, int nvars, int pc) {
+  int n = 0;
+  int i;
+  for (i = 0; i < nvars; i++) {
+    if (f->locvars[i].startpc <= pc && pc < f->locvars[i].endpc)
+      n++;
+  }
+  return n;
+}
+
+
+/*
+** Instructions that only write their result into register A, reading
+** before that their other operands. (They can be retargeted to
+** another register.)
+*/
+static int simpledest (OpCode op) {
+  switch (op) {
+    case OP_MOVE: case OP_LOADI: case OP_LOADF: case OP_LOADK:
+    case OP_LOADFALSE: case OP_LOADTRUE: case OP_GETUPVAL:
+    case OP_GETTABUP: case OP_GETTABLE: case OP_GETI: case OP_GETFIELD:
+    case OP_UNM: case OP_BNOT: case OP_NOT: case OP_LEN:
+      return 1;
+    default:  /* arithmetic instructions */
+      return (OP_ADDI <= op && op <= OP_SHR);
+  }
+}
+
+
+/*
+** Value loaded by instruction 'i' without side effects, in a form
+** independent of its target register, or NOVALUE if 'i' is not such
+** a load.
+*/
+static Instruction loadedvalue (Instruction i) {
+  switch (GET_OPCODE(i)) {
+    case OP_LOADNIL:
+      SETARG_B(i, 0);  /* value of each register */
+      /* FALLTHROUGH */
+    case OP_LOADI: case OP_LOADF: case OP_LOADK:
+    case OP_LOADFALSE: case OP_LOADTRUE:
+      SETARG_A(i, 0);
+      return i;
+    default: return NOVALUE;
+  }
+}
+
+
+/*
+** Register 'reg' gets a new value: forget what it had and forget it
+** as the source of copies in other registers.
+*/
+static void forget (Instruction *known, int nregs, int reg) {
+  int r;
+  known[reg] = NOVALUE;
+  for (r = 0; r < nregs; r++) {
+    if (known[r] == copyof(reg))
+      known[r] = NOVALUE;
+  }
+}
+
+
+static void forgetall (Instruction *known, int nregs) {
+  int r;
+  for (r = 0; r < nregs; r++)
+    known[r] = NOVALUE;
+}
+
+
+/*
+** Is instruction 'i' redundant, given the values known in registers?
+*/
+static int redundant (const Instruction *known, Instruction i) {
+  int a = GETARG_A(i);
+  if (GET_OPCODE(i) == OP_MOVE) {
+    Instruction ka = known[a];
+    int b = GETARG_B(i);
+    if (ka == copyof(b) || known[b] == copyof(a))
+      return 1;  /* one is a copy of the other */
+    return (ka != NOVALUE && GET_OPCODE(ka) != OP_MOVE && ka == known[b]);
+  }
+  else if (GET_OPCODE(i) == OP_LOADNIL) {
+    int b;
+    for (b = GETARG_B(i); b >= 0; b--) {
+      if (known[a + b] != loadedvalue(i))
+        return 0;
+    }
+    return 1;
+  }
+  else {
+    Instruction v = loadedvalue(i);
+    return (v != NOVALUE && known[a] == v);
+  }
+}
+
+
+/*
+** Update the values known in registers after instruction 'i'. Only
+** instructions that cannot run other code (metamethods, finalizers)
+** keep what is known about registers not written by them, as that
+** code might change captured local variables.
+*/
+static void updateknown (Instruction *known, int nregs, Instruction i) {
+  int a = GETARG_A(i);
+  switch (GET_OPCODE(i)) {
+    case OP_MOVE: {
+      int b = GETARG_B(i);
+      Instruction kb = known[b];
+      forget(known, nregs, a);
+      if (kb != NOVALUE && GET_OPCODE(kb) != OP_MOVE)
+        known[a] = kb;  /* same constant */
+      else
+        known[a] = copyof(b);
+      break;
+    }
+    case OP_LOADNIL: {
+      int b = GETARG_B(i);
+      Instruction v = loadedvalue(i);
+      for (; b >= 0; b--) {
+        forget(known, nregs, a + b);
+        known[a + b] = v;
+      }
+      break;
+    }
+    case OP_LOADI: case OP_LOADF: case OP_LOADK:
+    case OP_LOADFALSE: case OP_LOADTRUE: {
+      forget(known, nregs, a);
+      known[a] = loadedvalue(i);
+      break;
+    }
+    case OP_LOADKX: case OP_LFALSESKIP: case OP_GETUPVAL: case OP_NOT: {
+      forget(known, nregs, a);
+      break;
+    }
+    case OP_JMP: case OP_SETUPVAL: case OP_EXTRAARG:
+      break;  /* no registers written */
+    default:  /* anything else may run code or write many registers */
+      forgetall(known, nregs);
+      break;
+  }
+}
+
+
+/*
+** Loads and moves, which cannot run other code.
+*/
+static int isloadmove (OpCode op) {
+  switch (op) {
+    case OP_MOVE: case OP_LOADI: case OP_LOADF: case OP_LOADK:
+    case OP_LOADFALSE: case OP_LOADTRUE: case OP_LOADNIL: case OP_GETUPVAL:
+      return 1;
+    default: return 0;
+  }
+}
+
+
+/*
+** Does load or move 'i' use register 'r'?
+*/
+static int touches (Instruction i, int r) {
+  int a = GETARG_A(i);
+  switch (GET_OPCODE(i)) {
+    case OP_MOVE: return (a == r || GETARG_B(i) == r);
+    case OP_LOADNIL: return (a <= r && r <= a + GETARG_B(i));
+    default: return (a == r);
+  }
+}
+
+
+/*
+** Instruction at 'pc' is a MOVE 'D := T'. If an instruction before it
+** only computes 'T', a temporary register not used after the MOVE,
+** return the index of that instruction, which can compute 'D'
+** directly (so that the MOVE can be removed). Otherwise, return -1.
+** Between the two there can be only loads and moves not using 'D' or
+** 'T', and jumps cannot enter that sequence.
+*/
+static int coalesce (const Proto *f, int nvars, const lu_byte *flags,
+                     int pc) {
+  const Instruction *code = f->code;
+  int d = GETARG_A(code[pc]);
+  int t = GETARG_B(code[pc]);
+  int x;
+  for (x = pc - 1; x >= 0; x--) {
+    Instruction i = code[x];
+    OpCode op = GET_OPCODE(i);
+    if ((flags[x + 1] & PH_LABEL) || (flags[x] & (PH_REMOVE | PH_RETARGET)))
+      return -1;  /* not a straight path, or already changed */
+    if (simpledest(op) && GETARG_A(i) == t)
+      break;  /* found instruction computing 'T' */
+    else if (!testMMMode(op) &&  /* not MMBIN after an arithmetic op.? */
+             !(isloadmove(op) && !touches(i, t) && !touches(i, d)))
+      return -1;
+  }
+  if (x < 0 ||
+      (GET_OPCODE(code[x]) == OP_MOVE && GETARG_B(code[x]) == d))
+    return -1;  /* no such instruction, or it would move 'D' into itself */
+  for (pc++; pc > x; pc--) {
+    if (t < nactiveat(f, nvars, pc))
+      return -1;  /* 'T' is a local variable */
+  }
+  return x;
+}
+
+
+/*
+** Make sure 'abslineinfo' has space for 'n' entries. It cannot raise an
+** error, as the caller holds a temporary block; if there is no memory,
+** return false (and the optimizations are not done).
+*/
+static int growabslines (lua_State *L, Proto *f, int n) {
+  if (n > f->sizeabslineinfo) {
+    void *na = luaM_realloc_(L, f->abslineinfo,
+                  cast_sizet(f->sizeabslineinfo) * sizeof(AbsLineInfo),
+                  cast_sizet(n) * sizeof(AbsLineInfo));
+    if (na == NULL)
+      return 0;
+    f->abslineinfo = cast(AbsLineInfo *, na);
+    f->sizeabslineinfo = n;
+  }
+  return 1;
+}
+
+
+/*
+** Number of entries in 'abslineinfo' for the kept instructions, as
+** computed by 'savelineinfo'.
+*/
+static int countabslines (const int *lines, const lu_byte *flags, int n,
+                          int previousline) {
+  int iwthabs = 0;
+  int count = 0;
+  int pc;
+  for (pc = 0; pc < n; pc++) {
+    if (!(flags[pc] & PH_REMOVE)) {
+      int linedif = lines[pc] - previousline;
+      if (abs(linedif) >= LIMLINEDIFF || iwthabs++ >= MAXIWTHABS) {
+        count++;
+        iwthabs = 1;
+      }
+      previousline = lines[pc];
+    }
+  }
+  return count;
+}
+
+
+/*
+** Fix the offsets of jumps and loops in instruction 'pc' for its new
+** position, given the new positions of all instructions in 'newpc'.
+*/
+static Instruction relocate (const Instruction *code, const int *newpc,
+                             int pc) {
+  Instruction i = code[pc];
+  int npc = newpc[pc];
+  switch (GET_OPCODE(i)) {
+    case OP_JMP:
+      SETARG_sJ(i, newpc[pc + 1 + GETARG_sJ(i)] - (npc + 1));
+      break;
+    case OP_FORPREP: case OP_TFORPREP:  /* jump to FORLOOP/TFORCALL */
+      SETARG_Bx(i, newpc[pc + 1 + GETARG_Bx(i)] - (npc + 1));
+      break;
+    case OP_FORLOOP: case OP_TFORLOOP:
+      SETARG_Bx(i, npc + 1 - newpc[pc + 1 - GETARG_Bx(i)]);
+      break;
+    default: break;
+  }
+  return i;
+}
+
+
+/*
+** Remove unreachable instructions (except the final return), jumps to
+** the next instruction, loads of values already in their registers,
+** and MOVEs from temporaries that can be computed directly in their
+** final registers. Line events do not change: a reachable instruction
+** is removed only if its line is the line of the instruction before it
+** (when that one is its only predecessor) or after it.
+*/
+static void peephole (FuncState *fs) {
+  lua_State *L = fs->ls->L;
+  Proto *f = fs->f;
+  const Instruction *code = f->code;
+  int n = fs->pc;
+  int nvars = fs->ndebugvars;
+  int nregs = f->maxstacksize;
+  size_t size = (3 * cast_sizet(n) + 1) * sizeof(int) + cast_sizet(n);
+  char *block = luaM_newvector(L, size, char);
+  int *lines = cast(int *, block);  /* line of each instruction */
+  int *newpc = lines + n;  /* new position of each instruction */
+  int *aux = newpc + n + 1;  /* stack for 'markreachable'; new A's */
+  lu_byte *flags = cast(lu_byte *, aux + n);
+  Instruction known[MAXREGS];  /* values known in each register */
+  int prevline = f->linedefined;  /* line of last kept instruction */
+  int nremoved = 0;
+  int pc;
+  for (pc = 0; pc < n; pc++)
+    flags[pc] = 0;
+  getlines(f, n, lines);
+  markreachable(code, flags, aux);
+  forgetall(known, nregs);
+  for (pc = 0; pc < n; pc++) {
+    Instruction i = code[pc];
+    int label = (flags[pc] & PH_LABEL);
+    int skippable = (pc > 0 && (testTMode(GET_OPCODE(code[pc - 1])) ||
+                                GET_OPCODE(code[pc - 1]) == OP_LFALSESKIP));
+    int x = -1;  /* instruction to be retargeted */
+    if (!(flags[pc] & PH_REACH)) {  /* dead code? */
+      if (pc < n - 1) {  /* not the final return? */
+        flags[pc] |= PH_REMOVE;
+        nremoved++;
+      }
+      continue;
+    }
+    if (label)
+      forgetall(known, nregs);  /* other paths arrive here */
+    if (!skippable &&  /* removing it would change what gets skipped */
+        ((pc + 1 < n && lines[pc] == lines[pc + 1]) ||
+         (!label && lines[pc] == prevline)) &&
+        ((GET_OPCODE(i) == OP_JMP && GETARG_sJ(i) == 0) ||
+         (!label && redundant(known, i)) ||
+         (!label && GET_OPCODE(i) == OP_MOVE &&
+          (x = coalesce(f, nvars, flags, pc)) >= 0))) {
+      flags[pc] |= PH_REMOVE;
+      nremoved++;
+      if (x >= 0) {  /* coalesced MOVE? */
+        Instruction nx = code[x];
+        SETARG_A(nx, GETARG_A(i));
+        flags[x] |= PH_RETARGET;
+        aux[x] = GETARG_A(i);
+        forget(known, nregs, GETARG_B(i));  /* 'x' does not write 'T' */
+        updateknown(known, nregs, nx);
+      }
+    }
+    else {
+      updateknown(known, nregs, i);
+      prevline = lines[pc];
+    }
+  }
+  if (nremoved > 0 &&
+      growabslines(L, f, countabslines(lines, flags, n, f->linedefined))) {
+    int k = 0;
+    for (pc = 0; pc < n; pc++) {
+      newpc[pc] = k;  /* (next kept instruction, if this one is removed) */
+      if (!(flags[pc] & PH_REMOVE)) k++;
+    }
+    newpc[n] = k;
+    fs->pc = 0;  /* rebuild code and line information */
+    fs->previousline = f->linedefined;
+    fs->iwthabs = 0;
+    fs->nabslineinfo = 0;
+    for (pc = 0; pc < n; pc++) {
+      if (!(flags[pc] & PH_REMOVE)) {
+        Instruction i = relocate(code, newpc, pc);
+        if (flags[pc] & PH_RETARGET)
+          SETARG_A(i, aux[pc]);
+        f->code[fs->pc++] = i;
+        savelineinfo(fs, f, lines[pc]);
+      }
+    }
+    for (pc = 0; pc < nvars; pc++) {
+      f->locvars[pc].startpc = newpc[f->locvars[pc].startpc];
+      f->locvars[pc].endpc = newpc[f->locvars[pc].endpc];
+    }
+    f->nremoved = nremoved;
+  }
+  luaM_freemem(L, block, size);
+}
+
+#endif
+
+/* }====================================================================== */
+
+
 /*
 ** Do a final pass over the code of a function, doing small peephole
 ** optimizations and adjustments.
@@ -1869,4 +2361,7 @@ void luaK_finish (FuncState *fs) {
       default: break;
     }
   }
+#if LUA_USE_PEEPHOLE
+  peephole(fs);
+#endif
 }
@@ -181,6 +181,7 @@ static int db_getinfo (lua_State *L) {
     settabsi(L, "nups", ar.nups);
     settabsi(L, "nparams", ar.nparams);
     settabsb(L, "isvararg", ar.isvararg);
+    settabsi(L, "nremoved", ar.nremoved);
   }
   if (strchr(options, 'n')) {
     settabss(L, "name", ar.name);
@@ -432,6 +433,120 @@ static int db_debug (lua_State *L) {
 }
 
 
+/*
+** Names of the statistics returned by 'debug.cachestats', in the
+** order of their codes in 'lua_cachestat'.
+*/
+static const char *const cachestatnames[LUA_CSN] = {
+  "fieldhit", "fieldmiss", "quicken", "unquicken", "jit", "iter", "closure",
+  "globalhit", "globalmiss"
+};
+
+
+static int db_cachestats (lua_State *L) {
+  int reset = lua_toboolean(L, 1);
+  int i;
+  lua_createtable(L, 0, LUA_CSN);
+  for (i = 0; i < LUA_CSN; i++) {
+    lua_pushinteger(L, lua_cachestat(L, i, reset));
+    lua_setfield(L, -2, cachestatnames[i]);
+  }
+  return 1;
+}
+
+
+/*
+** Return a list with dumps of the recorded traces; with a true
+** argument, also discard them. Return fail if Lua does not record
+** traces.
+*/
+static int db_traces (lua_State *L) {
+  int reset = lua_toboolean(L, 1);
+  int n, res;
+  lua_newtable(L);
+  for (n = 1; (res = lua_gettrace(L, n)) > 0; n++)
+    lua_rawseti(L, -2, n);
+  if (res < 0) {
+    luaL_pushfail(L);
+    return 1;
+  }
+  if (reset)
+    lua_resettraces(L);
+  return 1;
+}
+
+
+static int db_tablesize (lua_State *L) {
+  unsigned asize, nnodes, nused;
+  size_t bytes;
+  luaL_checktype(L, 1, LUA_TTABLE);
+  bytes = lua_tablesize(L, 1, &asize, &nnodes, &nused);
+  lua_pushinteger(L, (lua_Integer)asize);
+  lua_pushinteger(L, (lua_Integer)nnodes);
+  lua_pushinteger(L, (lua_Integer)nused);
+  lua_pushinteger(L, (lua_Integer)bytes);
+  return 4;
+}
+
+
+/*
+** Return the number of short strings, the size of the string table,
+** and the average and maximum lengths of the searches that find each
+** string.
+*/
+static int db_stringtable (lua_State *L) {
+  int size, maxprobe;
+  size_t total;
+  int n = lua_stringtable(L, &size, &maxprobe, &total);
+  lua_pushinteger(L, n);
+  lua_pushinteger(L, size);
+  lua_pushnumber(L, (n > 0) ? (lua_Number)total / n : 0);
+  lua_pushinteger(L, maxprobe);
+  return 4;
+}
+
+
+/*
+** Return a list describing the live tables with more bytes allocated,
+** largest first: each entry has the table, its sizes (as returned by
+** 'debug.tablesize'), and, when known, where it was created.
+*/
+static int db_largesttables (lua_State *L) {
+  lua_Integer n = luaL_optinteger(L, 1, 10);
+  unsigned i, k;
+  luaL_argcheck(L, 0 <= n && n <= INT_MAX, 1, "out of range");
+  lua_settop(L, 0);
+  k = lua_largesttables(L, (unsigned)n);  /* list of tables at index 1 */
+  for (i = 1; i <= k; i++) {
+    unsigned asize, nnodes, nused;
+    const char *source;
+    int line;
+    size_t bytes;
+    lua_createtable(L, 0, 7);
+    lua_rawgeti(L, 1, i);
+    bytes = lua_tablesize(L, -1, &asize, &nnodes, &nused);
+    source = lua_tablesite(L, -1, &line);
+    lua_setfield(L, -2, "table");
+    lua_pushinteger(L, (lua_Integer)bytes);
+    lua_setfield(L, -2, "bytes");
+    lua_pushinteger(L, (lua_Integer)asize);
+    lua_setfield(L, -2, "asize");
+    lua_pushinteger(L, (lua_Integer)nnodes);
+    lua_setfield(L, -2, "nodes");
+    lua_pushinteger(L, (lua_Integer)nused);
+    lua_setfield(L, -2, "used");
+    if (source != NULL) {
+      lua_pushstring(L, source);
+      lua_setfield(L, -2, "source");
+      lua_pushinteger(L, line);
+      lua_setfield(L, -2, "line");
+    }
+    lua_rawseti(L, 1, i);  /* replace table by its description */
+  }
+  return 1;
+}
+
+
 static int db_traceback (lua_State *L) {
   int arg;
   lua_State *L1 = getthread(L, &arg);
@@ -447,6 +562,7 @@ static int db_traceback (lua_State *L) {
 
 
 static const luaL_Reg dblib[] = {
+  {"cachestats", db_cachestats},
   {"debug", db_debug},
   {"getuservalue", db_getuservalue},
   {"gethook", db_gethook},
@@ -455,6 +571,7 @@ static const luaL_Reg dblib[] = {
   {"getregistry", db_getregistry},
   {"getmetatable", db_getmetatable},
   {"getupvalue", db_getupvalue},
+  {"largesttables", db_largesttables},
   {"upvaluejoin", db_upvaluejoin},
   {"upvalueid", db_upvalueid},
   {"setuservalue", db_setuservalue},
@@ -462,7 +579,10 @@ static const luaL_Reg dblib[] = {
   {"setlocal", db_setlocal},
   {"setmetatable", db_setmetatable},
   {"setupvalue", db_setupvalue},
+  {"stringtable", db_stringtable},
+  {"tablesize", db_tablesize},
   {"traceback", db_traceback},
+  {"traces", db_traces},
   {NULL, NULL}
 };
 
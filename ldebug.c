@@ -27,6 +27,7 @@
 #include "lstring.h"
 #include "ltable.h"
 #include "ltm.h"
+#include "ltrace.h"
 #include "lvm.h"
 
 
@@ -157,6 +158,52 @@ LUA_API int lua_gethookcount (lua_State *L) {
 }
 
 
+/*
+** Get statistic 'what' of the internal caches, optionally resetting it.
+*/
+LUA_API lua_Integer lua_cachestat (lua_State *L, int what, int reset) {
+  global_State *g = G(L);
+  lua_Integer res;
+  api_check(L, 0 <= what && what < LUA_CSN, "invalid statistic");
+  lua_lock(L);
+  res = l_castU2S(g->cachestats[what]);
+  if (reset)
+    g->cachestats[what] = 0;
+  lua_unlock(L);
+  return res;
+}
+
+
+/*
+** Push a dump of the 'n'-th recorded trace (counting from 1). Returns
+** 0 (pushing nothing) if there is no such trace, and -1 if Lua does not
+** record traces.
+*/
+LUA_API int lua_gettrace (lua_State *L, int n) {
+#if LUA_USE_TRACE
+  int res;
+  lua_lock(L);
+  res = luaR_dump(L, n);
+  lua_unlock(L);
+  return res;
+#else
+  UNUSED(L); UNUSED(n);
+  return -1;
+#endif
+}
+
+
+LUA_API void lua_resettraces (lua_State *L) {
+#if LUA_USE_TRACE
+  lua_lock(L);
+  luaR_freetraces(L);
+  lua_unlock(L);
+#else
+  UNUSED(L);
+#endif
+}
+
+
 LUA_API int lua_getstack (lua_State *L, int level, lua_Debug *ar) {
   int status;
   CallInfo *ci;
@@ -342,10 +389,12 @@ static int auxgetinfo (lua_State *L, const char *what, lua_Debug *ar,
         if (noLuaClosure(f)) {
           ar->isvararg = 1;
           ar->nparams = 0;
+          ar->nremoved = 0;
         }
         else {
           ar->isvararg = f->l.p->flag & PF_ISVARARG;
           ar->nparams = f->l.p->numparams;
+          ar->nremoved = f->l.p->nremoved;
         }
         break;
       }
@@ -436,7 +485,7 @@ static int findsetreg (const Proto *p, int lastpc, int reg) {
     lastpc--;  /* previous instruction was not actually executed */
   for (pc = 0; pc < lastpc; pc++) {
     Instruction i = p->code[pc];
-    OpCode op = GET_OPCODE(i);
+    OpCode op = luaP_genericop(GET_OPCODE(i));
     int a = GETARG_A(i);
     int change;  /* true if current instruction changed 'reg' */
     switch (op) {
@@ -500,7 +549,7 @@ static const char *basicgetobjname (const Proto *p, int *ppc, int reg,
   *ppc = pc = findsetreg(p, pc, reg);
   if (pc != -1) {  /* could find instruction? */
     Instruction i = p->code[pc];
-    OpCode op = GET_OPCODE(i);
+    OpCode op = luaP_genericop(GET_OPCODE(i));
     switch (op) {
       case OP_MOVE: {
         int b = GETARG_B(i);  /* move from 'b' to 'a' */
@@ -568,7 +617,7 @@ static const char *getobjname (const Proto *p, int lastpc, int reg,
     return kind;
   else if (lastpc != -1) {  /* could find instruction? */
     Instruction i = p->code[lastpc];
-    OpCode op = GET_OPCODE(i);
+    OpCode op = luaP_genericop(GET_OPCODE(i));
     switch (op) {
       case OP_GETTABUP: {
         int k = GETARG_C(i);  /* key index */
@@ -610,7 +659,7 @@ static const char *funcnamefromcode (lua_State *L, const Proto *p,
                                      int pc, const char **name) {
   TMS tm = (TMS)0;  /* (initial value avoids warnings) */
   Instruction i = p->code[pc];  /* calling instruction */
-  switch (GET_OPCODE(i)) {
+  switch (luaP_genericop(GET_OPCODE(i))) {
     case OP_CALL:
     case OP_TAILCALL:
       return getobjname(p, pc, GETARG_A(i), name);  /* get function name */
@@ -922,7 +971,15 @@ int luaG_traceexec (lua_State *L, const Instruction *pc) {
   lu_byte mask = L->hookmask;
   const Proto *p = ci_func(ci)->p;
   int counthook;
+#if LUA_USE_TRACE
+  int rec = (G(L)->trec != NULL && !(ci->callstatus & CIST_HOOKYIELD) &&
+             luaR_record(L, ci, pc));  /* recording a trace? */
+#else
+  int rec = 0;
+#endif
   if (!(mask & (LUA_MASKLINE | LUA_MASKCOUNT))) {  /* no hooks? */
+    if (rec)
+      return 1;  /* keep 'trap' on to record next instruction */
     ci->u.l.trap = 0;  /* don't need to stop again */
     return 0;  /* turn off 'trap' */
   }
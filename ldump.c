@@ -17,6 +17,7 @@
 
 #include "lgc.h"
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
 #include "ltable.h"
 #include "lundump.h"
@@ -154,11 +155,31 @@ static void dumpString (DumpState *D, TString *ts) {
 }
 
 
+/* size for 'dumpCode' buffer */
+#define DCBS	64
+
+/*
+** Dump the code of a function. Instructions quickened by the
+** interpreter are dumped in their generic forms, so they go through a
+** buffer.
+*/
 static void dumpCode (DumpState *D, const Proto *f) {
-  dumpInt(D, f->sizecode);
+  int n = f->sizecode;
+  int i;
+  dumpInt(D, n);
   dumpAlign(D, sizeof(f->code[0]));
   lua_assert(f->code != NULL);
-  dumpVector(D, f->code, f->sizecode);
+  for (i = 0; i < n; i += DCBS) {
+    Instruction buff[DCBS];
+    int nb = (n - i < DCBS) ? n - i : DCBS;
+    int j;
+    for (j = 0; j < nb; j++) {
+      Instruction inst = f->code[i + j];
+      SET_OPCODE(inst, luaP_genericop(GET_OPCODE(inst)));
+      buff[j] = inst;
+    }
+    dumpVector(D, buff, nb);
+  }
 }
 
 
@@ -10,6 +10,7 @@
 #include "lprefix.h"
 
 
+#include <limits.h>
 #include <stddef.h>
 
 #include "lua.h"
@@ -18,9 +19,12 @@
 #include "ldo.h"
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
+#include "ltrace.h"
 
 
 
@@ -255,8 +259,18 @@ Proto *luaF_newproto (lua_State *L) {
   f->numparams = 0;
   f->flag = 0;
   f->maxstacksize = 0;
+  f->quickmiss = 0;
+  f->cachemiss = 0;
+  f->cache = NULL;
   f->locvars = NULL;
   f->sizelocvars = 0;
+  f->icache = NULL;
+  f->icmap = NULL;
+  f->sizeicache = 0;
+  f->dcode = NULL;
+  f->jit = NULL;
+  f->jitcalls = LUAI_JITCALLS;
+  f->nremoved = 0;
   f->linedefined = 0;
   f->lastlinedefined = 0;
   f->source = NULL;
@@ -264,6 +278,64 @@ Proto *luaF_newproto (lua_State *L) {
 }
 
 
+/*
+** Create the inline caches for a finished prototype: one entry for
+** each field-access instruction (including accesses to globals through
+** '_ENV', except in fixed code), plus a map from instructions to their
+** entries. (In huge functions, with more than USHRT_MAX + 1 of those
+** instructions, some of them share entries; that only causes misses.)
+** Entries do not need any particular initial value, as they are always
+** validated before being used.
+*/
+void luaF_initicache (lua_State *L, Proto *f) {
+#if LUA_USE_ICACHE
+  int i;
+  int n = 0;  /* number of instructions using the cache */
+  lua_assert(f->icache == NULL && f->icmap == NULL);
+  for (i = 0; i < f->sizecode; i++) {
+    switch (GET_OPCODE(f->code[i])) {
+      case OP_GETFIELD: case OP_SETFIELD: case OP_SELF:
+        n++;
+        break;
+      case OP_GETTABUP: case OP_SETTABUP:
+        if (!(f->flag & PF_FIXED))  /* (see 'globalget' in 'lvm.c') */
+          n++;
+        break;
+      default: break;
+    }
+  }
+  if (n > 0) {
+    int e = 0;  /* next entry to be assigned */
+    if (n > USHRT_MAX + 1)
+      n = USHRT_MAX + 1;
+    f->icmap = luaM_newvector(L, f->sizecode, unsigned short);
+    for (i = 0; i < f->sizecode; i++) {
+      switch (GET_OPCODE(f->code[i])) {
+        case OP_GETTABUP: case OP_SETTABUP:
+          if (f->flag & PF_FIXED) {
+            f->icmap[i] = 0;
+            break;
+          }  /* FALLTHROUGH */
+        case OP_GETFIELD: case OP_SETFIELD: case OP_SELF:
+          f->icmap[i] = cast(unsigned short, e);
+          e = (e + 1) % n;
+          break;
+        default:
+          f->icmap[i] = 0;
+          break;
+      }
+    }
+    f->icache = luaM_newvector(L, n, ICache);
+    f->sizeicache = n;
+    for (i = 0; i < n; i++)
+      f->icache[i].slot = f->icache[i].mtslot = f->icache[i].islot = 0;
+  }
+#else
+  UNUSED(L); UNUSED(f);
+#endif
+}
+
+
 void luaF_freeproto (lua_State *L, Proto *f) {
   if (!(f->flag & PF_FIXED)) {
     luaM_freearray(L, f->code, f->sizecode);
@@ -274,6 +346,18 @@ void luaF_freeproto (lua_State *L, Proto *f) {
   luaM_freearray(L, f->k, f->sizek);
   luaM_freearray(L, f->locvars, f->sizelocvars);
   luaM_freearray(L, f->upvalues, f->sizeupvalues);
+  luaM_freearray(L, f->icache, f->sizeicache);
+  if (f->icmap != NULL)
+    luaM_freearray(L, f->icmap, f->sizecode);
+  if (f->dcode != NULL)
+    luaM_freearray(L, f->dcode, f->sizecode);
+#if LUA_USE_JIT
+  if (f->jit != NULL)
+    luaJ_free(L, f);
+#endif
+#if LUA_USE_TRACE
+  luaR_freeproto(G(L), f);
+#endif
   luaM_free(L, f);
 }
 
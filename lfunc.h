@@ -43,6 +43,15 @@
 
 
 
+/*
+** Inline caches for field accesses are on by default; define
+** LUA_USE_ICACHE as 0 to build the interpreter without them.
+*/
+#if !defined(LUA_USE_ICACHE)
+#define LUA_USE_ICACHE	1
+#endif
+
+
 /* special status to close upvalues preserving the top of the stack */
 #define CLOSEKTOP	(-1)
 
@@ -56,6 +65,7 @@ LUAI_FUNC void luaF_newtbcupval (lua_State *L, StkId level);
 LUAI_FUNC void luaF_closeupval (lua_State *L, StkId level);
 LUAI_FUNC StkId luaF_close (lua_State *L, StkId level, int status, int yy);
 LUAI_FUNC void luaF_unlinkupval (UpVal *uv);
+LUAI_FUNC void luaF_initicache (lua_State *L, Proto *f);
 LUAI_FUNC void luaF_freeproto (lua_State *L, Proto *f);
 LUAI_FUNC const char *luaF_getlocalname (const Proto *func, int local_number,
                                          int pc);
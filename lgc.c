@@ -111,6 +111,11 @@ static void entersweep (lua_State *L);
 */
 #define gnodelast(h)	gnode(h, cast_sizet(sizenode(h)))
 
+/*
+** one after last element in the old hash array of a migrating table
+*/
+#define oldnodelast(h)	(oldnodes(h) + sizeoldnode(h))
+
 
 static GCObject **getgclist (GCObject *o) {
   switch (o->tt) {
@@ -294,7 +299,9 @@ static void reallymarkobject (global_State *g, GCObject *o) {
   switch (o->tt) {
     case LUA_VSHRSTR:
     case LUA_VLNGSTR: {
-      set2black(o);  /* nothing to visit */
+      set2black(o);  /* nothing to visit... */
+      if (isview(gco2ts(o)))  /* ...except the string it is a view into */
+        markobject(g, cast(TString *, gco2ts(o)->ud));
       break;
     }
     case LUA_VUPVAL: {
@@ -335,6 +342,25 @@ static void markmt (global_State *g) {
 }
 
 
+#if LUA_USE_SHAPES
+
+/*
+** mark the keys of all shapes. (Each shape marks only its last key, as
+** its other keys are the keys of its parent.) Shapes are freed only with
+** the tables that use them, so their keys must survive until then.
+*/
+static void markshapes (global_State *g) {
+  int i;
+  for (i = 0; i < g->shapes.size; i++) {
+    Shape *s;
+    for (s = g->shapes.hash[i]; s != NULL; s = s->hnext)
+      markobject(g, s->keys[s->nkeys - 1]);
+  }
+}
+
+#endif
+
+
 /*
 ** mark all objects in list of being-finalized
 */
@@ -437,18 +463,55 @@ static void genlink (global_State *g, GCObject *o) {
 }
 
 
+#if LUA_USE_SHAPES
+
 /*
-** Traverse a table with weak values and link it to proper list. During
-** propagate phase, keep it in 'grayagain' list, to be revisited in the
-** atomic phase. In the atomic phase, if table has any white value,
-** put it in 'weak' list, to be cleared.
+** Traverse the slots of a table with a shape. Slot keys are strings,
+** which are never weak, so slots are treated like entries with strong
+** keys.
 */
-static void traverseweakvalue (global_State *g, Table *h) {
-  Node *n, *limit = gnodelast(h);
-  /* if there is array part, assume it may have white values (it is not
-     worth traversing it now just to check) */
-  int hasclears = (h->alimit > 0);
-  for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
+static int traverseslots (global_State *g, Table *h) {
+  int marked = 0;  /* true if some object is marked in this traversal */
+  int i;
+  if (!isshaped(h))
+    return 0;
+  for (i = 0; i < h->shape->nkeys; i++) {
+    if (valiswhite(&h->slots[i])) {
+      marked = 1;
+      reallymarkobject(g, gcvalue(&h->slots[i]));
+    }
+  }
+  return marked;
+}
+
+
+/* true if table 'h' has some slot with a white value */
+static int slotscleared (global_State *g, Table *h) {
+  int i;
+  if (isshaped(h)) {
+    for (i = 0; i < h->shape->nkeys; i++) {
+      if (iscleared(g, gcvalueN(&h->slots[i])))
+        return 1;
+    }
+  }
+  return 0;
+}
+
+#else
+
+#define traverseslots(g,h)	0
+#define slotscleared(g,h)	0
+
+#endif
+
+
+/*
+** Traverse the nodes in ['n', 'limit') of a table with weak values.
+** Returns true if 'hasclears' or if there is some white value.
+*/
+static int traverseweaknodes (global_State *g, Node *n, Node *limit,
+                              int hasclears) {
+  for (; n < limit; n++) {
     if (isempty(gval(n)))  /* entry is empty? */
       clearkey(n);  /* clear its key */
     else {
@@ -458,6 +521,23 @@ static void traverseweakvalue (global_State *g, Table *h) {
         hasclears = 1;  /* table will have to be cleared */
     }
   }
+  return hasclears;
+}
+
+
+/*
+** Traverse a table with weak values and link it to proper list. During
+** propagate phase, keep it in 'grayagain' list, to be revisited in the
+** atomic phase. In the atomic phase, if table has any white value,
+** put it in 'weak' list, to be cleared.
+*/
+static void traverseweakvalue (global_State *g, Table *h) {
+  /* if there is array part, assume it may have white values (it is not
+     worth traversing it now just to check) */
+  int hasclears = (h->alimit > 0) || slotscleared(g, h);
+  hasclears = traverseweaknodes(g, gnode(h, 0), gnodelast(h), hasclears);
+  if (ismigrating(h))  /* traverse also the old hash part */
+    hasclears = traverseweaknodes(g, oldnodes(h), oldnodelast(h), hasclears);
   if (g->gcstate == GCSatomic && hasclears)
     linkgclist(h, g->weak);  /* has to be cleared later */
   else
@@ -466,10 +546,11 @@ static void traverseweakvalue (global_State *g, Table *h) {
 
 
 /*
-** Traverse the array part of a table.
+** Traverse the array part of a table. (A packed array has only numbers,
+** so there is nothing to traverse.)
 */
 static int traversearray (global_State *g, Table *h) {
-  unsigned asize = luaH_realasize(h);
+  unsigned asize = ispacked(h) ? 0 : luaH_realasize(h);
   int marked = 0;  /* true if some object is marked in this traversal */
   unsigned i;
   for (i = 0; i < asize; i++) {
@@ -483,6 +564,33 @@ static int traversearray (global_State *g, Table *h) {
 }
 
 
+/*
+** Traverse the 'nsize' nodes from 'node' of an ephemeron table (see
+** 'traverseephemeron'); if 'inv', traverse them descending. Returns
+** true iff any object was marked.
+*/
+static int traverseephnodes (global_State *g, Node *node, unsigned nsize,
+                             int inv, int *hasclears, int *hasww) {
+  int marked = 0;
+  unsigned int i;
+  for (i = 0; i < nsize; i++) {
+    Node *n = inv ? &node[nsize - 1 - i] : &node[i];
+    if (isempty(gval(n)))  /* entry is empty? */
+      clearkey(n);  /* clear its key */
+    else if (iscleared(g, gckeyN(n))) {  /* key is not marked (yet)? */
+      *hasclears = 1;  /* table must be cleared */
+      if (valiswhite(gval(n)))  /* value not marked yet? */
+        *hasww = 1;  /* white-white entry */
+    }
+    else if (valiswhite(gval(n))) {  /* value not marked yet? */
+      marked = 1;
+      reallymarkobject(g, gcvalue(gval(n)));  /* mark it now */
+    }
+  }
+  return marked;
+}
+
+
 /*
 ** Traverse an ephemeron table and link it to proper list. Returns true
 ** iff any object was marked during this traversal (which implies that
@@ -498,25 +606,15 @@ static int traversearray (global_State *g, Table *h) {
 static int traverseephemeron (global_State *g, Table *h, int inv) {
   int hasclears = 0;  /* true if table has white keys */
   int hasww = 0;  /* true if table has entry "white-key -> white-value" */
-  unsigned int i;
-  unsigned int nsize = sizenode(h);
   int marked = traversearray(g, h);  /* traverse array part */
+  marked |= traverseslots(g, h);  /* slots have strong keys */
   /* traverse hash part; if 'inv', traverse descending
      (see 'convergeephemerons') */
-  for (i = 0; i < nsize; i++) {
-    Node *n = inv ? gnode(h, nsize - 1 - i) : gnode(h, i);
-    if (isempty(gval(n)))  /* entry is empty? */
-      clearkey(n);  /* clear its key */
-    else if (iscleared(g, gckeyN(n))) {  /* key is not marked (yet)? */
-      hasclears = 1;  /* table must be cleared */
-      if (valiswhite(gval(n)))  /* value not marked yet? */
-        hasww = 1;  /* white-white entry */
-    }
-    else if (valiswhite(gval(n))) {  /* value not marked yet? */
-      marked = 1;
-      reallymarkobject(g, gcvalue(gval(n)));  /* mark it now */
-    }
-  }
+  marked |= traverseephnodes(g, gnode(h, 0), sizenode(h), inv,
+                             &hasclears, &hasww);
+  if (ismigrating(h))  /* traverse also the old hash part */
+    marked |= traverseephnodes(g, oldnodes(h), sizeoldnode(h), inv,
+                               &hasclears, &hasww);
   /* link table into proper list */
   if (g->gcstate == GCSpropagate)
     linkgclist(h, g->grayagain);  /* must retraverse it in atomic phase */
@@ -530,10 +628,8 @@ static int traverseephemeron (global_State *g, Table *h, int inv) {
 }
 
 
-static void traversestrongtable (global_State *g, Table *h) {
-  Node *n, *limit = gnodelast(h);
-  traversearray(g, h);
-  for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
+static void traversestrongnodes (global_State *g, Node *n, Node *limit) {
+  for (; n < limit; n++) {
     if (isempty(gval(n)))  /* entry is empty? */
       clearkey(n);  /* clear its key */
     else {
@@ -542,6 +638,15 @@ static void traversestrongtable (global_State *g, Table *h) {
       markvalue(g, gval(n));
     }
   }
+}
+
+
+static void traversestrongtable (global_State *g, Table *h) {
+  traversearray(g, h);
+  cast_void(traverseslots(g, h));
+  traversestrongnodes(g, gnode(h, 0), gnodelast(h));  /* hash part */
+  if (ismigrating(h))  /* traverse also the old hash part */
+    traversestrongnodes(g, oldnodes(h), oldnodelast(h));
   genlink(g, obj2gco(h));
 }
 
@@ -551,6 +656,9 @@ static void traversetable (global_State *g, Table *h) {
   const TValue *mode = gfasttm(g, h->metatable, TM_MODE);
   TString *smode;
   markobjectN(g, h->metatable);
+#if LUA_USE_TABLESITES
+  markobjectN(g, h->site);
+#endif
   if (mode && ttisshrstring(mode) &&  /* is there a weak mode? */
       (cast_void(smode = tsvalue(mode)),
        cast_void(weakkey = strchr(getshrstr(smode), 'k')),
@@ -580,10 +688,14 @@ static void traverseudata (global_State *g, Udata *u) {
 /*
 ** Traverse a prototype. (While a prototype is being build, its
 ** arrays can be larger than needed; the extra slots are filled with
-** NULL, so the use of 'markobjectN')
+** NULL, so the use of 'markobjectN') Its closure cache is a weak
+** reference, which the backward barrier in 'getclosure' makes the
+** collector check again in the atomic phase.
 */
 static void traverseproto (global_State *g, Proto *f) {
   int i;
+  if (f->cache && iswhite(f->cache))
+    f->cache = NULL;  /* allow cache to be collected */
   markobjectN(g, f->source);
   for (i = 0; i < f->sizek; i++)  /* mark literals */
     markvalue(g, &f->k[i]);
@@ -593,6 +705,7 @@ static void traverseproto (global_State *g, Proto *f) {
     markobjectN(g, f->p[i]);
   for (i = 0; i < f->sizelocvars; i++)  /* mark local-variable names */
     markobjectN(g, f->locvars[i].varname);
+  genlink(g, obj2gco(f));  /* its cache may be touched by a barrier */
 }
 
 
@@ -724,6 +837,16 @@ static l_obj convergeephemerons (global_State *g) {
 */
 
 
+static void clearnodesbykeys (global_State *g, Node *n, Node *limit) {
+  for (; n < limit; n++) {
+    if (iscleared(g, gckeyN(n)))  /* unmarked key? */
+      setempty(gval(n));  /* remove entry */
+    if (isempty(gval(n)))  /* is entry empty? */
+      clearkey(n);  /* clear its key */
+  }
+}
+
+
 /*
 ** clear entries with unmarked keys from all weaktables in list 'l'
 */
@@ -731,20 +854,25 @@ static l_obj clearbykeys (global_State *g, GCObject *l) {
   l_obj work = 0;
   for (; l; l = gco2t(l)->gclist) {
     Table *h = gco2t(l);
-    Node *limit = gnodelast(h);
-    Node *n;
-    for (n = gnode(h, 0); n < limit; n++) {
-      if (iscleared(g, gckeyN(n)))  /* unmarked key? */
-        setempty(gval(n));  /* remove entry */
-      if (isempty(gval(n)))  /* is entry empty? */
-        clearkey(n);  /* clear its key */
-    }
+    clearnodesbykeys(g, gnode(h, 0), gnodelast(h));
+    if (ismigrating(h))
+      clearnodesbykeys(g, oldnodes(h), oldnodelast(h));
     work++;
   }
   return work;
 }
 
 
+static void clearnodesbyvalues (global_State *g, Node *n, Node *limit) {
+  for (; n < limit; n++) {
+    if (iscleared(g, gcvalueN(gval(n))))  /* unmarked value? */
+      setempty(gval(n));  /* remove entry */
+    if (isempty(gval(n)))  /* is entry empty? */
+      clearkey(n);  /* clear its key */
+  }
+}
+
+
 /*
 ** clear entries with unmarked values from all weaktables in list 'l' up
 ** to element 'f'
@@ -753,20 +881,25 @@ static l_obj clearbyvalues (global_State *g, GCObject *l, GCObject *f) {
   l_obj work = 0;
   for (; l != f; l = gco2t(l)->gclist) {
     Table *h = gco2t(l);
-    Node *n, *limit = gnodelast(h);
     unsigned int i;
-    unsigned int asize = luaH_realasize(h);
+    unsigned int asize = ispacked(h) ? 0 : luaH_realasize(h);
     for (i = 0; i < asize; i++) {
       GCObject *o = gcvalarr(h, i);
       if (iscleared(g, o))  /* value was collected? */
         *getArrTag(h, i) = LUA_VEMPTY;  /* remove entry */
     }
-    for (n = gnode(h, 0); n < limit; n++) {
-      if (iscleared(g, gcvalueN(gval(n))))  /* unmarked value? */
-        setempty(gval(n));  /* remove entry */
-      if (isempty(gval(n)))  /* is entry empty? */
-        clearkey(n);  /* clear its key */
+#if LUA_USE_SHAPES
+    if (isshaped(h)) {
+      int j;
+      for (j = 0; j < h->shape->nkeys; j++) {
+        if (iscleared(g, gcvalueN(&h->slots[j])))  /* unmarked value? */
+          setempty(&h->slots[j]);  /* remove entry (slot stays) */
+      }
     }
+#endif
+    clearnodesbyvalues(g, gnode(h, 0), gnodelast(h));
+    if (ismigrating(h))
+      clearnodesbyvalues(g, oldnodes(h), oldnodelast(h));
     work++;
   }
   return work;
@@ -820,6 +953,8 @@ static void freeobj (lua_State *L, GCObject *o) {
       TString *ts = gco2ts(o);
       if (ts->shrlen == LSTRMEM)  /* must free external string? */
         (*ts->falloc)(ts->ud, ts->contents, ts->u.lnglen + 1, 0);
+      else if (ts->shrlen == LSTRCOPY)  /* must free copy of a view? */
+        luaM_freearray(L, ts->contents, ts->u.lnglen + 1);
       luaM_freemem(L, ts, luaS_sizelngstr(ts->u.lnglen, ts->shrlen));
       break;
     }
@@ -1487,6 +1622,9 @@ static l_obj atomic (lua_State *L) {
   /* registry and global metatables may be changed by API */
   markvalue(g, &g->l_registry);
   markmt(g);  /* mark global metatables */
+#if LUA_USE_SHAPES
+  markshapes(g);  /* mark keys of shapes */
+#endif
   work += propagateall(g);  /* empties 'gray' list */
   /* remark occasional upvalues of (maybe) dead threads */
   work += remarkupvals(g);
@@ -670,6 +670,12 @@ static int g_write (lua_State *L, FILE *f, int arg) {
                              (LUAI_UACNUMBER)lua_tonumber(L, arg));
       status = status && (len > 0);
     }
+    else if (lua_type(L, arg) == LUA_TUSERDATA &&
+             luaL_testudata(L, arg, LUA_BUFFERHANDLE) != NULL) {
+      /* write contents of a string buffer without creating a string */
+      luaL_StringBuffer *sb = (luaL_StringBuffer *)lua_touserdata(L, arg);
+      status = status && (fwrite(sb->b, sizeof(char), sb->n, f) == sb->n);
+    }
     else {
       size_t l;
       const char *s = luaL_checklstring(L, arg, &l);
@@ -0,0 +1,1143 @@
+/*
+** $Id: ljit.c $
+** Baseline compiler from Lua bytecode to native code
+** See Copyright Notice in lua.h
+*/
+
+#define ljit_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+
+#include <stddef.h>
+
+#include "lua.h"
+
+#include "lgc.h"
+#include "ljit.h"
+#include "lmem.h"
+#include "lobject.h"
+#include "lopcodes.h"
+#include "lstate.h"
+#include "ltable.h"
+#include "lvm.h"
+
+
+#if LUA_USE_JIT
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+#if LUA_INT_TYPE != LUA_INT_LONGLONG || LUA_FLOAT_TYPE != LUA_FLOAT_DOUBLE
+#error "LUA_USE_JIT needs 64-bit integers and double floats"
+#endif
+
+
+/*
+** {======================================================
+** Overview
+** =======================================================
+**
+** The compiler translates each instruction of a function into a
+** piece of x86-64 code, stitched from a template for its opcode.
+** Native code handles only the common cases of the instructions it
+** knows (e.g., arithmetic on numbers, accesses to existing table
+** entries, numeric loops); anything else (calls, metamethods, errors,
+** allocations) makes it return to 'luaV_execute', which executes the
+** instruction and goes on interpreting. The interpreter enters native
+** code again when a function starts or resumes after a call and at
+** backward jumps.
+**
+** So, native code never raises errors, never calls Lua or C functions,
+** and never allocates memory; the stack cannot move while it runs, and
+** 'base' stays in a register. Native code only runs while there are no
+** line or count hooks, and it checks for them at every backward jump,
+** so that hooks set by signals can stop a loop.
+**
+** Registers: rbx is 'L', r13 is 'base', r14 is the code of the
+** function ('p->code'), r15 is the closure, and r12 is not used (it
+** is saved only to keep the stack aligned). Native code returns the
+** address of the next instruction for the interpreter to execute.
+**
+** The code of a function has a prologue, the exit code, the code for
+** each instruction, and one exit stub for each instruction, which sets
+** the result to the address of that instruction and jumps to the exit.
+** Code is generated in two passes: the first one only computes the
+** size and the offsets of all instructions, the second one generates
+** the code, using the offsets of the first pass for jumps.
+** ========================================================
+*/
+
+
+/* type of the native code of a function */
+typedef const Instruction *(*JitFunction) (lua_State *L, StkId base,
+                                          LClosure *cl, const void *target);
+
+
+/* x86-64 registers */
+enum {
+  J_RAX, J_RCX, J_RDX, J_RBX, J_RSP, J_RBP, J_RSI, J_RDI,
+  J_R8, J_R9, J_R10, J_R11, J_R12, J_R13, J_R14, J_R15
+};
+
+/* condition codes */
+enum {
+  CC_E = 0x4, CC_NE = 0x5, CC_AE = 0x3, CC_A = 0x7,
+  CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF
+};
+
+/* unconditional jump for 'jumpto' */
+#define CC_ALWAYS	(-1)
+
+
+/* offset of the value and of the tag of register 'a' from 'base' */
+#define valoff(a)	((a) * cast_int(sizeof(StackValue)))
+#define tagoff(a)	(valoff(a) + cast_int(offsetof(TValue, tt_)))
+
+/* size of each exit stub */
+#define STUBSIZE	12
+
+/* hooks that native code cannot run with */
+#define JITHOOKS	(LUA_MASKLINE | LUA_MASKCOUNT)
+
+
+typedef struct JitState {
+  lu_byte *buff;  /* code buffer (NULL in the first pass) */
+  size_t pos;  /* current position in the code */
+  size_t exitpos;  /* position of the exit code */
+  size_t stubs;  /* position of the exit stubs */
+  Proto *p;
+  JitCode *jc;
+  int idx;  /* index of the instruction being compiled */
+} JitState;
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Helpers
+** =======================================================
+** Functions called by native code. All of them do only the fast case
+** of an operation; when they return 0, native code gives up and the
+** interpreter executes the whole instruction. They never raise errors
+** or allocate memory.
+*/
+
+/* arithmetic and bitwise operations over numbers */
+static int jit_arith (lua_State *L, int op, const TValue *p1,
+                      const TValue *p2, TValue *res) {
+  if (!ttisnumber(p1) || !ttisnumber(p2))
+    return 0;  /* strings and metamethods are the interpreter's business */
+  if ((op == LUA_OPMOD || op == LUA_OPIDIV) &&
+      ttisinteger(p1) && ttisinteger(p2) && ivalue(p2) == 0)
+    return 0;  /* let the interpreter raise the error */
+  return luaO_rawarith(L, op, p1, p2, res);
+}
+
+
+/* equality; returns -1 when the values may have an '__eq' metamethod */
+static int jit_eq (const TValue *p1, const TValue *p2) {
+  if (ttypetag(p1) == ttypetag(p2) &&
+      (ttistable(p1) || ttisfulluserdata(p1)) && gcvalue(p1) != gcvalue(p2))
+    return -1;
+  return luaV_rawequalobj(p1, p2);
+}
+
+
+static int jit_eqk (const TValue *p1, const TValue *k) {
+  return luaV_rawequalobj(p1, k);
+}
+
+
+static int jit_len (TValue *res, const TValue *rb) {
+  if (ttistable(rb) && hvalue(rb)->metatable == NULL) {
+    setivalue(res, l_castU2S(luaH_getn(hvalue(rb))));
+  }
+  else if (ttisstring(rb)) {
+    setivalue(res, cast(lua_Integer, tsslen(tsvalue(rb))));
+  }
+  else
+    return 0;
+  return 1;
+}
+
+
+static int jit_gettable (TValue *res, const TValue *t, const TValue *key) {
+  TValue v;
+  int tag;
+  if (ttisinteger(key)) {
+    luaV_fastgeti(t, ivalue(key), &v, tag);
+  }
+  else
+    luaV_fastget(t, key, &v, luaH_get, tag);
+  if (tagisempty(tag))
+    return 0;
+  setobj(((lua_State*)NULL), res, &v);
+  return 1;
+}
+
+
+static int jit_geti (TValue *res, const TValue *t, lua_Integer n) {
+  TValue v;
+  int tag;
+  luaV_fastgeti(t, n, &v, tag);
+  if (tagisempty(tag))
+    return 0;
+  setobj(((lua_State*)NULL), res, &v);
+  return 1;
+}
+
+
+static int jit_getfield (TValue *res, const TValue *t, TString *key) {
+  TValue v;
+  int tag;
+  luaV_fastget(t, key, &v, luaH_getshortstr, tag);
+  if (tagisempty(tag))
+    return 0;
+  setobj(((lua_State*)NULL), res, &v);
+  return 1;
+}
+
+
+static int jit_settable (lua_State *L, const TValue *t, const TValue *key,
+                         TValue *val) {
+  int hres;
+  if (ttisinteger(key)) {
+    luaV_fastseti(t, ivalue(key), val, hres);
+  }
+  else
+    luaV_fastset(t, key, val, hres, luaH_pset);
+  if (hres != HOK)
+    return 0;
+  luaV_finishfastset(L, t, val);
+  return 1;
+}
+
+
+static int jit_seti (lua_State *L, const TValue *t, lua_Integer n,
+                     TValue *val) {
+  int hres;
+  luaV_fastseti(t, n, val, hres);
+  if (hres != HOK)
+    return 0;
+  luaV_finishfastset(L, t, val);
+  return 1;
+}
+
+
+static int jit_setfield (lua_State *L, const TValue *t, TString *key,
+                         TValue *val) {
+  int hres;
+  luaV_fastset(t, key, val, hres, luaH_psetshortstr);
+  if (hres != HOK)
+    return 0;
+  luaV_finishfastset(L, t, val);
+  return 1;
+}
+
+
+static void jit_setupval (lua_State *L, UpVal *uv, TValue *val) {
+  setobj(L, uv->v.p, val);
+  luaC_barrier(L, uv, val);
+}
+
+
+/* float loop (see 'floatforloop' in 'lvm.c') */
+static int jit_floatforloop (StkId ra) {
+  lua_Number step = fltvalue(s2v(ra + 1));
+  lua_Number limit = fltvalue(s2v(ra));
+  lua_Number idx = fltvalue(s2v(ra + 2));
+  idx = luai_numadd(L, idx, step);
+  if (luai_numlt(0, step) ? luai_numle(idx, limit)
+                          : luai_numle(limit, idx)) {
+    chgfltvalue(s2v(ra + 2), idx);
+    return 1;
+  }
+  else
+    return 0;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Code emission
+** =======================================================
+*/
+
+static void b1 (JitState *J, int b) {
+  if (J->buff != NULL)
+    J->buff[J->pos] = cast_byte(b);
+  J->pos++;
+}
+
+
+static void b4 (JitState *J, unsigned int v) {
+  int i;
+  for (i = 0; i < 4; i++, v >>= 8)
+    b1(J, cast_int(v & 0xff));
+}
+
+
+static void b8 (JitState *J, lua_Unsigned v) {
+  int i;
+  for (i = 0; i < 8; i++, v >>= 8)
+    b1(J, cast_int(v & 0xff));
+}
+
+
+static void rex (JitState *J, int w, int reg, int rm) {
+  int r = 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+  if (r != 0x40)
+    b1(J, r);
+}
+
+
+static void opcode (JitState *J, int pfx, int w, const char *op, int reg,
+                                                                 int rm) {
+  if (pfx)
+    b1(J, pfx);
+  rex(J, w, reg, rm);
+  while (*op)
+    b1(J, cast_int(cast(unsigned char, *op++)));
+}
+
+
+/* instruction 'op' with operands 'reg' and '[base + disp]' */
+static void opmem (JitState *J, int pfx, int w, const char *op, int reg,
+                   int base, int disp) {
+  opcode(J, pfx, w, op, reg, base);
+  b1(J, 0x80 | ((reg & 7) << 3) | (base & 7));  /* [base + disp32] */
+  if ((base & 7) == J_RSP)
+    b1(J, 0x24);  /* SIB byte for 'rsp' and 'r12' */
+  b4(J, cast_uint(disp));
+}
+
+
+/* instruction 'op' with register operands 'reg' and 'rm' */
+static void opreg (JitState *J, int pfx, int w, const char *op, int reg,
+                                                                int rm) {
+  opcode(J, pfx, w, op, reg, rm);
+  b1(J, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+
+#define ldq(J,r,base,d)		opmem(J, 0, 1, "\x8B", r, base, d)
+#define stq(J,r,base,d)		opmem(J, 0, 1, "\x89", r, base, d)
+#define lea(J,r,base,d)		opmem(J, 0, 1, "\x8D", r, base, d)
+#define movsdld(J,x,base,d)	opmem(J, 0xF2, 0, "\x0F\x10", x, base, d)
+#define movsdst(J,x,base,d)	opmem(J, 0xF2, 0, "\x0F\x11", x, base, d)
+#define cvtsi2sd(J,x,base,d)	opmem(J, 0xF2, 1, "\x0F\x2A", x, base, d)
+#define movqx(J,x,r)		opreg(J, 0x66, 1, "\x0F\x6E", x, r)
+#define ucomisd(J,x1,x2)	opreg(J, 0x66, 0, "\x0F\x2E", x1, x2)
+#define testeax(J)		opreg(J, 0, 0, "\x85", J_RAX, J_RAX)
+#define callrax(J)		opreg(J, 0, 0, "\xFF", 2, J_RAX)
+
+
+/* mov 'r', 'v' */
+static void movimm (JitState *J, int r, lua_Unsigned v) {
+  rex(J, 1, 0, r);
+  b1(J, 0xB8 + (r & 7));
+  b8(J, v);
+}
+
+#define movptr(J,r,p)	movimm(J, r, cast(lua_Unsigned, cast(size_t, (p))))
+
+
+/* mov 'r32', 'v' */
+static void movimm32 (JitState *J, int r, int v) {
+  rex(J, 0, 0, r);
+  b1(J, 0xB8 + (r & 7));
+  b4(J, cast_uint(v));
+}
+
+
+/* movzx 'r32', byte [base + d] */
+static void ldtag (JitState *J, int r, int base, int d) {
+  opmem(J, 0, 0, "\x0F\xB6", r, base, d);
+}
+
+
+/* mov byte [base + d], 'tag' */
+static void sttag (JitState *J, int tag, int base, int d) {
+  opmem(J, 0, 0, "\xC6", 0, base, d);
+  b1(J, tag);
+}
+
+
+/* mov byte [base + d], 'r8' (only for al, cl, dl, and bl) */
+static void sttagr (JitState *J, int r, int base, int d) {
+  lua_assert(r <= J_RBX);
+  opmem(J, 0, 0, "\x88", r, base, d);
+}
+
+
+/* cmp byte [base + d], 'tag' */
+static void cmptag (JitState *J, int tag, int base, int d) {
+  opmem(J, 0, 0, "\x80", 7, base, d);
+  b1(J, tag);
+}
+
+
+/* cmp 'r', 'v' (32-bit immediate, sign extended) */
+static void cmpimm (JitState *J, int w, int r, int v) {
+  opreg(J, 0, w, "\x81", 7, r);
+  b4(J, cast_uint(v));
+}
+
+
+/* copy register 'b' to register 'a' */
+static void moveregs (JitState *J, int a, int b) {
+  ldq(J, J_RAX, J_R13, valoff(b));
+  ldtag(J, J_RCX, J_R13, tagoff(b));
+  stq(J, J_RAX, J_R13, valoff(a));
+  sttagr(J, J_RCX, J_R13, tagoff(a));
+}
+
+
+/* copy the value pointed by 'r' to register 'a' */
+static void movefrom (JitState *J, int a, int r) {
+  ldq(J, J_RCX, r, 0);
+  ldtag(J, J_RDX, r, cast_int(offsetof(TValue, tt_)));
+  stq(J, J_RCX, J_R13, valoff(a));
+  sttagr(J, J_RDX, J_R13, tagoff(a));
+}
+
+
+/* load a constant into register 'a' */
+static void loadconst (JitState *J, int a, const TValue *k) {
+  movimm(J, J_RAX, l_castS2U(k->value_.i));  /* covers the whole value */
+  stq(J, J_RAX, J_R13, valoff(a));
+  sttag(J, rawtt(k), J_R13, tagoff(a));
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Jumps
+** =======================================================
+*/
+
+/* position of the code for instruction 'idx' */
+static size_t target (JitState *J, int idx) {
+  return (J->buff == NULL) ? 0 : J->jc->entry[idx] >> 1;
+}
+
+
+/* position of the exit stub for instruction 'idx' */
+#define stub(J,idx)	((J)->stubs + cast_sizet(idx) * STUBSIZE)
+
+
+static void rel32 (JitState *J, size_t dest) {
+  b4(J, cast_uint(dest - (J->pos + 4)));
+}
+
+
+static void jcc (JitState *J, int cc, size_t dest) {
+  b1(J, 0x0F); b1(J, 0x80 | cc);
+  rel32(J, dest);
+}
+
+
+static void jmp (JitState *J, size_t dest) {
+  b1(J, 0xE9);
+  rel32(J, dest);
+}
+
+
+/* jump to the exit stub of the current instruction if 'cc' holds */
+#define exitif(J,cc)	jcc(J, cc, stub(J, (J)->idx))
+
+
+/* forward jumps inside an instruction; 'here' fixes them */
+static size_t jccfwd (JitState *J, int cc) {
+  jcc(J, cc, J->pos);
+  return J->pos;
+}
+
+
+static size_t jmpfwd (JitState *J) {
+  jmp(J, J->pos);
+  return J->pos;
+}
+
+
+static void here (JitState *J, size_t l) {
+  if (J->buff != NULL) {
+    unsigned int v = cast_uint(J->pos - l);
+    int i;
+    for (i = 0; i < 4; i++, v >>= 8)
+      J->buff[l - 4 + cast_sizet(i)] = cast_byte(v & 0xff);
+  }
+}
+
+
+/*
+** Jump to instruction 't' if 'cc' holds ('cc' may be CC_ALWAYS).
+** Backward jumps check for hooks, so that loops running in native code
+** can be interrupted.
+*/
+static void jumpto (JitState *J, int cc, int t) {
+  if (t > J->idx) {  /* forward jump? */
+    if (cc == CC_ALWAYS) jmp(J, target(J, t));
+    else jcc(J, cc, target(J, t));
+  }
+  else {
+    size_t skip = 0;
+    if (cc != CC_ALWAYS)
+      skip = jccfwd(J, cc ^ 1);  /* negated condition */
+    /* test dword [L + hookmask], JITHOOKS */
+    opmem(J, 0, 0, "\xF7", 0, J_RBX, cast_int(offsetof(lua_State, hookmask)));
+    b4(J, JITHOOKS);
+    jcc(J, CC_NE, stub(J, t));  /* hooks? leave native code */
+    jmp(J, target(J, t));
+    if (cc != CC_ALWAYS)
+      here(J, skip);
+  }
+}
+
+
+/*
+** Conditional jump of a test instruction followed by a jump: if the
+** test result ('cc' holding) is equal to 'k', do the jump, otherwise
+** skip it. (See 'docondjump' in 'lvm.c'.)
+*/
+static void emitcond (JitState *J, int cc, int k) {
+  Instruction ni = J->p->code[J->idx + 1];
+  int jt = J->idx + 2 + GETARG_sJ(ni);
+  lua_assert(GET_OPCODE(ni) == OP_JMP);
+  if (k) {
+    jumpto(J, cc, jt);
+    jumpto(J, CC_ALWAYS, J->idx + 2);
+  }
+  else {
+    jumpto(J, cc, J->idx + 2);
+    jumpto(J, CC_ALWAYS, jt);
+  }
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Templates
+** =======================================================
+*/
+
+/* call helper 'f' (arguments already in place) */
+#define callhelper(J,f)	(movptr(J, J_RAX, f), callrax(J))
+
+
+/* load the number in register 'a' into 'xmm', leaving if not a number */
+static void loadnum (JitState *J, int xmm, int a) {
+  size_t l1, l2;
+  cmptag(J, LUA_VNUMFLT, J_R13, tagoff(a));
+  l1 = jccfwd(J, CC_NE);
+  movsdld(J, xmm, J_R13, valoff(a));
+  l2 = jmpfwd(J);
+  here(J, l1);
+  cmptag(J, LUA_VNUMINT, J_R13, tagoff(a));
+  exitif(J, CC_NE);
+  cvtsi2sd(J, xmm, J_R13, valoff(a));
+  here(J, l2);
+}
+
+
+static void loadnumk (JitState *J, int xmm, lua_Number n) {
+  union { lua_Number n; lua_Unsigned u; } v;
+  v.n = n;
+  movimm(J, J_RAX, v.u);
+  movqx(J, xmm, J_RAX);
+}
+
+
+/*
+** Addition, subtraction, multiplication, and division, with an
+** integer and a float path. 'k2' is the second operand when it is a
+** constant; otherwise, the second operand is register 'c'. The
+** instruction is followed by an OP_MMBIN*, which is skipped.
+*/
+static int emitarith (JitState *J, OpCode op, int a, int b, int c,
+                                const TValue *k2) {
+  static const char *const intops[] = {"\x03", "\x2B", "\x0F\xAF"};
+  static const char *const fltops[] = {"\x0F\x58", "\x0F\x5C", "\x0F\x59",
+                                       "\x0F\x5E"};
+  int o = (op == OP_ADD) ? 0 : (op == OP_SUB) ? 1 : (op == OP_MUL) ? 2 : 3;
+  if (k2 != NULL && !ttisnumber(k2))
+    return 0;
+  if (o < 3 && (k2 == NULL || ttisinteger(k2))) {  /* integer path? */
+    size_t l1, l2 = 0;
+    cmptag(J, LUA_VNUMINT, J_R13, tagoff(b));
+    l1 = jccfwd(J, CC_NE);
+    if (k2 == NULL) {
+      cmptag(J, LUA_VNUMINT, J_R13, tagoff(c));
+      l2 = jccfwd(J, CC_NE);
+    }
+    ldq(J, J_RAX, J_R13, valoff(b));
+    if (k2 == NULL)
+      opmem(J, 0, 1, intops[o], J_RAX, J_R13, valoff(c));
+    else {
+      movimm(J, J_RCX, l_castS2U(ivalue(k2)));
+      opreg(J, 0, 1, intops[o], J_RAX, J_RCX);
+    }
+    stq(J, J_RAX, J_R13, valoff(a));
+    sttag(J, LUA_VNUMINT, J_R13, tagoff(a));
+    jumpto(J, CC_ALWAYS, J->idx + 2);
+    here(J, l1);
+    if (k2 == NULL)
+      here(J, l2);
+  }
+  loadnum(J, 0, b);
+  if (k2 == NULL)
+    loadnum(J, 1, c);
+  else
+    loadnumk(J, 1, nvalue(k2));
+  opreg(J, 0xF2, 0, fltops[o], 0, 1);
+  movsdst(J, 0, J_R13, valoff(a));
+  sttag(J, LUA_VNUMFLT, J_R13, tagoff(a));
+  jumpto(J, CC_ALWAYS, J->idx + 2);
+  return 1;
+}
+
+
+/*
+** Other arithmetic and bitwise operations, through 'jit_arith'. 'p2'
+** is the address of the second operand when it is a constant.
+*/
+static void emithelper (JitState *J, int op, int a, int b, int c,
+                         const TValue *p2, int next) {
+  opreg(J, 0, 1, "\x8B", J_RDI, J_RBX);  /* mov rdi, rbx */
+  movimm32(J, J_RSI, op);
+  lea(J, J_RDX, J_R13, valoff(b));
+  if (p2 != NULL)
+    movptr(J, J_RCX, p2);
+  else
+    lea(J, J_RCX, J_R13, valoff(c));
+  lea(J, J_R8, J_R13, valoff(a));
+  callhelper(J, jit_arith);
+  testeax(J);
+  exitif(J, CC_E);
+  jumpto(J, CC_ALWAYS, next);
+}
+
+
+/*
+** Order comparisons with registers (LT and LE). 'icc' is the condition
+** for integers, 'fcc' for floats (after 'ucomisd b, a').
+*/
+static void emitorder (JitState *J, Instruction i, int icc, int fcc) {
+  int a = GETARG_A(i);
+  int b = GETARG_B(i);
+  size_t l1, l2;
+  cmptag(J, LUA_VNUMINT, J_R13, tagoff(a));
+  l1 = jccfwd(J, CC_NE);
+  cmptag(J, LUA_VNUMINT, J_R13, tagoff(b));
+  l2 = jccfwd(J, CC_NE);
+  ldq(J, J_RAX, J_R13, valoff(a));
+  opmem(J, 0, 1, "\x3B", J_RAX, J_R13, valoff(b));  /* cmp rax, R[B] */
+  emitcond(J, icc, GETARG_k(i));
+  here(J, l1); here(J, l2);
+  cmptag(J, LUA_VNUMFLT, J_R13, tagoff(a));
+  exitif(J, CC_NE);
+  cmptag(J, LUA_VNUMFLT, J_R13, tagoff(b));
+  exitif(J, CC_NE);
+  movsdld(J, 0, J_R13, valoff(a));
+  movsdld(J, 1, J_R13, valoff(b));
+  ucomisd(J, 1, 0);
+  emitcond(J, fcc, GETARG_k(i));
+}
+
+
+/*
+** Order comparisons with an immediate operand. 'icc' is the condition
+** for integers; 'fcc' is the condition for floats after 'ucomisd' with
+** 'swap' telling whether the operands are swapped ('ucomisd im, a').
+*/
+static void emitorderI (JitState *J, Instruction i, int icc, int fcc,
+                                                int swap) {
+  int a = GETARG_A(i);
+  int im = GETARG_sB(i);
+  size_t l1;
+  cmptag(J, LUA_VNUMINT, J_R13, tagoff(a));
+  l1 = jccfwd(J, CC_NE);
+  ldq(J, J_RAX, J_R13, valoff(a));
+  cmpimm(J, 1, J_RAX, im);
+  emitcond(J, icc, GETARG_k(i));
+  here(J, l1);
+  cmptag(J, LUA_VNUMFLT, J_R13, tagoff(a));
+  exitif(J, CC_NE);
+  movsdld(J, 0, J_R13, valoff(a));
+  loadnumk(J, 1, cast_num(im));
+  if (swap) ucomisd(J, 1, 0);
+  else ucomisd(J, 0, 1);
+  emitcond(J, fcc, GETARG_k(i));
+}
+
+
+/* jump to 'lfalse' if register 'a' is false or nil (clobbers eax) */
+static size_t testfalse (JitState *J, int a, size_t *lnil) {
+  ldtag(J, J_RAX, J_R13, tagoff(a));
+  cmpimm(J, 0, J_RAX, LUA_VFALSE);
+  *lnil = jccfwd(J, CC_E);
+  opreg(J, 0, 0, "\xF7", 0, J_RAX);  /* test eax, 0x0F */
+  b4(J, 0x0F);
+  return jccfwd(J, CC_E);
+}
+
+
+/* load the upvalue table 'cl->upvals[b]->v.p' into register 'r' */
+static void loadupval (JitState *J, int r, int b) {
+  ldq(J, J_RAX, J_R15, cast_int(offsetof(LClosure, upvals)) +
+                       b * cast_int(sizeof(UpVal *)));
+  ldq(J, r, J_RAX, cast_int(offsetof(UpVal, v)));
+}
+
+
+/* load the address of the RK operand of instruction 'i' into 'r' */
+static void loadRKC (JitState *J, int r, Instruction i) {
+  if (TESTARG_k(i))
+    movptr(J, r, J->p->k + GETARG_C(i));
+  else
+    lea(J, r, J_R13, valoff(GETARG_C(i)));
+}
+
+
+/* call helper 'f' (arguments already in place); exit if it fails */
+#define finishhelper(J,f)  \
+	(callhelper(J,f), testeax(J), exitif(J, CC_E))
+
+
+/*
+** Compile instruction 'i'. Returns 0 when the instruction only exits
+** native code (so that there is no point in entering native code
+** there).
+*/
+static int compileinst (JitState *J, Instruction i) {
+  OpCode op = luaP_genericop(GET_OPCODE(i));
+  Proto *p = J->p;
+  int a = GETARG_A(i);
+  int idx = J->idx;
+  switch (op) {
+    case OP_MOVE: {
+      moveregs(J, a, GETARG_B(i));
+      return 1;
+    }
+    case OP_LOADI: {
+      movimm(J, J_RAX, l_castS2U(GETARG_sBx(i)));
+      stq(J, J_RAX, J_R13, valoff(a));
+      sttag(J, LUA_VNUMINT, J_R13, tagoff(a));
+      return 1;
+    }
+    case OP_LOADF: {
+      TValue v;
+      setfltvalue(&v, cast_num(GETARG_sBx(i)));
+      loadconst(J, a, &v);
+      return 1;
+    }
+    case OP_LOADK: {
+      loadconst(J, a, p->k + GETARG_Bx(i));
+      return 1;
+    }
+    case OP_LOADFALSE: {
+      sttag(J, LUA_VFALSE, J_R13, tagoff(a));
+      return 1;
+    }
+    case OP_LFALSESKIP: {
+      sttag(J, LUA_VFALSE, J_R13, tagoff(a));
+      jumpto(J, CC_ALWAYS, idx + 2);
+      return 1;
+    }
+    case OP_LOADTRUE: {
+      sttag(J, LUA_VTRUE, J_R13, tagoff(a));
+      return 1;
+    }
+    case OP_LOADNIL: {
+      int b = GETARG_B(i);
+      do {
+        sttag(J, LUA_VNIL, J_R13, tagoff(a++));
+      } while (b--);
+      return 1;
+    }
+    case OP_GETUPVAL: {
+      loadupval(J, J_RSI, GETARG_B(i));
+      movefrom(J, a, J_RSI);
+      return 1;
+    }
+    case OP_SETUPVAL: {
+      opreg(J, 0, 1, "\x8B", J_RDI, J_RBX);  /* mov rdi, rbx */
+      ldq(J, J_RSI, J_R15, cast_int(offsetof(LClosure, upvals)) +
+                           GETARG_B(i) * cast_int(sizeof(UpVal *)));
+      lea(J, J_RDX, J_R13, valoff(a));
+      callhelper(J, jit_setupval);
+      return 1;
+    }
+    case OP_GETTABUP: {
+      lea(J, J_RDI, J_R13, valoff(a));
+      loadupval(J, J_RSI, GETARG_B(i));
+      movptr(J, J_RDX, tsvalue(p->k + GETARG_C(i)));
+      finishhelper(J, jit_getfield);
+      return 1;
+    }
+    case OP_GETTABLE: {
+      lea(J, J_RDI, J_R13, valoff(a));
+      lea(J, J_RSI, J_R13, valoff(GETARG_B(i)));
+      lea(J, J_RDX, J_R13, valoff(GETARG_C(i)));
+      finishhelper(J, jit_gettable);
+      return 1;
+    }
+    case OP_GETI: {
+      lea(J, J_RDI, J_R13, valoff(a));
+      lea(J, J_RSI, J_R13, valoff(GETARG_B(i)));
+      movimm(J, J_RDX, cast(lua_Unsigned, GETARG_C(i)));
+      finishhelper(J, jit_geti);
+      return 1;
+    }
+    case OP_GETFIELD: {
+      lea(J, J_RDI, J_R13, valoff(a));
+      lea(J, J_RSI, J_R13, valoff(GETARG_B(i)));
+      movptr(J, J_RDX, tsvalue(p->k + GETARG_C(i)));
+      finishhelper(J, jit_getfield);
+      return 1;
+    }
+    case OP_SETTABUP: {
+      opreg(J, 0, 1, "\x8B", J_RDI, J_RBX);  /* mov rdi, rbx */
+      loadupval(J, J_RSI, a);
+      movptr(J, J_RDX, tsvalue(p->k + GETARG_B(i)));
+      loadRKC(J, J_RCX, i);
+      finishhelper(J, jit_setfield);
+      return 1;
+    }
+    case OP_SETTABLE: {
+      opreg(J, 0, 1, "\x8B", J_RDI, J_RBX);  /* mov rdi, rbx */
+      lea(J, J_RSI, J_R13, valoff(a));
+      lea(J, J_RDX, J_R13, valoff(GETARG_B(i)));
+      loadRKC(J, J_RCX, i);
+      finishhelper(J, jit_settable);
+      return 1;
+    }
+    case OP_SETI: {
+      opreg(J, 0, 1, "\x8B", J_RDI, J_RBX);  /* mov rdi, rbx */
+      lea(J, J_RSI, J_R13, valoff(a));
+      movimm(J, J_RDX, cast(lua_Unsigned, GETARG_B(i)));
+      loadRKC(J, J_RCX, i);
+      finishhelper(J, jit_seti);
+      return 1;
+    }
+    case OP_SETFIELD: {
+      opreg(J, 0, 1, "\x8B", J_RDI, J_RBX);  /* mov rdi, rbx */
+      lea(J, J_RSI, J_R13, valoff(a));
+      movptr(J, J_RDX, tsvalue(p->k + GETARG_B(i)));
+      loadRKC(J, J_RCX, i);
+      finishhelper(J, jit_setfield);
+      return 1;
+    }
+    case OP_ADDI: {
+      TValue v;
+      setivalue(&v, GETARG_sC(i));
+      return emitarith(J, OP_ADD, a, GETARG_B(i), 0, &v);
+    }
+    case OP_ADDK: case OP_SUBK: case OP_MULK: case OP_DIVK: {
+      OpCode aop = cast(OpCode, op - OP_ADDK + OP_ADD);
+      return emitarith(J, aop, a, GETARG_B(i), 0, p->k + GETARG_C(i));
+    }
+    case OP_MODK: case OP_POWK: case OP_IDIVK:
+    case OP_BANDK: case OP_BORK: case OP_BXORK: {
+      emithelper(J, op - OP_ADDK + LUA_OPADD, a, GETARG_B(i), 0,
+                     p->k + GETARG_C(i), idx + 2);
+      return 1;
+    }
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: {
+      return emitarith(J, op, a, GETARG_B(i), GETARG_C(i), NULL);
+    }
+    case OP_MOD: case OP_POW: case OP_IDIV:
+    case OP_BAND: case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR: {
+      emithelper(J, op - OP_ADD + LUA_OPADD, a, GETARG_B(i), GETARG_C(i),
+                     NULL, idx + 2);
+      return 1;
+    }
+    case OP_UNM: {
+      int b = GETARG_B(i);
+      size_t l1, l2;
+      ldq(J, J_RAX, J_R13, valoff(b));
+      ldtag(J, J_RCX, J_R13, tagoff(b));
+      cmpimm(J, 0, J_RCX, LUA_VNUMINT);
+      l1 = jccfwd(J, CC_NE);
+      opreg(J, 0, 1, "\xF7", 3, J_RAX);  /* neg rax */
+      l2 = jmpfwd(J);
+      here(J, l1);
+      cmpimm(J, 0, J_RCX, LUA_VNUMFLT);
+      exitif(J, CC_NE);
+      movimm(J, J_RDX, l_castS2U(LUA_MININTEGER));  /* sign bit */
+      opreg(J, 0, 1, "\x33", J_RAX, J_RDX);  /* xor rax, rdx */
+      here(J, l2);
+      stq(J, J_RAX, J_R13, valoff(a));
+      sttagr(J, J_RCX, J_R13, tagoff(a));
+      return 1;
+    }
+    case OP_BNOT: {
+      int b = GETARG_B(i);
+      emithelper(J, LUA_OPBNOT, a, b, b, NULL, idx + 1);
+      return 1;
+    }
+    case OP_NOT: {
+      size_t lnil, lfalse, lend;
+      lfalse = testfalse(J, GETARG_B(i), &lnil);
+      sttag(J, LUA_VFALSE, J_R13, tagoff(a));
+      lend = jmpfwd(J);
+      here(J, lnil); here(J, lfalse);
+      sttag(J, LUA_VTRUE, J_R13, tagoff(a));
+      here(J, lend);
+      return 1;
+    }
+    case OP_LEN: {
+      lea(J, J_RDI, J_R13, valoff(a));
+      lea(J, J_RSI, J_R13, valoff(GETARG_B(i)));
+      finishhelper(J, jit_len);
+      return 1;
+    }
+    case OP_JMP: {
+      jumpto(J, CC_ALWAYS, idx + 1 + GETARG_sJ(i));
+      return 1;
+    }
+    case OP_EQ: {
+      int b = GETARG_B(i);
+      size_t l1, l2;
+      cmptag(J, LUA_VNUMINT, J_R13, tagoff(a));
+      l1 = jccfwd(J, CC_NE);
+      cmptag(J, LUA_VNUMINT, J_R13, tagoff(b));
+      l2 = jccfwd(J, CC_NE);
+      ldq(J, J_RAX, J_R13, valoff(a));
+      opmem(J, 0, 1, "\x3B", J_RAX, J_R13, valoff(b));  /* cmp rax, R[B] */
+      emitcond(J, CC_E, GETARG_k(i));
+      here(J, l1); here(J, l2);
+      lea(J, J_RDI, J_R13, valoff(a));
+      lea(J, J_RSI, J_R13, valoff(b));
+      callhelper(J, jit_eq);
+      cmpimm(J, 0, J_RAX, 0);
+      exitif(J, CC_L);  /* may need a metamethod */
+      emitcond(J, CC_NE, GETARG_k(i));
+      return 1;
+    }
+    case OP_EQK: {
+      lea(J, J_RDI, J_R13, valoff(a));
+      movptr(J, J_RSI, p->k + GETARG_B(i));
+      callhelper(J, jit_eqk);
+      testeax(J);
+      emitcond(J, CC_NE, GETARG_k(i));
+      return 1;
+    }
+    case OP_EQI: {
+      cmptag(J, LUA_VNUMINT, J_R13, tagoff(a));
+      exitif(J, CC_NE);
+      ldq(J, J_RAX, J_R13, valoff(a));
+      cmpimm(J, 1, J_RAX, GETARG_sB(i));
+      emitcond(J, CC_E, GETARG_k(i));
+      return 1;
+    }
+    case OP_LT: emitorder(J, i, CC_L, CC_A); return 1;
+    case OP_LE: emitorder(J, i, CC_LE, CC_AE); return 1;
+    case OP_LTI: emitorderI(J, i, CC_L, CC_A, 1); return 1;
+    case OP_LEI: emitorderI(J, i, CC_LE, CC_AE, 1); return 1;
+    case OP_GTI: emitorderI(J, i, CC_G, CC_A, 0); return 1;
+    case OP_GEI: emitorderI(J, i, CC_GE, CC_AE, 0); return 1;
+    case OP_TEST: {  /* condition is "value is true" */
+      size_t lnil, lfalse;
+      lfalse = testfalse(J, a, &lnil);
+      jumpto(J, CC_ALWAYS, GETARG_k(i) ? idx + 2 + GETARG_sJ(p->code[idx + 1])
+                                       : idx + 2);
+      here(J, lnil); here(J, lfalse);
+      jumpto(J, CC_ALWAYS, GETARG_k(i) ? idx + 2
+                                       : idx + 2 + GETARG_sJ(p->code[idx + 1]));
+      return 1;
+    }
+    case OP_TESTSET: {
+      int b = GETARG_B(i);
+      int jt = idx + 2 + GETARG_sJ(p->code[idx + 1]);
+      size_t lnil, lfalse;
+      lfalse = testfalse(J, b, &lnil);
+      /* value is true */
+      if (GETARG_k(i)) {
+        moveregs(J, a, b);
+        jumpto(J, CC_ALWAYS, jt);
+      }
+      else
+        jumpto(J, CC_ALWAYS, idx + 2);
+      here(J, lnil); here(J, lfalse);
+      /* value is false */
+      if (!GETARG_k(i)) {
+        moveregs(J, a, b);
+        jumpto(J, CC_ALWAYS, jt);
+      }
+      else
+        jumpto(J, CC_ALWAYS, idx + 2);
+      return 1;
+    }
+    case OP_FORLOOP: {
+      int back = idx + 1 - GETARG_Bx(i);
+      size_t lflt, lend1, lend2;
+      cmptag(J, LUA_VNUMINT, J_R13, tagoff(a + 1));
+      lflt = jccfwd(J, CC_NE);
+      ldq(J, J_RAX, J_R13, valoff(a));  /* counter */
+      opreg(J, 0, 1, "\x85", J_RAX, J_RAX);  /* test rax, rax */
+      lend1 = jccfwd(J, CC_E);
+      opreg(J, 0, 1, "\xFF", 1, J_RAX);  /* dec rax */
+      stq(J, J_RAX, J_R13, valoff(a));
+      ldq(J, J_RCX, J_R13, valoff(a + 2));
+      opmem(J, 0, 1, "\x03", J_RCX, J_R13, valoff(a + 1));  /* add step */
+      stq(J, J_RCX, J_R13, valoff(a + 2));
+      jumpto(J, CC_ALWAYS, back);
+      here(J, lflt);
+      lea(J, J_RDI, J_R13, valoff(a));
+      callhelper(J, jit_floatforloop);
+      testeax(J);
+      lend2 = jccfwd(J, CC_E);
+      jumpto(J, CC_ALWAYS, back);
+      here(J, lend1); here(J, lend2);
+      return 1;
+    }
+    case OP_TFORLOOP: {
+      ldtag(J, J_RAX, J_R13, tagoff(a + 3));
+      opreg(J, 0, 0, "\xF7", 0, J_RAX);  /* test eax, 0x0F */
+      b4(J, 0x0F);
+      jumpto(J, CC_NE, idx + 1 - GETARG_Bx(i));
+      return 1;
+    }
+    default: {  /* anything else is left for the interpreter */
+      jmp(J, stub(J, idx));
+      return 0;
+    }
+  }
+}
+
+
+static void emitcode (JitState *J) {
+  Proto *p = J->p;
+  int idx;
+  /* prologue */
+  b1(J, 0x53);  /* push rbx */
+  b1(J, 0x41); b1(J, 0x54);  /* push r12 */
+  b1(J, 0x41); b1(J, 0x55);  /* push r13 */
+  b1(J, 0x41); b1(J, 0x56);  /* push r14 */
+  b1(J, 0x41); b1(J, 0x57);  /* push r15 */
+  opreg(J, 0, 1, "\x8B", J_RBX, J_RDI);  /* mov rbx, rdi */
+  opreg(J, 0, 1, "\x8B", J_R13, J_RSI);  /* mov r13, rsi */
+  opreg(J, 0, 1, "\x8B", J_R15, J_RDX);  /* mov r15, rdx */
+  movptr(J, J_R14, p->code);
+  opreg(J, 0, 0, "\xFF", 4, J_RCX);  /* jmp rcx */
+  /* exit */
+  J->exitpos = J->pos;
+  b1(J, 0x41); b1(J, 0x5F);  /* pop r15 */
+  b1(J, 0x41); b1(J, 0x5E);  /* pop r14 */
+  b1(J, 0x41); b1(J, 0x5D);  /* pop r13 */
+  b1(J, 0x41); b1(J, 0x5C);  /* pop r12 */
+  b1(J, 0x5B);  /* pop rbx */
+  b1(J, 0xC3);  /* ret */
+  /* instructions */
+  for (idx = 0; idx < p->sizecode; idx++) {
+    size_t pos = J->pos;
+    int canenter;
+    J->idx = idx;
+    canenter = compileinst(J, p->code[idx]);
+    J->jc->entry[idx] = cast_uint(pos << 1) | cast_uint(canenter);
+  }
+  /* exit stubs */
+  J->stubs = J->pos;
+  for (idx = 0; idx < p->sizecode; idx++) {
+    lea(J, J_RAX, J_R14, idx * cast_int(sizeof(Instruction)));
+    jmp(J, J->exitpos);
+  }
+  lua_assert(J->pos - J->stubs == cast_sizet(p->sizecode) * STUBSIZE);
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Executable memory
+** =======================================================
+*/
+
+static void *newexec (size_t size) {
+  void *m;
+#if defined(MAP_ANONYMOUS)
+  m = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#else
+  int fd = open("/dev/zero", O_RDWR);
+  if (fd < 0) return NULL;
+  m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+#endif
+  return (m == MAP_FAILED) ? NULL : m;
+}
+
+/* }====================================================== */
+
+
+
+void luaJ_compile (lua_State *L, Proto *p) {
+  JitState J;
+  size_t esize = offsetof(JitCode, entry) +
+                 cast_sizet(p->sizecode) * sizeof(unsigned int);
+  JitCode *jc = cast(JitCode *, luaM_realloc_(L, NULL, 0, esize));
+  if (jc == NULL)
+    return;  /* no memory; just keep interpreting the function */
+  jc->sizeentry = p->sizecode;
+  J.p = p; J.jc = jc;
+  J.exitpos = J.stubs = 0;
+  /* first pass: compute size and offsets */
+  J.buff = NULL; J.pos = 0;
+  emitcode(&J);
+  jc->msize = J.pos;
+  jc->mcode = newexec(jc->msize);
+  if (jc->mcode == NULL) {
+    luaM_freemem(L, jc, esize);
+    return;
+  }
+  /* second pass: generate the code */
+  J.buff = cast(lu_byte *, jc->mcode); J.pos = 0;
+  emitcode(&J);
+  lua_assert(J.pos == jc->msize);
+  if (mprotect(jc->mcode, jc->msize, PROT_READ | PROT_EXEC) != 0) {
+    munmap(jc->mcode, jc->msize);
+    luaM_freemem(L, jc, esize);
+    return;
+  }
+  p->jit = jc;
+  cachestat(G(L), LUA_CSJIT);
+}
+
+
+const Instruction *luaJ_run (lua_State *L, StkId base, LClosure *cl,
+                             const Instruction *pc) {
+  JitCode *jc = cl->p->jit;
+  char *mcode = cast_charp(jc->mcode);
+  JitFunction f = cast(JitFunction, jc->mcode);
+  lua_assert(luaJ_canenter(cl->p, pc) && !(L->hookmask & JITHOOKS));
+  return f(L, base, cl, mcode + (jc->entry[pc - cl->p->code] >> 1));
+}
+
+
+void luaJ_free (lua_State *L, Proto *p) {
+  JitCode *jc = p->jit;
+  munmap(jc->mcode, jc->msize);
+  luaM_freemem(L, jc, offsetof(JitCode, entry) +
+                      cast_sizet(jc->sizeentry) * sizeof(unsigned int));
+  p->jit = NULL;
+}
+
+#endif
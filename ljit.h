@@ -0,0 +1,74 @@
+/*
+** $Id: ljit.h $
+** Baseline compiler from Lua bytecode to native code
+** See Copyright Notice in lua.h
+*/
+
+#ifndef ljit_h
+#define ljit_h
+
+
+#include "lobject.h"
+#include "lstate.h"
+
+
+/*
+** Define LUA_USE_JIT as 1 to compile hot Lua functions into native
+** code. The compiler only targets x86-64 with gcc (or compatible
+** compilers) on POSIX systems, with the default integer and float
+** types.
+*/
+#if !defined(LUA_USE_JIT)
+#define LUA_USE_JIT	0
+#endif
+
+
+/* number of calls after which a function is compiled */
+#if !defined(LUAI_JITCALLS)
+#define LUAI_JITCALLS	1000
+#endif
+
+
+#if LUA_USE_JIT
+
+#if !defined(__x86_64__) || !defined(__GNUC__) || \
+    !(defined(__unix__) || defined(__APPLE__))
+#error "LUA_USE_JIT needs x86-64, gcc, and a POSIX system"
+#endif
+
+
+/*
+** Native code of a function. 'entry' has, for each instruction, the
+** offset of its code in 'mcode' (shifted left one bit) and, in its
+** lowest bit, whether it is worth entering the native code at that
+** instruction.
+*/
+typedef struct JitCode {
+  void *mcode;  /* machine code */
+  size_t msize;  /* size of the memory area with 'mcode' */
+  int sizeentry;  /* size of 'entry' (equal to 'sizecode') */
+  unsigned int entry[1];
+} JitCode;
+
+
+/* can native code for proto 'p' run instruction at 'pc'? */
+#define luaJ_canenter(p,pc)	((p)->jit->entry[(pc) - (p)->code] & 1u)
+
+
+/* count a call to a Lua function, compiling it when it gets hot */
+#define luaJ_count(L,p)  \
+	{ if ((p)->jitcalls > 0 && --(p)->jitcalls == 0) luaJ_compile(L, p); }
+
+
+LUAI_FUNC void luaJ_compile (lua_State *L, Proto *p);
+LUAI_FUNC const Instruction *luaJ_run (lua_State *L, StkId base,
+                                       LClosure *cl, const Instruction *pc);
+LUAI_FUNC void luaJ_free (lua_State *L, Proto *p);
+
+#else
+
+#define luaJ_count(L,p)	((void)0)
+
+#endif
+
+#endif
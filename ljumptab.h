@@ -9,7 +9,11 @@
 #undef vmcase
 #undef vmbreak
 
+#if LUA_USE_PREDECODE
+#define vmdispatch(x)     goto *d->op;
+#else
 #define vmdispatch(x)     goto *disptab[x];
+#endif
 
 #define vmcase(l)     L_##l:
 
@@ -107,6 +111,24 @@ static const void *const disptab[NUM_OPCODES] = {
 &&L_OP_CLOSURE,
 &&L_OP_VARARG,
 &&L_OP_VARARGPREP,
-&&L_OP_EXTRAARG
+&&L_OP_EXTRAARG,
+&&L_OP_ADDIINT,
+&&L_OP_ADDIFLT,
+&&L_OP_ADDKINT,
+&&L_OP_ADDKFLT,
+&&L_OP_SUBKINT,
+&&L_OP_SUBKFLT,
+&&L_OP_MULKINT,
+&&L_OP_MULKFLT,
+&&L_OP_ADDINT,
+&&L_OP_ADDFLT,
+&&L_OP_SUBINT,
+&&L_OP_SUBFLT,
+&&L_OP_MULINT,
+&&L_OP_MULFLT,
+&&L_OP_LTINT,
+&&L_OP_LTFLT,
+&&L_OP_LEINT,
+&&L_OP_LEFLT
 
 };
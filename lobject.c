@@ -377,6 +377,26 @@ size_t luaO_str2num (const char *s, TValue *o) {
 }
 
 
+/*
+** Convert a string that may not end with a '\0' (a view). The numeral
+** (without the spaces around it) is copied to a buffer, so it fails
+** if it is longer than L_MAXLENNUM. Return true on success.
+*/
+int luaO_lstr2num (const char *s, size_t len, TValue *o) {
+  char buff[L_MAXLENNUM + 1];
+  while (len > 0 && lisspace(cast_uchar(*s))) {  /* skip initial spaces */
+    s++; len--;
+  }
+  while (len > 0 && lisspace(cast_uchar(s[len - 1])))  /* and final ones */
+    len--;
+  if (len > L_MAXLENNUM)
+    return 0;
+  memcpy(buff, s, len * sizeof(char));
+  buff[len] = '\0';
+  return (luaO_str2num(buff, o) == len + 1);
+}
+
+
 int luaO_utf8esc (char *buff, unsigned long x) {
   int n = 1;  /* number of bytes put in buffer (backwards) */
   lua_assert(x <= 0x7FFFFFFFu);
@@ -397,6 +397,8 @@ typedef struct GCObject {
 #define LSTRREG		-1  /* regular long string */
 #define LSTRFIX		-2  /* fixed external long string */
 #define LSTRMEM		-3  /* external long string with deallocation */
+#define LSTRVIEW	-4  /* part of another long string (kept in 'ud') */
+#define LSTRCOPY	-5  /* former view, now with its own copy of the part */
 
 
 /*
@@ -576,11 +578,36 @@ typedef struct AbsLineInfo {
 } AbsLineInfo;
 
 
+/*
+** Entry of an inline cache for field accesses. Entries only record
+** positions (node indices) where keys were last found; they are
+** validated at each use (see 'lvm.c').
+*/
+typedef struct ICache {
+  unsigned int slot;  /* node with the key in the indexed table */
+  unsigned int mtslot;  /* node with '__index' in the table's metatable */
+  unsigned int islot;  /* node with the key in the '__index' table */
+} ICache;
+
+
+/*
+** Pre-decoded instruction, for interpreters built with
+** LUA_USE_PREDECODE (see 'lvm.c'): the address of the code that
+** runs the instruction plus its unpacked arguments.
+*/
+typedef struct DecodedIns {
+  const void *op;  /* handler for the instruction's opcode */
+  Instruction i;  /* original instruction */
+  lu_byte a, b, c;  /* arguments A, B, and C */
+} DecodedIns;
+
+
 /*
 ** Flags in Prototypes
 */
 #define PF_ISVARARG	1
 #define PF_FIXED	2  /* prototype has parts in fixed memory */
+#define PF_NOQUICK	4  /* interpreter does not quicken its code */
 
 
 /*
@@ -591,6 +618,8 @@ typedef struct Proto {
   lu_byte numparams;  /* number of fixed (named) parameters */
   lu_byte flag;
   lu_byte maxstacksize;  /* number of registers needed by this function */
+  lu_byte quickmiss;  /* number of de-specializations of quickened code */
+  lu_byte cachemiss;  /* number of misses of 'cache' */
   int sizeupvalues;  /* size of 'upvalues' */
   int sizek;  /* size of 'k' */
   int sizecode;
@@ -598,6 +627,9 @@ typedef struct Proto {
   int sizep;  /* size of 'p' */
   int sizelocvars;
   int sizeabslineinfo;  /* size of 'abslineinfo' */
+  int sizeicache;  /* size of 'icache' */
+  int jitcalls;  /* calls left before compiling the function */
+  int nremoved;  /* number of instructions removed by the optimizer */
   int linedefined;  /* debug information  */
   int lastlinedefined;  /* debug information  */
   TValue *k;  /* constants used by the function */
@@ -607,6 +639,11 @@ typedef struct Proto {
   ls_byte *lineinfo;  /* information about source lines (debug information) */
   AbsLineInfo *abslineinfo;  /* idem */
   LocVar *locvars;  /* information about local variables (debug information) */
+  ICache *icache;  /* inline caches for field accesses */
+  unsigned short *icmap;  /* entry in 'icache' for each instruction */
+  DecodedIns *dcode;  /* pre-decoded copy of 'code' (or NULL) */
+  struct JitCode *jit;  /* native code for the function (see 'ljit.c') */
+  struct LClosure *cache;  /* last-created closure with this prototype */
   TString  *source;  /* used for debug information */
   GCObject *gclist;
 } Proto;
@@ -773,6 +810,61 @@ typedef union Node {
 #define setnorealasize(t)	((t)->flags |= BITRAS)
 
 
+/*
+** Define LUA_USE_SHAPES as 1 to keep the short-string keys of tables
+** in shapes shared among tables (see 'ltable.c').
+*/
+#if !defined(LUA_USE_SHAPES)
+#define LUA_USE_SHAPES	0
+#endif
+
+
+/*
+** Define LUA_USE_PACKEDARRAYS as 1 to keep array parts holding only
+** integers or only floats without their tags (see 'ltable.c').
+*/
+#if !defined(LUA_USE_PACKEDARRAYS)
+#define LUA_USE_PACKEDARRAYS	0
+#endif
+
+
+/*
+** Define LUA_USE_INCREHASH as 1 to grow large hash parts incrementally,
+** moving entries from the old node vector a few at a time (see
+** 'ltable.c').
+*/
+#if !defined(LUA_USE_INCREHASH)
+#define LUA_USE_INCREHASH	0
+#endif
+
+
+/*
+** Define LUA_USE_TABLESITES as 1 to record in each table the function
+** and the instruction that created it, for heap walkers (see
+** 'lua_tablesite').
+*/
+#if !defined(LUA_USE_TABLESITES)
+#define LUA_USE_TABLESITES	0
+#endif
+
+
+/*
+** A shape is a sequence of short-string keys, shared by all tables that
+** got those keys in that order. Each table with a shape keeps the values
+** of those keys in its array 'slots', in the order of the keys.
+*/
+typedef struct Shape {
+  struct Shape *parent;  /* shape without the last key */
+  struct Shape *hnext;  /* next shape in the same bucket of the shape table */
+  lu_mem bloom;  /* one bit for each key (see 'ltable.c') */
+  unsigned int refs;  /* number of tables and shapes using this shape */
+  unsigned int hash;  /* hash of 'parent' and the last key */
+  unsigned short nkeys;  /* number of keys */
+  unsigned short nkids;  /* number of shapes with one more key */
+  TString *keys[1];  /* keys, in the order of the slots */
+} Shape;
+
+
 typedef struct Table {
   CommonHeader;
   lu_byte flags;  /* 1<<p means tagmethod(p) is not present */
@@ -782,6 +874,24 @@ typedef struct Table {
   Node *node;
   struct Table *metatable;
   GCObject *gclist;
+  unsigned int hbound;  /* hint for a border in the hash part */
+#if LUA_USE_SHAPES
+  Shape *shape;  /* keys of the fields in 'slots' (or NULL) */
+  TValue *slots;  /* values of the keys in 'shape' */
+#endif
+#if LUA_USE_PACKEDARRAYS
+  lu_byte packtag;  /* tag of all entries of a packed array (or LUA_VNIL) */
+  unsigned int npacked;  /* number of entries in a packed array */
+#endif
+#if LUA_USE_INCREHASH
+  lu_byte oldlsizenode;  /* log2 of size of 'oldnode' array */
+  unsigned int migrated;  /* number of nodes of 'oldnode' already moved */
+  Node *oldnode;  /* old hash part still being moved (or NULL) */
+#endif
+#if LUA_USE_TABLESITES
+  struct Proto *site;  /* function that created the table (or NULL) */
+  int sitepc;  /* instruction of 'site' that created the table */
+#endif
 } Table;
 
 
@@ -842,6 +952,7 @@ LUAI_FUNC int luaO_rawarith (lua_State *L, int op, const TValue *p1,
 LUAI_FUNC void luaO_arith (lua_State *L, int op, const TValue *p1,
                            const TValue *p2, StkId res);
 LUAI_FUNC size_t luaO_str2num (const char *s, TValue *o);
+LUAI_FUNC int luaO_lstr2num (const char *s, size_t len, TValue *o);
 LUAI_FUNC int luaO_hexavalue (int c);
 LUAI_FUNC void luaO_tostring (lua_State *L, TValue *obj);
 LUAI_FUNC const char *luaO_pushvfstring (lua_State *L, const char *fmt,
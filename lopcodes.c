@@ -100,5 +100,38 @@ LUAI_DDEF const lu_byte luaP_opmodes[NUM_OPCODES] = {
  ,opmode(0, 1, 0, 0, 1, iABC)		/* OP_VARARG */
  ,opmode(0, 0, 1, 0, 1, iABC)		/* OP_VARARGPREP */
  ,opmode(0, 0, 0, 0, 0, iAx)		/* OP_EXTRAARG */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_ADDIINT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_ADDIFLT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_ADDKINT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_ADDKFLT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_SUBKINT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_SUBKFLT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_MULKINT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_MULKFLT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_ADDINT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_ADDFLT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_SUBINT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_SUBFLT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_MULINT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_MULFLT */
+ ,opmode(0, 0, 0, 1, 0, iABC)		/* OP_LTINT */
+ ,opmode(0, 0, 0, 1, 0, iABC)		/* OP_LTFLT */
+ ,opmode(0, 0, 0, 1, 0, iABC)		/* OP_LEINT */
+ ,opmode(0, 0, 0, 1, 0, iABC)		/* OP_LEFLT */
+};
+
+
+/* generic opcodes of the quickened ones (ORDER OP) */
+
+LUAI_DDEF const lu_byte luaP_quickbase[NUM_OPCODES - NUM_BASEOPCODES] = {
+  OP_ADDI, OP_ADDI,		/* OP_ADDIINT, OP_ADDIFLT */
+  OP_ADDK, OP_ADDK,		/* OP_ADDKINT, OP_ADDKFLT */
+  OP_SUBK, OP_SUBK,		/* OP_SUBKINT, OP_SUBKFLT */
+  OP_MULK, OP_MULK,		/* OP_MULKINT, OP_MULKFLT */
+  OP_ADD, OP_ADD,		/* OP_ADDINT, OP_ADDFLT */
+  OP_SUB, OP_SUB,		/* OP_SUBINT, OP_SUBFLT */
+  OP_MUL, OP_MUL,		/* OP_MULINT, OP_MULFLT */
+  OP_LT, OP_LT,			/* OP_LTINT, OP_LTFLT */
+  OP_LE, OP_LE			/* OP_LEINT, OP_LEFLT */
 };
 
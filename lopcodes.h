@@ -306,11 +306,36 @@ OP_VARARG,/*	A C	R[A], R[A+1], ..., R[A+C-2] = vararg		*/
 
 OP_VARARGPREP,/*A	(adjust vararg parameters)			*/
 
-OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
+OP_EXTRAARG,/*	Ax	extra (larger) argument for previous opcode	*/
+
+/* quickened opcodes (*) */
+OP_ADDIINT,/*	A B sC	R[A] := R[B]:integer + sC			*/
+OP_ADDIFLT,/*	A B sC	R[A] := R[B]:float + sC				*/
+OP_ADDKINT,/*	A B C	R[A] := R[B]:integer + K[C]:integer		*/
+OP_ADDKFLT,/*	A B C	R[A] := R[B]:float + K[C]:number			*/
+OP_SUBKINT,/*	A B C	R[A] := R[B]:integer - K[C]:integer		*/
+OP_SUBKFLT,/*	A B C	R[A] := R[B]:float - K[C]:number			*/
+OP_MULKINT,/*	A B C	R[A] := R[B]:integer * K[C]:integer		*/
+OP_MULKFLT,/*	A B C	R[A] := R[B]:float * K[C]:number			*/
+OP_ADDINT,/*	A B C	R[A] := R[B]:integer + R[C]:integer		*/
+OP_ADDFLT,/*	A B C	R[A] := R[B]:float + R[C]:float			*/
+OP_SUBINT,/*	A B C	R[A] := R[B]:integer - R[C]:integer		*/
+OP_SUBFLT,/*	A B C	R[A] := R[B]:float - R[C]:float			*/
+OP_MULINT,/*	A B C	R[A] := R[B]:integer * R[C]:integer		*/
+OP_MULFLT,/*	A B C	R[A] := R[B]:float * R[C]:float			*/
+OP_LTINT,/*	A B k	if ((R[A]:integer <  R[B]:integer) ~= k) then pc++ */
+OP_LTFLT,/*	A B k	if ((R[A]:float <  R[B]:float) ~= k) then pc++	*/
+OP_LEINT,/*	A B k	if ((R[A]:integer <= R[B]:integer) ~= k) then pc++ */
+OP_LEFLT/*	A B k	if ((R[A]:float <= R[B]:float) ~= k) then pc++	*/
 } OpCode;
 
 
-#define NUM_OPCODES	((int)(OP_EXTRAARG) + 1)
+#define NUM_OPCODES	((int)(OP_LEFLT) + 1)
+
+/* number of opcodes that can appear in code generated by the compiler */
+#define NUM_BASEOPCODES	((int)(OP_EXTRAARG) + 1)
+
+#define isquickop(o)	((o) >= NUM_BASEOPCODES)
 
 
 
@@ -365,6 +390,13 @@ OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
   original operand was a float. (It must be corrected in case of
   metamethods.)
 
+  (*) Quickened opcodes are never generated by the compiler. The
+  interpreter rewrites an arithmetic or order instruction into one of
+  them when its operands have the given types; if a later execution
+  finds other types, the instruction goes back to its generic form
+  (see 'luaP_genericop'). They have the same arguments and modes as
+  their generic versions, and they are never dumped.
+
 ===========================================================================*/
 
 
@@ -380,6 +412,8 @@ OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
 
 LUAI_DDEC(const lu_byte luaP_opmodes[NUM_OPCODES];)
 
+LUAI_DDEC(const lu_byte luaP_quickbase[NUM_OPCODES - NUM_BASEOPCODES];)
+
 #define getOpMode(m)	(cast(enum OpMode, luaP_opmodes[m] & 7))
 #define testAMode(m)	(luaP_opmodes[m] & (1 << 3))
 #define testTMode(m)	(luaP_opmodes[m] & (1 << 4))
@@ -395,6 +429,11 @@ LUAI_DDEC(const lu_byte luaP_opmodes[NUM_OPCODES];)
 /* "in top" (uses top from previous instruction) */
 #define isIT(i)		(testITMode(GET_OPCODE(i)) && GETARG_B(i) == 0)
 
+/* generic opcode of a (possibly quickened) opcode */
+#define luaP_genericop(o)  \
+	(isquickop(o) ? cast(OpCode, luaP_quickbase[(o) - NUM_BASEOPCODES]) \
+                      : (o))
+
 #define opmode(mm,ot,it,t,a,m)  \
     (((mm) << 7) | ((ot) << 6) | ((it) << 5) | ((t) << 4) | ((a) << 3) | (m))
 
@@ -96,6 +96,24 @@ static const char *const opnames[] = {
   "VARARG",
   "VARARGPREP",
   "EXTRAARG",
+  "ADDIINT",
+  "ADDIFLT",
+  "ADDKINT",
+  "ADDKFLT",
+  "SUBKINT",
+  "SUBKFLT",
+  "MULKINT",
+  "MULKFLT",
+  "ADDINT",
+  "ADDFLT",
+  "SUBINT",
+  "SUBFLT",
+  "MULINT",
+  "MULFLT",
+  "LTINT",
+  "LTFLT",
+  "LEINT",
+  "LEFLT",
   NULL
 };
 
@@ -384,7 +384,13 @@ static int os_setlocale (lua_State *L) {
      "numeric", "time", NULL};
   const char *l = luaL_optstring(L, 1, NULL);
   int op = luaL_checkoption(L, 2, "all", catnames);
-  lua_pushstring(L, setlocale(cat[op], l));
+  const char *res = setlocale(cat[op], l);
+  if (l != NULL && res != NULL) {  /* changed the locale? */
+    /* compiled patterns may have old character classes */
+    lua_pushnil(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, LUA_PATTCACHE_TABLE);
+  }
+  lua_pushstring(L, res);
   return 1;
 }
 
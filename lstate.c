@@ -26,6 +26,7 @@
 #include "lstring.h"
 #include "ltable.h"
 #include "ltm.h"
+#include "ltrace.h"
 
 
 
@@ -246,7 +247,14 @@ static void close_state (lua_State *L) {
     luaC_freeallobjects(L);  /* collect all objects */
     luai_userstateclose(L);
   }
-  luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
+  luaS_freetable(L);
+#if LUA_USE_SHAPES
+  lua_assert(G(L)->shapes.nuse == 0);  /* all tables are gone */
+  luaM_freearray(L, G(L)->shapes.hash, G(L)->shapes.size);
+#endif
+#if LUA_USE_TRACE
+  luaR_freetraces(L);
+#endif
   freestack(L);
   lua_assert(g->totalbytes == sizeof(LG));
   lua_assert(gettotalobjs(g) == 1);
@@ -343,7 +351,17 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud, unsigned seed) {
   g->seed = seed;
   g->gcstp = GCSTPGC;  /* no GC while building state */
   g->strt.size = g->strt.nuse = 0;
+#if !LUA_USE_OPENSTRTAB
   g->strt.hash = NULL;
+#else
+  g->strt.slot = g->strt.old = NULL;
+  g->strt.oldsize = g->strt.moved = 0;
+#endif
+#if LUA_USE_SHAPES
+  g->shapes.size = g->shapes.nuse = 0;
+  g->shapes.hash = NULL;
+  memset(&g->shapes.root, 0, sizeof(g->shapes.root));  /* empty shape */
+#endif
   setnilvalue(&g->l_registry);
   g->panic = NULL;
   g->gcstate = GCSpause;
@@ -369,6 +387,10 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud, unsigned seed) {
   setgcparam(g, MINORMAJOR, LUAI_MINORMAJOR);
   setgcparam(g, MAJORMINOR, LUAI_MAJORMINOR);
   for (i=0; i < LUA_NUMTYPES; i++) g->mt[i] = NULL;
+  for (i=0; i < LUA_CSN; i++) g->cachestats[i] = 0;
+  for (i=0; i < LUA_NUMITERS; i++) g->iterators[i] = NULL;
+  for (i=0; i < HOTCOUNTSIZE; i++) g->hotcount[i] = LUAI_HOTLOOP;
+  g->trec = NULL;
   if (luaD_rawrunprotected(L, f_luaopen, NULL) != LUA_OK) {
     /* memory allocation error: free partial state */
     close_state(L);
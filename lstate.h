@@ -153,12 +153,59 @@ struct lua_longjmp;  /* defined in ldo.c */
 #define KGC_GENMAJOR	2	/* generational in major mode */
 
 
+/*
+** By default, the string table is an array of buckets, each a linked
+** list of strings; define LUA_USE_OPENSTRTAB as 1 to keep the strings
+** (and their hashes) directly in an open-addressing array that grows
+** incrementally (see 'lstring.c').
+*/
+#if !defined(LUA_USE_OPENSTRTAB)
+#define LUA_USE_OPENSTRTAB	0
+#endif
+
+
+#if !LUA_USE_OPENSTRTAB
+
 typedef struct stringtable {
   TString **hash;  /* array of buckets (linked lists of strings) */
   int nuse;  /* number of elements */
   int size;  /* number of buckets */
 } stringtable;
 
+#else
+
+/*
+** A slot in the string table. A free slot has 'ts' NULL and 'hash' 0;
+** a slot whose string was removed or moved has 'ts' NULL and 'hash' 1.
+*/
+typedef struct StrSlot {
+  unsigned int hash;  /* copy of 'ts->hash' */
+  TString *ts;
+} StrSlot;
+
+typedef struct stringtable {
+  StrSlot *slot;  /* array of slots */
+  StrSlot *old;  /* previous array, while moving strings from it */
+  int nuse;  /* number of elements (in both arrays) */
+  int size;  /* number of slots */
+  int oldsize;  /* number of slots in 'old' */
+  int moved;  /* slots of 'old' already moved to 'slot' */
+} stringtable;
+
+#endif
+
+
+/*
+** Table of shapes (see 'ltable.c'), to find the shape that extends
+** a given shape with a given key. 'root' is the shape without keys.
+*/
+typedef struct shapetable {
+  Shape **hash;  /* array of buckets (linked lists of shapes) */
+  int nuse;  /* number of elements */
+  int size;  /* number of buckets */
+  Shape root;
+} shapetable;
+
 
 /*
 ** Information about a call.
@@ -249,6 +296,10 @@ struct CallInfo {
 #define getoah(st)	((st) & CIST_OAH)
 
 
+/* size of the table of counters for hot loops (must be a power of 2) */
+#define HOTCOUNTSIZE	64
+
+
 /*
 ** 'global state', shared by all threads of this state
 */
@@ -261,6 +312,7 @@ typedef struct global_State {
   l_obj marked;  /* number of objects marked in a GC cycle */
   l_obj GCmajorminor;  /* auxiliar counter to control major-minor shifts */
   stringtable strt;  /* hash table for strings */
+  shapetable shapes;  /* hash table for shapes of tables */
   TValue l_registry;
   TValue nilvalue;  /* a nil value */
   unsigned int seed;  /* randomized seed for hashes */
@@ -298,6 +350,10 @@ typedef struct global_State {
   TString *strcache[STRCACHE_N][STRCACHE_M];  /* cache for strings in API */
   lua_WarnFunction warnf;  /* warning function */
   void *ud_warn;         /* auxiliary data to 'warnf' */
+  lua_CFunction iterators[LUA_NUMITERS];  /* see 'lua_setiterator' */
+  lu_mem cachestats[LUA_CSN];  /* statistics of internal caches */
+  unsigned short hotcount[HOTCOUNTSIZE];  /* counters for hot loops */
+  struct TraceRec *trec;  /* trace recorder (see 'ltrace.c') */
 } global_State;
 
 
@@ -332,6 +388,10 @@ struct lua_State {
 
 #define G(L)	(L->l_G)
 
+
+/* count an event for 'lua_cachestat' */
+#define cachestat(g,s)	((g)->cachestats[s]++)
+
 /*
 ** 'g->nilvalue' being a nil value flags that the state was completely
 ** build.
@@ -40,6 +40,8 @@ int luaS_eqlngstr (TString *a, TString *b) {
 }
 
 
+#if !LUA_USE_WORDHASH
+
 unsigned luaS_hash (const char *str, size_t l, unsigned seed) {
   unsigned int h = seed ^ cast_uint(l);
   for (; l > 0; l--)
@@ -47,6 +49,105 @@ unsigned luaS_hash (const char *str, size_t l, unsigned seed) {
   return h;
 }
 
+#else
+
+/*
+** {==================================================================
+** Word-at-a-time hash (in the style of wyhash): the string is read
+** in 64-bit words, and each pair of words is mixed into the state
+** with a full 64x64->128-bit multiplication, folding the high half
+** into the low one. Strings longer than 48 bytes are consumed by three
+** independent lanes, so that their multiplications can overlap.
+** The seed is the initial state, so that (as with the byte-wise hash)
+** the hash of a string cannot be predicted without it.
+** ===================================================================
+*/
+
+typedef unsigned long long l_uint64;
+
+/* arbitrary odd constants with a balanced number of bits set */
+#define HP0	0xa0761d6478bd642fULL
+#define HP1	0xe7037ed1a0b428dbULL
+#define HP2	0x8ebc6af09c88c6e3ULL
+#define HP3	0x589965cc75374cc3ULL
+
+
+static l_uint64 hmix (l_uint64 a, l_uint64 b) {
+#if defined(__SIZEOF_INT128__)
+  __uint128_t r = (__uint128_t)a * b;
+  return (l_uint64)r ^ (l_uint64)(r >> 64);
+#else  /* compute the 128-bit product from 32-bit halves */
+  l_uint64 ha = a >> 32, la = (unsigned int)a;
+  l_uint64 hb = b >> 32, lb = (unsigned int)b;
+  l_uint64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  l_uint64 t = rl + (rm0 << 32);
+  l_uint64 lo = t + (rm1 << 32);
+  l_uint64 hi = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+  return lo ^ hi;
+#endif
+}
+
+
+/* unaligned reads; 'memcpy' compiles to a plain load */
+static l_uint64 rd64 (const unsigned char *p) {
+  l_uint64 v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static l_uint64 rd32 (const unsigned char *p) {
+  unsigned int v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+
+unsigned luaS_hash (const char *str, size_t l, unsigned seed) {
+  const unsigned char *p = cast(const unsigned char *, str);
+  l_uint64 h = seed ^ HP0;
+  l_uint64 a, b;
+  if (l <= 16) {
+    if (l >= 4) {  /* read (overlapping) 4-byte words from both ends */
+      size_t d = (l >> 3) << 2;
+      a = (rd32(p) << 32) | rd32(p + d);
+      b = (rd32(p + l - 4) << 32) | rd32(p + l - 4 - d);
+    }
+    else if (l > 0) {
+      a = (cast(l_uint64, p[0]) << 16) | (cast(l_uint64, p[l >> 1]) << 8)
+        | p[l - 1];
+      b = 0;
+    }
+    else
+      a = b = 0;
+  }
+  else {
+    size_t i = l;
+    if (i > 48) {
+      l_uint64 h1 = h, h2 = h;
+      do {
+        h = hmix(rd64(p) ^ HP1, rd64(p + 8) ^ h);
+        h1 = hmix(rd64(p + 16) ^ HP2, rd64(p + 24) ^ h1);
+        h2 = hmix(rd64(p + 32) ^ HP3, rd64(p + 40) ^ h2);
+        p += 48; i -= 48;
+      } while (i > 48);
+      h ^= h1 ^ h2;
+    }
+    while (i > 16) {
+      h = hmix(rd64(p) ^ HP1, rd64(p + 8) ^ h);
+      p += 16; i -= 16;
+    }
+    a = rd64(p + i - 16);  /* last 16 bytes (may overlap previous ones) */
+    b = rd64(p + i - 8);
+  }
+  h = hmix(a ^ HP1, b ^ h);
+  h = hmix(h ^ HP0 ^ l, HP1);
+  return cast_uint(h ^ (h >> 32));
+}
+
+/* }================================================================== */
+
+#endif
+
 
 unsigned luaS_hashlongstr (TString *ts) {
   lua_assert(ts->tt == LUA_VLNGSTR);
@@ -59,6 +160,8 @@ unsigned luaS_hashlongstr (TString *ts) {
 }
 
 
+#if !LUA_USE_OPENSTRTAB
+
 static void tablerehash (TString **vect, int osize, int nsize) {
   int i;
   for (i = osize; i < nsize; i++)  /* clear new elements */
@@ -103,6 +206,255 @@ void luaS_resize (lua_State *L, int nsize) {
 }
 
 
+void luaS_freetable (lua_State *L) {
+  luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
+}
+
+
+/*
+** Statistics of the string table: its number of strings and of
+** buckets, plus the largest and the total number of strings visited
+** by searches that find each string.
+*/
+int luaS_strtabstats (global_State *g, int *size, int *maxprobe,
+                                       size_t *totalprobe) {
+  stringtable *tb = &g->strt;
+  int i;
+  *maxprobe = 0;
+  *totalprobe = 0;
+  for (i = 0; i < tb->size; i++) {
+    TString *ts;
+    int n = 0;
+    for (ts = tb->hash[i]; ts != NULL; ts = ts->u.hnext) {
+      n++;
+      *totalprobe += cast_sizet(n);
+    }
+    if (n > *maxprobe)
+      *maxprobe = n;
+  }
+  *size = tb->size;
+  return tb->nuse;
+}
+
+#else
+
+/*
+** {==================================================================
+** String table with open addressing: the strings live directly in an
+** array of slots, each with a copy of its string's hash, so that a
+** search only touches the strings whose hashes match. Collisions use
+** linear probing. To grow, the table allocates an array with twice
+** the size and, at each new string, moves STRMOVE slots of the old
+** array into it; until all are moved, searches look in both arrays.
+** ===================================================================
+*/
+
+/* number of slots of the old array moved at each new string */
+#define STRMOVE		8
+
+/*
+** Maximum number of strings in an array with 'size' slots. (There must
+** always be some free slot, to end the loop in 'freeslot'.)
+*/
+#define maxstrs(size)	((size) / 4 * 3)
+
+#define isfreeslot(s)	((s)->ts == NULL && (s)->hash == 0)
+
+#define nextslot(i,size)	(((i) + 1) & ((size) - 1))
+
+/*
+** Main slot of a string with hash 'h'. Linear probing is sensitive to
+** clusters in the lower bits of hashes, so they are first spread with
+** a multiplication.
+*/
+static int mainslot (unsigned int h, int size) {
+  h *= 0x9e3779b1u;
+  return lmod(h ^ (h >> 16), size);
+}
+
+
+static void clearslots (StrSlot *v, int size) {
+  int i;
+  for (i = 0; i < size; i++) {
+    v[i].ts = NULL;
+    v[i].hash = 0;
+  }
+}
+
+
+/*
+** Allocate a new array of slots; return NULL if allocation fails.
+*/
+static StrSlot *newslots (lua_State *L, int size) {
+  StrSlot *v = luaM_reallocvector(L, NULL, 0, size, StrSlot);
+  if (v != NULL)
+    clearslots(v, size);
+  return v;
+}
+
+
+/*
+** Put string 'ts' with hash 'h' in the first free slot of its probe
+** sequence. (The array must have a free slot.)
+*/
+static void putslot (StrSlot *v, int size, unsigned int h, TString *ts) {
+  int i = mainslot(h, size);
+  while (v[i].ts != NULL)
+    i = nextslot(i, size);
+  v[i].hash = h;
+  v[i].ts = ts;
+}
+
+
+/*
+** Search for a short string with contents 'str[0..l-1]' and hash 'h'.
+*/
+static StrSlot *findslot (StrSlot *v, int size, const char *str, size_t l,
+                                                unsigned int h) {
+  int i = mainslot(h, size);
+  int n;
+  for (n = 0; n < size && !isfreeslot(&v[i]); n++) {
+    TString *ts = v[i].ts;
+    if (v[i].hash == h && ts != NULL && l == cast_uint(ts->shrlen) &&
+        memcmp(str, getshrstr(ts), l * sizeof(char)) == 0)
+      return &v[i];
+    i = nextslot(i, size);
+  }
+  return NULL;
+}
+
+
+/*
+** Search for the slot with string 'ts'.
+*/
+static StrSlot *slotof (StrSlot *v, int size, TString *ts) {
+  int i = mainslot(ts->hash, size);
+  int n;
+  for (n = 0; n < size && !isfreeslot(&v[i]); n++) {
+    if (v[i].ts == ts)
+      return &v[i];
+    i = nextslot(i, size);
+  }
+  return NULL;
+}
+
+
+/*
+** Free slot 'i' of an array without removed slots, moving back the
+** following strings of its cluster that would not be found otherwise
+** (so that the array stays without removed slots).
+*/
+static void freeslot (StrSlot *v, int size, int i) {
+  int j = i;
+  for (;;) {
+    int k;
+    j = nextslot(j, size);
+    if (v[j].ts == NULL)  /* end of cluster? */
+      break;
+    k = mainslot(v[j].hash, size);  /* main position of string at 'j' */
+    if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+      continue;  /* string at 'j' is still reachable without 'i' */
+    v[i] = v[j];
+    i = j;
+  }
+  v[i].ts = NULL;
+  v[i].hash = 0;
+}
+
+
+/*
+** Move 'n' slots of the old array into the current one; free the old
+** array when all its slots have been moved. Moved slots are marked as
+** removed, so that searches in the old array still go through them.
+*/
+static void movestrings (lua_State *L, stringtable *tb, int n) {
+  int i = tb->moved;
+  int lim = (n < tb->oldsize - i) ? i + n : tb->oldsize;
+  for (; i < lim; i++) {
+    StrSlot *s = &tb->old[i];
+    if (s->ts != NULL) {
+      putslot(tb->slot, tb->size, s->hash, s->ts);
+      s->ts = NULL;
+      s->hash = 1;
+    }
+  }
+  tb->moved = i;
+  if (i == tb->oldsize) {  /* moved everything? */
+    luaM_freearray(L, tb->old, tb->oldsize);
+    tb->old = NULL;
+    tb->oldsize = tb->moved = 0;
+  }
+}
+
+
+/*
+** Resize the string table at once. If allocation fails, keep the
+** current size.
+*/
+void luaS_resize (lua_State *L, int nsize) {
+  stringtable *tb = &G(L)->strt;
+  StrSlot *v;
+  int i;
+  if (tb->old != NULL)  /* still growing? */
+    movestrings(L, tb, tb->oldsize);  /* finish it */
+  if (tb->nuse > maxstrs(nsize))  /* new size too small? */
+    return;
+  v = newslots(L, nsize);
+  if (l_unlikely(v == NULL))  /* allocation failed? */
+    return;  /* leave table as it was */
+  for (i = 0; i < tb->size; i++) {
+    if (tb->slot[i].ts != NULL)
+      putslot(v, nsize, tb->slot[i].hash, tb->slot[i].ts);
+  }
+  luaM_freearray(L, tb->slot, tb->size);
+  tb->slot = v;
+  tb->size = nsize;
+}
+
+
+void luaS_freetable (lua_State *L) {
+  stringtable *tb = &G(L)->strt;
+  luaM_freearray(L, tb->old, tb->oldsize);
+  luaM_freearray(L, tb->slot, tb->size);
+}
+
+
+static void slotstats (StrSlot *v, int size, int *maxprobe,
+                                             size_t *totalprobe) {
+  int i;
+  for (i = 0; i < size; i++) {
+    if (v[i].ts != NULL) {
+      int n = ((i - mainslot(v[i].hash, size)) & (size - 1)) + 1;
+      *totalprobe += cast_sizet(n);
+      if (n > *maxprobe)
+        *maxprobe = n;
+    }
+  }
+}
+
+
+/*
+** Statistics of the string table: its number of strings and of slots,
+** plus the largest and the total number of slots visited by searches
+** that find each string.
+*/
+int luaS_strtabstats (global_State *g, int *size, int *maxprobe,
+                                       size_t *totalprobe) {
+  stringtable *tb = &g->strt;
+  *maxprobe = 0;
+  *totalprobe = 0;
+  slotstats(tb->slot, tb->size, maxprobe, totalprobe);
+  if (tb->old != NULL)
+    slotstats(tb->old, tb->oldsize, maxprobe, totalprobe);
+  *size = tb->size;
+  return tb->nuse;
+}
+
+/* }================================================================== */
+
+#endif
+
+
 /*
 ** Clear API string cache. (Entries cannot be empty, so fill them with
 ** a non-collectable string.)
@@ -124,8 +476,13 @@ void luaS_init (lua_State *L) {
   global_State *g = G(L);
   int i, j;
   stringtable *tb = &G(L)->strt;
+#if !LUA_USE_OPENSTRTAB
   tb->hash = luaM_newvector(L, MINSTRTABSIZE, TString*);
   tablerehash(tb->hash, 0, MINSTRTABSIZE);  /* clear array */
+#else
+  tb->slot = luaM_newvector(L, MINSTRTABSIZE, StrSlot);
+  clearslots(tb->slot, MINSTRTABSIZE);
+#endif
   tb->size = MINSTRTABSIZE;
   /* pre-create memory-error message */
   g->memerrmsg = luaS_newliteral(L, MEMERRMSG);
@@ -144,8 +501,8 @@ size_t luaS_sizelngstr (size_t len, int kind) {
     case LSTRFIX:  /* fixed external long string */
       /* don't need 'falloc'/'ud' */
       return offsetof(TString, falloc);
-    default:  /* external long string with deallocation */
-      lua_assert(kind == LSTRMEM);
+    default:  /* external, view, or copied view */
+      lua_assert(kind == LSTRMEM || kind == LSTRVIEW || kind == LSTRCOPY);
       return sizeof(TString);
   }
 }
@@ -177,6 +534,8 @@ TString *luaS_createlngstrobj (lua_State *L, size_t l) {
 }
 
 
+#if !LUA_USE_OPENSTRTAB
+
 void luaS_remove (lua_State *L, TString *ts) {
   stringtable *tb = &G(L)->strt;
   TString **p = &tb->hash[lmod(ts->hash, tb->size)];
@@ -232,6 +591,86 @@ static TString *internshrstr (lua_State *L, const char *str, size_t l) {
   return ts;
 }
 
+#else
+
+void luaS_remove (lua_State *L, TString *ts) {
+  stringtable *tb = &G(L)->strt;
+  StrSlot *s = slotof(tb->slot, tb->size, ts);
+  if (s != NULL)
+    freeslot(tb->slot, tb->size, cast_int(s - tb->slot));
+  else {  /* string is still in the old array */
+    s = slotof(tb->old, tb->oldsize, ts);
+    lua_assert(s != NULL);
+    s->ts = NULL;
+    s->hash = 1;  /* removed */
+  }
+  tb->nuse--;
+}
+
+
+/*
+** Start growing the string table: the current array becomes the old
+** one, to be moved into a new array with twice its size. If the
+** allocation fails, go on with the current array while it has room.
+*/
+static void growstrtab (lua_State *L, stringtable *tb) {
+  StrSlot *v;
+  if (l_unlikely(tb->nuse == MAX_INT)) {  /* too many strings? */
+    luaC_fullgc(L, 1);  /* try to free some... */
+    if (tb->nuse == MAX_INT)  /* still too many? */
+      luaM_error(L);  /* cannot even create a message... */
+  }
+  if (tb->old != NULL)  /* previous growth not finished? */
+    movestrings(L, tb, tb->oldsize);  /* finish it */
+  v = (tb->size <= MAXSTRTB / 2) ? newslots(L, tb->size * 2) : NULL;
+  if (l_unlikely(v == NULL)) {  /* cannot grow? */
+    if (tb->nuse + 1 >= tb->size)  /* no room for one more string? */
+      luaM_error(L);
+    return;
+  }
+  tb->old = tb->slot;
+  tb->oldsize = tb->size;
+  tb->moved = 0;
+  tb->slot = v;
+  tb->size *= 2;
+}
+
+
+/*
+** Checks whether short string exists and reuses it or creates a new one.
+*/
+static TString *internshrstr (lua_State *L, const char *str, size_t l) {
+  TString *ts;
+  global_State *g = G(L);
+  stringtable *tb = &g->strt;
+  unsigned int h = luaS_hash(str, l, g->seed);
+  StrSlot *s;
+  lua_assert(str != NULL);  /* otherwise 'memcmp'/'memcpy' are undefined */
+  s = findslot(tb->slot, tb->size, str, l, h);
+  if (s == NULL && tb->old != NULL)  /* not found but still growing? */
+    s = findslot(tb->old, tb->oldsize, str, l, h);
+  if (s != NULL) {  /* found! */
+    ts = s->ts;
+    if (isdead(g, ts))  /* dead (but not collected yet)? */
+      changewhite(ts);  /* resurrect it */
+    return ts;
+  }
+  /* else must create a new string */
+  if (tb->nuse >= maxstrs(tb->size))  /* need to grow string table? */
+    growstrtab(L, tb);
+  if (tb->old != NULL)  /* growing? */
+    movestrings(L, tb, STRMOVE);  /* move a few more strings */
+  ts = createstrobj(L, sizestrshr(l), LUA_VSHRSTR, h);
+  ts->shrlen = cast_byte(l);
+  getshrstr(ts)[l] = '\0';  /* ending 0 */
+  memcpy(getshrstr(ts), str, l * sizeof(char));
+  putslot(tb->slot, tb->size, h, ts);
+  tb->nuse++;
+  return ts;
+}
+
+#endif
+
 
 /*
 ** new string (with explicit length)
@@ -250,6 +689,50 @@ TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
 }
 
 
+/*
+** Substring of 'ts' with 'len' bytes from position 'start' (0-based).
+** With slices enabled, a long enough substring of a long string is a
+** view into that string, or into the string a view points into. (So,
+** a view never points into another view.)
+*/
+TString *luaS_sub (lua_State *L, TString *ts, size_t start, size_t len) {
+  lua_assert(start <= tsslen(ts) && len <= tsslen(ts) - start);
+  if (start == 0 && len == tsslen(ts))  /* whole string? */
+    return ts;
+#if LUA_USE_SLICES
+  if (len >= LUAI_MINSLICE) {  /* big enough for a view? */
+    TString *v;
+    lua_assert(!strisshr(ts));
+    v = createstrobj(L, luaS_sizelngstr(len, LSTRVIEW), LUA_VLNGSTR,
+                        G(L)->seed);
+    v->shrlen = LSTRVIEW;
+    v->u.lnglen = len;
+    v->contents = getlngstr(ts) + start;
+    v->falloc = NULL;
+    v->ud = isview(ts) ? ts->ud : ts;  /* string that owns the contents */
+    return v;
+  }
+#endif
+  return luaS_newlstr(L, getstr(ts) + start, len);
+}
+
+
+/*
+** Give view 'ts' its own copy of its contents (ending with a '\0').
+*/
+void luaS_copyview (lua_State *L, TString *ts) {
+  size_t len = ts->u.lnglen;
+  char *buff;
+  lua_assert(isview(ts));
+  buff = luaM_newvector(L, len + 1, char);
+  memcpy(buff, ts->contents, len * sizeof(char));
+  buff[len] = '\0';
+  ts->contents = buff;
+  ts->shrlen = LSTRCOPY;
+  ts->ud = NULL;  /* no longer needs the other string */
+}
+
+
 /*
 ** Create or reuse a zero-terminated string, first checking in the
 ** cache (using the string address as a key). The cache can contain
@@ -12,6 +12,45 @@
 #include "lstate.h"
 
 
+/*
+** By default, strings are hashed one byte at a time; define
+** LUA_USE_WORDHASH as 1 to hash them one 64-bit word at a time
+** (see 'luaS_hash').
+*/
+#if !defined(LUA_USE_WORDHASH)
+#define LUA_USE_WORDHASH	0
+#endif
+
+#if LUA_USE_WORDHASH && !defined(LLONG_MAX)
+#error "LUA_USE_WORDHASH needs 'long long' (C99)"
+#endif
+
+
+/*
+** Define LUA_USE_SLICES as 1 to make substrings with at least
+** LUAI_MINSLICE bytes views into the string they come from, instead
+** of copies. A view keeps that string alive, and its contents do not
+** end with a '\0': anything that needs the '\0' must first call
+** 'luaS_copyview', which gives the view its own copy.
+*/
+#if !defined(LUA_USE_SLICES)
+#define LUA_USE_SLICES		0
+#endif
+
+#if !defined(LUAI_MINSLICE)
+#define LUAI_MINSLICE		256
+#endif
+
+#if LUA_USE_SLICES
+#define isview(ts)	((ts)->shrlen == LSTRVIEW)
+#else
+#define isview(ts)	0
+#endif
+
+/* make sure the contents of string 'ts' end with a '\0' */
+#define luaS_checkview(L,ts)  { if (isview(ts)) luaS_copyview(L, ts); }
+
+
 /*
 ** Memory-allocation error message must be preallocated (it cannot
 ** be created after memory is exhausted)
@@ -47,6 +86,9 @@ LUAI_FUNC unsigned luaS_hash (const char *str, size_t l, unsigned seed);
 LUAI_FUNC unsigned luaS_hashlongstr (TString *ts);
 LUAI_FUNC int luaS_eqlngstr (TString *a, TString *b);
 LUAI_FUNC void luaS_resize (lua_State *L, int newsize);
+LUAI_FUNC void luaS_freetable (lua_State *L);
+LUAI_FUNC int luaS_strtabstats (global_State *g, int *size, int *maxprobe,
+                                            size_t *totalprobe);
 LUAI_FUNC void luaS_clearcache (global_State *g);
 LUAI_FUNC void luaS_init (lua_State *L);
 LUAI_FUNC void luaS_remove (lua_State *L, TString *ts);
@@ -57,5 +99,8 @@ LUAI_FUNC TString *luaS_createlngstrobj (lua_State *L, size_t l);
 LUAI_FUNC TString *luaS_newextlstr (lua_State *L,
 		const char *s, size_t len, lua_Alloc falloc, void *ud);
 LUAI_FUNC size_t luaS_sizelngstr (size_t len, int kind);
+LUAI_FUNC TString *luaS_sub (lua_State *L, TString *ts, size_t start,
+                                                        size_t len);
+LUAI_FUNC void luaS_copyview (lua_State *L, TString *ts);
 
 #endif
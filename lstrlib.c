@@ -98,12 +98,14 @@ static size_t getendpos (lua_State *L, int arg, lua_Integer def,
 
 
 static int str_sub (lua_State *L) {
-  size_t l;
-  const char *s = luaL_checklstring(L, 1, &l);
-  size_t start = posrelatI(luaL_checkinteger(L, 2), l);
-  size_t end = getendpos(L, 3, -1, l);
+  size_t l, start, end;
+  if (lua_type(L, 1) != LUA_TSTRING)  /* not a string? */
+    luaL_checklstring(L, 1, NULL);  /* convert it (or raise an error) */
+  l = lua_rawlen(L, 1);  /* (does not copy a view, as 'lua_tolstring') */
+  start = posrelatI(luaL_checkinteger(L, 2), l);
+  end = getendpos(L, 3, -1, l);
   if (start <= end)
-    lua_pushlstring(L, s + start - 1, (end - start) + 1);
+    lua_pushsubstring(L, 1, start - 1, (end - start) + 1);
   else lua_pushliteral(L, "");
   return 1;
 }
@@ -368,6 +370,7 @@ typedef struct MatchState {
   lua_State *L;
   int matchdepth;  /* control for recursive depth (to avoid C stack overflow) */
   unsigned char level;  /* total number of captures (finished or unfinished) */
+  const struct CPattern *cp;  /* compiled pattern (NULL if none) */
   struct {
     const char *init;
     ptrdiff_t len;
@@ -698,6 +701,609 @@ static const char *lmemfind (const char *s1, size_t l1,
 }
 
 
+/*
+** {======================================================
+** Compiled patterns
+** A pattern used more than once is compiled into an array of items,
+** with its character classes as bitmaps, and kept in a cache in the
+** registry, keyed by the pattern string. Only patterns that cannot
+** raise errors while matching are compiled; all others are left to
+** 'match', so that errors are raised exactly as before.
+** =======================================================
+*/
+
+/*
+** Maximum number of patterns kept in the cache (0 disables it)
+*/
+#if !defined(LUAL_PATTCACHE)
+#define LUAL_PATTCACHE		64
+#endif
+
+
+/* kinds of pattern items */
+#define PI_CHAR		0	/* single character */
+#define PI_ANY		1	/* '.' */
+#define PI_SET		2	/* character class */
+#define PI_OPEN		3	/* start capture */
+#define PI_POSITION	4	/* position capture */
+#define PI_CLOSE	5	/* end capture */
+#define PI_END		6	/* '$' at the end of the pattern */
+#define PI_BALANCE	7	/* '%bxy' */
+#define PI_FRONTIER	8	/* '%f[set]' */
+#define PI_BACKREF	9	/* '%1'-'%9' */
+#define PI_STOP		10	/* end of the pattern */
+
+
+typedef struct PItem {
+  unsigned char kind;
+  unsigned char rep;  /* suffix ('*', '+', '-', or '?') or 0 */
+  unsigned char c1, c2;  /* characters or capture index */
+  unsigned int set;  /* index of the bitmap for PI_SET and PI_FRONTIER */
+} PItem;
+
+
+#define CSETSIZE	((UCHAR_MAX / CHAR_BIT) + 1)
+
+typedef unsigned char CharSet[CSETSIZE];
+
+#define testcset(cs,c)	((cs)[(c) / CHAR_BIT] & (1u << ((c) % CHAR_BIT)))
+
+
+typedef struct CPattern {
+  int anchor;  /* pattern starts with '^'? */
+  int firstset;  /* set that must match the first character, or -1 */
+  size_t lprefix;  /* length of the literal prefix of all matches */
+  const char *prefix;
+  PItem *items;
+  CharSet *sets;
+} CPattern;
+
+
+/* state for the compiler */
+typedef struct CompState {
+  const char *p_end;  /* end of the pattern */
+  CPattern *cp;  /* result (NULL when only counting items and sets) */
+  size_t nitems;
+  size_t nsets;
+  int level;  /* total number of captures */
+  int nopen;  /* number of unfinished captures */
+  unsigned char open[LUA_MAXCAPTURES];  /* stack of unfinished captures */
+  char closed[LUA_MAXCAPTURES];  /* captures already closed */
+  PItem ditem;  /* dummy item and set for the counting pass */
+  CharSet dset;
+} CompState;
+
+
+/*
+** Like 'classend', but returning NULL for malformed classes.
+*/
+static const char *cclassend (const char *p, const char *p_end) {
+  switch (*p++) {
+    case L_ESC: {
+      return (p == p_end) ? NULL : p + 1;
+    }
+    case '[': {
+      if (*p == '^') p++;
+      do {  /* look for a ']' */
+        if (p == p_end)
+          return NULL;
+        if (*(p++) == L_ESC && p < p_end)
+          p++;  /* skip escapes (e.g. '%]') */
+      } while (*p != ']');
+      return p+1;
+    }
+    default: {
+      return p;
+    }
+  }
+}
+
+
+static PItem *newitem (CompState *cs, int kind) {
+  PItem *item = (cs->cp != NULL) ? &cs->cp->items[cs->nitems] : &cs->ditem;
+  cs->nitems++;
+  item->kind = uchar(kind);
+  item->rep = item->c1 = item->c2 = 0;
+  item->set = 0;
+  return item;
+}
+
+
+/*
+** Fills the item for the single-character class 'p'..'ep'. Classes
+** other than '.' and plain characters become bitmaps, built with the
+** same functions used by 'singlematch'; bitmaps with only one
+** character become plain characters.
+*/
+static void singleitem (CompState *cs, PItem *item, const char *p,
+                                                    const char *ep) {
+  if (*p == '.')
+    item->kind = PI_ANY;
+  else if (*p != L_ESC && *p != '[') {
+    item->kind = PI_CHAR;
+    item->c1 = uchar(*p);
+  }
+  else {
+    unsigned char *set = (cs->cp != NULL) ? cs->cp->sets[cs->nsets]
+                                          : cs->dset;
+    int c;
+    int n = 0;  /* number of characters in the set */
+    int last = 0;
+    memset(set, 0, sizeof(CharSet));
+    for (c = 0; c <= UCHAR_MAX; c++) {
+      if (*p == L_ESC ? match_class(c, uchar(*(p + 1)))
+                      : matchbracketclass(c, p, ep - 1)) {
+        set[c / CHAR_BIT] |= uchar(1u << (c % CHAR_BIT));
+        n++; last = c;
+      }
+    }
+    if (n == 1) {
+      item->kind = PI_CHAR;
+      item->c1 = uchar(last);
+    }
+    else {
+      item->kind = PI_SET;
+      item->set = (unsigned int)(cs->nsets++);
+    }
+  }
+}
+
+
+/*
+** Compiles the pattern from 'p' into 'cs->cp' or, if it is NULL, only
+** counts its items and sets. Returns false for patterns that cannot
+** be compiled.
+*/
+static int compile (CompState *cs, const char *p) {
+  const char *p_end = cs->p_end;
+  while (p < p_end) {
+    switch (*p) {
+      case '(': {
+        PItem *item;
+        if (cs->level >= LUA_MAXCAPTURES)
+          return 0;  /* too many captures */
+        if (*(p + 1) == ')') {  /* position capture? */
+          item = newitem(cs, PI_POSITION);
+          cs->closed[cs->level] = 1;
+          p += 2;
+        }
+        else {
+          item = newitem(cs, PI_OPEN);
+          cs->closed[cs->level] = 0;
+          cs->open[cs->nopen++] = uchar(cs->level);
+          p++;
+        }
+        item->c1 = uchar(cs->level++);
+        break;
+      }
+      case ')': {
+        int l;
+        if (cs->nopen == 0)
+          return 0;  /* invalid pattern capture */
+        l = cs->open[--cs->nopen];
+        cs->closed[l] = 1;
+        newitem(cs, PI_CLOSE)->c1 = uchar(l);
+        p++;
+        break;
+      }
+      case '$': {
+        if ((p + 1) != p_end)  /* is the '$' the last char in pattern? */
+          goto dflt;  /* no; go to default */
+        newitem(cs, PI_END);
+        p++;
+        break;
+      }
+      case L_ESC: {
+        switch (*(p + 1)) {
+          case 'b': {
+            PItem *item;
+            if (p + 2 >= p_end - 1)
+              return 0;  /* missing arguments to '%b' */
+            item = newitem(cs, PI_BALANCE);
+            item->c1 = uchar(*(p + 2));
+            item->c2 = uchar(*(p + 3));
+            p += 4;
+            break;
+          }
+          case 'f': {
+            const char *ep;
+            PItem *item;
+            p += 2;
+            if (*p != '[' || (ep = cclassend(p, p_end)) == NULL)
+              return 0;  /* malformed frontier */
+            item = newitem(cs, PI_FRONTIER);
+            singleitem(cs, item, p, ep);
+            if (item->kind == PI_CHAR) {  /* keep it as a set */
+              item->set = (unsigned int)(cs->nsets++);
+            }
+            item->kind = PI_FRONTIER;
+            p = ep;
+            break;
+          }
+          case '0': case '1': case '2': case '3':
+          case '4': case '5': case '6': case '7':
+          case '8': case '9': {
+            int l = uchar(*(p + 1)) - '1';
+            if (l < 0 || l >= cs->level || !cs->closed[l])
+              return 0;  /* invalid capture index */
+            newitem(cs, PI_BACKREF)->c1 = uchar(l);
+            p += 2;
+            break;
+          }
+          default: goto dflt;
+        }
+        break;
+      }
+      default: dflt: {  /* pattern class plus optional suffix */
+        const char *ep = cclassend(p, p_end);
+        PItem *item;
+        if (ep == NULL)
+          return 0;  /* malformed class */
+        item = newitem(cs, PI_CHAR);
+        singleitem(cs, item, p, ep);
+        if (ep < p_end &&
+            (*ep == '*' || *ep == '+' || *ep == '-' || *ep == '?'))
+          item->rep = uchar(*ep++);
+        p = ep;
+        break;
+      }
+    }
+  }
+  newitem(cs, PI_STOP);
+  return (cs->nopen == 0);  /* unfinished captures raise errors */
+}
+
+
+/*
+** Returns the compiled form of the pattern at index 'arg', pushing it
+** on the stack, or pushes false and returns NULL if the pattern cannot
+** be compiled. Items and sets are counted in a first pass, so that the
+** userdata has the exact size for them (plus room for the prefix).
+*/
+static const CPattern *compilepattern (lua_State *L, int arg) {
+  size_t lp;
+  const char *p = lua_tolstring(L, arg, &lp);
+  CompState cs;
+  CPattern *cp;
+  const PItem *pi;
+  char *prefix;
+  int anchor = (*p == '^');
+  if (anchor) {
+    p++; lp--;  /* skip anchor character */
+  }
+  memset(&cs, 0, sizeof(cs));
+  cs.p_end = p + lp;
+  if (!compile(&cs, p)) {
+    lua_pushboolean(L, 0);
+    return NULL;
+  }
+  cs.nsets++;  /* room to build a set that becomes a plain character */
+  cp = (CPattern *)lua_newuserdatauv(L, sizeof(CPattern) +
+             cs.nitems * (sizeof(PItem) + 1) + cs.nsets * sizeof(CharSet), 0);
+  cp->items = (PItem *)(cp + 1);
+  cp->sets = (CharSet *)(cp->items + cs.nitems);
+  prefix = (char *)(cp->sets + cs.nsets);
+  cp->anchor = anchor;
+  memset(&cs, 0, sizeof(cs));
+  cs.p_end = p + lp;
+  cs.cp = cp;
+  compile(&cs, p);  /* second pass fills the items and sets */
+  /* compute prefix (captures do not consume characters) */
+  cp->prefix = prefix;
+  cp->lprefix = 0;
+  cp->firstset = -1;
+  for (pi = cp->items; ; pi++) {
+    if (pi->kind == PI_OPEN || pi->kind == PI_POSITION ||
+        pi->kind == PI_CLOSE)
+      continue;
+    else if (pi->kind == PI_CHAR && (pi->rep == 0 || pi->rep == '+')) {
+      prefix[cp->lprefix++] = (char)pi->c1;
+      if (pi->rep == 0) continue;  /* prefix can go on */
+    }
+    else if (cp->lprefix == 0 && pi->kind == PI_SET &&
+             (pi->rep == 0 || pi->rep == '+'))
+      cp->firstset = (int)pi->set;
+    break;
+  }
+  return cp;
+}
+
+
+/*
+** Returns the first position from 's' on where a match for 'cp' can
+** start, or NULL if there is none.
+*/
+static const char *nextstart (const CPattern *cp, const char *s,
+                                                  const char *e) {
+  if (cp->lprefix > 0)
+    return lmemfind(s, e - s, cp->prefix, cp->lprefix);
+  else if (cp->firstset >= 0) {
+    const unsigned char *cs = cp->sets[cp->firstset];
+    while (s < e && !testcset(cs, uchar(*s)))
+      s++;
+    return (s < e) ? s : NULL;
+  }
+  else
+    return s;
+}
+
+
+static void newcache (lua_State *L) {
+  lua_createtable(L, 0, 4);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, LUA_REGISTRYINDEX, LUA_PATTCACHE_TABLE);
+}
+
+
+/*
+** Pushes the compiled form of the pattern at index 'arg' and returns
+** it, or pushes a non-pattern value and returns NULL when there is no
+** compiled form. Patterns are compiled the second time they are seen,
+** so that patterns used only once do not pay for a compilation. Entry
+** [1] of the cache counts its patterns; when it is full, it is replaced
+** by an empty one. (The caller must keep the compiled pattern on the
+** stack while using it, as a new cache may be created meanwhile.)
+*/
+static const CPattern *getpattern (lua_State *L, int arg) {
+  const CPattern *cp = NULL;
+  if (LUAL_PATTCACHE == 0) {  /* no cache? */
+    lua_pushnil(L);
+    return NULL;
+  }
+  if (lua_getfield(L, LUA_REGISTRYINDEX, LUA_PATTCACHE_TABLE) != LUA_TTABLE) {
+    lua_pop(L, 1);
+    newcache(L);
+  }
+  lua_pushvalue(L, arg);
+  switch (lua_rawget(L, -2)) {
+    case LUA_TUSERDATA: {  /* already compiled */
+      cp = (const CPattern *)lua_touserdata(L, -1);
+      break;
+    }
+    case LUA_TNIL: {  /* first time */
+      lua_Integer n;
+      lua_pop(L, 1);
+      lua_rawgeti(L, -1, 1);
+      n = lua_tointeger(L, -1);  /* number of patterns in the cache */
+      lua_pop(L, 1);
+      if (n >= LUAL_PATTCACHE) {  /* cache is full? */
+        lua_pop(L, 1);
+        newcache(L);
+        n = 0;
+      }
+      lua_pushinteger(L, n + 1);
+      lua_rawseti(L, -2, 1);
+      lua_pushvalue(L, arg);
+      lua_pushboolean(L, 1);  /* seen once */
+      lua_rawset(L, -3);
+      lua_pushnil(L);
+      break;
+    }
+    default: {
+      if (lua_toboolean(L, -1)) {  /* seen once? */
+        lua_pop(L, 1);
+        cp = compilepattern(L, arg);
+        lua_pushvalue(L, arg);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, -4);  /* cache[pattern] = compiled pattern or false */
+      }
+      break;
+    }
+  }
+  lua_remove(L, -2);  /* remove cache */
+  return cp;
+}
+
+
+static const char *cmatch (MatchState *ms, const char *s, const PItem *pi);
+
+
+static int csinglematch (MatchState *ms, const char *s, const PItem *pi) {
+  if (s >= ms->src_end)
+    return 0;
+  else {
+    int c = uchar(*s);
+    switch (pi->kind) {
+      case PI_CHAR: return (pi->c1 == c);
+      case PI_ANY: return 1;
+      default: return testcset(ms->cp->sets[pi->set], c);
+    }
+  }
+}
+
+
+static const char *cmax_expand (MatchState *ms, const char *s,
+                                                const PItem *pi) {
+  const char *e = s;  /* end of maximum expansion */
+  switch (pi->kind) {
+    case PI_CHAR: {
+      while (e < ms->src_end && uchar(*e) == pi->c1)
+        e++;
+      break;
+    }
+    case PI_ANY: {
+      e = ms->src_end;
+      break;
+    }
+    default: {
+      const unsigned char *cs = ms->cp->sets[pi->set];
+      while (e < ms->src_end && testcset(cs, uchar(*e)))
+        e++;
+      break;
+    }
+  }
+  /* keeps trying to match with the maximum repetitions */
+  for (;;) {
+    const char *res = cmatch(ms, e, pi + 1);
+    if (res) return res;
+    else if (e == s) return NULL;
+    e--;  /* else didn't match; reduce 1 repetition to try again */
+  }
+}
+
+
+static const char *cmin_expand (MatchState *ms, const char *s,
+                                                const PItem *pi) {
+  for (;;) {
+    const char *res = cmatch(ms, s, pi + 1);
+    if (res != NULL)
+      return res;
+    else if (csinglematch(ms, s, pi))
+      s++;  /* try with one more repetition */
+    else return NULL;
+  }
+}
+
+
+static const char *cstart_capture (MatchState *ms, const char *s,
+                                   const PItem *pi, int what) {
+  const char *res;
+  int level = ms->level;
+  ms->capture[level].init = s;
+  ms->capture[level].len = what;
+  ms->level = level+1;
+  if ((res=cmatch(ms, s, pi)) == NULL)  /* match failed? */
+    ms->level--;  /* undo capture */
+  return res;
+}
+
+
+static const char *cend_capture (MatchState *ms, const char *s,
+                                 const PItem *pi) {
+  int l = pi->c1;
+  const char *res;
+  ms->capture[l].len = s - ms->capture[l].init;  /* close capture */
+  if ((res = cmatch(ms, s, pi + 1)) == NULL)  /* match failed? */
+    ms->capture[l].len = CAP_UNFINISHED;  /* undo capture */
+  return res;
+}
+
+
+static const char *cmatchbalance (MatchState *ms, const char *s,
+                                  const PItem *pi) {
+  if (s >= ms->src_end || uchar(*s) != pi->c1) return NULL;
+  else {
+    int cont = 1;
+    while (++s < ms->src_end) {
+      if (uchar(*s) == pi->c2) {
+        if (--cont == 0) return s+1;
+      }
+      else if (uchar(*s) == pi->c1) cont++;
+    }
+  }
+  return NULL;  /* string ends out of balance */
+}
+
+
+static const char *cmatch_capture (MatchState *ms, const char *s, int l) {
+  size_t len = ms->capture[l].len;
+  if ((size_t)(ms->src_end-s) >= len &&
+      memcmp(ms->capture[l].init, s, len) == 0)
+    return s+len;
+  else return NULL;
+}
+
+
+/*
+** Same as 'match', for compiled patterns. It keeps the same structure
+** of recursive calls, so that both count 'matchdepth' in the same way.
+*/
+static const char *cmatch (MatchState *ms, const char *s, const PItem *pi) {
+  if (l_unlikely(ms->matchdepth-- == 0))
+    luaL_error(ms->L, "pattern too complex");
+  init: /* using goto to optimize tail recursion */
+  switch (pi->kind) {
+    case PI_STOP: break;  /* end of pattern */
+    case PI_OPEN: {
+      s = cstart_capture(ms, s, pi + 1, CAP_UNFINISHED);
+      break;
+    }
+    case PI_POSITION: {
+      s = cstart_capture(ms, s, pi + 1, CAP_POSITION);
+      break;
+    }
+    case PI_CLOSE: {
+      s = cend_capture(ms, s, pi);
+      break;
+    }
+    case PI_END: {  /* check end of string */
+      s = (s == ms->src_end) ? s : NULL;
+      break;
+    }
+    case PI_BALANCE: {
+      s = cmatchbalance(ms, s, pi);
+      if (s != NULL) {
+        pi++; goto init;
+      }
+      break;
+    }
+    case PI_FRONTIER: {
+      const unsigned char *cs = ms->cp->sets[pi->set];
+      int previous = (s == ms->src_init) ? '\0' : uchar(*(s - 1));
+      int current = (s < ms->src_end) ? uchar(*s) : '\0';
+      if (!testcset(cs, previous) && testcset(cs, current)) {
+        pi++; goto init;
+      }
+      s = NULL;  /* match failed */
+      break;
+    }
+    case PI_BACKREF: {
+      s = cmatch_capture(ms, s, pi->c1);
+      if (s != NULL) {
+        pi++; goto init;
+      }
+      break;
+    }
+    default: {  /* single-character class plus optional suffix */
+      if (!csinglematch(ms, s, pi)) {
+        if (pi->rep == '*' || pi->rep == '?' || pi->rep == '-') {
+          pi++; goto init;  /* accept empty */
+        }
+        else  /* '+' or no suffix */
+          s = NULL;  /* fail */
+      }
+      else {  /* matched once */
+        switch (pi->rep) {
+          case '?': {  /* optional */
+            const char *res;
+            if ((res = cmatch(ms, s + 1, pi + 1)) != NULL)
+              s = res;
+            else {
+              pi++; goto init;
+            }
+            break;
+          }
+          case '+':  /* 1 or more repetitions */
+            s++;  /* 1 match already done */
+            /* FALLTHROUGH */
+          case '*':  /* 0 or more repetitions */
+            s = cmax_expand(ms, s, pi);
+            break;
+          case '-':  /* 0 or more repetitions (minimum) */
+            s = cmin_expand(ms, s, pi);
+            break;
+          default:  /* no suffix */
+            s++; pi++; goto init;
+        }
+      }
+      break;
+    }
+  }
+  ms->matchdepth++;
+  return s;
+}
+
+
+static const char *domatch (MatchState *ms, const char *s, const char *p) {
+  if (ms->cp != NULL)
+    return cmatch(ms, s, ms->cp->items);
+  else
+    return match(ms, s, p);
+}
+
+/* }====================================================== */
+
+
 /*
 ** get information about the i-th capture. If there are no captures
 ** and 'i==0', return information about the whole match, which
@@ -761,8 +1367,10 @@ static int nospecials (const char *p, size_t l) {
 
 
 static void prepstate (MatchState *ms, lua_State *L,
-                       const char *s, size_t ls, const char *p, size_t lp) {
+                       const char *s, size_t ls, const char *p, size_t lp,
+                       const CPattern *cp) {
   ms->L = L;
+  ms->cp = cp;
   ms->matchdepth = MAXCCALLS;
   ms->src_init = s;
   ms->src_end = s + ls;
@@ -799,14 +1407,18 @@ static int str_find_aux (lua_State *L, int find) {
     MatchState ms;
     const char *s1 = s + init;
     int anchor = (*p == '^');
+    const CPattern *cp = getpattern(L, 2);
     if (anchor) {
       p++; lp--;  /* skip anchor character */
     }
-    prepstate(&ms, L, s, ls, p, lp);
+    prepstate(&ms, L, s, ls, p, lp, cp);
     do {
       const char *res;
+      if (cp != NULL && !anchor &&
+          (s1 = nextstart(cp, s1, ms.src_end)) == NULL)
+        break;  /* no more places where a match can start */
       reprepstate(&ms);
-      if ((res=match(&ms, s1, p)) != NULL) {
+      if ((res=domatch(&ms, s1, p)) != NULL) {
         if (find) {
           lua_pushinteger(L, (s1 - s) + 1);  /* start */
           lua_pushinteger(L, res - s);   /* end */
@@ -842,13 +1454,16 @@ typedef struct GMatchState {
 
 
 static int gmatch_aux (lua_State *L) {
-  GMatchState *gm = (GMatchState *)lua_touserdata(L, lua_upvalueindex(3));
+  GMatchState *gm = (GMatchState *)lua_touserdata(L, lua_upvalueindex(4));
   const char *src;
   gm->ms.L = L;
   for (src = gm->src; src <= gm->ms.src_end; src++) {
     const char *e;
+    if (gm->ms.cp != NULL &&
+        (src = nextstart(gm->ms.cp, src, gm->ms.src_end)) == NULL)
+      break;  /* no more places where a match can start */
     reprepstate(&gm->ms);
-    if ((e = match(&gm->ms, src, gm->p)) != NULL && e != gm->lastmatch) {
+    if ((e = domatch(&gm->ms, src, gm->p)) != NULL && e != gm->lastmatch) {
       gm->src = gm->lastmatch = e;
       return push_captures(&gm->ms, src, e);
     }
@@ -862,14 +1477,18 @@ static int gmatch (lua_State *L) {
   const char *s = luaL_checklstring(L, 1, &ls);
   const char *p = luaL_checklstring(L, 2, &lp);
   size_t init = posrelatI(luaL_optinteger(L, 3, 1), ls) - 1;
+  const CPattern *cp;
   GMatchState *gm;
   lua_settop(L, 2);  /* keep strings on closure to avoid being collected */
+  cp = getpattern(L, 2);  /* also kept on closure */
+  if (cp != NULL && cp->anchor)  /* '^' is not an anchor for 'gmatch' */
+    cp = NULL;
   gm = (GMatchState *)lua_newuserdatauv(L, sizeof(GMatchState), 0);
   if (init > ls)  /* start after string's end? */
     init = ls + 1;  /* avoid overflows in 's + init' */
-  prepstate(&gm->ms, L, s, ls, p, lp);
+  prepstate(&gm->ms, L, s, ls, p, lp, cp);
   gm->src = s + init; gm->p = p; gm->lastmatch = NULL;
-  lua_pushcclosure(L, gmatch_aux, 3);
+  lua_pushcclosure(L, gmatch_aux, 4);
   return 1;
 }
 
@@ -955,20 +1574,29 @@ static int str_gsub (lua_State *L) {
   int anchor = (*p == '^');
   lua_Integer n = 0;  /* replacement count */
   int changed = 0;  /* change flag */
+  const CPattern *cp;
   MatchState ms;
   luaL_Buffer b;
   luaL_argexpected(L, tr == LUA_TNUMBER || tr == LUA_TSTRING ||
                    tr == LUA_TFUNCTION || tr == LUA_TTABLE, 3,
                       "string/function/table");
+  cp = getpattern(L, 2);  /* (must be below the buffer) */
   luaL_buffinit(L, &b);
   if (anchor) {
     p++; lp--;  /* skip anchor character */
   }
-  prepstate(&ms, L, src, srcl, p, lp);
+  prepstate(&ms, L, src, srcl, p, lp, cp);
   while (n < max_s) {
     const char *e;
+    if (cp != NULL && !anchor) {  /* skip places where no match starts */
+      const char *next = nextstart(cp, src, ms.src_end);
+      if (next == NULL)
+        break;  /* no more matches */
+      luaL_addlstring(&b, src, next - src);
+      src = next;
+    }
     reprepstate(&ms);  /* (re)prepare state for new match */
-    if ((e = match(&ms, src, p)) != NULL && e != lastmatch) {  /* match? */
+    if ((e = domatch(&ms, src, p)) != NULL && e != lastmatch) {  /* match? */
       n++;
       changed = add_value(&ms, &b, src, e, tr) | changed;
       src = lastmatch = e;
@@ -1276,27 +1904,27 @@ static void addlenmod (char *form, const char *lenmod) {
 }
 
 
-static int str_format (lua_State *L) {
-  int top = lua_gettop(L);
-  int arg = 1;
+/*
+** Add to buffer 'b' the values from 'arg' + 1 up to 'top' formatted
+** according to the format string at index 'arg'.
+*/
+static void addformat (lua_State *L, luaL_Buffer *b, int arg, int top) {
   size_t sfl;
   const char *strfrmt = luaL_checklstring(L, arg, &sfl);
   const char *strfrmt_end = strfrmt+sfl;
   const char *flags;
-  luaL_Buffer b;
-  luaL_buffinit(L, &b);
   while (strfrmt < strfrmt_end) {
     if (*strfrmt != L_ESC)
-      luaL_addchar(&b, *strfrmt++);
+      luaL_addchar(b, *strfrmt++);
     else if (*++strfrmt == L_ESC)
-      luaL_addchar(&b, *strfrmt++);  /* %% */
+      luaL_addchar(b, *strfrmt++);  /* %% */
     else { /* format item */
       char form[MAX_FORMAT];  /* to store the format ('%...') */
       int maxitem = MAX_ITEM;  /* maximum length for the result */
-      char *buff = luaL_prepbuffsize(&b, maxitem);  /* to put result */
+      char *buff = luaL_prepbuffsize(b, maxitem);  /* to put result */
       int nb = 0;  /* number of bytes in result */
       if (++arg > top)
-        return luaL_argerror(L, arg, "no value");
+        luaL_argerror(L, arg, "no value");
       strfrmt = getformat(L, strfrmt, form);
       switch (*strfrmt++) {
         case 'c': {
@@ -1327,7 +1955,7 @@ static int str_format (lua_State *L) {
           break;
         case 'f':
           maxitem = MAX_ITEMF;  /* extra space for '%f' */
-          buff = luaL_prepbuffsize(&b, maxitem);
+          buff = luaL_prepbuffsize(b, maxitem);
           /* FALLTHROUGH */
         case 'e': case 'E': case 'g': case 'G': {
           lua_Number n = luaL_checknumber(L, arg);
@@ -1348,21 +1976,21 @@ static int str_format (lua_State *L) {
         }
         case 'q': {
           if (form[2] != '\0')  /* modifiers? */
-            return luaL_error(L, "specifier '%%q' cannot have modifiers");
-          addliteral(L, &b, arg);
+            luaL_error(L, "specifier '%%q' cannot have modifiers");
+          addliteral(L, b, arg);
           break;
         }
         case 's': {
           size_t l;
           const char *s = luaL_tolstring(L, arg, &l);
           if (form[2] == '\0')  /* no modifiers? */
-            luaL_addvalue(&b);  /* keep entire string */
+            luaL_addvalue(b);  /* keep entire string */
           else {
             luaL_argcheck(L, l == strlen(s), arg, "string contains zeros");
             checkformat(L, form, L_FMTFLAGSC, 1);
             if (strchr(form, '.') == NULL && l >= 100) {
               /* no precision and string is too long to be formatted */
-              luaL_addvalue(&b);  /* keep entire string */
+              luaL_addvalue(b);  /* keep entire string */
             }
             else {  /* format the string into 'buff' */
               nb = l_sprintf(buff, maxitem, form, s);
@@ -1372,13 +2000,21 @@ static int str_format (lua_State *L) {
           break;
         }
         default: {  /* also treat cases 'pnLlh' */
-          return luaL_error(L, "invalid conversion '%s' to 'format'", form);
+          luaL_error(L, "invalid conversion '%s' to 'format'", form);
         }
       }
       lua_assert(nb < maxitem);
-      luaL_addsize(&b, nb);
+      luaL_addsize(b, nb);
     }
   }
+}
+
+
+static int str_format (lua_State *L) {
+  int top = lua_gettop(L);
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  addformat(L, &b, 1, top);
   luaL_pushresult(&b);
   return 1;
 }
@@ -1386,6 +2022,301 @@ static int str_format (lua_State *L) {
 /* }====================================================== */
 
 
+/*
+** {======================================================
+** STRING BUFFERS
+** =======================================================
+*/
+
+
+/*
+** Contents with at least this many characters are handed over to the
+** string created by 'tostring'; shorter ones are copied, so that the
+** buffer keeps its storage for reuse.
+*/
+#if !defined(LUAL_MINHANDOVER)
+#define LUAL_MINHANDOVER	LUAL_BUFFERSIZE
+#endif
+
+
+/* buffer shares its contents with the string in its user value? */
+#define isshared(sb)	((sb)->size < (sb)->n)
+
+
+#define checkstrbuf(L)  \
+	((luaL_StringBuffer *)luaL_checkudata(L, 1, LUA_BUFFERHANDLE))
+
+
+/*
+** Resize the storage of a buffer (which cannot be shared), using the
+** allocator of the state, as boxes in 'lauxlib.c' do.
+*/
+static void resizestrbuf (lua_State *L, luaL_StringBuffer *sb,
+                          size_t newsize) {
+  void *ud;
+  lua_Alloc allocf = lua_getallocf(L, &ud);
+  char *temp = (char *)allocf(ud, sb->b, sb->size, newsize);
+  if (l_unlikely(temp == NULL && newsize > 0)) {  /* allocation error? */
+    lua_pushliteral(L, "not enough memory");
+    lua_error(L);  /* raise a memory error */
+  }
+  sb->b = temp;
+  sb->size = newsize;
+}
+
+
+/*
+** Returns a pointer to a free area with at least 'sz' bytes at the end
+** of the buffer at index 1. A buffer sharing its contents with a string
+** first gets a copy of them in its own storage. New sizes follow the
+** same policy as 'luaL_Buffer', with room for a final zero.
+*/
+static char *prepstrbuf (lua_State *L, luaL_StringBuffer *sb, size_t sz) {
+  if (isshared(sb) || sb->size - sb->n < sz) {
+    size_t newsize = (sb->size / 2) * 3;  /* buffer size * 1.5 */
+    if (l_unlikely(MAX_SIZET - sz - 1 < sb->n))  /* overflow? */
+      luaL_error(L, "buffer too large");
+    if (newsize < sb->n + sz + 1)  /* not big enough? */
+      newsize = sb->n + sz + 1;
+    if (isshared(sb)) {  /* copy contents from the string */
+      luaL_StringBuffer nb;
+      nb.b = NULL; nb.size = nb.n = 0;
+      resizestrbuf(L, &nb, newsize);  /* on errors, 'sb' is unchanged */
+      memcpy(nb.b, sb->b, sb->n * sizeof(char));
+      sb->b = nb.b;
+      sb->size = nb.size;
+      lua_pushnil(L);
+      lua_setiuservalue(L, 1, 1);  /* release the string */
+    }
+    else
+      resizestrbuf(L, sb, newsize);
+  }
+  return sb->b + sb->n;
+}
+
+
+static void addstrbuf (lua_State *L, luaL_StringBuffer *sb,
+                       const char *s, size_t l) {
+  if (l > 0) {  /* avoid 'memcpy' when 's' can be NULL */
+    char *b = prepstrbuf(L, sb, l);
+    memcpy(b, s, l * sizeof(char));
+    sb->n += l;
+  }
+}
+
+
+static int buf_new (lua_State *L) {
+  lua_Integer sz = luaL_optinteger(L, 1, 0);
+  luaL_StringBuffer *sb;
+  luaL_argcheck(L, 0 <= sz && (lua_Unsigned)sz < MAX_SIZET, 1,
+                   "invalid size");
+  sb = (luaL_StringBuffer *)lua_newuserdatauv(L, sizeof(luaL_StringBuffer), 1);
+  sb->b = NULL;
+  sb->size = sb->n = 0;
+  luaL_setmetatable(L, LUA_BUFFERHANDLE);
+  if (sz > 0) {
+    lua_replace(L, 1);  /* 'prepstrbuf' needs the buffer at index 1 */
+    prepstrbuf(L, sb, (size_t)sz);
+  }
+  return 1;
+}
+
+
+/*
+** Appends all its arguments (strings, numbers, or other buffers) to
+** the buffer and returns the buffer. Integers are written directly
+** into the buffer.
+*/
+static int buf_append (lua_State *L) {
+  luaL_StringBuffer *sb = checkstrbuf(L);
+  int n = lua_gettop(L);
+  int i;
+  for (i = 2; i <= n; i++) {
+    luaL_StringBuffer *other =
+        (luaL_StringBuffer *)luaL_testudata(L, i, LUA_BUFFERHANDLE);
+    if (other != NULL) {
+      if (other == sb) {  /* appending buffer to itself? */
+        size_t l = sb->n;
+        char *b = prepstrbuf(L, sb, l);  /* may move the contents */
+        memcpy(b, sb->b, l * sizeof(char));
+        sb->n += l;
+      }
+      else
+        addstrbuf(L, sb, other->b, other->n);
+    }
+    else if (lua_isinteger(L, i)) {  /* format it without a new string */
+      char *b = prepstrbuf(L, sb, MAX_ITEM);
+      sb->n += (size_t)lua_integer2str(b, MAX_ITEM, lua_tointeger(L, i));
+    }
+    else {
+      size_t l;
+      const char *s = luaL_checklstring(L, i, &l);
+      addstrbuf(L, sb, s, l);
+    }
+  }
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+/*
+** Appends its arguments formatted as by 'string.format'. The result
+** is built in a 'luaL_Buffer', which needs no allocations for short
+** results.
+*/
+static int buf_appendf (lua_State *L) {
+  luaL_StringBuffer *sb = checkstrbuf(L);
+  int top = lua_gettop(L);
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  addformat(L, &b, 2, top);
+  addstrbuf(L, sb, luaL_buffaddr(&b), luaL_bufflen(&b));
+  lua_settop(L, 1);  /* also closes the box of 'b', if there is one */
+  return 1;
+}
+
+
+static int buf_reserve (lua_State *L) {
+  luaL_StringBuffer *sb = checkstrbuf(L);
+  lua_Integer sz = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, 0 <= sz && (lua_Unsigned)sz < MAX_SIZET, 2,
+                   "invalid size");
+  prepstrbuf(L, sb, (size_t)sz);
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+static int buf_reset (lua_State *L) {
+  luaL_StringBuffer *sb = checkstrbuf(L);
+  if (isshared(sb)) {  /* release the string holding the contents */
+    sb->b = NULL;
+    lua_pushnil(L);
+    lua_setiuservalue(L, 1, 1);
+  }
+  sb->n = 0;  /* keep storage, if any */
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+/*
+** Storage handed over from a buffer to a string. 'lua_pushextlstring'
+** frees the storage of a string it fails to create, or of a string it
+** copies (short strings); 'freehandover' only frees it after 'done' is
+** set, so that in those cases the storage stays with the buffer.
+*/
+typedef struct Handover {
+  lua_Alloc allocf;  /* allocator of the state */
+  void *ud;
+  int done;  /* true when the string owns the storage */
+} Handover;
+
+
+static void *freehandover (void *ud, void *ptr, size_t osize,
+                                                size_t nsize) {
+  Handover *h = (Handover *)ud;
+  lua_Alloc allocf = h->allocf;
+  void *aud = h->ud;
+  (void)nsize;  /* not used (always zero) */
+  if (h->done)
+    allocf(aud, ptr, osize, 0);  /* free contents */
+  allocf(aud, h, sizeof(Handover), 0);
+  return NULL;
+}
+
+
+/*
+** Long contents are handed over to the new string, which keeps the
+** storage of the buffer; the buffer then shares the contents with
+** that string until it changes again. (So, calling 'tostring' again
+** on an unchanged buffer returns the same string.) If the handover
+** fails, the buffer keeps its contents.
+*/
+static int buf_tostring (lua_State *L) {
+  luaL_StringBuffer *sb = checkstrbuf(L);
+  if (isshared(sb))
+    lua_getiuservalue(L, 1, 1);  /* string already holding the contents */
+  else if (sb->n == 0)
+    lua_pushliteral(L, "");
+  else if (sb->n < LUAL_MINHANDOVER)
+    lua_pushlstring(L, sb->b, sb->n);  /* copy short contents */
+  else {
+    size_t len = sb->n;  /* final string length */
+    Handover *h;
+    void *ud;
+    lua_Alloc allocf = lua_getallocf(L, &ud);
+    resizestrbuf(L, sb, len + 1);  /* adjust storage to content size */
+    sb->b[len] = '\0';  /* add ending zero */
+    h = (Handover *)allocf(ud, NULL, 0, sizeof(Handover));
+    if (l_unlikely(h == NULL)) {  /* cannot hand over? */
+      lua_pushlstring(L, sb->b, len);  /* copy contents */
+      return 1;
+    }
+    h->allocf = allocf; h->ud = ud; h->done = 0;
+    if (lua_pushextlstring(L, sb->b, len, freehandover, h) != sb->b)
+      return 1;  /* string got a copy (and already freed 'h') */
+    h->done = 1;  /* string created; it owns the storage now */
+    sb->size = 0;  /* now shared with the new string */
+    lua_pushvalue(L, -1);
+    lua_setiuservalue(L, 1, 1);  /* keep the string with the buffer */
+  }
+  return 1;
+}
+
+
+static int buf_len (lua_State *L) {
+  luaL_StringBuffer *sb = checkstrbuf(L);
+  lua_pushinteger(L, (lua_Integer)sb->n);
+  return 1;
+}
+
+
+static int buf_gc (lua_State *L) {
+  luaL_StringBuffer *sb = checkstrbuf(L);
+  if (!isshared(sb))
+    resizestrbuf(L, sb, 0);
+  return 0;
+}
+
+
+/*
+** methods for string buffers
+*/
+static const luaL_Reg bufmeth[] = {
+  {"append", buf_append},
+  {"appendf", buf_appendf},
+  {"reserve", buf_reserve},
+  {"reset", buf_reset},
+  {"tostring", buf_tostring},
+  {NULL, NULL}
+};
+
+
+/*
+** metamethods for string buffers
+*/
+static const luaL_Reg bufmetameth[] = {
+  {"__index", NULL},  /* place holder */
+  {"__gc", buf_gc},
+  {"__len", buf_len},
+  {"__tostring", buf_tostring},
+  {NULL, NULL}
+};
+
+
+static void createbufmeta (lua_State *L) {
+  luaL_newmetatable(L, LUA_BUFFERHANDLE);  /* metatable for buffers */
+  luaL_setfuncs(L, bufmetameth, 0);  /* add metamethods to new metatable */
+  luaL_newlibtable(L, bufmeth);  /* create method table */
+  luaL_setfuncs(L, bufmeth, 0);  /* add buffer methods to method table */
+  lua_setfield(L, -2, "__index");  /* metatable.__index = method table */
+  lua_pop(L, 1);  /* pop metatable */
+}
+
+/* }====================================================== */
+
+
 /*
 ** {======================================================
 ** PACK/UNPACK
@@ -1834,6 +2765,7 @@ static int str_unpack (lua_State *L) {
 
 
 static const luaL_Reg strlib[] = {
+  {"buffer", buf_new},
   {"byte", str_byte},
   {"char", str_char},
   {"dump", str_dump},
@@ -1875,6 +2807,7 @@ static void createmetatable (lua_State *L) {
 LUAMOD_API int luaopen_string (lua_State *L) {
   luaL_newlib(L, strlib);
   createmetatable(L);
+  createbufmeta(L);
   return 1;
 }
 
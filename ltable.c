@@ -21,6 +21,42 @@
 ** in its main position (i.e. the 'original' position that its hash gives
 ** to it), then the colliding element is in its own main position.
 ** Hence even when the load factor reaches 100%, performance remains good.
+**
+** With LUA_USE_SWISSHASH, the hash part uses open addressing instead,
+** in the style of "Swiss tables": after the array of nodes comes an
+** array of control bytes, one for each node, which is either CTRLEMPTY
+** (a node never used) or 7 bits of the hash of the node's key. A search
+** compares its hash bits against a group of GROUPSIZE control bytes at
+** once (with SSE2, when available), looks at the keys only of the nodes
+** that matched, and stops at the first group with an empty node.
+** Nodes are never emptied (removed keys keep their nodes, as in the
+** chained table), so those tables have no tombstones; the load is
+** limited to 7/8 of the nodes, to keep searches for absent keys short.
+**
+** With LUA_USE_SHAPES, a table with no hash part keeps its short-string
+** keys in a shape (see 'lobject.h'), shared with the other tables that
+** got the same keys in the same order, and their values in its array
+** 'slots'; its other keys go to the array and hash parts as usual. The
+** shapes of a state form a tree, kept in the shape table, where each
+** shape has one more key than its parent. A table that gets too many
+** keys, or keys in an order followed by too few other tables, moves its
+** fields to its hash part and does not use shapes anymore. Removed keys
+** keep their slots, as removed keys keep their nodes.
+**
+** With LUA_USE_PACKEDARRAYS, a new array part starts "packed" (see
+** 'ltable.h'): it keeps only values, all with the same tag, which must
+** be an integer or a float tag, and all entries after the first empty
+** one are empty too. The first store that breaks these rules unpacks
+** the array, giving it the usual array of tags for good.
+**
+** With LUA_USE_INCREHASH, a rehash that only grows a large hash part
+** does not move its entries at once: the table keeps its previous node
+** vector in 'oldnode', and each new key inserted into the table moves
+** the entries of a few old nodes into the new vector. Searches look in
+** the new vector and then in the old one; an old node whose entry was
+** moved (or removed) is empty, so a key lives in at most one of them.
+** As only new keys move entries, traversals see the usual order:
+** array part, new vector, old vector.
 */
 
 #include <math.h>
@@ -50,17 +86,25 @@
 
 /*
 ** The union 'Limbox' stores 'lastfree' and ensures that what follows it
-** is properly aligned to store a Node.
+** is properly aligned to store a Node. (Tables with open addressing use
+** it in all their hash parts, to store the number of empty nodes that
+** still can be used, in 'left'.)
 */
 typedef struct { Node *dummy; Node follows_pNode; } Limbox_aux;
 
 typedef union {
   Node *lastfree;
+  unsigned int left;
   char padding[offsetof(Limbox_aux, follows_pNode)];
 } Limbox;
 
+#if !LUA_USE_SWISSHASH
 #define haslastfree(t)     ((t)->lsizenode > LIMFORLAST)
+#else
+#define haslastfree(t)     1
+#endif
 #define getlastfree(t)     ((cast(Limbox *, (t)->node) - 1)->lastfree)
+#define getleft(t)         ((cast(Limbox *, (t)->node) - 1)->left)
 
 
 /*
@@ -119,6 +163,8 @@ typedef union {
 #define hashpointer(t,p)	hashmod(t, point2uint(p))
 
 
+#if !LUA_USE_SWISSHASH
+
 #define dummynode		(&dummynode_)
 
 static const Node dummynode_ = {
@@ -126,10 +172,40 @@ static const Node dummynode_ = {
    LUA_VNIL, 0, {NULL}}  /* key type, next, and key value */
 };
 
+#else
+
+/* number of control bytes compared at once */
+#define GROUPSIZE	16
+
+/* control byte of a node never used */
+#define CTRLEMPTY	0x80
+
+/*
+** The dummy node comes with its control bytes, all empty, so that
+** searches in tables without a hash part need no special case.
+*/
+#define dummynode		(&dummynode_.node)
+
+static const struct {
+  Node node;
+  lu_byte ctrl[GROUPSIZE];
+} dummynode_ = {
+  {{{NULL}, LUA_VEMPTY,  /* value's value and type */
+    LUA_VNIL, 0, {NULL}}},  /* key type, next, and key value */
+  {CTRLEMPTY, CTRLEMPTY, CTRLEMPTY, CTRLEMPTY,
+   CTRLEMPTY, CTRLEMPTY, CTRLEMPTY, CTRLEMPTY,
+   CTRLEMPTY, CTRLEMPTY, CTRLEMPTY, CTRLEMPTY,
+   CTRLEMPTY, CTRLEMPTY, CTRLEMPTY, CTRLEMPTY}
+};
+
+#endif
+
 
 static const TValue absentkey = {ABSTKEYCONSTANT};
 
 
+#if !LUA_USE_SWISSHASH
+
 /*
 ** Hash for integers. To allow a good hash, use the remainder operator
 ** ('%'). If integer fits as a non-negative int, compute an int
@@ -144,6 +220,8 @@ static Node *hashint (const Table *t, lua_Integer i) {
     return hashmod(t, ui);
 }
 
+#endif
+
 
 /*
 ** Hash for floating-point numbers.
@@ -175,6 +253,8 @@ static int l_hashfloat (lua_Number n) {
 #endif
 
 
+#if !LUA_USE_SWISSHASH
+
 /*
 ** returns the 'main' position of an element in a table (that is,
 ** the index of its hash value).
@@ -223,6 +303,8 @@ l_sinline Node *mainpositionfromnode (const Table *t, Node *nd) {
   return mainpositionTV(t, &key);
 }
 
+#endif
+
 
 /*
 ** Check whether key 'k1' is equal to the key in node 'n2'. This
@@ -267,6 +349,473 @@ static int equalkey (const TValue *k1, const Node *n2, int deadok) {
 }
 
 
+#if LUA_USE_SWISSHASH
+
+/*
+** {=============================================================
+** Open addressing with groups of control bytes
+** ==============================================================
+*/
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+
+/* bit mask of the bytes in group 'g' equal to 'b' */
+l_sinline unsigned int matchbyte (const lu_byte *g, lu_byte b) {
+  __m128i ctrl = _mm_loadu_si128(cast(const __m128i *, g));
+  return cast_uint(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl,
+                                     _mm_set1_epi8(cast_char(b)))));
+}
+
+#else
+
+l_sinline unsigned int matchbyte (const lu_byte *g, lu_byte b) {
+  unsigned int m = 0;
+  int i;
+  for (i = 0; i < GROUPSIZE; i++) {
+    if (g[i] == b)
+      m |= 1u << i;
+  }
+  return m;
+}
+
+#endif
+
+
+/* index of the lowest bit set in a (non-zero) mask */
+#if defined(__GNUC__)
+#define lowbit(m)	__builtin_ctz(m)
+#else
+static int lowbit (unsigned int m) {
+  int i = 0;
+  while (!(m & 1u)) { m >>= 1; i++; }
+  return i;
+}
+#endif
+
+
+/*
+** The control bytes come after the nodes. There are GROUPSIZE - 1 more
+** of them, copies of the first ones (wrapping around as many times as
+** needed in small tables), so that a group can start at any node.
+*/
+#define ctrlof(t)	cast(lu_byte *, gnode(t, sizenode(t)))
+#define sizectrl(size)	((size) + GROUPSIZE - 1)
+
+/* hash bits kept in control bytes */
+#define hashfrag(h)	cast_byte((h) >> (sizeof(unsigned int) * CHAR_BIT - 7))
+
+/* maximum number of used nodes in a hash part with 'size' nodes */
+#define maxload(size)	((size) - (size) / 8)
+
+
+static void setctrl (Table *t, unsigned int i, lu_byte c) {
+  unsigned int size = sizenode(t);
+  lu_byte *ctrl = ctrlof(t);
+  for (; i < sizectrl(size); i += size)
+    ctrl[i] = c;
+}
+
+
+/*
+** Hash values of keys. Unlike main positions, which only use the bits
+** selected by the size of the table, these hashes also provide the bits
+** for control bytes, so they are mixed to spread all bits of the keys.
+*/
+l_sinline unsigned int mixhash (unsigned int h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  return h;
+}
+
+
+l_sinline unsigned int hashintval (lua_Integer i) {
+  lua_Unsigned ui = l_castS2U(i);
+  return mixhash(cast_uint(ui ^ (ui >> (sizeof(ui) * CHAR_BIT / 2))));
+}
+
+
+static unsigned int hashvalue (const TValue *key) {
+  switch (ttypetag(key)) {
+    case LUA_VNUMINT: return hashintval(ivalue(key));
+    case LUA_VNUMFLT: return mixhash(cast_uint(l_hashfloat(fltvalue(key))));
+    case LUA_VSHRSTR: return mixhash(tsvalue(key)->hash);
+    case LUA_VLNGSTR: return mixhash(luaS_hashlongstr(tsvalue(key)));
+    case LUA_VFALSE: return mixhash(0);
+    case LUA_VTRUE: return mixhash(1);
+    case LUA_VLIGHTUSERDATA: return mixhash(point2uint(pvalue(key)));
+    case LUA_VLCF: return mixhash(point2uint(fvalue(key)));
+    default: return mixhash(point2uint(gcvalue(key)));
+  }
+}
+
+
+/*
+** Search for a key with hash 'h' in table 't': for each node 'n' whose
+** control byte matches the hash, return the value of 'n' if 'eq' (an
+** expression over 'n') is true. Each step looks at the group following
+** the previous one by a growing distance ("triangular" probing, which
+** visits all groups in a power-of-2 table); the search fails at the
+** first group with an empty node or after looking at all nodes.
+*/
+#define searchhash(t,h,n,eq) {  \
+  const lu_byte *ctrl_ = ctrlof(t);  \
+  unsigned int mask_ = cast_uint(sizenode(t)) - 1;  \
+  unsigned int pos_ = (h) & mask_;  \
+  unsigned int step_ = 0;  \
+  lu_byte frag_ = hashfrag(h);  \
+  for (;;) {  \
+    unsigned int m_ = matchbyte(ctrl_ + pos_, frag_);  \
+    while (m_ != 0) {  \
+      n = gnode(t, (pos_ + cast_uint(lowbit(m_))) & mask_);  \
+      if (eq) return gval(n);  \
+      m_ &= m_ - 1;  \
+    }  \
+    if (matchbyte(ctrl_ + pos_, CTRLEMPTY) != 0 ||  \
+        (step_ += GROUPSIZE) > mask_)  \
+      break;  \
+    pos_ = (pos_ + step_) & mask_;  \
+  } }
+
+
+/*
+** Get a node for a new key with hash 'h' (which is not in the table),
+** or NULL if the table has no room for it. The key goes to the first
+** node in its search path whose entry is empty: a node of a removed key
+** (as in the chained table) or an empty node. Taking the first one also
+** keeps the new key ahead of any dead key with the same address (see
+** 'equalkey'), so that 'next' finds the right node for it.
+*/
+static Node *getfreepos (Table *t, unsigned int h) {
+  lu_byte *ctrl = ctrlof(t);
+  unsigned int mask = cast_uint(sizenode(t)) - 1;
+  unsigned int pos = h & mask;
+  unsigned int step = 0;
+  if (isdummy(t))
+    return NULL;
+  for (;;) {
+    int i;
+    for (i = 0; i < GROUPSIZE; i++) {
+      unsigned int j = (pos + cast_uint(i)) & mask;
+      if (ctrl[pos + cast_uint(i)] == CTRLEMPTY) {  /* an empty node? */
+        if (getleft(t) == 0)  /* reached maximum load? */
+          return NULL;
+        getleft(t)--;
+      }
+      else if (!isempty(gval(gnode(t, j))))
+        continue;  /* node in use */
+      setctrl(t, j, hashfrag(h));
+      return gnode(t, j);
+    }
+    if ((step += GROUPSIZE) > mask)
+      return NULL;  /* all nodes are in use */
+    pos = (pos + step) & mask;
+  }
+}
+
+/* }============================================================= */
+
+#endif
+
+
+#if LUA_USE_SHAPES
+
+/*
+** {=============================================================
+** Shapes
+** ==============================================================
+*/
+
+/* maximum number of keys in a shape */
+#define MAXSHAPEKEYS	32
+
+/* maximum number of extensions of a shape (other than the root) */
+#define MAXSHAPEKIDS	8
+
+/* initial size of the shape table */
+#define MINSHAPETABSIZE	64
+
+
+#define sizeshape(n)  \
+	(offsetof(Shape, keys) + cast_sizet(n) * sizeof(TString *))
+
+/*
+** Each shape has a Bloom filter of its keys, with one bit for each key,
+** so that most searches for absent keys need not compare keys.
+*/
+#define bloombit(key)  \
+	(cast(lu_mem, 1) << ((key)->hash % (sizeof(lu_mem) * CHAR_BIT)))
+
+/*
+** Hash of the extension of shape 'p' with 'key'. Each shape keeps its
+** hash, as its last key may be already collected when the shape is
+** freed (when closing the state).
+*/
+#define shapehash(p,key)	((key)->hash ^ point2uint(p))
+
+#define shapebucket(tb,h)	(&(tb)->hash[lmod(h, (tb)->size)])
+
+
+/*
+** The union 'Slotbox' stores the number of slots of a table, just
+** before them, in the same block, and ensures that the slots that
+** follow it are properly aligned.
+*/
+typedef struct { unsigned int dummy; TValue follows_pTValue; } Slotbox_aux;
+
+typedef union {
+  unsigned int size;
+  char padding[offsetof(Slotbox_aux, follows_pTValue)];
+} Slotbox;
+
+#define sizeslots(t)  \
+	((t)->slots == NULL ? 0u : (cast(Slotbox *, (t)->slots) - 1)->size)
+
+#define slotsblock(sl)	(cast_charp(sl) - sizeof(Slotbox))
+#define sizeslotsblock(n)  (sizeof(Slotbox) + cast_sizet(n) * sizeof(TValue))
+
+
+/*
+** Returns the index of 'key' in shape 's', or -1 if it is not there.
+*/
+static int shapeindex (const Shape *s, const TString *key) {
+  if (s->bloom & bloombit(key)) {
+    int i;
+    for (i = 0; i < s->nkeys; i++) {
+      if (s->keys[i] == key)
+        return i;
+    }
+  }
+  return -1;
+}
+
+
+static void freeslots (lua_State *L, TValue *slots) {
+  if (slots != NULL) {
+    unsigned int size = (cast(Slotbox *, slots) - 1)->size;
+    luaM_freemem(L, slotsblock(slots), sizeslotsblock(size));
+  }
+}
+
+
+/*
+** Give table 't' room for 'size' slots.
+*/
+static void resizeslots (lua_State *L, Table *t, unsigned int size) {
+  unsigned int osize = sizeslots(t);
+  char *block = (t->slots == NULL) ? NULL : slotsblock(t->slots);
+  lua_assert(size <= MAXSHAPEKEYS);
+  lua_assert(!isshaped(t) || size >= t->shape->nkeys);
+  block = cast_charp(luaM_saferealloc_(L, block,
+                     (osize == 0) ? 0 : sizeslotsblock(osize),
+                     sizeslotsblock(size)));
+  cast(Slotbox *, block)->size = size;
+  t->slots = cast(TValue *, block + sizeof(Slotbox));
+}
+
+
+/*
+** Rehash the shape table after its array grew from 'osize' buckets (as in 'tablerehash' in the string table).
+*/
+static void shaperehash (shapetable *tb, int osize) {
+  int i;
+  for (i = osize; i < tb->size; i++)  /* clear new buckets */
+    tb->hash[i] = NULL;
+  for (i = 0; i < osize; i++) {  /* rehash old buckets */
+    Shape *p = tb->hash[i];
+    tb->hash[i] = NULL;
+    while (p) {  /* for each shape in the list */
+      Shape *hnext = p->hnext;  /* save next */
+      Shape **b = shapebucket(tb, p->hash);
+      p->hnext = *b;  /* chain it into its new bucket */
+      *b = p;
+      p = hnext;
+    }
+  }
+}
+
+
+/*
+** Grow the shape table, if possible. (As with the string table, the
+** shape table can work with long lists, so it is not an error if it
+** cannot grow.)
+*/
+static void growshapes (lua_State *L, shapetable *tb) {
+  int osize = tb->size;
+  if (osize == 0) {  /* first shape? */
+    tb->hash = luaM_newvector(L, MINSHAPETABSIZE, Shape *);
+    tb->size = MINSHAPETABSIZE;
+    shaperehash(tb, 0);
+  }
+  else if (osize <= MAX_INT / 2) {
+    Shape **newvect = luaM_reallocvector(L, tb->hash, osize, osize * 2,
+                                         Shape *);
+    if (newvect != NULL) {  /* allocation succeeded? */
+      tb->hash = newvect;
+      tb->size = osize * 2;
+      shaperehash(tb, osize);
+    }
+  }
+}
+
+
+/*
+** Returns the extension of shape 'p' with 'key', or NULL if there is
+** no such shape.
+*/
+static Shape *findshape (shapetable *tb, const Shape *p, TString *key) {
+  if (tb->size > 0) {
+    Shape *s;
+    for (s = *shapebucket(tb, shapehash(p, key)); s != NULL; s = s->hnext) {
+      if (s->parent == p && s->keys[p->nkeys] == key)
+        return s;
+    }
+  }
+  return NULL;
+}
+
+
+/*
+** Creates the extension of shape 'p' with 'key'. All allocations come
+** before the new shape is linked into the shape table: they may run
+** the collector, which may free shapes.
+*/
+static Shape *newshape (lua_State *L, Shape *p, TString *key) {
+  shapetable *tb = &G(L)->shapes;
+  unsigned int n = p->nkeys;
+  Shape *s;
+  Shape **b;
+  if (tb->nuse >= tb->size)
+    growshapes(L, tb);
+  s = cast(Shape *, luaM_newblock(L, sizeshape(n + 1)));
+  memcpy(s->keys, p->keys, n * sizeof(TString *));
+  s->keys[n] = key;
+  s->nkeys = cast(unsigned short, n + 1);
+  s->nkids = 0;
+  s->refs = 0;
+  s->bloom = p->bloom | bloombit(key);
+  s->hash = shapehash(p, key);
+  s->parent = p;
+  p->refs++;  /* a shape uses its parent */
+  p->nkids++;
+  b = shapebucket(tb, s->hash);
+  s->hnext = *b;
+  *b = s;
+  tb->nuse++;
+  return s;
+}
+
+
+/*
+** Release a use of shape 's', freeing it when it is not used anymore
+** (and then releasing its use of its parent).
+*/
+static void releaseshape (lua_State *L, Shape *s) {
+  shapetable *tb = &G(L)->shapes;
+  while (--s->refs == 0 && s->parent != NULL) {  /* free 's'? */
+    Shape *p = s->parent;
+    Shape **b = shapebucket(tb, s->hash);
+    while (*b != s)  /* find 's' in its bucket */
+      b = &(*b)->hnext;
+    *b = s->hnext;  /* remove it */
+    tb->nuse--;
+    p->nkids--;
+    luaM_freemem(L, s, sizeshape(s->nkeys));
+    s = p;
+  }
+}
+
+
+/*
+** Make table 't' use shape 's' (the empty shape, for a table with no
+** shape), releasing its previous one.
+*/
+static void setshape (lua_State *L, Table *t, Shape *s) {
+  Shape *old = t->shape;
+  s->refs++;
+  t->shape = s;
+  if (old != NULL)
+    releaseshape(L, old);
+}
+
+
+/*
+** Add short-string 'key', with 'value', to the fields of table 't',
+** which has a shape or no hash part. Returns 0 if the table should keep
+** its fields in its hash part instead: its shape has too many keys or,
+** not being extended with 'key' yet, it has too many extensions.
+*/
+static int addslot (lua_State *L, Table *t, TString *key, TValue *value) {
+  shapetable *tb = &G(L)->shapes;
+  Shape *s = isshaped(t) ? t->shape : &tb->root;
+  unsigned int n = s->nkeys;
+  Shape *ns;
+  if (n == MAXSHAPEKEYS ||
+      (s->parent != NULL && s->nkids >= MAXSHAPEKIDS &&
+       findshape(tb, s, key) == NULL))
+    return 0;
+  if (sizeslots(t) <= n)  /* no room for another slot? */
+    resizeslots(L, t, (n < 2) ? 4 : (n * 2 > MAXSHAPEKEYS) ? MAXSHAPEKEYS
+                                                          : n * 2);
+  if (!isshaped(t))
+    setshape(L, t, s);  /* 't' starts with the empty shape */
+  /* shapes may have been freed by the collector; look again */
+  ns = findshape(tb, s, key);
+  if (ns == NULL)
+    ns = newshape(L, s, key);
+  setobj2t(L, &t->slots[n], value);
+  setshape(L, t, ns);
+  return 1;
+}
+
+
+/*
+** Move the fields of table 't' from its shape into its hash part, with
+** room for one more key.
+*/
+static void unshape (lua_State *L, Table *t) {
+  Shape *s = t->shape;
+  TValue *slots = t->slots;
+  unsigned int nh = 1;  /* room for the new key */
+  int i;
+  for (i = 0; i < sizenode(t); i++) {
+    if (!isempty(gval(gnode(t, i))))
+      nh++;
+  }
+#if LUA_USE_INCREHASH
+  if (ismigrating(t)) {
+    for (i = 0; i < cast_int(sizeoldnode(t)); i++) {
+      if (!isempty(gval(&t->oldnode[i])))
+        nh++;
+    }
+  }
+#endif
+  for (i = 0; i < s->nkeys; i++) {
+    if (!isempty(&slots[i]))
+      nh++;
+  }
+  /* the table is still complete if 'luaH_resize' raises an error */
+  luaH_resize(L, t, luaH_realasize(t), nh);
+  t->shape = NULL;
+  t->slots = NULL;
+  for (i = 0; i < s->nkeys; i++) {
+    if (!isempty(&slots[i])) {
+      TValue k;
+      setsvalue(L, &k, s->keys[i]);
+      luaH_set(L, t, &k, &slots[i]);  /* there is room for it */
+    }
+  }
+  freeslots(L, slots);
+  releaseshape(L, s);
+}
+
+/* }============================================================= */
+
+#endif
+
+
 /*
 ** True if value of 'alimit' is equal to the real size of the array
 ** part of table 't'. (Otherwise, the array part must be larger than
@@ -322,23 +871,78 @@ static unsigned int setlimittosize (Table *t) {
 
 
 
+#if LUA_USE_INCREHASH
+
+/*
+** Only hash parts with at least LUAI_MIGRATEMIN nodes grow
+** incrementally; each insertion of a new key into a migrating table
+** moves the entries of MIGRATESTEP old nodes. As the new vector has at
+** least twice the size of the old one, it has room for all entries
+** moved plus all keys inserted until the end of the migration.
+*/
+#if !defined(LUAI_MIGRATEMIN)
+#define LUAI_MIGRATEMIN		(1 << 12)
+#endif
+
+#define MIGRATESTEP	16
+
+
+/*
+** Fill 'aux' as a fake table whose hash part is the old node vector of
+** table 't'.
+*/
+static Table *oldhashpart (const Table *t, Table *aux) {
+  aux->flags = 0;  /* not dummy, real array size (0) */
+  aux->alimit = 0;
+  aux->node = t->oldnode;
+  aux->lsizenode = t->oldlsizenode;
+  aux->oldnode = NULL;
+  return aux;
+}
+
+
+/*
+** Result of a search in an old node vector: an empty entry there
+** counts as absent (unless 'deadok'), so that new values for its key
+** go to the new vector.
+*/
+static const TValue *oldentry (const TValue *v, int deadok) {
+  return (isempty(v) && !deadok) ? &absentkey : v;
+}
+
+#endif
+
+
 /*
 ** "Generic" get version. (Not that generic: not valid for integers,
 ** which may be in array part, nor for floats with integral values.)
 ** See explanation about 'deadok' in function 'equalkey'.
 */
 static const TValue *getgeneric (Table *t, const TValue *key, int deadok) {
+#if !LUA_USE_SWISSHASH
   Node *n = mainpositionTV(t, key);
   for (;;) {  /* check whether 'key' is somewhere in the chain */
     if (equalkey(key, n, deadok))
       return gval(n);  /* that's it */
     else {
       int nx = gnext(n);
-      if (nx == 0)
-        return &absentkey;  /* not found */
+      if (nx == 0) break;
       n += nx;
     }
   }
+#if LUA_USE_INCREHASH
+  if (ismigrating(t)) {  /* try the old vector */
+    Table aux;
+    return oldentry(getgeneric(oldhashpart(t, &aux), key, deadok), deadok);
+  }
+#endif
+  return &absentkey;  /* not found */
+#else
+  Node *n;
+  unsigned int h = hashvalue(key);
+  searchhash(t, h, n, equalkey(key, n, deadok));
+  return &absentkey;  /* not found */
+#endif
 }
 
 
@@ -354,38 +958,72 @@ static unsigned int arrayindex (lua_Integer k) {
 }
 
 
+/* index of a key not present in a table */
+#define NOINDEX		(~0u)
+
+/* number of nodes in the hash part(s) of table 't', for traversals */
+#define travhsize(t)  \
+	(cast_uint(sizenode(t)) + (ismigrating(t) ? sizeoldnode(t) : 0u))
+
 /*
 ** returns the index of a 'key' for table traversals. First goes all
 ** elements in the array part, then elements in the hash part. The
-** beginning of a traversal is signaled by 0.
+** beginning of a traversal is signaled by 0. Returns NOINDEX if 'key'
+** is not in the table.
 */
-static unsigned findindex (lua_State *L, Table *t, TValue *key,
-                               unsigned asize) {
+static unsigned keyindex (Table *t, const TValue *key, unsigned asize) {
   unsigned int i;
   if (ttisnil(key)) return 0;  /* first iteration */
   i = ttisinteger(key) ? arrayindex(ivalue(key)) : 0;
   if (i - 1u < asize)  /* is 'key' inside array part? */
     return i;  /* yes; that's the index */
+#if LUA_USE_SHAPES
+  else if (isshaped(t) && ttisshrstring(key)) {  /* key in the shape? */
+    int k = shapeindex(t->shape, tsvalue(key));
+    if (l_unlikely(k < 0))
+      return NOINDEX;  /* key not found */
+    /* slots are numbered after hash elements */
+    return cast_uint(k + 1) + asize + travhsize(t);
+  }
+#endif
   else {
     const TValue *n = getgeneric(t, key, 1);
     if (l_unlikely(isabstkey(n)))
-      luaG_runerror(L, "invalid key to 'next'");  /* key not found */
+      return NOINDEX;  /* key not found */
     i = cast_int(nodefromval(n) - gnode(t, 0));  /* key index in hash table */
+#if LUA_USE_INCREHASH
+    if (i >= cast_uint(sizenode(t)))  /* key in the old vector? */
+      i = cast_uint(nodefromval(n) - t->oldnode) + cast_uint(sizenode(t));
+#endif
     /* hash elements are numbered after array ones */
     return (i + 1) + asize;
   }
 }
 
 
-int luaH_next (lua_State *L, Table *t, StkId key) {
-  unsigned int asize = luaH_realasize(t);
-  unsigned int i = findindex(L, t, s2v(key), asize);  /* find original key */
+static unsigned findindex (lua_State *L, Table *t, TValue *key,
+                               unsigned asize) {
+  unsigned int i = keyindex(t, key, asize);
+  if (l_unlikely(i == NOINDEX))
+    luaG_runerror(L, "invalid key to 'next'");  /* key not found */
+  return i;
+}
+
+
+/*
+** Put in 'key' and 'key + 1' the first non-empty entry of table 't'
+** from position 'i' in its traversal (array entries followed by hash
+** entries). Returns the position after that entry (which is what
+** 'findindex' returns for its key), or 0 if there are no more elements.
+*/
+static unsigned int nextfrom (lua_State *L, Table *t, unsigned int i,
+                              unsigned int asize, StkId key) {
   for (; i < asize; i++) {  /* try first array part */
-    int tag = *getArrTag(t, i);
+    int tag = arraytag(t, i);
     if (!tagisempty(tag)) {  /* a non-empty entry? */
       setivalue(s2v(key), i + 1);
       farr2val(t, i + 1, tag, s2v(key + 1));
-      return 1;
+      return i + 1;
     }
   }
   for (i -= asize; cast_int(i) < sizenode(t); i++) {  /* hash part */
@@ -393,34 +1031,125 @@ int luaH_next (lua_State *L, Table *t, StkId key) {
       Node *n = gnode(t, i);
       getnodekey(L, s2v(key), n);
       setobj2s(L, key + 1, gval(n));
-      return 1;
+      return (i + 1) + asize;
     }
   }
+#if LUA_USE_INCREHASH
+  if (ismigrating(t)) {
+    unsigned int hsize = cast_uint(sizenode(t));
+    for (i -= hsize; i < sizeoldnode(t); i++) {  /* old hash part */
+      Node *n = &t->oldnode[i];
+      if (!isempty(gval(n))) {  /* a non-empty entry? */
+        getnodekey(L, s2v(key), n);
+        setobj2s(L, key + 1, gval(n));
+        return (i + 1) + asize + hsize;
+      }
+    }
+    i += hsize;
+  }
+#endif
+#if LUA_USE_SHAPES
+  if (isshaped(t)) {
+    unsigned int hsize = travhsize(t);
+    for (i -= hsize; i < t->shape->nkeys; i++) {  /* slots */
+      if (!isempty(&t->slots[i])) {  /* a non-empty entry? */
+        setsvalue2s(L, key, t->shape->keys[i]);
+        setobj2s(L, key + 1, &t->slots[i]);
+        return (i + 1) + asize + hsize;
+      }
+    }
+  }
+#endif
   return 0;  /* no more elements */
 }
 
 
-static void freehash (lua_State *L, Table *t) {
-  if (!isdummy(t)) {
-    size_t bsize = sizenode(t) * sizeof(Node);  /* 'node' size in bytes */
-    char *arr = cast_charp(t->node);
-    if (haslastfree(t)) {
-      bsize += sizeof(Limbox);
-      arr -= sizeof(Limbox);
-    }
-    luaM_freearray(L, arr, bsize);
-  }
+int luaH_next (lua_State *L, Table *t, StkId key) {
+  unsigned int asize = luaH_realasize(t);
+  unsigned int i = findindex(L, t, s2v(key), asize);  /* find original key */
+  return (nextfrom(L, t, i, asize, key) != 0);
 }
 
 
 /*
-** Check whether an integer key is in the array part. If 'alimit' is
-** not the real size of the array, the key still can be in the array
-** part.  In this case, do the "Xmilia trick" to check whether 'key-1'
-** is smaller than the real size.
-** The trick works as follow: let 'p' be the integer such that
-** '2^(p+1) >= alimit > 2^p', or '2^(p+1) > alimit-1 >= 2^p'.  That is,
-** 'p' is the highest 1-bit in 'alimit-1', and 2^(p+1) is the real size
+** Check whether 'i' is the index of 'key' for traversals of table 't'.
+*/
+static int isindex (Table *t, const TValue *key, unsigned int i,
+                    unsigned int asize) {
+  if (i == 0)
+    return ttisnil(key);
+  else if (i <= asize)  /* index in the array part? */
+    return (ttisinteger(key) && l_castS2U(ivalue(key)) == i);
+  else if (i - asize <= cast_uint(sizenode(t)))  /* in the hash part? */
+    return equalkey(key, gnode(t, i - asize - 1), 1);
+#if LUA_USE_INCREHASH
+  else if (i - asize <= travhsize(t))  /* in the old hash part? */
+    return equalkey(key, &t->oldnode[i - asize - sizenode(t) - 1], 1);
+#endif
+#if LUA_USE_SHAPES
+  else if (isshaped(t)) {  /* index in the slots? */
+    i -= asize + travhsize(t);
+    return (i <= t->shape->nkeys && ttisshrstring(key) &&
+            tsvalue(key) == t->shape->keys[i - 1]);
+  }
+#endif
+  else
+    return 0;
+}
+
+
+/*
+** Same as 'luaH_next', but trying first '*pos' as the index of 'key'
+** (usually the index returned by the previous call), which avoids
+** looking for the key in the table. Updates '*pos' with the index of
+** the new key. Returns -1, without raising errors, if 'key' is not in
+** the table.
+*/
+int luaH_nextpos (lua_State *L, Table *t, StkId key, unsigned int *pos) {
+  unsigned int asize = luaH_realasize(t);
+  unsigned int i = *pos;
+  if (!isindex(t, s2v(key), i, asize)) {  /* wrong hint? */
+    i = keyindex(t, s2v(key), asize);
+    if (i == NOINDEX)
+      return -1;
+  }
+  *pos = nextfrom(L, t, i, asize, key);
+  return (*pos != 0);
+}
+
+
+/*
+** Size in bytes of the block of the (non-dummy) hash part of table 't'.
+*/
+static size_t hashbytes (const Table *t) {
+  size_t bsize = sizenode(t) * sizeof(Node);  /* 'node' size in bytes */
+  if (haslastfree(t))
+    bsize += sizeof(Limbox);
+#if LUA_USE_SWISSHASH
+  bsize += sizectrl(cast_sizet(sizenode(t)));  /* control bytes */
+#endif
+  return bsize;
+}
+
+
+static void freehash (lua_State *L, Table *t) {
+  if (!isdummy(t)) {
+    char *arr = cast_charp(t->node);
+    if (haslastfree(t))
+      arr -= sizeof(Limbox);
+    luaM_freearray(L, arr, hashbytes(t));
+  }
+}
+
+
+/*
+** Check whether an integer key is in the array part. If 'alimit' is
+** not the real size of the array, the key still can be in the array
+** part.  In this case, do the "Xmilia trick" to check whether 'key-1'
+** is smaller than the real size.
+** The trick works as follow: let 'p' be the integer such that
+** '2^(p+1) >= alimit > 2^p', or '2^(p+1) > alimit-1 >= 2^p'.  That is,
+** 'p' is the highest 1-bit in 'alimit-1', and 2^(p+1) is the real size
 ** of the array. What we have to check becomes 'key-1 < 2^(p+1)'.  We
 ** compute '(key-1) & ~(alimit-1)', which we call 'res'; it will have
 ** the 'p' bit cleared. (It may also clear other bits smaller than 'p',
@@ -497,7 +1226,7 @@ static int countint (lua_Integer key, unsigned int *nums) {
 
 
 l_sinline int arraykeyisempty (const Table *t, lua_Integer key) {
-  int tag = *getArrTag(t, key - 1);
+  int tag = arraytag(t, key - 1);
   return tagisempty(tag);
 }
 
@@ -547,6 +1276,12 @@ static int numusehash (const Table *t, unsigned *nums, unsigned *pna) {
     }
   }
   *pna += ause;
+#if LUA_USE_INCREHASH
+  if (ismigrating(t)) {  /* count also keys still in the old vector */
+    Table aux;
+    totaluse += numusehash(oldhashpart(t, &aux), nums, pna);
+  }
+#endif
   return totaluse;
 }
 
@@ -560,6 +1295,60 @@ static size_t concretesize (unsigned int size) {
 }
 
 
+#if LUA_USE_PACKEDARRAYS
+
+/* concrete size of an array part, packed (no tags) or not */
+#define arraybytes(size,packed)  \
+	((packed) ? cast_sizet(size) * sizeof(Value) : concretesize(size))
+
+
+/*
+** Check whether the array part of table 't', with size 'asize', can be
+** packed after getting the integer keys in the hash part of 't': these
+** keys must extend the entries already packed, if any, with no holes and
+** with values of their type. Returns the new number of packed entries
+** in '*pn' and their tag in '*ptag'.
+*/
+static int packable (const Table *t, unsigned int asize,
+                     unsigned int *pn, lu_byte *ptag) {
+  unsigned int n = 0;  /* entries already packed */
+  int tag = LUA_VNIL;  /* tag of all entries (nil if not known yet) */
+  unsigned int count = 0;  /* number of keys moving to the array */
+  lua_Unsigned last = 0;  /* largest key moving to the array */
+  int i;
+  if (ispacked(t)) {
+    n = (t->npacked < asize) ? t->npacked : asize;
+    if (n > 0)
+      tag = t->packtag;
+  }
+  for (i = 0; i < sizenode(t); i++) {
+    Node *nd = gnode(t, i);
+    if (!isempty(gval(nd)) && keyisinteger(nd) &&
+        l_castS2U(keyival(nd)) - 1u < asize) {  /* going to the array? */
+      int vtag = ttypetag(gval(nd));
+      if (tag == LUA_VNIL && (vtag == LUA_VNUMINT || vtag == LUA_VNUMFLT))
+        tag = vtag;  /* first value sets the type */
+      else if (vtag != tag)
+        return 0;  /* different types */
+      count++;
+      if (l_castS2U(keyival(nd)) > last)
+        last = l_castS2U(keyival(nd));
+    }
+  }
+  if (count > 0 && last != n + count)
+    return 0;  /* keys would leave holes */
+  *pn = n + count;
+  *ptag = cast_byte((tag == LUA_VNIL) ? LUA_VNUMINT : tag);
+  return 1;
+}
+
+#else
+
+#define arraybytes(size,packed)	concretesize(size)
+
+#endif
+
+
 /*
 ** Resize the array part of a table. If new size is equal to the old,
 ** do nothing. Else, if new size is zero, free the old array. (It must
@@ -574,16 +1363,16 @@ static size_t concretesize (unsigned int size) {
 */
 static Value *resizearray (lua_State *L , Table *t,
                                unsigned oldasize,
-                               unsigned newasize) {
-  if (oldasize == newasize)
+                               unsigned newasize, int packed) {
+  if (oldasize == newasize && packed == ispacked(t))
     return t->array;  /* nothing to be done */
   else if (newasize == 0) {  /* erasing array? */
     Value *op = t->array - oldasize;  /* original array's real address */
-    luaM_freemem(L, op, concretesize(oldasize));  /* free it */
+    luaM_freemem(L, op, arraybytes(oldasize, ispacked(t)));  /* free it */
     return NULL;
   }
   else {
-    size_t newasizeb = concretesize(newasize);
+    size_t newasizeb = arraybytes(newasize, packed);
     Value *np = cast(Value *,
                   luaM_reallocvector(L, NULL, 0, newasizeb, lu_byte));
     if (np == NULL)  /* allocation error? */
@@ -592,17 +1381,41 @@ static Value *resizearray (lua_State *L , Table *t,
       Value *op = t->array - oldasize;  /* real original array */
       unsigned tomove = (oldasize < newasize) ? oldasize : newasize;
       lua_assert(tomove > 0);
-      /* move common elements to new position */
+      /* move common elements to new position (only their values, if
+         either array is packed; 'luaH_resize' takes care of tags) */
       memcpy(np + newasize - tomove,
              op + oldasize - tomove,
-             concretesize(tomove));
-      luaM_freemem(L, op, concretesize(oldasize));
+             (packed || ispacked(t)) ? tomove * sizeof(Value)
+                                     : concretesize(tomove));
+      luaM_freemem(L, op, arraybytes(oldasize, ispacked(t)));
     }
     return np + newasize;  /* shift pointer to the end of value segment */
   }
 }
 
 
+/*
+** Make all nodes of the (non-dummy) hash part of table 't' free.
+*/
+static void clearnodes (Table *t) {
+  int size = sizenode(t);
+  int i;
+#if !LUA_USE_SWISSHASH
+  if (haslastfree(t))
+    getlastfree(t) = gnode(t, size);  /* all positions are free */
+#else
+  getleft(t) = maxload(cast_uint(size));
+  memset(ctrlof(t), CTRLEMPTY, sizectrl(cast_uint(size)));
+#endif
+  for (i = 0; i < size; i++) {
+    Node *n = gnode(t, i);
+    gnext(n) = 0;
+    setnilkey(n);
+    setempty(gval(n));
+  }
+}
+
+
 /*
 ** Creates an array for the hash part of a table with the given
 ** size, or reuses the dummy node if size is zero.
@@ -617,27 +1430,32 @@ static void setnodevector (lua_State *L, Table *t, unsigned size) {
     setdummy(t);  /* signal that it is using dummy node */
   }
   else {
-    int i;
-    int lsize = luaO_ceillog2(size);
+    int lsize;
+#if LUA_USE_SWISSHASH
+    size += size / 7;  /* room for 'size' keys under 'maxload' */
+#endif
+    lsize = luaO_ceillog2(size);
     if (lsize > MAXHBITS || (1u << lsize) > MAXHSIZE)
       luaG_runerror(L, "table overflow");
     size = twoto(lsize);
+#if !LUA_USE_SWISSHASH
     if (lsize <= LIMFORLAST)  /* no 'lastfree' field? */
       t->node = luaM_newvector(L, size, Node);
     else {
       size_t bsize = size * sizeof(Node) + sizeof(Limbox);
       char *node = luaM_newblock(L, bsize);
       t->node = cast(Node *, node + sizeof(Limbox));
-      getlastfree(t) = gnode(t, size);  /* all positions are free */
     }
+#else
+    {  /* nodes plus control bytes */
+      size_t bsize = size * sizeof(Node) + sizeof(Limbox) + sizectrl(size);
+      char *node = luaM_newblock(L, bsize);
+      t->node = cast(Node *, node + sizeof(Limbox));
+    }
+#endif
     t->lsizenode = cast_byte(lsize);
     setnodummy(t);
-    for (i = 0; i < cast_int(size); i++) {
-      Node *n = gnode(t, i);
-      gnext(n) = 0;
-      setnilkey(n);
-      setempty(gval(n));
-    }
+    clearnodes(t);
   }
 }
 
@@ -689,7 +1507,7 @@ static void reinsertOldSlice (lua_State *L, Table *t, unsigned oldasize,
   unsigned i;
   t->alimit = newasize;  /* pretend array has new size... */
   for (i = newasize; i < oldasize; i++) {  /* traverse vanishing slice */
-    int tag = *getArrTag(t, i);
+    int tag = arraytag(t, i);
     if (!tagisempty(tag)) {  /* a non-empty entry? */
       TValue aux;
       farr2val(t, i + 1, tag, &aux);  /* copy entry into 'aux' */
@@ -704,6 +1522,8 @@ static void reinsertOldSlice (lua_State *L, Table *t, unsigned oldasize,
 ** Clear new slice of the array.
 */
 static void clearNewSlice (Table *t, unsigned oldasize, unsigned newasize) {
+  if (ispacked(t))
+    return;  /* entries after the packed ones are already empty */
   for (; oldasize < newasize; oldasize++)
     *getArrTag(t, oldasize) = LUA_VEMPTY;
 }
@@ -725,13 +1545,36 @@ static void clearNewSlice (Table *t, unsigned oldasize, unsigned newasize) {
 void luaH_resize (lua_State *L, Table *t, unsigned newasize,
                                           unsigned nhsize) {
   Table newt;  /* to keep the new hash part */
+#if LUA_USE_INCREHASH
+  Table oldt;  /* to keep an old vector still being migrated */
+#endif
   unsigned int oldasize = setlimittosize(t);
   Value *newarray;
+  int packed = 0;  /* true if new array will be packed */
+#if LUA_USE_PACKEDARRAYS
+  unsigned int npacked = 0;
+  lu_byte packtag = LUA_VNIL;
+#endif
   if (newasize > MAXASIZE)
     luaG_runerror(L, "table overflow");
+#if LUA_USE_PACKEDARRAYS
+  /* a new array starts packed; an unpacked one stays so */
+  if (newasize > 0 && (oldasize == 0 || ispacked(t)))
+    packed = packable(t, newasize, &npacked, &packtag);
+#endif
   /* create new hash part with appropriate size into 'newt' */
   newt.flags = 0;
   setnodevector(L, &newt, nhsize);
+#if LUA_USE_INCREHASH
+  /* entries not yet migrated go directly to the new parts */
+  oldt.flags = 0;
+  if (ismigrating(t)) {
+    oldhashpart(t, &oldt);
+    t->oldnode = NULL;  /* detach old vector (so that searches miss it) */
+  }
+  else
+    setnodevector(L, &oldt, 0);
+#endif
   if (newasize < oldasize) {  /* will array shrink? */
     /* re-insert into the new hash the elements from vanishing slice */
     exchangehashpart(t, &newt);  /* pretend table has new hash */
@@ -739,19 +1582,37 @@ void luaH_resize (lua_State *L, Table *t, unsigned newasize,
     exchangehashpart(t, &newt);  /* restore old hash (in case of errors) */
   }
   /* allocate new array */
-  newarray = resizearray(L, t, oldasize, newasize);
+  newarray = resizearray(L, t, oldasize, newasize, packed);
   if (l_unlikely(newarray == NULL && newasize > 0)) {  /* allocation failed? */
     freehash(L, &newt);  /* release new hash part */
+#if LUA_USE_INCREHASH
+    if (!isdummy(&oldt))
+      t->oldnode = oldt.node;  /* reattach old vector */
+#endif
     luaM_error(L);  /* raise error (with array unchanged) */
   }
   /* allocation ok; initialize new part of the array */
   exchangehashpart(t, &newt);  /* 't' has the new hash ('newt' has the old) */
   t->array = newarray;  /* set new array part */
+#if LUA_USE_PACKEDARRAYS
+  if (!packed && ispacked(t)) {  /* unpacking a packed array? */
+    unsigned int i;
+    for (i = 0; i < oldasize && i < newasize; i++)  /* give tags to entries */
+      *getArrTag(t, i) = (i < t->npacked) ? t->packtag : LUA_VEMPTY;
+  }
+  /* entries from the old hash part come next, with no holes */
+  t->packtag = packed ? packtag : LUA_VNIL;
+  t->npacked = npacked;
+#endif
   t->alimit = newasize;
   clearNewSlice(t, oldasize, newasize);
   /* re-insert elements from old hash part into new parts */
   reinsert(L, &newt, t);  /* 'newt' now has the old hash */
   freehash(L, &newt);  /* free old hash part */
+#if LUA_USE_INCREHASH
+  reinsert(L, &oldt, t);
+  freehash(L, &oldt);
+#endif
 }
 
 
@@ -760,11 +1621,56 @@ void luaH_resizearray (lua_State *L, Table *t, unsigned int nasize) {
   luaH_resize(L, t, nasize, nsize);
 }
 
+
+/*
+** Size a new table for 'nasize' array elements and 'nhsize' other
+** fields. (With shapes, the fields of a table small enough to use them
+** go to its slots, as they are most probably short-string keys.)
+*/
+void luaH_presize (lua_State *L, Table *t, unsigned nasize,
+                                           unsigned nhsize) {
+#if LUA_USE_SHAPES
+  if (nhsize <= MAXSHAPEKEYS && !isshaped(t) && isdummy(t)) {
+    if (nhsize > 0) {
+      resizeslots(L, t, nhsize);
+      setshape(L, t, &G(L)->shapes.root);
+    }
+    nhsize = 0;
+  }
+#endif
+  if (nasize > 0 || nhsize > 0)
+    luaH_resize(L, t, nasize, nhsize);
+}
+
+#if LUA_USE_INCREHASH
+
+/*
+** Give table 't' a new hash part with room for 'nhsize' keys, keeping
+** the current one as its old vector, to be migrated by 'migrate'.
+*/
+static void startmigration (lua_State *L, Table *t, unsigned nhsize) {
+  Table newt;  /* to keep the new hash part */
+  newt.flags = 0;
+  setnodevector(L, &newt, nhsize);
+  exchangehashpart(t, &newt);  /* 't' has the new hash ('newt' the old) */
+  lua_assert(!isdummy(&newt));
+  t->oldnode = newt.node;
+  t->oldlsizenode = newt.lsizenode;
+  t->migrated = 0;
+}
+
+#endif
+
+
 /*
+** Compute the optimal sizes for the keys of table 't' plus the extra
+** key 'ek', if not NULL: return the size for the array part and put in
+** '*pna' the number of keys that go there and in '*ptotal' the total
+** number of keys.
 ** nums[i] = number of keys 'k' where 2^(i - 1) < k <= 2^i
 */
-static void rehash (lua_State *L, Table *t, const TValue *ek) {
-  unsigned int asize;  /* optimal size for array part */
+static unsigned int optimalsizes (Table *t, const TValue *ek,
+                                  unsigned int *pna, int *ptotal) {
   unsigned int na;  /* number of keys in the array part */
   unsigned int nums[MAXABITS + 1];
   int i;
@@ -774,17 +1680,48 @@ static void rehash (lua_State *L, Table *t, const TValue *ek) {
   na = numusearray(t, nums);  /* count keys in array part */
   totaluse = na;  /* all those keys are integer keys */
   totaluse += numusehash(t, nums, &na);  /* count keys in hash part */
-  /* count extra key */
-  if (ttisinteger(ek))
-    na += countint(ivalue(ek), nums);
-  totaluse++;
+  if (ek != NULL) {  /* count extra key */
+    if (ttisinteger(ek))
+      na += countint(ivalue(ek), nums);
+    totaluse++;
+  }
+  *ptotal = totaluse;
+  *pna = na;
+  return computesizes(nums, pna);
+}
+
+
+/*
+** Resize table 't' to the optimal sizes for its keys plus the extra
+** key 'ek', if not NULL.
+*/
+static void rehash (lua_State *L, Table *t, const TValue *ek) {
+  unsigned int na;  /* number of keys in the array part */
+  int totaluse;
   /* compute new size for array part */
-  asize = computesizes(nums, &na);
+  unsigned int asize = optimalsizes(t, ek, &na, &totaluse);
+#if LUA_USE_INCREHASH
+  if (ek != NULL && asize == t->alimit && !ismigrating(t) &&
+      sizenode(t) >= LUAI_MIGRATEMIN &&
+      luaO_ceillog2(totaluse - na) > t->lsizenode) {  /* hash part grows? */
+    startmigration(L, t, totaluse - na);
+    return;
+  }
+#endif
   /* resize the table to new computed sizes */
   luaH_resize(L, t, asize, totaluse - na);
 }
 
 
+/*
+** Resize both parts of table 't' to the optimal sizes for its current
+** keys, releasing the space left by removed ones.
+*/
+void luaH_compact (lua_State *L, Table *t) {
+  rehash(L, t, NULL);
+}
+
+
 
 /*
 ** }=============================================================
@@ -798,6 +1735,31 @@ Table *luaH_new (lua_State *L) {
   t->flags = cast_byte(maskflags);  /* table has no metamethod fields */
   t->array = NULL;
   t->alimit = 0;
+  t->hbound = 0;
+#if LUA_USE_PACKEDARRAYS
+  t->packtag = LUA_VNIL;
+  t->npacked = 0;
+#endif
+#if LUA_USE_SHAPES
+  t->shape = NULL;
+  t->slots = NULL;
+#endif
+#if LUA_USE_INCREHASH
+  t->oldnode = NULL;
+#endif
+#if LUA_USE_TABLESITES
+  {  /* creation site is the innermost Lua function being run */
+    CallInfo *ci;
+    t->site = NULL;
+    for (ci = L->ci; ci != NULL; ci = ci->previous) {
+      if (isLua(ci)) {
+        t->site = ci_func(ci)->p;
+        t->sitepc = pcRel(ci->u.l.savedpc, t->site);
+        break;
+      }
+    }
+  }
+#endif
   setnodevector(L, t, 0);
   return t;
 }
@@ -809,11 +1771,233 @@ Table *luaH_new (lua_State *L) {
 void luaH_free (lua_State *L, Table *t) {
   unsigned int realsize = luaH_realasize(t);
   freehash(L, t);
-  resizearray(L, t, realsize, 0);
+#if LUA_USE_INCREHASH
+  if (ismigrating(t)) {
+    Table aux;
+    freehash(L, oldhashpart(t, &aux));
+  }
+#endif
+  resizearray(L, t, realsize, 0, 0);
+#if LUA_USE_SHAPES
+  freeslots(L, t->slots);
+  if (isshaped(t))
+    releaseshape(L, t->shape);
+#endif
   luaM_free(L, t);
 }
 
 
+/*
+** Number of bytes allocated for table 't', with its parts.
+*/
+lu_mem luaH_memsize (const Table *t) {
+  lu_mem size = sizeof(Table);
+  size += arraybytes(luaH_realasize(t), ispacked(t));
+  if (!isdummy(t))
+    size += hashbytes(t);
+#if LUA_USE_INCREHASH
+  if (ismigrating(t)) {
+    Table aux;
+    size += hashbytes(oldhashpart(t, &aux));
+  }
+#endif
+#if LUA_USE_SHAPES
+  if (t->slots != NULL)
+    size += sizeslotsblock(sizeslots(t));
+#endif
+  return size;
+}
+
+
+/*
+** Number of nodes of table 't' ('*nnodes') and how many of them are
+** in use ('*nused'). Nodes of an old vector being migrated and slots
+** of a shape count as nodes too.
+*/
+void luaH_nodeuse (const Table *t, unsigned *nnodes, unsigned *nused) {
+  unsigned int total = cast_uint(allocsizenode(t));
+  unsigned int n = 0;
+  unsigned int i;
+  for (i = 0; i < total; i++)
+    n += !isempty(gval(gnode(t, i)));
+#if LUA_USE_INCREHASH
+  if (ismigrating(t)) {
+    for (i = 0; i < sizeoldnode(t); i++)
+      n += !isempty(gval(&t->oldnode[i]));
+    total += sizeoldnode(t);
+  }
+#endif
+#if LUA_USE_SHAPES
+  if (isshaped(t)) {
+    for (i = 0; i < t->shape->nkeys; i++)
+      n += !isempty(&t->slots[i]);
+  }
+  total += sizeslots(t);
+#endif
+  *nnodes = total;
+  *nused = n;
+}
+
+
+/*
+** Remove all entries from table 't', keeping its array and hash parts
+** (and its shape, whose slots become empty) for new entries. Keys
+** are removed with their nodes, so a traversal cannot go on after
+** that.
+*/
+void luaH_clear (lua_State *L, Table *t) {
+  setlimittosize(t);
+#if LUA_USE_PACKEDARRAYS
+  t->npacked = 0;
+#endif
+  clearNewSlice(t, 0, t->alimit);
+  if (!isdummy(t))
+    clearnodes(t);
+#if LUA_USE_INCREHASH
+  if (ismigrating(t)) {  /* old vector has nothing more to move */
+    Table aux;
+    oldhashpart(t, &aux);
+    t->oldnode = NULL;
+    freehash(L, &aux);
+  }
+#endif
+#if LUA_USE_SHAPES
+  if (isshaped(t)) {
+    int i;
+    for (i = 0; i < t->shape->nkeys; i++)
+      setempty(&t->slots[i]);
+  }
+#endif
+  UNUSED(L);
+}
+
+
+/*
+** Give the hash part of 'to' a copy of the (non-dummy) hash part of
+** 'from', copying its whole block. Only fields 'node' and 'lsizenode'
+** of 'to' are set.
+*/
+static void copyhashpart (lua_State *L, Table *to, const Table *from) {
+  size_t off = haslastfree(from) ? sizeof(Limbox) : 0;
+  size_t bsize = hashbytes(from);
+  char *block = luaM_newblock(L, bsize);
+  memcpy(block, cast_charp(from->node) - off, bsize);
+  to->node = cast(Node *, block + off);
+  to->lsizenode = from->lsizenode;
+#if !LUA_USE_SWISSHASH
+  if (haslastfree(from))  /* 'lastfree' must point into the copy */
+    getlastfree(to) = gnode(to, getlastfree(from) - from->node);
+#endif
+}
+
+
+/*
+** Make the new (empty) table 't' a copy of table 'src', without its
+** metatable. As 't' gets parts with the sizes of the parts of 'src',
+** each part is copied as a block of memory, with no rehash.
+*/
+void luaH_clone (lua_State *L, Table *t, Table *src) {
+  unsigned int asize = luaH_realasize(src);
+  lua_assert(luaH_realasize(t) == 0 && isdummy(t) && !isshaped(t) &&
+             !ismigrating(t));
+  if (asize > 0) {
+    Value *np = resizearray(L, t, 0, asize, ispacked(src));
+    if (l_unlikely(np == NULL))
+      luaM_error(L);
+    memcpy(np - asize, src->array - asize,
+           arraybytes(asize, ispacked(src)));
+    t->array = np;
+    t->alimit = src->alimit;
+    if (!isrealasize(src))
+      setnorealasize(t);
+#if LUA_USE_PACKEDARRAYS
+    t->packtag = src->packtag;
+    t->npacked = src->npacked;
+#endif
+  }
+  if (!isdummy(src)) {
+    copyhashpart(L, t, src);
+    setnodummy(t);
+  }
+#if LUA_USE_INCREHASH
+  if (ismigrating(src)) {
+    Table aux, old;
+    copyhashpart(L, &old, oldhashpart(src, &aux));
+    t->migrated = src->migrated;
+    t->oldlsizenode = old.lsizenode;
+    t->oldnode = old.node;
+  }
+#endif
+#if LUA_USE_SHAPES
+  if (isshaped(src)) {
+    resizeslots(L, t, sizeslots(src));
+    memcpy(t->slots, src->slots, src->shape->nkeys * sizeof(TValue));
+    setshape(L, t, src->shape);
+  }
+#endif
+  t->hbound = src->hbound;
+  invalidateTMcache(t);  /* 't' may have metamethod fields */
+  if (isblack(t))  /* 't' was already marked (by an emergency collection)? */
+    luaC_barrierback_(L, obj2gco(t));
+}
+
+
+/*
+** Copy into table 't' all entries of table 'src' (a raw assignment for
+** each one), growing 't' at most once before the copy, to the sizes
+** needed if no key of 'src' is already in 't'. An empty 't' becomes a
+** clone of 'src'.
+*/
+void luaH_copy (lua_State *L, Table *t, Table *src) {
+  unsigned int asize = luaH_realasize(src);
+  unsigned int tasize = luaH_realasize(t);
+  unsigned int nnodes, nused, tnodes, tused;
+  unsigned int i;
+  if (t == src)
+    return;  /* nothing to copy */
+  else if (tasize == 0 && isdummy(t) && !isshaped(t)) {  /* 't' is empty? */
+    luaH_clone(L, t, src);  /* copy the parts of 'src' as blocks */
+    return;
+  }
+  luaH_nodeuse(src, &nnodes, &nused);
+  luaH_nodeuse(t, &tnodes, &tused);
+  if (asize > tasize || tused + nused > tnodes)  /* 't' must grow? */
+    luaH_resize(L, t, (asize > tasize) ? asize : tasize, tused + nused);
+  for (i = 1; i <= asize; i++) {
+    if (!arraykeyisempty(src, i)) {
+      TValue v;
+      arr2obj(src, i, &v);
+      luaH_setint(L, t, i, &v);
+    }
+  }
+  if (!isdummy(src))
+    reinsert(L, src, t);
+#if LUA_USE_INCREHASH
+  if (ismigrating(src)) {
+    Table aux;
+    reinsert(L, oldhashpart(src, &aux), t);
+  }
+#endif
+#if LUA_USE_SHAPES
+  if (isshaped(src)) {
+    int j;
+    for (j = 0; j < src->shape->nkeys; j++) {
+      if (!isempty(&src->slots[j])) {
+        TValue k;
+        setsvalue(L, &k, src->shape->keys[j]);
+        luaH_set(L, t, &k, &src->slots[j]);
+      }
+    }
+  }
+#endif
+  invalidateTMcache(t);
+  if (isblack(t))  /* 't' got values not marked yet? */
+    luaC_barrierback_(L, obj2gco(t));
+}
+
+
+#if !LUA_USE_SWISSHASH
+
 static Node *getfreepos (Table *t) {
   if (haslastfree(t)) {  /* does it have 'lastfree' information? */
     /* look for a spot before 'lastfree', updating 'lastfree' */
@@ -837,42 +2021,22 @@ static Node *getfreepos (Table *t) {
 }
 
 
-
 /*
-** Inserts a new key into a hash table; first, check whether key's main
-** position is free. If not, check whether colliding node is in its main
-** position or not: if it is not, move colliding node to an empty place
-** and put new key in its main position; otherwise (colliding node is in
-** its main position), new key goes to an empty position.
+** Find a node for a new key in the hash part of table 't'; first,
+** check whether key's main position is free. If not, check whether
+** colliding node is in its main position or not: if it is not, move
+** colliding node to an empty place and put new key in its main
+** position; otherwise (colliding node is in its main position), new
+** key goes to an empty position. Returns NULL if there is no free
+** position.
 */
-static void luaH_newkey (lua_State *L, Table *t, const TValue *key,
-                                                 TValue *value) {
-  Node *mp;
-  TValue aux;
-  if (l_unlikely(ttisnil(key)))
-    luaG_runerror(L, "table index is nil");
-  else if (ttisfloat(key)) {
-    lua_Number f = fltvalue(key);
-    lua_Integer k;
-    if (luaV_flttointeger(f, &k, F2Ieq)) {  /* does key fit in an integer? */
-      setivalue(&aux, k);
-      key = &aux;  /* insert it as an integer */
-    }
-    else if (l_unlikely(luai_numisnan(f)))
-      luaG_runerror(L, "table index is NaN");
-  }
-  if (ttisnil(value))
-    return;  /* do not insert nil values */
-  mp = mainpositionTV(t, key);
+static Node *newposition (Table *t, const TValue *key) {
+  Node *mp = mainpositionTV(t, key);
   if (!isempty(gval(mp)) || isdummy(t)) {  /* main position is taken? */
     Node *othern;
     Node *f = getfreepos(t);  /* get a free place */
-    if (f == NULL) {  /* cannot find a free place? */
-      rehash(L, t, key);  /* grow table */
-      /* whatever called 'newkey' takes care of TM cache */
-      luaH_set(L, t, key, value);  /* insert key into grown table */
-      return;
-    }
+    if (f == NULL)  /* cannot find a free place? */
+      return NULL;
     lua_assert(!isdummy(t));
     othern = mainpositionfromnode(t, mp);
     if (othern != mp) {  /* is colliding node out of its main position? */
@@ -896,46 +2060,177 @@ static void luaH_newkey (lua_State *L, Table *t, const TValue *key,
       mp = f;
     }
   }
-  setnodekey(L, mp, key);
-  luaC_barrierback(L, obj2gco(t), key);
-  lua_assert(isempty(gval(mp)));
-  setobj2t(L, gval(mp), value);
+  return mp;
 }
 
+#endif
 
-static const TValue *getintfromhash (Table *t, lua_Integer key) {
-  Node *n = hashint(t, key);
-  lua_assert(l_castS2U(key) - 1u >= luaH_realasize(t));
-  for (;;) {  /* check whether 'key' is somewhere in the chain */
-    if (keyisinteger(n) && keyival(n) == key)
-      return gval(n);  /* that's it */
-    else {
-      int nx = gnext(n);
-      if (nx == 0) break;
-      n += nx;
+
+#if LUA_USE_INCREHASH
+
+/*
+** Move the entries of the next MIGRATESTEP nodes of the old vector of
+** table 't' into its new hash part, freeing the old vector after its
+** last node. (No barriers are needed, as the entries are already in the
+** table.)
+*/
+static void migrate (lua_State *L, Table *t) {
+  Table aux;
+  unsigned int size = sizeoldnode(t);
+  unsigned int limit = t->migrated + MIGRATESTEP;
+  oldhashpart(t, &aux);
+  if (limit > size) limit = size;
+  for (; t->migrated < limit; t->migrated++) {
+    Node *old = gnode(&aux, t->migrated);
+    if (!isempty(gval(old))) {
+      TValue k;
+      Node *n;
+      getnodekey(L, &k, old);
+      n = newposition(t, &k);
+      if (n == NULL)  /* no free position? */
+        return;  /* 'luaH_newkey' will rehash the table */
+      setnodekey(L, n, &k);
+      setobj2t(L, gval(n), gval(old));
+      setempty(gval(old));  /* entry moved (key stays for traversals) */
     }
   }
-  return &absentkey;
+  if (t->migrated == size) {  /* moved all entries? */
+    t->oldnode = NULL;
+    freehash(L, &aux);
+  }
 }
 
-
-static int hashkeyisempty (Table *t, lua_Integer key) {
-  const TValue *val = getintfromhash(t, key);
-  return isempty(val);
-}
+#endif
 
 
-static int finishnodeget (const TValue *val, TValue *res) {
-  if (!ttisnil(val)) {
-    setobj(((lua_State*)NULL), res, val);
-  }
-  return ttypetag(val);
+/*
+** Check whether integer 'key' appends to an array part of table 't'
+** that looks full, in a table whose hash part is not larger than that
+** array. In that case, it is better to grow the array part than to
+** start a sequence tail in the hash part, where '#t' must search for
+** it. The array looks full when its last entry is present and the
+** border hint ('alimit') knows no border before its end; that costs
+** O(1), while checking every entry would cost O(asize) for each such
+** key. (If the array has holes after all, 'luaH_newkey' finds out when
+** counting the keys for the new sizes, and then inserts the key in the
+** hash part; as the key stays there, that happens at most once between
+** rehashes.)
+*/
+static int growsarray (Table *t, lua_Integer key) {
+  unsigned int asize = luaH_realasize(t);
+  return (asize > 0 && l_castS2U(key) == asize + 1u && !isdummy(t) &&
+          cast_uint(allocsizenode(t)) <= asize && t->alimit == asize &&
+          !arraykeyisempty(t, asize));
 }
 
 
-int luaH_getint (Table *t, lua_Integer key, TValue *res) {
-  if (keyinarray(t, key)) {
-    int tag = *getArrTag(t, key - 1);
+/*
+** Inserts a new key into a table. With chained hash parts, new keys
+** also drive the migration of a growing hash part.
+*/
+static void luaH_newkey (lua_State *L, Table *t, const TValue *key,
+                                                 TValue *value) {
+  Node *mp;
+  TValue aux;
+  if (l_unlikely(ttisnil(key)))
+    luaG_runerror(L, "table index is nil");
+  else if (ttisfloat(key)) {
+    lua_Number f = fltvalue(key);
+    lua_Integer k;
+    if (luaV_flttointeger(f, &k, F2Ieq)) {  /* does key fit in an integer? */
+      setivalue(&aux, k);
+      key = &aux;  /* insert it as an integer */
+    }
+    else if (l_unlikely(luai_numisnan(f)))
+      luaG_runerror(L, "table index is NaN");
+  }
+  if (ttisnil(value))
+    return;  /* do not insert nil values */
+  if (ttisinteger(key) && growsarray(t, ivalue(key))) {
+    unsigned int na;
+    int totaluse;
+    unsigned int asize = optimalsizes(t, key, &na, &totaluse);
+    if (asize > luaH_realasize(t)) {  /* array part grows? */
+      luaH_resize(L, t, asize, totaluse - na);
+      luaH_set(L, t, key, value);  /* insert key into grown array */
+      return;
+    }
+  }
+#if LUA_USE_SHAPES
+  if (ttisshrstring(key) && (isshaped(t) || isdummy(t))) {
+    if (addslot(L, t, tsvalue(key), value))
+      return;
+    unshape(L, t);  /* table cannot use shapes; go on with its hash part */
+  }
+#endif
+#if LUA_USE_SWISSHASH
+  mp = getfreepos(t, hashvalue(key));
+#else
+#if LUA_USE_INCREHASH
+  if (ismigrating(t))
+    migrate(L, t);
+#endif
+  mp = newposition(t, key);
+#endif
+  if (mp == NULL) {  /* no room for the new key? */
+    rehash(L, t, key);  /* grow table */
+    /* whatever called 'newkey' takes care of TM cache */
+    luaH_set(L, t, key, value);  /* insert key into grown table */
+    return;
+  }
+  setnodekey(L, mp, key);
+  luaC_barrierback(L, obj2gco(t), key);
+  lua_assert(isempty(gval(mp)));
+  setobj2t(L, gval(mp), value);
+}
+
+
+static const TValue *getintfromhash (Table *t, lua_Integer key) {
+#if LUA_USE_SWISSHASH
+  Node *n;
+  lua_assert(l_castS2U(key) - 1u >= luaH_realasize(t));
+  searchhash(t, hashintval(key), n, keyisinteger(n) && keyival(n) == key);
+  return &absentkey;  /* not found */
+#else
+  Node *n = hashint(t, key);
+  lua_assert(l_castS2U(key) - 1u >= luaH_realasize(t));
+  for (;;) {  /* check whether 'key' is somewhere in the chain */
+    if (keyisinteger(n) && keyival(n) == key)
+      return gval(n);  /* that's it */
+    else {
+      int nx = gnext(n);
+      if (nx == 0) break;
+      n += nx;
+    }
+  }
+#if LUA_USE_INCREHASH
+  if (ismigrating(t)) {  /* try the old vector */
+    Table aux;
+    return oldentry(getintfromhash(oldhashpart(t, &aux), key), 0);
+  }
+#endif
+  return &absentkey;
+#endif
+}
+
+
+static int hashkeyisempty (Table *t, lua_Integer key) {
+  const TValue *val = getintfromhash(t, key);
+  return isempty(val);
+}
+
+
+static int finishnodeget (const TValue *val, TValue *res) {
+  if (!ttisnil(val)) {
+    setobj(((lua_State*)NULL), res, val);
+  }
+  return ttypetag(val);
+}
+
+
+int luaH_getint (Table *t, lua_Integer key, TValue *res) {
+  if (keyinarray(t, key)) {
+    int tag = arraytag(t, key - 1);
     if (!tagisempty(tag))
       farr2val(t, key, tag, res);
     return tag;
@@ -945,10 +2240,14 @@ int luaH_getint (Table *t, lua_Integer key, TValue *res) {
 }
 
 
-/*
-** search function for short strings
-*/
-const TValue *luaH_Hgetshortstr (Table *t, TString *key) {
+static const TValue *getshortstrfromhash (Table *t, TString *key) {
+#if LUA_USE_SWISSHASH
+  Node *n;
+  lua_assert(key->tt == LUA_VSHRSTR);
+  searchhash(t, mixhash(key->hash), n,
+             keyisshrstr(n) && eqshrstr(keystrval(n), key));
+  return &absentkey;  /* not found */
+#else
   Node *n = hashstr(t, key);
   lua_assert(key->tt == LUA_VSHRSTR);
   for (;;) {  /* check whether 'key' is somewhere in the chain */
@@ -956,11 +2255,32 @@ const TValue *luaH_Hgetshortstr (Table *t, TString *key) {
       return gval(n);  /* that's it */
     else {
       int nx = gnext(n);
-      if (nx == 0)
-        return &absentkey;  /* not found */
+      if (nx == 0) break;
       n += nx;
     }
   }
+#if LUA_USE_INCREHASH
+  if (ismigrating(t)) {  /* try the old vector */
+    Table aux;
+    return oldentry(getshortstrfromhash(oldhashpart(t, &aux), key), 0);
+  }
+#endif
+  return &absentkey;  /* not found */
+#endif
+}
+
+
+/*
+** search function for short strings
+*/
+const TValue *luaH_Hgetshortstr (Table *t, TString *key) {
+#if LUA_USE_SHAPES
+  if (isshaped(t)) {  /* key can only be in the shape */
+    int i = shapeindex(t->shape, key);
+    return (i < 0) ? &absentkey : &t->slots[i];
+  }
+#endif
+  return getshortstrfromhash(t, key);
 }
 
 
@@ -986,7 +2306,14 @@ int luaH_getstr (Table *t, TString *key, TValue *res) {
 
 
 TString *luaH_getstrkey (Table *t, TString *key) {
-  const TValue *o = Hgetstr(t, key);
+  const TValue *o;
+#if LUA_USE_SHAPES
+  if (isshaped(t) && key->tt == LUA_VSHRSTR) {
+    int i = shapeindex(t->shape, key);
+    return (i < 0) ? NULL : t->shape->keys[i];
+  }
+#endif
+  o = Hgetstr(t, key);
   if (!isabstkey(o))  /* string already present? */
     return keystrval(nodefromval(o));  /* get saved copy */
   else
@@ -1044,9 +2371,91 @@ static int rawfinishnodeset (const TValue *slot, TValue *val) {
 }
 
 
+#if LUA_USE_PACKEDARRAYS
+
+/*
+** Store 'val' into entry 'k' (a Lua index) of the packed array part of
+** table 't', if that keeps the array packed. Returns 0 otherwise.
+*/
+static int packedset (Table *t, lua_Unsigned k, const TValue *val) {
+  int tag = ttypetag(val);
+  if (k <= t->npacked) {  /* entry is present? */
+    if (tag == t->packtag) {
+      *getArrVal(t, k - 1) = val->value_;
+      return 1;
+    }
+    else if (tagisempty(tag) && k == t->npacked) {  /* erasing last one? */
+      t->npacked--;
+      return 1;
+    }
+  }
+  else if (tagisempty(tag))  /* erasing an empty entry? */
+    return 1;  /* nothing to be done */
+  else if (k == t->npacked + 1 &&  /* appending an entry? */
+           (tag == t->packtag || (t->npacked == 0 && ttisnumber(val)))) {
+    t->packtag = cast_byte(tag);  /* (first entry can change the type) */
+    *getArrVal(t, k - 1) = val->value_;
+    t->npacked++;
+    return 1;
+  }
+  return 0;  /* array must be unpacked */
+}
+
+
+/*
+** Give the array part of table 't', which is packed, its array of
+** tags.
+*/
+static void unpackarray (lua_State *L, Table *t) {
+  unsigned int asize = luaH_realasize(t);
+  Value *op = t->array - asize;  /* real address of the array */
+  Value *np = cast(Value *, luaM_saferealloc_(L, op, arraybytes(asize, 1),
+                                                 concretesize(asize)));
+  unsigned int i;
+  t->array = np + asize;  /* tags go after the values */
+  for (i = 0; i < asize; i++)
+    *getArrTag(t, i) = (i < t->npacked) ? t->packtag : LUA_VEMPTY;
+  t->packtag = LUA_VNIL;
+}
+
+
+static int packedpset (Table *t, lua_Unsigned k, TValue *val) {
+  if (k > t->npacked && !checknoTM(t->metatable, TM_NEWINDEX))
+    return ~cast_int(k);  /* empty slot in the array part */
+  else if (packedset(t, k, val))
+    return HOK;  /* success */
+  else
+    return HUNPACK;
+}
+
+#endif
+
+
+/*
+** Set entry 'k' (a Lua index) of the array part of table 't'.
+*/
+static void arrayset (lua_State *L, Table *t, lua_Unsigned k, TValue *val) {
+#if LUA_USE_PACKEDARRAYS
+  if (ispacked(t)) {
+    if (packedset(t, k, val))
+      return;
+    unpackarray(L, t);
+  }
+#else
+  UNUSED(L);
+#endif
+  obj2arr(t, k, val);
+}
+
+
 int luaH_psetint (Table *t, lua_Integer key, TValue *val) {
   if (keyinarray(t, key)) {
-    lu_byte *tag = getArrTag(t, key - 1);
+    lu_byte *tag;
+#if LUA_USE_PACKEDARRAYS
+    if (ispacked(t))
+      return packedpset(t, l_castS2U(key), val);
+#endif
+    tag = getArrTag(t, key - 1);
     if (!tagisempty(*tag) || checknoTM(t->metatable, TM_NEWINDEX)) {
       fval2arr(t, key, tag, val);
       return HOK;  /* success */
@@ -1060,12 +2469,20 @@ int luaH_psetint (Table *t, lua_Integer key, TValue *val) {
 
 
 int luaH_psetshortstr (Table *t, TString *key, TValue *val) {
-  return finishnodeset(t, luaH_Hgetshortstr(t, key), val);
+  const TValue *slot = luaH_Hgetshortstr(t, key);
+#if LUA_USE_SHAPES
+  if (isshaped(t) && isempty(slot) && !isabstkey(slot))  /* empty slot? */
+    return cast_int(slot - t->slots) + sizenode(t) + HFIRSTNODE;
+#endif
+  return finishnodeset(t, slot, val);
 }
 
 
 int luaH_psetstr (Table *t, TString *key, TValue *val) {
-  return finishnodeset(t, Hgetstr(t, key), val);
+  if (key->tt == LUA_VSHRSTR)
+    return luaH_psetshortstr(t, key, val);
+  else
+    return finishnodeset(t, Hgetstr(t, key), val);
 }
 
 
@@ -1099,12 +2516,27 @@ void luaH_finishset (lua_State *L, Table *t, const TValue *key,
   if (hres == HNOTFOUND) {
     luaH_newkey(L, t, key, value);
   }
+#if LUA_USE_PACKEDARRAYS
+  else if (hres == HUNPACK) {  /* present key in a packed array? */
+    lua_Integer k;  /* key is an integer or a float with an integral value */
+    k = ttisinteger(key) ? ivalue(key) : cast(lua_Integer, fltvalue(key));
+    arrayset(L, t, l_castS2U(k), value);
+  }
+#endif
   else if (hres > 0) {  /* regular Node? */
-    setobj2t(L, gval(gnode(t, hres - HFIRSTNODE)), value);
+    hres -= HFIRSTNODE;
+#if LUA_USE_SHAPES
+    if (hres >= sizenode(t)) {  /* slot of a shape? */
+      lua_assert(isshaped(t) && hres - sizenode(t) < t->shape->nkeys);
+      setobj2t(L, &t->slots[hres - sizenode(t)], value);
+      return;
+    }
+#endif
+    setobj2t(L, gval(gnode(t, hres)), value);
   }
   else {  /* array entry */
     hres = ~hres;  /* real index */
-    obj2arr(t, hres, value);
+    arrayset(L, t, cast_uint(hres), value);
   }
 }
 
@@ -1126,7 +2558,7 @@ void luaH_set (lua_State *L, Table *t, const TValue *key, TValue *value) {
 */
 void luaH_setint (lua_State *L, Table *t, lua_Integer key, TValue *value) {
   if (keyinarray(t, key))
-    obj2arr(t, key, value);
+    arrayset(L, t, l_castS2U(key), value);
   else {
     int ok = rawfinishnodeset(getintfromhash(t, key), value);
     if (!ok) {
@@ -1138,6 +2570,21 @@ void luaH_setint (lua_State *L, Table *t, lua_Integer key, TValue *value) {
 }
 
 
+/*
+** Binary search for a boundary in the hash part of table 't' between
+** 'i' (zero or present) and 'j' (absent).
+*/
+static lua_Unsigned hash_binsearch (Table *t, lua_Unsigned i,
+                                              lua_Unsigned j) {
+  while (j - i > 1u) {  /* do a binary search between them */
+    lua_Unsigned m = (i + j) / 2;
+    if (hashkeyisempty(t, m)) j = m;
+    else i = m;
+  }
+  return i;
+}
+
+
 /*
 ** Try to find a boundary in the hash part of table 't'. From the
 ** caller, we know that 'j' is zero or present and that 'j + 1' is
@@ -1167,12 +2614,38 @@ static lua_Unsigned hash_search (Table *t, lua_Unsigned j) {
     }
   } while (!hashkeyisempty(t, j));  /* repeat until an absent t[j] */
   /* i < j  &&  t[i] present  &&  t[j] absent */
-  while (j - i > 1u) {  /* do a binary search between them */
-    lua_Unsigned m = (i + j) / 2;
-    if (hashkeyisempty(t, m)) j = m;
-    else i = m;
+  return hash_binsearch(t, i, j);
+}
+
+
+/*
+** Find a boundary in the hash part of table 't', knowing that 'limit'
+** is zero or present and that 'limit + 1' is present. Field 'hbound'
+** keeps the boundary found by the previous call, which is checked
+** before any search: for sequences growing (or shrinking) one element
+** at a time, it is still a boundary or is one off, and so '#t' costs
+** only a few lookups. The hint is never trusted, so the table does
+** not need to invalidate it when it changes.
+*/
+static lua_Unsigned hash_border (Table *t, unsigned int limit) {
+  lua_Unsigned h = t->hbound;
+  lua_Unsigned b;
+  if (h <= limit)  /* no useful hint? */
+    b = hash_search(t, limit);
+  else if (!hashkeyisempty(t, cast(lua_Integer, h))) {  /* 'h' present? */
+    if (hashkeyisempty(t, cast(lua_Integer, h + 1)))
+      return h;  /* hint is still a boundary */
+    else if (hashkeyisempty(t, cast(lua_Integer, h + 2)))
+      b = h + 1;  /* sequence got one more element */
+    else
+      b = hash_search(t, h);
   }
-  return i;
+  else if (!hashkeyisempty(t, cast(lua_Integer, h - 1)))
+    b = h - 1;  /* sequence lost its last element */
+  else  /* 'limit + 1' present and 'h' absent */
+    b = hash_binsearch(t, limit + 1u, h);
+  t->hbound = (b <= UINT_MAX) ? cast_uint(b) : 0;
+  return b;
 }
 
 
@@ -1214,7 +2687,7 @@ static unsigned int binsearch (Table *array, unsigned int i, unsigned int j) {
 ** (limit == 0) or its last element (the new limit) is present.
 ** In this case, must check the hash part. If there is no hash part
 ** or 'limit+1' is absent, 'limit' is a boundary.  Otherwise, call
-** 'hash_search' to find a boundary in the hash part of the table.
+** 'hash_border' to find a boundary in the hash part of the table.
 ** (In those cases, the boundary is not inside the array part, and
 ** therefore cannot be used as a new limit.)
 */
@@ -1262,17 +2735,584 @@ lua_Unsigned luaH_getn (Table *t) {
   if (isdummy(t) || hashkeyisempty(t, cast(lua_Integer, limit + 1)))
     return limit;  /* 'limit + 1' is absent */
   else  /* 'limit + 1' is also present */
-    return hash_search(t, limit);
+    return hash_border(t, limit);
+}
+
+
+
+
+/*
+** {======================================================
+** Sorting arrays of numbers or strings
+** (pattern-defeating quicksort, by Orson Peters, with the block
+**  partition of BlockQuicksort, by Edelkamp and Weiss)
+** =======================================================
+*/
+
+/*
+** The elements of an array being sorted: numbers are sorted as keys
+** ('k') that keep their order as unsigned integers; strings are sorted
+** as themselves ('s'), with the order of 'luaV_strcmp'.
+*/
+typedef union SortElem {
+  lua_Unsigned k;
+  TString *s;
+} SortElem;
+
+
+#define SIGNBIT		(~(~l_castS2U(0) >> 1))
+
+/* an order-preserving key for integer 'i', and back */
+#define int2key(i)	(l_castS2U(i) ^ SIGNBIT)
+#define key2int(k)	l_castU2S((k) ^ SIGNBIT)
+
+/*
+** An order-preserving key for the bits 'b' of a float: negative floats
+** have all bits flipped (so that larger magnitudes come first), other
+** floats only the sign bit; and back.
+*/
+#define flt2key(b)	(((b) & SIGNBIT) ? ~(b) : (b) | SIGNBIT)
+#define key2flt(k)	(((k) & SIGNBIT) ? (k) ^ SIGNBIT : ~(k))
+
+
+/* 'a < b', for strings if 'strs' is true and for number keys otherwise */
+l_sinline int sortlt (int strs, SortElem a, SortElem b) {
+  if (strs)
+    return (a.s != b.s && luaV_strcmp(a.s, b.s) < 0);
+  else
+    return (a.k < b.k);
+}
+
+#define sortswap(a,b)	{ SortElem t_ = *(a); *(a) = *(b); *(b) = t_; }
+
+/* partitions below this size are sorted by insertion */
+#define INSERTIONLIM	24
+
+/* partitions above this size choose their pivots with the ninther */
+#define NINTHERLIM	128
+
+/* number of elements in each block of the block partition */
+#define SORTBLOCK	64
+
+/* limit of moves for a partial insertion sort to give up */
+#define PARTIALLIM	8
+
+
+static void insertionsort (SortElem *b, SortElem *e, int strs) {
+  SortElem *cur;
+  for (cur = b + 1; cur < e; cur++) {
+    SortElem *sift = cur;
+    if (sortlt(strs, *sift, *(sift - 1))) {
+      SortElem tmp = *sift;
+      do {
+        *sift = *(sift - 1);
+        sift--;
+      } while (sift != b && sortlt(strs, tmp, *(sift - 1)));
+      *sift = tmp;
+    }
+  }
+}
+
+
+/*
+** Insertion sort that gives up (returning 0) after moving more than
+** PARTIALLIM elements, to check cheaply whether a partition is already
+** sorted or nearly so.
+*/
+static int partialinsertionsort (SortElem *b, SortElem *e, int strs) {
+  size_t moves = 0;
+  SortElem *cur;
+  for (cur = b + 1; cur < e; cur++) {
+    SortElem *sift = cur;
+    if (sortlt(strs, *sift, *(sift - 1))) {
+      SortElem tmp = *sift;
+      do {
+        *sift = *(sift - 1);
+        sift--;
+      } while (sift != b && sortlt(strs, tmp, *(sift - 1)));
+      *sift = tmp;
+      moves += cast_sizet(cur - sift);
+      if (moves > PARTIALLIM)
+        return 0;
+    }
+  }
+  return 1;
+}
+
+
+/* sort the elements at 'a', 'b', and 'c' */
+static void sort3 (SortElem *a, SortElem *b, SortElem *c, int strs) {
+  if (sortlt(strs, *b, *a)) sortswap(a, b);
+  if (sortlt(strs, *c, *b)) sortswap(b, c);
+  if (sortlt(strs, *b, *a)) sortswap(a, b);
+}
+
+
+static void siftheap (SortElem *b, size_t i, size_t n, int strs) {
+  for (;;) {
+    size_t c = 2 * i + 1;  /* first child */
+    if (c >= n)
+      break;
+    if (c + 1 < n && sortlt(strs, b[c], b[c + 1]))
+      c++;  /* go to larger child */
+    if (!sortlt(strs, b[i], b[c]))
+      break;
+    sortswap(&b[i], &b[c]);
+    i = c;
+  }
+}
+
+
+/* heap sort, for when quicksort keeps getting bad partitions */
+static void heapsort (SortElem *b, SortElem *e, int strs) {
+  size_t n = cast_sizet(e - b);
+  size_t i;
+  for (i = n / 2; i > 0; i--)
+    siftheap(b, i - 1, n, strs);
+  for (i = n - 1; i > 0; i--) {
+    sortswap(&b[0], &b[i]);
+    siftheap(b, 0, i, strs);
+  }
+}
+
+
+/*
+** Partition [b, e) around the pivot '*b', putting elements equal to it
+** to its left. Used when the element before 'b' equals the pivot, so
+** that all of those are already in their final place. Returns the
+** final position of the pivot.
+*/
+static SortElem *partitionleft (SortElem *b, SortElem *e, int strs) {
+  SortElem pivot = *b;
+  SortElem *first = b;
+  SortElem *last = e;
+  while (sortlt(strs, pivot, *--last)) ;
+  if (last + 1 == e)
+    while (first < last && !sortlt(strs, pivot, *++first)) ;
+  else
+    while (!sortlt(strs, pivot, *++first)) ;
+  while (first < last) {
+    sortswap(first, last);
+    while (sortlt(strs, pivot, *--last)) ;
+    while (!sortlt(strs, pivot, *++first)) ;
+  }
+  *b = *last;
+  *last = pivot;
+  return last;
+}
+
+
+/*
+** Partition [b, e) around the pivot '*b', putting elements equal to it
+** to its right. Returns the final position of the pivot, and in
+** '*done' whether there was nothing to move.
+*/
+static SortElem *partitionright (SortElem *b, SortElem *e, int strs,
+                                 int *done) {
+  SortElem pivot = *b;
+  SortElem *first = b;
+  SortElem *last = e;
+  while (sortlt(strs, *++first, pivot)) ;
+  if (first - 1 == b)
+    while (first < last && !sortlt(strs, *--last, pivot)) ;
+  else
+    while (!sortlt(strs, *--last, pivot)) ;
+  *done = (first >= last);
+  while (first < last) {
+    sortswap(first, last);
+    while (sortlt(strs, *++first, pivot)) ;
+    while (!sortlt(strs, *--last, pivot)) ;
+  }
+  first--;  /* final position of the pivot */
+  *b = *first;
+  *first = pivot;
+  return first;
+}
+
+
+/*
+** Exchange 'n' elements misplaced at the left (at offsets 'offl' from
+** 'lbase') with as many misplaced at the right (at offsets 'offr'
+** before 'rbase'), with a cyclic permutation when there will be
+** misplaced elements left in one of the sides.
+*/
+static void swapoffsets (SortElem *lbase, SortElem *rbase,
+                         const unsigned char *offl,
+                         const unsigned char *offr, size_t n, int swaps) {
+  size_t i;
+  if (swaps) {
+    for (i = 0; i < n; i++)
+      sortswap(lbase + offl[i], rbase - offr[i]);
+  }
+  else if (n > 0) {
+    SortElem *l = lbase + offl[0];
+    SortElem *r = rbase - offr[0];
+    SortElem tmp = *l;
+    *l = *r;
+    for (i = 1; i < n; i++) {
+      l = lbase + offl[i];
+      *r = *l;
+      r = rbase - offr[i];
+      *l = *r;
+    }
+    *r = tmp;
+  }
+}
+
+
+/*
+** Same as 'partitionright', for number keys, without branches that
+** depend on the results of comparisons: each step compares a block of
+** elements at each end, recording the offsets of the misplaced ones
+** (relative to 'lbase' and 'rbase'), and then exchanges as many of
+** them as it can.
+*/
+static SortElem *partitionblocks (SortElem *b, SortElem *e, int *done) {
+  SortElem pivot = *b;
+  SortElem *first = b;
+  SortElem *last = e;
+  while ((++first)->k < pivot.k) ;
+  if (first - 1 == b)
+    while (first < last && !((--last)->k < pivot.k)) ;
+  else
+    while (!((--last)->k < pivot.k)) ;
+  *done = (first >= last);
+  if (!*done) {
+    unsigned char offl[SORTBLOCK], offr[SORTBLOCK];
+    size_t nl = 0, nr = 0, startl = 0, startr = 0;
+    SortElem *lbase, *rbase;
+    sortswap(first, last);
+    first++;
+    lbase = first; rbase = last;
+    while (first < last) {
+      size_t unknown = cast_sizet(last - first);
+      size_t lsplit = (nl == 0) ? ((nr == 0) ? unknown / 2 : unknown) : 0;
+      size_t rsplit = (nr == 0) ? unknown - lsplit : 0;
+      size_t i, n;
+      if (lsplit > SORTBLOCK) lsplit = SORTBLOCK;
+      if (rsplit > SORTBLOCK) rsplit = SORTBLOCK;
+      for (i = 0; i < lsplit; i++) {
+        offl[nl] = cast_byte(i);
+        nl += !((first++)->k < pivot.k);
+      }
+      for (i = 0; i < rsplit; ) {
+        offr[nr] = cast_byte(++i);
+        nr += ((--last)->k < pivot.k);
+      }
+      n = (nl < nr) ? nl : nr;
+      swapoffsets(lbase, rbase, offl + startl, offr + startr, n, nl == nr);
+      nl -= n; nr -= n;
+      startl += n; startr += n;
+      if (nl == 0) {
+        startl = 0;
+        lbase = first;
+      }
+      if (nr == 0) {
+        startr = 0;
+        rbase = last;
+      }
+    }
+    /* put the misplaced elements left in one side in place */
+    if (nl > 0) {
+      while (nl-- > 0) {
+        last--;
+        sortswap(lbase + offl[startl + nl], last);
+      }
+      first = last;
+    }
+    if (nr > 0) {
+      while (nr-- > 0) {
+        sortswap(rbase - offr[startr + nr], first);
+        first++;
+      }
+    }
+  }
+  first--;  /* final position of the pivot */
+  *b = *first;
+  *first = pivot;
+  return first;
 }
 
 
+/* break patterns in partition [b, b + n) with some swaps */
+static void breakpatterns (SortElem *b, size_t n, int atstart) {
+  size_t q = n / 4;
+  if (atstart) {
+    sortswap(b, b + q);
+    if (n > NINTHERLIM) {
+      sortswap(b + 1, b + q + 1);
+      sortswap(b + 2, b + q + 2);
+    }
+  }
+  else {
+    sortswap(b + n - 1, b + n - q);
+    if (n > NINTHERLIM) {
+      sortswap(b + n - 2, b + n - q - 1);
+      sortswap(b + n - 3, b + n - q - 2);
+    }
+  }
+}
+
+
+/*
+** Sort [b, e). 'bad' counts how many more unbalanced partitions are
+** allowed before switching to heap sort; 'leftmost' tells whether
+** there is no element before 'b' (which otherwise is not larger than
+** any element in the interval).
+*/
+static void pdqsort (SortElem *b, SortElem *e, int strs, int bad,
+                     int leftmost) {
+  for (;;) {
+    size_t n = cast_sizet(e - b);
+    size_t half = n / 2;
+    size_t ln, rn;
+    SortElem *p;
+    int done;
+    if (n < INSERTIONLIM) {
+      insertionsort(b, e, strs);
+      return;
+    }
+    if (n > NINTHERLIM) {  /* pivot is the ninther, moved to 'b' */
+      sort3(b, b + half, e - 1, strs);
+      sort3(b + 1, b + half - 1, e - 2, strs);
+      sort3(b + 2, b + half + 1, e - 3, strs);
+      sort3(b + half - 1, b + half, b + half + 1, strs);
+      sortswap(b, b + half);
+    }
+    else  /* pivot is the median of three, moved to 'b' */
+      sort3(b + half, b, e - 1, strs);
+    if (!leftmost && !sortlt(strs, *(b - 1), *b)) {
+      /* pivot equals the element before the interval: all elements
+         equal to it can stay at the left */
+      b = partitionleft(b, e, strs) + 1;
+      continue;
+    }
+    p = strs ? partitionright(b, e, strs, &done)
+             : partitionblocks(b, e, &done);
+    ln = cast_sizet(p - b);
+    rn = cast_sizet(e - (p + 1));
+    if (ln < n / 8 || rn < n / 8) {  /* unbalanced partition? */
+      if (--bad == 0) {
+        heapsort(b, e, strs);
+        return;
+      }
+      if (ln >= INSERTIONLIM)
+        breakpatterns(b, ln, 1), breakpatterns(b, ln, 0);
+      if (rn >= INSERTIONLIM)
+        breakpatterns(p + 1, rn, 1), breakpatterns(p + 1, rn, 0);
+    }
+    else if (done && partialinsertionsort(b, p, strs) &&
+                     partialinsertionsort(p + 1, e, strs))
+      return;  /* partitions were (nearly) sorted already */
+    pdqsort(b, p, strs, bad, leftmost);
+    b = p + 1;
+    leftmost = 0;
+  }
+}
+
+
+/*
+** Sort the elements 1..n of table 't', with the order of '<', if they
+** are all in its array part and are all integers, all floats (but no
+** NaN), or all strings. Returns 0, without touching the table,
+** otherwise.
+*/
+int luaH_sort (lua_State *L, Table *t, unsigned int n) {
+  SortElem *a;
+  int kind;  /* tag of all elements, or LUA_TSTRING */
+  int bad = 1;
+  unsigned int i;
+  TValue v;
+  if (n > luaH_realasize(t))
+    return 0;  /* some elements are not in the array part */
+  else if (n < 2)
+    return 1;
+  arr2obj(t, 1, &v);
+  kind = ttisstring(&v) ? LUA_TSTRING : ttypetag(&v);
+  if (kind == LUA_VNUMFLT && sizeof(lua_Number) != sizeof(lua_Unsigned))
+    return 0;  /* cannot use float bits as keys */
+  else if (kind != LUA_VNUMINT && kind != LUA_VNUMFLT && kind != LUA_TSTRING)
+    return 0;
+  for (i = 1; i <= n; i++) {  /* check the elements */
+    arr2obj(t, i, &v);
+    if (kind == LUA_TSTRING ? !ttisstring(&v)
+                            : ttypetag(&v) != kind ||
+                              (kind == LUA_VNUMFLT &&
+                               luai_numisnan(fltvalue(&v))))
+      return 0;
+    else if (kind == LUA_TSTRING)
+      luaS_checkview(L, tsvalue(&v));  /* 'luaV_strcmp' needs the '\0' */
+  }
+  a = luaM_newvector(L, n, SortElem);
+  for (i = 1; i <= n; i++) {
+    arr2obj(t, i, &v);
+    if (kind == LUA_VNUMINT)
+      a[i - 1].k = int2key(ivalue(&v));
+    else if (kind == LUA_VNUMFLT) {
+      lua_Number f = fltvalue(&v);
+      lua_Unsigned b;
+      memcpy(&b, &f, sizeof(b));
+      a[i - 1].k = flt2key(b);
+    }
+    else
+      a[i - 1].s = tsvalue(&v);
+  }
+  for (i = n; i > 1; i >>= 1)
+    bad++;  /* allow log2(n) bad partitions */
+  pdqsort(a, a + n, kind == LUA_TSTRING, bad, 1);
+  for (i = 1; i <= n; i++) {  /* put back the sorted elements */
+    Value *val = getArrVal(t, i - 1);
+    if (kind == LUA_VNUMINT)
+      val->i = key2int(a[i - 1].k);
+    else if (kind == LUA_VNUMFLT) {
+      lua_Unsigned b = key2flt(a[i - 1].k);
+      memcpy(&val->n, &b, sizeof(b));
+    }
+    else {  /* strings may be short or long */
+      setsvalue(L, &v, a[i - 1].s);
+      obj2arr(t, i, &v);
+    }
+  }
+  luaM_freearray(L, a, n);
+  return 1;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Heap walker: the tables taking most memory
+** =======================================================
+*/
+
+/*
+** The walker keeps the largest tables found so far in a min-heap in
+** entries [1, k] of the array part of a result table, so that it does
+** not allocate memory (and so no collection can run) while it goes
+** through the lists of objects.
+*/
+
+/* size of the table at entry 'i' of heap 'h' */
+static lu_mem heapsize (Table *h, unsigned int i) {
+  TValue v;
+  arr2obj(h, i, &v);
+  return luaH_memsize(hvalue(&v));
+}
+
+
+static void heapswap (Table *h, unsigned int i, unsigned int j) {
+  TValue vi, vj;
+  arr2obj(h, i, &vi);
+  arr2obj(h, j, &vj);
+  obj2arr(h, i, &vj);
+  obj2arr(h, j, &vi);
+}
+
+
+/* move down entry 'i' of heap 'h', with 'k' entries, to its place */
+static void siftdown (Table *h, unsigned int i, unsigned int k) {
+  for (;;) {
+    unsigned int c = 2 * i;  /* first child */
+    if (c > k)
+      break;
+    if (c < k && heapsize(h, c + 1) < heapsize(h, c))
+      c++;  /* go to smaller child */
+    if (heapsize(h, i) <= heapsize(h, c))
+      break;
+    heapswap(h, i, c);
+    i = c;
+  }
+}
+
+
+/* move up entry 'i' of heap 'h' to its place */
+static void siftup (Table *h, unsigned int i) {
+  while (i > 1 && heapsize(h, i / 2) > heapsize(h, i)) {
+    heapswap(h, i, i / 2);
+    i /= 2;
+  }
+}
+
+
+/*
+** Number of live tables in the heap.
+*/
+unsigned int luaH_numtables (lua_State *L) {
+  global_State *g = G(L);
+  GCObject *lists[3];
+  unsigned int k = 0;
+  int i;
+  lists[0] = g->allgc; lists[1] = g->finobj; lists[2] = g->tobefnz;
+  for (i = 0; i < 3; i++) {
+    GCObject *o;
+    for (o = lists[i]; o != NULL; o = o->next) {
+      if (o->tt == LUA_VTABLE && !isdead(g, o))
+        k++;
+    }
+  }
+  return k;
+}
+
+
+/*
+** Put in the array part of 'res' the (at most) 'n' tables with more
+** bytes allocated among all live tables, largest first, and return how
+** many they are. 'res' must have an array part of size at least 'n'
+** with non-empty entries and no tags packed.
+*/
+unsigned int luaH_largest (lua_State *L, Table *res, unsigned int n) {
+  global_State *g = G(L);
+  GCObject *lists[3];
+  unsigned int k = 0;  /* number of tables in the heap */
+  unsigned int i;
+  lists[0] = g->allgc; lists[1] = g->finobj; lists[2] = g->tobefnz;
+  lua_assert(luaH_realasize(res) >= n && !ispacked(res));
+  for (i = 0; i < 3; i++) {
+    GCObject *o;
+    for (o = lists[i]; o != NULL; o = o->next) {
+      if (o->tt == LUA_VTABLE && !isdead(g, o) && gco2t(o) != res) {
+        Table *t = gco2t(o);
+        TValue v;
+        sethvalue(L, &v, t);
+        if (k < n) {  /* heap not full? */
+          k++;
+          obj2arr(res, k, &v);
+          siftup(res, k);
+        }
+        else if (n > 0 && luaH_memsize(t) > heapsize(res, 1)) {
+          obj2arr(res, 1, &v);  /* replace the smallest one */
+          siftdown(res, 1, k);
+        }
+      }
+    }
+  }
+  for (i = k; i > 1; i--) {  /* sort the heap, largest tables first */
+    heapswap(res, 1, i);
+    siftdown(res, 1, i - 1);
+  }
+  for (i = k + 1; i <= n; i++)  /* clear unused entries */
+    *getArrTag(res, i - 1) = LUA_VEMPTY;
+  if (isblack(res))  /* 'res' got white tables? */
+    luaC_barrierback_(L, obj2gco(res));
+  return k;
+}
+
+/* }====================================================== */
+
+
 
 #if defined(LUA_DEBUG)
 
 /* export these functions for the test library */
 
 Node *luaH_mainposition (const Table *t, const TValue *key) {
+#if LUA_USE_SWISSHASH
+  return gnode(t, hashvalue(key) & (cast_uint(sizenode(t)) - 1));
+#else
   return mainpositionTV(t, key);
+#endif
 }
 
 #endif
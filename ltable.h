@@ -15,6 +15,20 @@
 #define gnext(n)	((n)->u.next)
 
 
+/*
+** By default, the hash part of a table is a chained scatter table; define
+** LUA_USE_SWISSHASH as 1 to use open addressing with groups of control
+** bytes instead (see 'ltable.c').
+*/
+#if !defined(LUA_USE_SWISSHASH)
+#define LUA_USE_SWISSHASH	0
+#endif
+
+#if LUA_USE_SWISSHASH && LUA_USE_INCREHASH
+#error "LUA_USE_INCREHASH needs the chained hash part"
+#endif
+
+
 /*
 ** Clear all bits of fast-access metamethods, which means that the table
 ** may have any of these metamethods. (First access that fails after the
@@ -37,6 +51,29 @@
 
 
 
+/* true if table 't' keeps its short-string keys in a shape */
+#if LUA_USE_SHAPES
+#define isshaped(t)		((t)->shape != NULL)
+#else
+#define isshaped(t)		0
+#endif
+
+
+/*
+** A table growing its hash part incrementally keeps its previous node
+** vector in 'oldnode' until all its entries move to the new one.
+*/
+#if LUA_USE_INCREHASH
+#define ismigrating(t)		((t)->oldnode != NULL)
+#define oldnodes(t)		((t)->oldnode)
+#define sizeoldnode(t)		cast_uint(twoto((t)->oldlsizenode))
+#else
+#define ismigrating(t)		0
+#define oldnodes(t)		cast(Node *, NULL)
+#define sizeoldnode(t)		0u
+#endif
+
+
 /* allocated size for hash nodes */
 #define allocsizenode(t)	(isdummy(t) ? 0 : sizenode(t))
 
@@ -49,11 +86,13 @@
 #define luaH_fastgeti(t,k,res,tag) \
   { Table *h = t; lua_Unsigned u = l_castS2U(k); \
     if ((u - 1u < h->alimit)) { \
-      tag = *getArrTag(h,(u)-1u); \
+      tag = arraytag(h,(u)-1u); \
       if (!tagisempty(tag)) { farr2val(h, u, tag, res); }} \
     else { tag = luaH_getint(h, u, res); }}
 
 
+#if !LUA_USE_PACKEDARRAYS
+
 #define luaH_fastseti(t,k,val,hres) \
   { Table *h = t; lua_Unsigned u = l_castS2U(k); \
     if ((u - 1u < h->alimit)) { \
@@ -62,12 +101,30 @@
       else { fval2arr(h, u, tag, val); hres = HOK; }} \
     else { hres = luaH_psetint(h, u, val); }}
 
+#else
+
+/* (only stores keeping the type of a packed array are done inline) */
+#define luaH_fastseti(t,k,val,hres) \
+  { Table *h = t; lua_Unsigned u = l_castS2U(k); \
+    if ((u - 1u < h->alimit)) { \
+      if (ispacked(h)) { \
+        if (u - 1u < h->npacked && ttypetag(val) == h->packtag) \
+          { *getArrVal(h,(u)-1u) = (val)->value_; hres = HOK; } \
+        else hres = luaH_psetint(h, u, val); } \
+      else { lu_byte *tag = getArrTag(h,(u)-1u); \
+      if (tagisempty(*tag)) hres = ~cast_int(u); \
+      else { fval2arr(h, u, tag, val); hres = HOK; }}} \
+    else { hres = luaH_psetint(h, u, val); }}
+
+#endif
+
 
 /* results from pset */
 #define HOK		0
 #define HNOTFOUND	1
 #define HNOTATABLE	2
-#define HFIRSTNODE	3
+#define HUNPACK		3
+#define HFIRSTNODE	4
 
 /*
 ** 'luaH_get*' operations set 'res', unless the value is absent, and
@@ -80,8 +137,12 @@
 ** value because there might be a metamethod.) If the slot is in the
 ** hash part, the encoding is (HFIRSTNODE + hash index); if the slot is
 ** in the array part, the encoding is (~array index), a negative value.
+** (The slots of a table with a shape come after its hash part, so the
+** encoding for slot 'i' is (HFIRSTNODE + size of hash part + i).)
 ** The value HNOTATABLE is used by the fast macros to signal that the
-** value being indexed is not a table.
+** value being indexed is not a table. The value HUNPACK signals a key
+** present in a packed array part that must be unpacked to get the new
+** value; as the key is present, there is no metamethod to call.
 */
 
 
@@ -110,10 +171,33 @@
 
 
 /*
-** Move TValues to/from arrays, using Lua indices
+** With LUA_USE_PACKEDARRAYS, an array part whose entries are all
+** integers or all floats may be "packed": it has no array of tags. Its
+** first 'npacked' entries have the tag 'packtag'; the others are empty.
+*/
+#if LUA_USE_PACKEDARRAYS
+
+#define ispacked(t)	((t)->packtag != LUA_VNIL)
+
+/* Gets the tag of the abstract index 'k' */
+#define arraytag(t,k)  \
+	(ispacked(t) ? ((k) < (t)->npacked ? (t)->packtag : LUA_VEMPTY)  \
+	             : *getArrTag(t,k))
+
+#else
+
+#define ispacked(t)	0
+#define arraytag(t,k)	(*getArrTag(t,k))
+
+#endif
+
+
+/*
+** Move TValues to/from arrays, using Lua indices. (Values can be
+** moved into packed arrays only by 'ltable.c'.)
 */
 #define arr2obj(h,k,val)  \
-  ((val)->tt_ = *getArrTag(h,(k)-1u), (val)->value_ = *getArrVal(h,(k)-1u))
+  ((val)->tt_ = arraytag(h,(k)-1u), (val)->value_ = *getArrVal(h,(k)-1u))
 
 #define obj2arr(h,k,val)  \
   (*getArrTag(h,(k)-1u) = (val)->tt_, *getArrVal(h,(k)-1u) = (val)->value_)
@@ -156,9 +240,23 @@ LUAI_FUNC void luaH_finishset (lua_State *L, Table *t, const TValue *key,
 LUAI_FUNC Table *luaH_new (lua_State *L);
 LUAI_FUNC void luaH_resize (lua_State *L, Table *t, unsigned nasize,
                                                     unsigned nhsize);
+LUAI_FUNC void luaH_presize (lua_State *L, Table *t, unsigned nasize,
+                                                     unsigned nhsize);
 LUAI_FUNC void luaH_resizearray (lua_State *L, Table *t, unsigned nasize);
 LUAI_FUNC void luaH_free (lua_State *L, Table *t);
+LUAI_FUNC void luaH_compact (lua_State *L, Table *t);
+LUAI_FUNC void luaH_clear (lua_State *L, Table *t);
+LUAI_FUNC void luaH_clone (lua_State *L, Table *t, Table *src);
+LUAI_FUNC void luaH_copy (lua_State *L, Table *t, Table *src);
+LUAI_FUNC int luaH_sort (lua_State *L, Table *t, unsigned int n);
+LUAI_FUNC lu_mem luaH_memsize (const Table *t);
+LUAI_FUNC void luaH_nodeuse (const Table *t, unsigned *nnodes,
+                                             unsigned *nused);
+LUAI_FUNC unsigned luaH_numtables (lua_State *L);
+LUAI_FUNC unsigned luaH_largest (lua_State *L, Table *res, unsigned n);
 LUAI_FUNC int luaH_next (lua_State *L, Table *t, StkId key);
+LUAI_FUNC int luaH_nextpos (lua_State *L, Table *t, StkId key,
+                                          unsigned int *pos);
 LUAI_FUNC lua_Unsigned luaH_getn (Table *t);
 LUAI_FUNC unsigned luaH_realasize (const Table *t);
 
@@ -68,6 +68,94 @@ static int tcreate (lua_State *L) {
 }
 
 
+static int tcompact (lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_settop(L, 1);
+  lua_compacttable(L, 1);
+  return 1;
+}
+
+
+static int tclear (lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_settop(L, 1);
+  lua_cleartable(L, 1);
+  return 1;
+}
+
+
+/*
+** Replace, in the clone at index 2 of the table at index 1, all values
+** that are tables by their clones, and so on in these clones. Each
+** table is cloned only once, so that the result keeps shared
+** subtables and cycles: 'memo' (at index 3) maps each table to its
+** clone, and 'pending' (at index 4) keeps the clones still to be
+** visited. (Keys are not cloned.)
+*/
+static void deepclone (lua_State *L) {
+  lua_Integer n = 1;  /* number of clones in 'pending' */
+  lua_settop(L, 2);
+  lua_newtable(L);  /* memo */
+  lua_pushvalue(L, 1);
+  lua_pushvalue(L, 2);
+  lua_rawset(L, 3);  /* memo[t] = clone */
+  lua_createtable(L, 1, 0);  /* pending */
+  lua_pushvalue(L, 2);
+  lua_rawseti(L, 4, 1);
+  while (n > 0) {
+    lua_rawgeti(L, 4, n);  /* clone to visit (at index 5) */
+    lua_pushnil(L);
+    lua_rawseti(L, 4, n--);
+    lua_pushnil(L);  /* first key */
+    while (lua_next(L, 5)) {  /* key at index 6, value at index 7 */
+      if (lua_type(L, 7) == LUA_TTABLE) {
+        lua_pushvalue(L, 7);
+        if (lua_rawget(L, 3) == LUA_TNIL) {  /* not cloned yet? */
+          lua_pop(L, 1);
+          lua_clonetable(L, 7);
+          if (lua_getmetatable(L, 7))
+            lua_setmetatable(L, 8);
+          lua_pushvalue(L, 7);
+          lua_pushvalue(L, 8);
+          lua_rawset(L, 3);  /* memo[value] = its clone */
+          lua_pushvalue(L, 8);
+          lua_rawseti(L, 4, ++n);  /* visit it later */
+        }
+        lua_pushvalue(L, 6);
+        lua_insert(L, -2);
+        lua_rawset(L, 5);  /* clone[key] = clone of value */
+      }
+      lua_pop(L, 1);  /* pop value */
+    }
+    lua_pop(L, 1);  /* pop visited clone */
+  }
+  lua_settop(L, 2);
+}
+
+
+static int tclone (lua_State *L) {
+  int deep = lua_toboolean(L, 2);
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_settop(L, 1);
+  lua_clonetable(L, 1);
+  if (lua_getmetatable(L, 1))
+    lua_setmetatable(L, 2);
+  if (deep)
+    deepclone(L);
+  return 1;
+}
+
+
+static int tcopyinto (lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  lua_settop(L, 2);
+  lua_copytable(L, 2, 1);
+  lua_pop(L, 1);
+  return 1;
+}
+
+
 static int tinsert (lua_State *L) {
   lua_Integer pos;  /* where to insert new element */
   lua_Integer e = aux_getn(L, 1, TAB_RW);
@@ -388,6 +476,8 @@ static int sort (lua_State *L) {
     luaL_argcheck(L, n < INT_MAX, 1, "array too big");
     if (!lua_isnoneornil(L, 2))  /* is there a 2nd argument? */
       luaL_checktype(L, 2, LUA_TFUNCTION);  /* must be a function */
+    else if (lua_sortarray(L, 1, n))  /* plain numbers or strings? */
+      return 0;  /* sorted them directly */
     lua_settop(L, 2);  /* make sure there are two arguments */
     auxsort(L, 1, (IdxT)n, 0);
   }
@@ -398,7 +488,11 @@ static int sort (lua_State *L) {
 
 
 static const luaL_Reg tab_funcs[] = {
+  {"clear", tclear},
+  {"clone", tclone},
+  {"compact", tcompact},
   {"concat", tconcat},
+  {"copyinto", tcopyinto},
   {"create", tcreate},
   {"insert", tinsert},
   {"pack", tpack},
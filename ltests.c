@@ -363,6 +363,14 @@ static void checktable (global_State *g, Table *h) {
   Node *n, *limit = gnode(h, sizenode(h));
   GCObject *hgc = obj2gco(h);
   checkobjrefN(g, hgc, h->metatable);
+#if LUA_USE_TABLESITES
+  checkobjrefN(g, hgc, h->site);
+#endif
+#if LUA_USE_PACKEDARRAYS
+  if (ispacked(h))
+    assert(asize > 0 && h->npacked <= asize &&
+           (h->packtag == LUA_VNUMINT || h->packtag == LUA_VNUMFLT));
+#endif
   for (i = 0; i < asize; i++) {
     TValue aux;
     arr2obj(h, i + 1, &aux);
@@ -377,6 +385,28 @@ static void checktable (global_State *g, Table *h) {
       checkvalref(g, hgc, gval(n));
     }
   }
+#if LUA_USE_INCREHASH
+  if (ismigrating(h)) {  /* old nodes not yet migrated */
+    assert(h->migrated < sizeoldnode(h));
+    for (i = 0; i < sizeoldnode(h); i++) {
+      n = &h->oldnode[i];
+      if (!isempty(gval(n))) {
+        TValue k;
+        getnodekey(g->mainthread, &k, n);
+        assert(i >= h->migrated && !keyisnil(n));
+        checkvalref(g, hgc, &k);
+        checkvalref(g, hgc, gval(n));
+      }
+    }
+  }
+#endif
+#if LUA_USE_SHAPES
+  if (isshaped(h)) {  /* slot keys are anchored by the shapes */
+    int j;
+    for (j = 0; j < h->shape->nkeys; j++)
+      checkvalref(g, hgc, &h->slots[j]);
+  }
+#endif
 }
 
 
@@ -392,6 +422,7 @@ static void checkudata (global_State *g, Udata *u) {
 static void checkproto (global_State *g, Proto *f) {
   int i;
   GCObject *fgc = obj2gco(f);
+  checkobjrefN(g, fgc, f->cache);
   checkobjrefN(g, fgc, f->source);
   for (i=0; i<f->sizek; i++) {
     if (iscollectable(f->k + i))
@@ -683,7 +714,7 @@ static char *buildop (Proto *p, int pc, char *buff) {
   char *obuff = buff;
   Instruction i = p->code[pc];
   OpCode o = GET_OPCODE(i);
-  const char *name = opnames[o];
+  const char *name = opnames[luaP_genericop(o)];
   int line = luaG_getfuncline(p, pc);
   int lineinfo = (p->lineinfo != NULL) ? p->lineinfo[pc] : 0;
   if (lineinfo == ABSLINEINFO)
@@ -710,6 +741,8 @@ static char *buildop (Proto *p, int pc, char *buff) {
       sprintf(buff, "%-12s%4d", name, GETARG_sJ(i));
       break;
   }
+  if (isquickop(o))  /* show quickened opcode after the generic one */
+    sprintf(buff + strlen(buff), " [%s]", opnames[o]);
   return obuff;
 }
 
@@ -741,6 +774,7 @@ static int listcode (lua_State *L) {
   lua_newtable(L);
   setnameval(L, "maxstack", p->maxstacksize);
   setnameval(L, "numparams", p->numparams);
+  setnameval(L, "removed", p->nremoved);
   for (pc=0; pc<p->sizecode; pc++) {
     char buff[100];
     lua_pushinteger(L, pc+1);
@@ -1072,6 +1106,7 @@ static int string_query (lua_State *L) {
     return 2;
   }
   else if (s < tb->size) {
+#if !LUA_USE_OPENSTRTAB
     TString *ts;
     int n = 0;
     for (ts = tb->hash[s]; ts != NULL; ts = ts->u.hnext) {
@@ -1080,6 +1115,13 @@ static int string_query (lua_State *L) {
       n++;
     }
     return n;
+#else
+    if (tb->slot[s].ts == NULL)
+      return 0;
+    setsvalue2s(L, L->top.p, tb->slot[s].ts);
+    api_incr_top(L);
+    return 1;
+#endif
   }
   else return 0;
 }
@@ -2060,6 +2102,14 @@ int luaB_opentests (lua_State *L) {
   lua_assert(f == debug_realloc && ud == cast_voidp(&l_memcontrol));
   lua_setallocf(L, f, ud);  /* exercise this function */
   luaL_newlib(L, tests_funcs);
+  lua_pushboolean(L, LUA_USE_SWISSHASH);  /* hash parts have other sizes */
+  lua_setfield(L, -2, "swisshash");
+  lua_pushboolean(L, LUA_USE_SHAPES);
+  lua_setfield(L, -2, "shapes");
+  lua_pushboolean(L, LUA_USE_PACKEDARRAYS);
+  lua_setfield(L, -2, "packedarrays");
+  lua_pushboolean(L, LUA_USE_INCREHASH);
+  lua_setfield(L, -2, "increhash");
   return 1;
 }
 
@@ -118,6 +118,7 @@ LUA_API void *debug_realloc (void *ud, void *block,
 #define LUAL_BUFFERSIZE		23
 #define MINSTRTABSIZE		2
 #define MAXIWTHABS		3
+#define LUAI_MIGRATEMIN		8
 
 #define STRCACHE_N	23
 #define STRCACHE_M	5
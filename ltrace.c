@@ -0,0 +1,385 @@
+/*
+** $Id: ltrace.c $
+** Hot-loop detection and trace recording
+** See Copyright Notice in lua.h
+*/
+
+#define ltrace_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+
+#include "lua.h"
+
+#include "ldebug.h"
+#include "ldo.h"
+#include "lmem.h"
+#include "lobject.h"
+#include "lopcodes.h"
+#include "lopnames.h"
+#include "lstate.h"
+#include "ltm.h"
+#include "ltrace.h"
+#include "lvm.h"
+
+
+#if LUA_USE_TRACE
+
+/*
+** The interpreter counts the iterations of numeric and generic 'for'
+** loops (see 'countloop' in 'lvm.c'). When a loop gets hot, the
+** recorder sets 'trap' in the frame running it and, through
+** 'luaG_traceexec', records the instructions of the next iteration of
+** the loop, together with the types of their operands. Recorded traces
+** are kept only for inspection ('lua_gettrace'); nothing uses them to
+** run code.
+*/
+
+
+static Trace *findtrace (TraceRec *tr, const Proto *p, int loop) {
+  int i;
+  for (i = 0; i < tr->ntraces; i++) {
+    Trace *t = tr->traces[i];
+    if (t->p == p && t->loop == loop)
+      return t;
+  }
+  return NULL;
+}
+
+
+/*
+** Finish the trace being recorded, if there is one.
+*/
+static void stoprecording (TraceRec *tr, int status) {
+  if (tr->cur != NULL) {
+    tr->cur->status = cast_byte(status);
+    tr->cur = NULL;
+  }
+  tr->L = NULL;
+  tr->ci = NULL;
+}
+
+
+/*
+** Called when the loop closed by the instruction at 'lpc' gets hot;
+** 'start' is the first instruction of its body. Starts recording its
+** next iteration, unless the loop already has a trace. Once the table
+** of traces is full, loops are not matched anymore (so their 'hot'
+** counts stop) and their counters are set to expire as late as possible.
+*/
+void luaR_hotloop (lua_State *L, CallInfo *ci, const Instruction *lpc,
+                                               const Instruction *start) {
+  global_State *g = G(L);
+  TraceRec *tr = g->trec;
+  const Proto *p = ci_func(ci)->p;
+  int loop = cast_int(lpc - p->code);
+  Trace *t;
+  g->hotcount[hotslot(lpc)] = LUAI_HOTLOOP;  /* restart counting */
+  if (tr == NULL) {  /* first hot loop? */
+    tr = cast(TraceRec *, luaM_realloc_(L, NULL, 0, sizeof(TraceRec)));
+    if (tr == NULL)  /* not enough memory? */
+      return;  /* give up; traces are not essential */
+    tr->L = NULL; tr->ci = NULL; tr->cur = NULL;
+    tr->ntraces = 0;
+    g->trec = tr;
+  }
+  if (tr->ntraces >= LUAI_MAXTRACES) {  /* no room for more traces? */
+    g->hotcount[hotslot(lpc)] = USHRT_MAX;  /* come back here rarely */
+    return;
+  }
+  t = findtrace(tr, p, loop);
+  if (t != NULL) {  /* loop already has a trace? */
+    t->hot++;
+    return;
+  }
+  if (tr->cur != NULL && tr->L == L && tr->ci == ci && ci->u.l.trap)
+    return;  /* already recording another loop of this frame */
+  stoprecording(tr, TR_ABORTED);  /* abandon any pending recording */
+  t = cast(Trace *, luaM_realloc_(L, NULL, 0, sizeof(Trace)));
+  if (t == NULL)  /* not enough memory? */
+    return;
+  t->p = p;
+  t->start = cast_int(start - p->code);
+  t->loop = loop;
+  t->hot = 1;
+  t->n = 0;
+  t->status = TR_RECORDING;
+  if (p->source) {
+    size_t len;
+    const char *source = getlstr(p->source, len);
+    luaO_chunkid(t->source, source, len);
+  }
+  else
+    luaO_chunkid(t->source, "=?", 2);
+  t->line = luaG_getfuncline(p, loop);
+  tr->traces[tr->ntraces++] = t;
+  tr->L = L;
+  tr->ci = ci;
+  tr->cur = t;
+  ci->u.l.trap = 1;  /* call 'luaG_traceexec' for each instruction */
+}
+
+
+/*
+** Does 'op' use its register A? Register A is an output when
+** 'testAMode' is true and an input otherwise.
+*/
+static int usesA (OpCode op) {
+  switch (op) {
+    case OP_SETTABUP: case OP_JMP: case OP_EXTRAARG:
+    case OP_VARARGPREP: case OP_RETURN0:
+      return 0;
+    default: return 1;
+  }
+}
+
+
+/*
+** Kind of operands B and C of an instruction: 'TR_RB' for a register
+** B, 'TR_RC' for a register C, and 'TR_KC' for a register-or-constant C.
+*/
+#define TR_RB	1
+#define TR_RC	2
+#define TR_KC	4
+
+static int operandsBC (OpCode op) {
+  switch (op) {
+    case OP_MOVE: case OP_GETI: case OP_GETFIELD:
+    case OP_ADDI: case OP_ADDK: case OP_SUBK: case OP_MULK: case OP_MODK:
+    case OP_POWK: case OP_DIVK: case OP_IDIVK: case OP_BANDK:
+    case OP_BORK: case OP_BXORK: case OP_SHRI: case OP_SHLI:
+    case OP_MMBIN: case OP_UNM: case OP_BNOT: case OP_NOT: case OP_LEN:
+    case OP_EQ: case OP_LT: case OP_LE: case OP_TESTSET:
+      return TR_RB;
+    case OP_GETTABLE:
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD: case OP_POW:
+    case OP_DIV: case OP_IDIV: case OP_BAND: case OP_BOR: case OP_BXOR:
+    case OP_SHL: case OP_SHR:
+      return TR_RB | TR_RC;
+    case OP_SELF: case OP_SETTABLE:
+      return TR_RB | TR_KC;
+    case OP_SETTABUP: case OP_SETI: case OP_SETFIELD:
+      return TR_KC;
+    default: return 0;
+  }
+}
+
+
+/*
+** Record the types of the input operands of instruction 'ti', which
+** is about to run in the frame with the given 'base'.
+*/
+static void settypes (const Proto *p, StkId base, TraceIns *ti) {
+  Instruction i = ti->i;
+  OpCode op = luaP_genericop(GET_OPCODE(i));
+  int bc = operandsBC(op);
+  ti->types[0] = ti->types[1] = ti->types[2] = TR_NOTYPE;
+  if (usesA(op) && !testAMode(op))
+    ti->types[0] = ttypetag(s2v(base + GETARG_A(i)));
+  if (bc & TR_RB)
+    ti->types[1] = ttypetag(s2v(base + GETARG_B(i)));
+  if (bc & TR_RC)
+    ti->types[2] = ttypetag(s2v(base + GETARG_C(i)));
+  else if (bc & TR_KC)
+    ti->types[2] = ttypetag(GETARG_k(i) ? &p->k[GETARG_C(i)]
+                                        : s2v(base + GETARG_C(i)));
+}
+
+
+/*
+** Record the type of the result of the last recorded instruction,
+** now that it has run.
+*/
+static void setresult (Trace *t, StkId base) {
+  if (t->n > 0) {
+    TraceIns *ti = &t->ins[t->n - 1];
+    OpCode op = luaP_genericop(GET_OPCODE(ti->i));
+    if (usesA(op) && testAMode(op))
+      ti->types[0] = ttypetag(s2v(base + GETARG_A(ti->i)));
+  }
+}
+
+
+static void addins (Trace *t, const Proto *p, StkId base,
+                                              const Instruction *pc) {
+  TraceIns *ti = &t->ins[t->n++];
+  ti->i = *pc;
+  ti->pc = cast_int(pc - p->code);
+  ti->line = luaG_getfuncline(p, ti->pc);
+  settypes(p, base, ti);
+}
+
+
+/*
+** Called by 'luaG_traceexec' before running the instruction at 'pc' in
+** frame 'ci'. Returns true while that frame is still being recorded
+** (so that it must keep its 'trap' on).
+*/
+int luaR_record (lua_State *L, CallInfo *ci, const Instruction *pc) {
+  TraceRec *tr = G(L)->trec;
+  Trace *t;
+  const Proto *p;
+  StkId base = ci->func.p + 1;
+  int idx;
+  OpCode op;
+  if (tr == NULL || tr->cur == NULL || tr->L != L || tr->ci != ci)
+    return 0;  /* not recording this frame */
+  t = tr->cur;
+  p = ci_func(ci)->p;
+  if (p != t->p) {  /* frame was reused by another function? */
+    stoprecording(tr, TR_ABORTED);
+    return 0;
+  }
+  setresult(t, base);
+  idx = cast_int(pc - p->code);
+  if (t->n > 0 && idx == t->start) {  /* back to the start of the loop? */
+    if (t->ins[t->n - 1].pc != t->loop) {  /* loop instr. not recorded? */
+      if (t->n == LUAI_MAXTRACELEN) {
+        stoprecording(tr, TR_TOOLONG);
+        return 0;
+      }
+      addins(t, p, base, p->code + t->loop);  /* e.g., TFORLOOP */
+    }
+    stoprecording(tr, TR_COMPLETE);
+    return 0;
+  }
+  if (idx < t->start || idx > t->loop) {  /* left the loop? */
+    stoprecording(tr, TR_LEFTLOOP);
+    return 0;
+  }
+  if (t->n == LUAI_MAXTRACELEN) {
+    stoprecording(tr, TR_TOOLONG);
+    return 0;
+  }
+  addins(t, p, base, pc);
+  op = luaP_genericop(GET_OPCODE(*pc));
+  if (op == OP_RETURN || op == OP_RETURN0 || op == OP_RETURN1 ||
+      op == OP_TAILCALL) {  /* leaving the function? */
+    stoprecording(tr, TR_LEFTFUNC);
+    return 0;
+  }
+  return 1;
+}
+
+
+/*
+** {======================================================
+** Dump of traces
+** =======================================================
+*/
+
+static const char *const statusnames[] = {
+  "recording", "complete", "left the loop", "left the function",
+  "too long", "aborted"
+};
+
+
+static const char *tagname (int tag) {
+  switch (tag) {
+    case TR_NOTYPE: return "-";
+    case LUA_VNUMINT: return "integer";
+    case LUA_VNUMFLT: return "float";
+    case LUA_VLCF: case LUA_VCCL: return "cfunction";
+    case LUA_VLIGHTUSERDATA: return "lightuserdata";
+    default: return ttypename(novariant(tag));
+  }
+}
+
+
+/*
+** Push a line describing a recorded instruction: index of the
+** instruction, line, opcode, operands, and types of operands A, B,
+** and C.
+*/
+static void pushins (lua_State *L, const TraceIns *ti) {
+  Instruction i = ti->i;
+  OpCode op = GET_OPCODE(i);
+  luaO_pushfstring(L, "\t%d\t[%d]\t%s\t", ti->pc + 1, ti->line,
+                                          opnames[op]);
+  switch (getOpMode(luaP_genericop(op))) {
+    case iABC:
+      luaO_pushfstring(L, "%d %d %d%s", GETARG_A(i), GETARG_B(i),
+                          GETARG_C(i), GETARG_k(i) ? "k" : "");
+      break;
+    case iABx:
+      luaO_pushfstring(L, "%d %d", GETARG_A(i), GETARG_Bx(i));
+      break;
+    case iAsBx:
+      luaO_pushfstring(L, "%d %d", GETARG_A(i), GETARG_sBx(i));
+      break;
+    case iAx:
+      luaO_pushfstring(L, "%d", GETARG_Ax(i));
+      break;
+    case isJ:
+      luaO_pushfstring(L, "%d", GETARG_sJ(i));
+      break;
+  }
+  luaO_pushfstring(L, "\t; %s %s %s\n", tagname(ti->types[0]),
+                      tagname(ti->types[1]), tagname(ti->types[2]));
+  luaV_concat(L, 3);
+}
+
+
+/*
+** Push a string with a dump of the 'n'-th trace (counting from 1).
+** Returns 0 (pushing nothing) if there is no such trace.
+*/
+int luaR_dump (lua_State *L, int n) {
+  TraceRec *tr = G(L)->trec;
+  const Trace *t;
+  int k;
+  if (tr == NULL || n < 1 || n > tr->ntraces)
+    return 0;
+  t = tr->traces[n - 1];
+  luaD_checkstack(L, 4);  /* space for the pieces of the dump */
+  luaO_pushfstring(L, "trace %d: loop at %s:%d (instructions %d-%d), "
+                      "hot %d, %s\n", n, t->source, t->line,
+                      t->start + 1, t->loop + 1, t->hot,
+                      statusnames[t->status]);
+  for (k = 0; k < t->n; k++) {
+    pushins(L, &t->ins[k]);
+    luaV_concat(L, 2);
+  }
+  return 1;
+}
+
+/* }====================================================== */
+
+
+/*
+** Function 'p' is being collected; its traces stay available, but
+** they cannot be matched anymore.
+*/
+void luaR_freeproto (global_State *g, const Proto *p) {
+  TraceRec *tr = g->trec;
+  if (tr != NULL) {
+    int i;
+    for (i = 0; i < tr->ntraces; i++) {
+      if (tr->traces[i]->p == p)
+        tr->traces[i]->p = NULL;
+    }
+    if (tr->cur != NULL && tr->cur->p == NULL)
+      stoprecording(tr, TR_ABORTED);
+  }
+}
+
+
+/*
+** Free all traces and the recorder, and restart all loop counters.
+*/
+void luaR_freetraces (lua_State *L) {
+  global_State *g = G(L);
+  TraceRec *tr = g->trec;
+  int i;
+  for (i = 0; i < HOTCOUNTSIZE; i++)
+    g->hotcount[i] = LUAI_HOTLOOP;
+  if (tr != NULL) {
+    for (i = 0; i < tr->ntraces; i++)
+      luaM_freemem(L, tr->traces[i], sizeof(Trace));
+    luaM_freemem(L, tr, sizeof(TraceRec));
+    g->trec = NULL;
+  }
+}
+
+#endif
@@ -0,0 +1,107 @@
+/*
+** $Id: ltrace.h $
+** Hot-loop detection and trace recording
+** See Copyright Notice in lua.h
+*/
+
+#ifndef ltrace_h
+#define ltrace_h
+
+
+#include "lobject.h"
+#include "lstate.h"
+
+
+/*
+** Define LUA_USE_TRACE as 1 to count the iterations of 'for' loops
+** and record traces of the loops that get hot.
+*/
+#if !defined(LUA_USE_TRACE)
+#define LUA_USE_TRACE	0
+#endif
+
+
+/* number of iterations after which a loop is considered hot */
+#if !defined(LUAI_HOTLOOP)
+#define LUAI_HOTLOOP	56
+#endif
+
+/* maximum number of traces kept by a state */
+#if !defined(LUAI_MAXTRACES)
+#define LUAI_MAXTRACES	64
+#endif
+
+/* maximum number of instructions in a trace */
+#if !defined(LUAI_MAXTRACELEN)
+#define LUAI_MAXTRACELEN	200
+#endif
+
+
+/*
+** Counter (in 'g->hotcount') for the loop closed by the instruction at
+** 'pc'. Counters are hashed by address, so different loops may share
+** a counter; that only makes them look hotter.
+*/
+#define hotslot(pc)	((point2uint(pc) >> 2) & (HOTCOUNTSIZE - 1))
+
+
+/* operand without a recorded type */
+#define TR_NOTYPE	0xFF
+
+
+/* recorded instruction */
+typedef struct TraceIns {
+  Instruction i;
+  int pc;  /* index of the instruction in its function */
+  int line;
+  lu_byte types[3];  /* observed types of operands A, B, and C */
+} TraceIns;
+
+
+/* states of a trace */
+enum TraceStatus {
+  TR_RECORDING,  /* still being recorded */
+  TR_COMPLETE,  /* recorded a whole iteration of the loop */
+  TR_LEFTLOOP,  /* execution left the loop before closing it */
+  TR_LEFTFUNC,  /* function returned inside the loop */
+  TR_TOOLONG,  /* iteration longer than LUAI_MAXTRACELEN */
+  TR_ABORTED  /* recording interrupted (e.g., by an error) */
+};
+
+
+typedef struct Trace {
+  const Proto *p;  /* function with the loop (NULL if collected) */
+  int start;  /* index of the first instruction of the loop body */
+  int loop;  /* index of the instruction closing the loop */
+  int hot;  /* number of times the loop got hot */
+  int n;  /* number of recorded instructions */
+  lu_byte status;
+  char source[LUA_IDSIZE];  /* 'chunkid' of the function */
+  int line;  /* line of the loop instruction */
+  TraceIns ins[LUAI_MAXTRACELEN];
+} Trace;
+
+
+/* recorder state (in 'g->trec') */
+typedef struct TraceRec {
+  lua_State *L;  /* thread being recorded */
+  CallInfo *ci;  /* frame being recorded (NULL if not recording) */
+  Trace *cur;  /* trace being recorded */
+  int ntraces;  /* number of traces in 'traces' */
+  Trace *traces[LUAI_MAXTRACES];
+} TraceRec;
+
+
+#if LUA_USE_TRACE
+
+LUAI_FUNC void luaR_hotloop (lua_State *L, CallInfo *ci,
+                             const Instruction *lpc, const Instruction *start);
+LUAI_FUNC int luaR_record (lua_State *L, CallInfo *ci,
+                                         const Instruction *pc);
+LUAI_FUNC int luaR_dump (lua_State *L, int n);
+LUAI_FUNC void luaR_freeproto (global_State *g, const Proto *p);
+LUAI_FUNC void luaR_freetraces (lua_State *L);
+
+#endif
+
+#endif
@@ -246,6 +246,8 @@ LUA_API void        (lua_pushinteger) (lua_State *L, lua_Integer n);
 LUA_API const char *(lua_pushlstring) (lua_State *L, const char *s, size_t len);
 LUA_API const char *(lua_pushextlstring) (lua_State *L,
 		const char *s, size_t len, lua_Alloc falloc, void *ud);
+LUA_API void        (lua_pushsubstring) (lua_State *L, int idx,
+                                         size_t start, size_t len);
 LUA_API const char *(lua_pushstring) (lua_State *L, const char *s);
 LUA_API const char *(lua_pushvfstring) (lua_State *L, const char *fmt,
                                                       va_list argp);
@@ -368,6 +370,26 @@ LUA_API int   (lua_error) (lua_State *L);
 
 LUA_API int   (lua_next) (lua_State *L, int idx);
 
+/* standard iterators, which generic 'for' loops can run inline */
+#define LUA_ITERNEXT	0
+#define LUA_ITERIPAIRS	1
+
+#define LUA_NUMITERS	2
+
+LUA_API void  (lua_setiterator) (lua_State *L, int what, lua_CFunction f);
+
+LUA_API void  (lua_compacttable) (lua_State *L, int idx);
+LUA_API void  (lua_cleartable) (lua_State *L, int idx);
+LUA_API void  (lua_clonetable) (lua_State *L, int idx);
+LUA_API void  (lua_copytable) (lua_State *L, int fromidx, int toidx);
+LUA_API int   (lua_sortarray) (lua_State *L, int idx, lua_Integer n);
+LUA_API size_t (lua_tablesize) (lua_State *L, int idx, unsigned *asize,
+                                unsigned *nnodes, unsigned *nused);
+LUA_API const char *(lua_tablesite) (lua_State *L, int idx, int *line);
+LUA_API unsigned (lua_largesttables) (lua_State *L, unsigned n);
+LUA_API int   (lua_stringtable) (lua_State *L, int *size, int *maxprobe,
+                                 size_t *totalprobe);
+
 LUA_API void  (lua_concat) (lua_State *L, int n);
 LUA_API void  (lua_len)    (lua_State *L, int idx);
 
@@ -483,6 +505,28 @@ LUA_API void *(lua_upvalueid) (lua_State *L, int fidx, int n);
 LUA_API void  (lua_upvaluejoin) (lua_State *L, int fidx1, int n1,
                                                int fidx2, int n2);
 
+/*
+** Statistics of internal caches
+*/
+#define LUA_CSFIELDHIT		0  /* field accesses served by inline caches */
+#define LUA_CSFIELDMISS		1  /* field accesses that missed them */
+#define LUA_CSQUICKEN		2  /* instructions quickened */
+#define LUA_CSUNQUICKEN		3  /* quickened instructions de-specialized */
+#define LUA_CSJIT		4  /* functions compiled to native code */
+#define LUA_CSITER		5  /* generic 'for' steps run inline */
+#define LUA_CSCLOSURE		6  /* closures reused from caches */
+#define LUA_CSGLOBALHIT		7  /* global accesses served by inline caches */
+#define LUA_CSGLOBALMISS	8  /* global accesses that missed them */
+
+/* number of statistics */
+#define LUA_CSN			9
+
+
+LUA_API lua_Integer (lua_cachestat) (lua_State *L, int what, int reset);
+
+LUA_API int (lua_gettrace) (lua_State *L, int n);
+LUA_API void (lua_resettraces) (lua_State *L);
+
 LUA_API void (lua_sethook) (lua_State *L, lua_Hook func, int mask, int count);
 LUA_API lua_Hook (lua_gethook) (lua_State *L);
 LUA_API int (lua_gethookmask) (lua_State *L);
@@ -502,6 +546,7 @@ struct lua_Debug {
   unsigned char nups;	/* (u) number of upvalues */
   unsigned char nparams;/* (u) number of parameters */
   char isvararg;        /* (u) */
+  int nremoved;		/* (u) instructions removed by the optimizer */
   char istailcall;	/* (t) */
   unsigned short ftransfer;   /* (r) index of first value transferred */
   unsigned short ntransfer;   /* (r) number of transferred values */
@@ -327,6 +327,7 @@ static void loadFunction (LoadState *S, Proto *f) {
     f->flag |= PF_FIXED;  /* signal that code is fixed */
   f->maxstacksize = loadByte(S);
   loadCode(S, f);
+  luaF_initicache(S->L, f);
   loadConstants(S, f);
   loadUpvalues(S, f);
   loadProtos(S, f);
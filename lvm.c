@@ -22,12 +22,14 @@
 #include "ldo.h"
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "lobject.h"
 #include "lopcodes.h"
 #include "lstate.h"
 #include "lstring.h"
 #include "ltable.h"
 #include "ltm.h"
+#include "ltrace.h"
 #include "lvm.h"
 
 
@@ -44,6 +46,40 @@
 #endif
 
 
+/*
+** Define LUA_USE_PREDECODE as 1 to run functions from pre-decoded
+** copies of their code, built the first time each function runs. A
+** pre-decoded instruction has the address of its handler and its
+** arguments already unpacked, so that dispatching it is a single
+** indirect jump. It needs jump tables and uses four times the memory
+** of the original code.
+*/
+#if !defined(LUA_USE_PREDECODE) || !LUA_USE_JUMPTABLE
+#undef LUA_USE_PREDECODE
+#define LUA_USE_PREDECODE	0
+#endif
+
+
+/*
+** By default, the interpreter quickens arithmetic and order
+** instructions into versions specialized for the types of their
+** operands. Define LUA_USE_QUICKEN as 0 to turn that off.
+*/
+#if !defined(LUA_USE_QUICKEN)
+#define LUA_USE_QUICKEN		1
+#endif
+
+
+/*
+** Number of de-specializations after which a function stops
+** quickening its instructions (to avoid rewriting instructions whose
+** operands keep changing types).
+*/
+#if !defined(MAXQUICKMISS)
+#define MAXQUICKMISS	50
+#endif
+
+
 
 /* limit for table tag-method chains (to avoid infinite loops) */
 #define MAXTAGLOOP	2000
@@ -95,6 +131,8 @@ static int l_strton (const TValue *obj, TValue *result) {
   TString *st = tsvalue(obj);
   size_t stlen;
   const char *s = getlstr(st, stlen);
+  if (isview(st))  /* no '\0' at the end? */
+    return luaO_lstr2num(s, stlen, result);
   return (luaO_str2num(s, result) == stlen + 1);
   }
 }
@@ -284,6 +322,86 @@ static int floatforloop (StkId ra) {
 }
 
 
+/*
+** Execute a step of a generic for loop, with 'nvars' variables, whose
+** iterator is the standard 'next' over a table, without calling 'next'.
+** The index of the control variable in the traversal of the table is
+** kept in the closing variable, unless that variable is in use.
+** Returns false when the step must be done by a regular call.
+*/
+static int nextstep (lua_State *L, StkId ra, int nvars) {
+  unsigned int pos = 0;
+  int more;
+  if (L->tbclist.p == ra + 2)  /* closing variable in use? */
+    return 0;
+  if (ttisinteger(s2v(ra + 2)))  /* has an index from previous step? */
+    pos = cast_uint(ivalue(s2v(ra + 2)));
+  more = luaH_nextpos(L, hvalue(s2v(ra + 1)), ra + 3, &pos);
+  if (more < 0)  /* invalid key? */
+    return 0;  /* let 'next' raise the error */
+  else if (more) {
+    setivalue(s2v(ra + 2), cast(lua_Integer, pos));
+    ra += 5;  /* skip key and value */
+    nvars -= 2;
+  }
+  else  /* no more elements */
+    ra += 3;
+  for (; nvars > 0; nvars--)
+    setnilvalue(s2v(ra++));  /* complete missing results */
+  return 1;
+}
+
+
+/*
+** Execute a step of a generic for loop, with 'nvars' variables, whose
+** iterator is the one returned by 'ipairs' over a table, reading the
+** next element directly from the table. An absent element ends the
+** loop, unless the table has an '__index' metamethod; then, as with
+** a non-integer control variable, the step must be done by a regular
+** call (which returns false).
+*/
+static int ipairsstep (lua_State *L, StkId ra, int nvars) {
+  Table *t = hvalue(s2v(ra + 1));
+  lua_Integer n;
+  int tag;
+  if (!ttisinteger(s2v(ra + 3)))  /* let 'ipairs' raise the error */
+    return 0;
+  n = intop(+, ivalue(s2v(ra + 3)), 1);
+  luaH_fastgeti(t, n, s2v(ra + 4), tag);
+  if (!tagisempty(tag)) {  /* found an element? */
+    setivalue(s2v(ra + 3), n);
+    ra += 5;  /* skip index and value */
+    nvars -= 2;
+  }
+  else if (fasttm(L, t->metatable, TM_INDEX) != NULL)
+    return 0;  /* let 'ipairs' call the metamethod */
+  else  /* end of the array */
+    ra += 3;
+  for (; nvars > 0; nvars--)
+    setnilvalue(s2v(ra++));  /* complete missing results */
+  return 1;
+}
+
+
+/*
+** Try to execute a step of a generic for loop whose iterator is one
+** of the standard iterators (see 'lua_setiterator') over a table,
+** without calling it. Returns false when the step must be done by a
+** regular call.
+*/
+static int iterstep (lua_State *L, StkId ra, int nvars) {
+  const TValue *f = s2v(ra);
+  if (!ttislcf(f) || !ttistable(s2v(ra + 1)))
+    return 0;
+  else if (fvalue(f) == G(L)->iterators[LUA_ITERIPAIRS])
+    return ipairsstep(L, ra, nvars);
+  else if (fvalue(f) == G(L)->iterators[LUA_ITERNEXT])
+    return nextstep(L, ra, nvars);
+  else
+    return 0;
+}
+
+
 /*
 ** Finish the table access 'val = t[key]' and return the tag of the result.
 */
@@ -333,7 +451,7 @@ void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
     if (hres != HNOTATABLE) {  /* is 't' a table? */
       Table *h = hvalue(t);  /* save 't' table */
       tm = fasttm(L, h->metatable, TM_NEWINDEX);  /* get metamethod */
-      if (tm == NULL) {  /* no metamethod? */
+      if (tm == NULL || hres == HUNPACK) {  /* no metamethod to call? */
         luaH_finishset(L, h, key, val, hres);  /* set new value */
         invalidateTMcache(h);
         luaC_barrierback(L, obj2gco(h), val);
@@ -367,9 +485,9 @@ void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
 ** The code is a little tricky because it allows '\0' in the strings
 ** and it uses 'strcoll' (to respect locales) for each segment
 ** of the strings. Note that segments can compare equal but still
-** have different lengths.
+** have different lengths. (So, neither string can be a view.)
 */
-static int l_strcmp (const TString *ts1, const TString *ts2) {
+int luaV_strcmp (const TString *ts1, const TString *ts2) {
   size_t rl1;  /* real length */
   const char *s1 = getlstr(ts1, rl1);
   size_t rl2;
@@ -517,8 +635,10 @@ l_sinline int LEnum (const TValue *l, const TValue *r) {
 */
 static int lessthanothers (lua_State *L, const TValue *l, const TValue *r) {
   lua_assert(!ttisnumber(l) || !ttisnumber(r));
-  if (ttisstring(l) && ttisstring(r))  /* both are strings? */
-    return l_strcmp(tsvalue(l), tsvalue(r)) < 0;
+  if (ttisstring(l) && ttisstring(r)) {  /* both are strings? */
+    luaS_checkview(L, tsvalue(l)); luaS_checkview(L, tsvalue(r));
+    return luaV_strcmp(tsvalue(l), tsvalue(r)) < 0;
+  }
   else
     return luaT_callorderTM(L, l, r, TM_LT);
 }
@@ -539,8 +659,10 @@ int luaV_lessthan (lua_State *L, const TValue *l, const TValue *r) {
 */
 static int lessequalothers (lua_State *L, const TValue *l, const TValue *r) {
   lua_assert(!ttisnumber(l) || !ttisnumber(r));
-  if (ttisstring(l) && ttisstring(r))  /* both are strings? */
-    return l_strcmp(tsvalue(l), tsvalue(r)) <= 0;
+  if (ttisstring(l) && ttisstring(r)) {  /* both are strings? */
+    luaS_checkview(L, tsvalue(l)); luaS_checkview(L, tsvalue(r));
+    return luaV_strcmp(tsvalue(l), tsvalue(r)) <= 0;
+  }
   else
     return luaT_callorderTM(L, l, r, TM_LE);
 }
@@ -803,6 +925,62 @@ static void pushclosure (lua_State *L, Proto *p, UpVal **encup, StkId base,
 }
 
 
+/*
+** Check whether the closure cached in prototype 'p' can be reused by
+** an OP_CLOSURE in a function with upvalues 'encup' and stack frame
+** 'base': that closure must capture the very same variables that a
+** new closure would capture (and so it cannot be distinguished from
+** it). Open upvalues are unique for each stack slot, so an upvalue
+** pointing to the same slot refers to the same variable.
+*/
+static LClosure *getcached (Proto *p, UpVal **encup, StkId base) {
+  LClosure *c = p->cache;
+  if (c != NULL) {  /* is there a cached closure? */
+    int nup = p->sizeupvalues;
+    Upvaldesc *uv = p->upvalues;
+    int i;
+    for (i = 0; i < nup; i++) {  /* check whether it has right upvalues */
+      TValue *v = uv[i].instack ? s2v(base + uv[i].idx)
+                                : encup[uv[i].idx]->v.p;
+      if (c->upvals[i]->v.p != v)
+        return NULL;  /* wrong upvalue; cannot reuse closure */
+    }
+  }
+  return c;
+}
+
+
+/*
+** Create or reuse a closure for prototype 'p' (see 'getcached'). A
+** new closure goes to the cache of its prototype, unless the cache
+** already missed MAXMISS times; prototypes that keep creating closures
+** over new variables (e.g., inside loops) then stop paying for the
+** checks and stop keeping their last closure alive. The cache is a
+** weak reference (see 'traverseproto'), so it uses a backward barrier:
+** a forward one would make each closure cached in an old prototype old,
+** too, in generational mode.
+*/
+static void getclosure (lua_State *L, Proto *p, UpVal **encup, StkId base,
+                        StkId ra) {
+  LClosure *ncl = getcached(p, encup, base);
+  if (ncl != NULL) {  /* reuse cached closure? */
+    setclLvalue2s(L, ra, ncl);
+    cachestat(G(L), LUA_CSCLOSURE);
+  }
+  else {
+    pushclosure(L, p, encup, base, ra);
+    if (p->cache != NULL)  /* missed the cache? */
+      p->cachemiss++;
+    if (p->cachemiss < MAXMISS) {
+      p->cache = clLvalue(s2v(ra));  /* save it for reuse */
+      luaC_objbarrierback(L, obj2gco(p), p->cache);
+    }
+    else
+      p->cache = NULL;  /* give up the cache */
+  }
+}
+
+
 /*
 ** finish execution of an opcode interrupted by a yield
 */
@@ -810,7 +988,7 @@ void luaV_finishOp (lua_State *L) {
   CallInfo *ci = L->ci;
   StkId base = ci->func.p + 1;
   Instruction inst = *(ci->u.l.savedpc - 1);  /* interrupted instruction */
-  OpCode op = GET_OPCODE(inst);
+  OpCode op = luaP_genericop(GET_OPCODE(inst));  /* may be quickened */
   switch (op) {  /* finish its execution */
     case OP_MMBIN: case OP_MMBINI: case OP_MMBINK: {
       setobjs2s(L, base + GETARG_A(*(ci->u.l.savedpc - 2)), --L->top.p);
@@ -874,6 +1052,448 @@ void luaV_finishOp (lua_State *L) {
 
 
 
+/*
+** {==================================================================
+** Inline caches for field accesses
+** ===================================================================
+*/
+
+#if LUA_USE_ICACHE
+
+/*
+** Each instruction OP_GETFIELD, OP_SETFIELD, OP_SELF, OP_GETTABUP, or
+** OP_SETTABUP has its own entry in the inline cache of its prototype
+** (see 'luaF_initicache'); for the last two, which access global
+** variables through '_ENV', the cache binds the instruction to the
+** node of the global in the '_ENV' table.
+** An entry
+** records in which node of the accessed table the key was last found
+** and, for accesses that go through an '__index' table, in which node
+** of the metatable '__index' was found and in which node of the
+** '__index' table the key was found. Before any use, the entry is
+** validated by checking that the node still holds the expected key,
+** so that entries need no invalidation: tables resized, keys removed,
+** and different tables accessed by the same instruction just cause
+** misses.
+*/
+
+/* entry for the instruction just fetched ('pc' already incremented) */
+#define icentry(p,pc)	(&(p)->icache[(p)->icmap[pcRel(pc, p)]])
+
+/* check whether node 'n' of table 'h' holds the short string 'key' */
+#define nodeslotok(h,n,key)  \
+	((n) < cast_uint(sizenode(h)) &&  \
+	 keyisshrstr(gnode(h, n)) && keystrval(gnode(h, n)) == (key))
+
+/* an index that no node vector has */
+#define NOSLOT		(~0u)
+
+/*
+** Index of the node holding the (non absent) value 'slot', or NOSLOT
+** if 'slot' is not in the node vector of 'h' (e.g., it is in the old
+** vector of a table being migrated), so that the entry never matches.
+** The range check comes first because subtracting pointers into
+** different vectors is undefined.
+*/
+l_sinline unsigned int nodeslot (Table *h, const TValue *slot) {
+  const Node *n = nodefromval(slot);
+  if (gnode(h, 0) <= n && n < gnode(h, sizenode(h)))
+    return cast_uint(n - gnode(h, 0));
+  else
+    return NOSLOT;
+}
+
+#if LUA_USE_SHAPES
+
+/*
+** Tables with shapes keep short-string keys only in their slots, so
+** for them entries record slot indices.
+*/
+#define icslotok(h,n,key)  \
+	(isshaped(h) ? ((n) < (h)->shape->nkeys && (h)->shape->keys[n] == (key))  \
+	             : nodeslotok(h,n,key))
+
+#define icslot(h,slot)  \
+	(isshaped(h) ? cast_uint((slot) - (h)->slots) : nodeslot(h,slot))
+
+/* value at index 'n' of table 'h' (already checked by 'icslotok') */
+#define icval(h,n)	(isshaped(h) ? &(h)->slots[n] : gval(gnode(h, n)))
+
+/* 'hres' encoding of index 'n' of table 'h' */
+#define ichres(h,n)  \
+	(cast_int(n) + (isshaped(h) ? sizenode(h) : 0) + HFIRSTNODE)
+
+#else
+
+#define icslotok	nodeslotok
+#define icslot		nodeslot
+#define icval(h,n)	gval(gnode(h, n))
+#define ichres(h,n)	(cast_int(n) + HFIRSTNODE)
+
+#endif
+
+
+/*
+** Get the metatable of a value (as in 'luaT_gettmbyobj').
+*/
+l_sinline Table *icgetmt (global_State *g, const TValue *o) {
+  switch (ttype(o)) {
+    case LUA_TTABLE: return hvalue(o)->metatable;
+    case LUA_TUSERDATA: return uvalue(o)->metatable;
+    default: return g->mt[ttype(o)];
+  }
+}
+
+
+/*
+** Slow path for 'icget': search the key in the table itself and then,
+** if absent, in its '__index' table (only one level, and only if it is
+** a table), refreshing the cache entry 'ic' along the way. If the value
+** is not found, return an empty tag (or LUA_VNOTABLE if 't' is not a
+** table) so that the caller can finish the access with
+** 'luaV_finishget'. 'st' is the statistic counting hits; the next one
+** counts misses.
+*/
+static int icgetmiss (lua_State *L, ICache *ic, const TValue *t,
+                      TString *key, TValue *res, int st) {
+  global_State *g = G(L);
+  Table *mt;
+  int tag;
+  const TValue *slot;
+  if (ttistable(t)) {
+    Table *h = hvalue(t);
+    slot = luaH_Hgetshortstr(h, key);
+    if (!isabstkey(slot)) {  /* key present in the table? */
+      ic->slot = icslot(h, slot);
+      if (!isempty(slot)) {
+        cachestat(g, st + 1);
+        setobj(L, res, slot);
+        return ttypetag(slot);
+      }
+    }
+    mt = h->metatable;
+    tag = LUA_VABSTKEY;
+  }
+  else {
+    mt = icgetmt(g, t);
+    tag = LUA_VNOTABLE;
+  }
+  if (mt != NULL) {  /* try an '__index' table */
+    const TValue *tm;
+    TString *iname = g->tmname[TM_INDEX];
+    int hit = icslotok(mt, ic->mtslot, iname);
+    if (hit)
+      tm = icval(mt, ic->mtslot);
+    else {
+      tm = fasttm(L, mt, TM_INDEX);
+      if (tm != NULL)
+        ic->mtslot = icslot(mt, tm);
+    }
+    if (tm != NULL && ttistable(tm)) {
+      Table *idx = hvalue(tm);
+      if (icslotok(idx, ic->islot, key))
+        slot = icval(idx, ic->islot);
+      else {
+        hit = 0;
+        slot = luaH_Hgetshortstr(idx, key);
+        if (!isabstkey(slot))
+          ic->islot = icslot(idx, slot);
+      }
+      if (!isempty(slot)) {
+        cachestat(g, hit ? st : st + 1);
+        setobj(L, res, slot);
+        return ttypetag(slot);
+      }
+    }
+  }
+  cachestat(g, st + 1);
+  return tag;  /* let 'luaV_finishget' handle this access */
+}
+
+
+/*
+** Get 't[key]', for a short string 'key', using the cache entry 'ic'.
+** The fast path handles keys present in the table itself at the
+** cached node.
+*/
+l_sinline int icget (lua_State *L, ICache *ic, const TValue *t,
+                     TString *key, TValue *res, int st) {
+  if (ttistable(t)) {
+    Table *h = hvalue(t);
+    if (icslotok(h, ic->slot, key)) {
+      const TValue *slot = icval(h, ic->slot);
+      if (!isempty(slot)) {
+        cachestat(G(L), st);
+        setobj(L, res, slot);
+        return ttypetag(slot);
+      }
+    }
+  }
+  return icgetmiss(L, ic, t, key, res, st);
+}
+
+
+/*
+** "Pre-set" 't[key] = val', for a table 't' and a short string 'key',
+** using the cache entry 'ic'. Return values are like those of
+** 'luaH_psetshortstr'.
+*/
+l_sinline int icpset (lua_State *L, ICache *ic, Table *h, TString *key,
+                      TValue *val, int st) {
+  const TValue *slot;
+  if (icslotok(h, ic->slot, key)) {
+    slot = icval(h, ic->slot);
+    if (!isempty(slot)) {
+      cachestat(G(L), st);
+      setobj(L, cast(TValue *, slot), val);
+      return HOK;
+    }
+  }
+  cachestat(G(L), st + 1);
+  slot = luaH_Hgetshortstr(h, key);
+  if (isabstkey(slot))
+    return HNOTFOUND;  /* no slot with that key */
+  ic->slot = icslot(h, slot);
+  if (!isempty(slot)) {
+    setobj(L, cast(TValue *, slot), val);
+    return HOK;
+  }
+  else {  /* return node encoded */
+    lua_assert(ic->slot != NOSLOT);  /* old vectors have no empty slots */
+    return ichres(h, ic->slot);
+  }
+}
+
+
+#define fieldget(L,p,pc,t,k,res,tag)  \
+	(tag = icget(L, icentry(p, pc), t, k, res, LUA_CSFIELDHIT))
+
+#define fieldset(L,p,pc,t,k,val,hres)  \
+	(hres = (!ttistable(t) ? HNOTATABLE  \
+       : icpset(L, icentry(p, pc), hvalue(t), k, val, LUA_CSFIELDHIT)))
+
+
+/*
+** Accesses to global variables. Code loaded in place from a fixed
+** buffer does not use caches for them: a chunk made mostly of global
+** accesses would need a cache entry for most of its instructions,
+** while such code is expected to use as little memory as possible.
+*/
+l_sinline int globalget_ (lua_State *L, Proto *p, const Instruction *pc,
+                          const TValue *t, TString *key, TValue *res) {
+  if (l_unlikely(p->flag & PF_FIXED)) {  /* no caches? */
+    int tag;
+    luaV_fastget(t, key, res, luaH_getshortstr, tag);
+    return tag;
+  }
+  return icget(L, icentry(p, pc), t, key, res, LUA_CSGLOBALHIT);
+}
+
+
+l_sinline int globalset_ (lua_State *L, Proto *p, const Instruction *pc,
+                          const TValue *t, TString *key, TValue *val) {
+  int hres;
+  if (l_unlikely(p->flag & PF_FIXED))  /* no caches? */
+    luaV_fastset(t, key, val, hres, luaH_psetshortstr);
+  else if (!ttistable(t))
+    hres = HNOTATABLE;
+  else
+    hres = icpset(L, icentry(p, pc), hvalue(t), key, val, LUA_CSGLOBALHIT);
+  return hres;
+}
+
+#define globalget(L,p,pc,t,k,res,tag)  \
+	(tag = globalget_(L, p, pc, t, k, res))
+
+#define globalset(L,p,pc,t,k,val,hres)  \
+	(hres = globalset_(L, p, pc, t, k, val))
+
+#else
+
+#define fieldget(L,p,pc,t,k,res,tag)  \
+	luaV_fastget(t, k, res, luaH_getshortstr, tag)
+
+#define fieldset(L,p,pc,t,k,val,hres)  \
+	luaV_fastset(t, k, val, hres, luaH_psetshortstr)
+
+#define globalget	fieldget
+#define globalset	fieldset
+
+#endif
+
+/* }================================================================== */
+
+
+/*
+** {==================================================================
+** Pre-decoded dispatch
+** ===================================================================
+*/
+
+#if LUA_USE_PREDECODE
+
+/* fill a pre-decoded instruction */
+static void decodeins (DecodedIns *d, Instruction i,
+                       const void *const *disptab) {
+  d->op = disptab[GET_OPCODE(i)];
+  d->i = i;
+  d->a = cast_byte(GETARG_A(i));
+  d->b = cast_byte(GETARG_B(i));
+  d->c = cast_byte(GETARG_C(i));
+}
+
+
+/* build the pre-decoded copy of the code of a function */
+static void predecode (lua_State *L, Proto *p,
+                       const void *const *disptab) {
+  int pc;
+  DecodedIns *dcode = luaM_newvector(L, p->sizecode, DecodedIns);
+  for (pc = 0; pc < p->sizecode; pc++)
+    decodeins(&dcode[pc], p->code[pc], disptab);
+  p->dcode = dcode;
+}
+
+
+/*
+** Update the pre-decoded copy of the instruction being executed after
+** it was rewritten.
+*/
+#define redecode(p)  \
+  { if ((p)->dcode != NULL) { int pc_ = pcRel(pc, p);  \
+      decodeins(&(p)->dcode[pc_], (p)->code[pc_], disptab); }}
+
+#else
+
+#define redecode(p)	((void)0)
+
+#endif
+
+/* }================================================================== */
+
+
+/*
+** {==================================================================
+** Quickening of arithmetic and order instructions
+** ===================================================================
+*/
+
+#if LUA_USE_QUICKEN
+
+/*
+** Rewrite the instruction being executed into its specialized version
+** 'op', unless the code of the function cannot (or should not) change.
+*/
+#define quicken(L,op)  \
+  { Proto *p_ = cl->p;  \
+    if (!(p_->flag & (PF_FIXED | PF_NOQUICK))) {  \
+      SET_OPCODE(p_->code[pcRel(pc, p_)], op);  \
+      redecode(p_);  \
+      cachestat(G(L), LUA_CSQUICKEN);  \
+    } }
+
+#else
+
+#define quicken(L,op)	((void)0)
+
+#endif
+
+
+/*
+** Rewrite a quickened instruction whose operands do not have the
+** expected types back into its generic form. After too many of these
+** de-specializations, the function stops quickening its code.
+*/
+static void unquicken (lua_State *L, Proto *p, const Instruction *pc) {
+  Instruction *inst = &p->code[pcRel(pc, p)];
+  lua_assert(isquickop(GET_OPCODE(*inst)));
+  if (!(p->flag & PF_FIXED)) {  /* (fixed code is never quickened) */
+    SET_OPCODE(*inst, luaP_genericop(GET_OPCODE(*inst)));
+    if (++p->quickmiss >= MAXQUICKMISS)
+      p->flag |= PF_NOQUICK;
+    cachestat(G(L), LUA_CSUNQUICKEN);
+  }
+}
+
+
+/*
+** De-specialize the instruction being executed and go on running it
+** at label 'l', in its generic opcode.
+*/
+#define despecialize(l)  \
+  { unquicken(L, cl->p, pc); redecode(cl->p); goto l; }
+
+
+/*
+** Quickened arithmetic operations over integers, with register
+** operands ('op_arithII') or K operands ('op_arithKI'). If the operands
+** do not have the expected types, the instruction is de-specialized
+** and execution continues at label 'l', in the generic opcode.
+*/
+#define op_arithII(L,iop,l) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  if (l_likely(ttisinteger(v1) && ttisinteger(v2))) {  \
+    StkId ra = RA(i);  \
+    pc++; setivalue(s2v(ra), iop(L, ivalue(v1), ivalue(v2)));  \
+  }  \
+  else despecialize(l)}
+
+#define op_arithKI(L,iop,l) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = KC(i); lua_assert(ttisinteger(v2));  \
+  if (l_likely(ttisinteger(v1))) {  \
+    StkId ra = RA(i);  \
+    pc++; setivalue(s2v(ra), iop(L, ivalue(v1), ivalue(v2)));  \
+  }  \
+  else despecialize(l)}
+
+
+/*
+** Quickened arithmetic operations over floats.
+*/
+#define op_arithFF(L,fop,l) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  if (l_likely(ttisfloat(v1) && ttisfloat(v2))) {  \
+    StkId ra = RA(i);  \
+    pc++; setfltvalue(s2v(ra), fop(L, fltvalue(v1), fltvalue(v2)));  \
+  }  \
+  else despecialize(l)}
+
+#define op_arithKF(L,fop,l) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = KC(i); lua_assert(ttisnumber(v2));  \
+  if (l_likely(ttisfloat(v1))) {  \
+    StkId ra = RA(i);  \
+    pc++; setfltvalue(s2v(ra), fop(L, fltvalue(v1), nvalue(v2)));  \
+  }  \
+  else despecialize(l)}
+
+
+/*
+** Quickened order operations over integers and over floats.
+*/
+#define op_orderII(L,opi,l) {  \
+  StkId ra = RA(i);  \
+  TValue *rb = vRB(i);  \
+  if (l_likely(ttisinteger(s2v(ra)) && ttisinteger(rb))) {  \
+    int cond = opi(ivalue(s2v(ra)), ivalue(rb));  \
+    docondjump();  \
+  }  \
+  else despecialize(l)}
+
+#define op_orderFF(L,opf,l) {  \
+  StkId ra = RA(i);  \
+  TValue *rb = vRB(i);  \
+  if (l_likely(ttisfloat(s2v(ra)) && ttisfloat(rb))) {  \
+    int cond = opf(fltvalue(s2v(ra)), fltvalue(rb));  \
+    docondjump();  \
+  }  \
+  else despecialize(l)}
+
+/* }================================================================== */
+
+
 /*
 ** {==================================================================
 ** Macros for arithmetic/bitwise/comparison opcodes in 'luaV_execute'
@@ -903,11 +1523,13 @@ void luaV_finishOp (lua_State *L) {
   int imm = GETARG_sC(i);  \
   if (ttisinteger(v1)) {  \
     lua_Integer iv1 = ivalue(v1);  \
+    quicken(L, OP_ADDIINT);  \
     pc++; setivalue(s2v(ra), iop(L, iv1, imm));  \
   }  \
   else if (ttisfloat(v1)) {  \
     lua_Number nb = fltvalue(v1);  \
     lua_Number fimm = cast_num(imm);  \
+    quicken(L, OP_ADDIFLT);  \
     pc++; setfltvalue(s2v(ra), fop(L, nb, fimm)); \
   }}
 
@@ -973,6 +1595,45 @@ void luaV_finishOp (lua_State *L) {
   op_arith_aux(L, v1, v2, iop, fop); }
 
 
+/*
+** Arithmetic operations that can be quickened: 'qi' is the opcode
+** specialized for integer operands and 'qf' the one specialized for
+** float operands, used when 'isf' is true.
+*/
+#define op_arithQ_aux(L,v1,v2,iop,fop,qi,qf,isf) {  \
+  StkId ra = RA(i); \
+  if (ttisinteger(v1) && ttisinteger(v2)) {  \
+    lua_Integer i1 = ivalue(v1); lua_Integer i2 = ivalue(v2);  \
+    quicken(L, qi);  \
+    pc++; setivalue(s2v(ra), iop(L, i1, i2));  \
+  }  \
+  else {  \
+    if (isf)  \
+      quicken(L, qf);  \
+    op_arithf_aux(L, v1, v2, fop);  \
+  }}
+
+
+/*
+** Quickenable arithmetic operations with register operands.
+*/
+#define op_arithQ(L,iop,fop,qi,qf) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  op_arithQ_aux(L, v1, v2, iop, fop, qi, qf,  \
+                ttisfloat(v1) && ttisfloat(v2)); }
+
+
+/*
+** Quickenable arithmetic operations with K operands. (A float operand
+** with any numeric constant goes to the float version.)
+*/
+#define op_arithKQ(L,iop,fop,qi,qf) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = KC(i); lua_assert(ttisnumber(v2));  \
+  op_arithQ_aux(L, v1, v2, iop, fop, qi, qf, ttisfloat(v1)); }
+
+
 /*
 ** Bitwise operations with constant operand.
 */
@@ -1003,19 +1664,23 @@ void luaV_finishOp (lua_State *L) {
 /*
 ** Order operations with register operands. 'opn' actually works
 ** for all numbers, but the fast track improves performance for
-** integers.
+** integers. 'qi' and 'qf' are the quickened versions of the opcode.
 */
-#define op_order(L,opi,opn,other) {  \
+#define op_order(L,opi,opn,other,qi,qf) {  \
   StkId ra = RA(i); \
   int cond;  \
   TValue *rb = vRB(i);  \
   if (ttisinteger(s2v(ra)) && ttisinteger(rb)) {  \
     lua_Integer ia = ivalue(s2v(ra));  \
     lua_Integer ib = ivalue(rb);  \
+    quicken(L, qi);  \
     cond = opi(ia, ib);  \
   }  \
-  else if (ttisnumber(s2v(ra)) && ttisnumber(rb))  \
+  else if (ttisnumber(s2v(ra)) && ttisnumber(rb)) {  \
+    if (ttisfloat(s2v(ra)) && ttisfloat(rb))  \
+      quicken(L, qf);  \
     cond = opn(s2v(ra), rb);  \
+  }  \
   else  \
     Protect(cond = other(L, s2v(ra), rb));  \
   docondjump(); }
@@ -1056,14 +1721,24 @@ void luaV_finishOp (lua_State *L) {
 */
 
 
+#if LUA_USE_PREDECODE
+/* arguments of the current instruction come unpacked in 'd' */
+#define RA(i)	(base+d->a)
+#define RB(i)	(base+d->b)
+#define KB(i)	(k+d->b)
+#define RC(i)	(base+d->c)
+#define KC(i)	(k+d->c)
+#define RKC(i)	((TESTARG_k(i)) ? k + d->c : s2v(base + d->c))
+#else
 #define RA(i)	(base+GETARG_A(i))
 #define RB(i)	(base+GETARG_B(i))
-#define vRB(i)	s2v(RB(i))
 #define KB(i)	(k+GETARG_B(i))
 #define RC(i)	(base+GETARG_C(i))
-#define vRC(i)	s2v(RC(i))
 #define KC(i)	(k+GETARG_C(i))
 #define RKC(i)	((TESTARG_k(i)) ? k + GETARG_C(i) : s2v(base + GETARG_C(i)))
+#endif
+#define vRB(i)	s2v(RB(i))
+#define vRC(i)	s2v(RC(i))
 
 
 
@@ -1129,15 +1804,56 @@ void luaV_finishOp (lua_State *L) {
            luai_threadyield(L); }
 
 
+/* get the next instruction (and its pre-decoded copy) */
+#if LUA_USE_PREDECODE
+#define fetchins()	{ d = dcode + (pc++ - code); i = d->i; }
+#else
+#define fetchins()	(i = *(pc++))
+#endif
+
+
 /* fetch an instruction and prepare its execution */
 #define vmfetch()	{ \
   if (l_unlikely(trap)) {  /* stack reallocation or hooks? */ \
     trap = luaG_traceexec(L, pc);  /* handle hooks */ \
     updatebase(ci);  /* correct stack */ \
   } \
-  i = *(pc++); \
+  fetchins(); \
 }
 
+/*
+** Count an iteration of the loop closed by the current instruction
+** (at 'pc - 1'), whose body starts 'bx' instructions after 'pc'
+** (before the jump back). When the loop gets hot, the trace recorder
+** may set 'trap' to record its next iteration.
+*/
+#if LUA_USE_TRACE
+#define countloop(bx)  \
+  { if (l_unlikely(--G(L)->hotcount[hotslot(pc - 1)] == 0)) { \
+      savestate(L,ci); \
+      luaR_hotloop(L, ci, pc - 1, pc - (bx)); \
+      updatetrap(ci); }}
+#else
+#define countloop(bx)	((void)(bx))
+#endif
+
+
+#if LUA_USE_JIT
+/*
+** Go on running the current function in native code, if it has been
+** compiled and its native code can run the instruction at 'pc'. Native
+** code returns the next instruction for the interpreter to run. (It
+** does not run with hooks, which set 'trap'.)
+*/
+#define jitenter()  \
+  { if (cl->p->jit != NULL && !trap && luaJ_canenter(cl->p, pc)) { \
+      pc = luaJ_run(L, base, cl, pc); \
+      updatetrap(ci); }}
+#else
+#define jitenter()	((void)0)
+#endif
+
+
 #define vmdispatch(o)	switch(o)
 #define vmcase(l)	case l:
 #define vmbreak		break
@@ -1149,6 +1865,10 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
   StkId base;
   const Instruction *pc;
   int trap;
+#if LUA_USE_PREDECODE
+  const Instruction *code;
+  const DecodedIns *dcode;  /* pre-decoded copy of 'code' */
+#endif
 #if LUA_USE_JUMPTABLE
 #include "ljumptab.h"
 #endif
@@ -1157,13 +1877,23 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
  returning:  /* trap already set */
   cl = ci_func(ci);
   k = cl->p->k;
+#if LUA_USE_PREDECODE
+  if (l_unlikely(cl->p->dcode == NULL))
+    predecode(L, cl->p, disptab);
+  code = cl->p->code;
+  dcode = cl->p->dcode;
+#endif
   pc = ci->u.l.savedpc;
   if (l_unlikely(trap))
     trap = luaG_tracecall(L);
   base = ci->func.p + 1;
+  jitenter();
   /* main loop of interpreter */
   for (;;) {
     Instruction i;  /* instruction being executed */
+#if LUA_USE_PREDECODE
+    const DecodedIns *d;  /* pre-decoded copy of 'i' */
+#endif
     vmfetch();
     #if 0
       /* low-level line tracing for debugging Lua */
@@ -1247,7 +1977,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rc = KC(i);
         TString *key = tsvalue(rc);  /* key must be a short string */
         int tag;
-        luaV_fastget(upval, key, s2v(ra), luaH_getshortstr, tag);
+        globalget(L, cl->p, pc, upval, key, s2v(ra), tag);
         if (tagisempty(tag))
           Protect(luaV_finishget(L, upval, rc, ra, tag));
         vmbreak;
@@ -1285,7 +2015,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rc = KC(i);
         TString *key = tsvalue(rc);  /* key must be a short string */
         int tag;
-        luaV_fastget(rb, key, s2v(ra), luaH_getshortstr, tag);
+        fieldget(L, cl->p, pc, rb, key, s2v(ra), tag);
         if (tagisempty(tag))
           Protect(luaV_finishget(L, rb, rc, ra, tag));
         vmbreak;
@@ -1296,7 +2026,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rb = KB(i);
         TValue *rc = RKC(i);
         TString *key = tsvalue(rb);  /* key must be a short string */
-        luaV_fastset(upval, key, rc, hres, luaH_psetshortstr);
+        globalset(L, cl->p, pc, upval, key, rc, hres);
         if (hres == HOK)
           luaV_finishfastset(L, upval, rc);
         else
@@ -1341,7 +2071,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rb = KB(i);
         TValue *rc = RKC(i);
         TString *key = tsvalue(rb);  /* key must be a short string */
-        luaV_fastset(s2v(ra), key, rc, hres, luaH_psetshortstr);
+        fieldset(L, cl->p, pc, s2v(ra), key, rc, hres);
         if (hres == HOK)
           luaV_finishfastset(L, s2v(ra), rc);
         else
@@ -1360,10 +2090,13 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
           c += GETARG_Ax(*pc) * (MAXARG_C + 1);  /* add it to size */
         pc++;  /* skip extra argument */
         L->top.p = ra + 1;  /* correct top in case of emergency GC */
+#if LUA_USE_TABLESITES
+        savepc(L);  /* 'luaH_new' records it */
+#endif
         t = luaH_new(L);  /* memory allocation */
         sethvalue2s(L, ra, t);
         if (b != 0 || c != 0)
-          luaH_resize(L, t, c, b);  /* idem */
+          luaH_presize(L, t, c, b);  /* idem */
         checkGC(L, ra + 1);
         vmbreak;
       }
@@ -1374,25 +2107,32 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rc = RKC(i);
         TString *key = tsvalue(rc);  /* key must be a string */
         setobj2s(L, ra + 1, rb);
-        luaV_fastget(rb, key, s2v(ra), luaH_getstr, tag);
+        if (key->tt == LUA_VSHRSTR)
+          fieldget(L, cl->p, pc, rb, key, s2v(ra), tag);
+        else
+          luaV_fastget(rb, key, s2v(ra), luaH_getstr, tag);
         if (tagisempty(tag))
           Protect(luaV_finishget(L, rb, rc, ra, tag));
         vmbreak;
       }
       vmcase(OP_ADDI) {
+       l_addimm:
         op_arithI(L, l_addi, luai_numadd);
         vmbreak;
       }
       vmcase(OP_ADDK) {
-        op_arithK(L, l_addi, luai_numadd);
+       l_addk:
+        op_arithKQ(L, l_addi, luai_numadd, OP_ADDKINT, OP_ADDKFLT);
         vmbreak;
       }
       vmcase(OP_SUBK) {
-        op_arithK(L, l_subi, luai_numsub);
+       l_subk:
+        op_arithKQ(L, l_subi, luai_numsub, OP_SUBKINT, OP_SUBKFLT);
         vmbreak;
       }
       vmcase(OP_MULK) {
-        op_arithK(L, l_muli, luai_nummul);
+       l_mulk:
+        op_arithKQ(L, l_muli, luai_nummul, OP_MULKINT, OP_MULKFLT);
         vmbreak;
       }
       vmcase(OP_MODK) {
@@ -1446,15 +2186,18 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_ADD) {
-        op_arith(L, l_addi, luai_numadd);
+       l_add:
+        op_arithQ(L, l_addi, luai_numadd, OP_ADDINT, OP_ADDFLT);
         vmbreak;
       }
       vmcase(OP_SUB) {
-        op_arith(L, l_subi, luai_numsub);
+       l_sub:
+        op_arithQ(L, l_subi, luai_numsub, OP_SUBINT, OP_SUBFLT);
         vmbreak;
       }
       vmcase(OP_MUL) {
-        op_arith(L, l_muli, luai_nummul);
+       l_mul:
+        op_arithQ(L, l_muli, luai_nummul, OP_MULINT, OP_MULFLT);
         vmbreak;
       }
       vmcase(OP_MOD) {
@@ -1500,7 +2243,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         Instruction pi = *(pc - 2);  /* original arith. expression */
         TValue *rb = vRB(i);
         TMS tm = (TMS)GETARG_C(i);
-        StkId result = RA(pi);
+        StkId result = base + GETARG_A(pi);
         lua_assert(OP_ADD <= GET_OPCODE(pi) && GET_OPCODE(pi) <= OP_SHR);
         Protect(luaT_trybinTM(L, s2v(ra), rb, result, tm));
         vmbreak;
@@ -1511,7 +2254,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         int imm = GETARG_sB(i);
         TMS tm = (TMS)GETARG_C(i);
         int flip = GETARG_k(i);
-        StkId result = RA(pi);
+        StkId result = base + GETARG_A(pi);
         Protect(luaT_trybiniTM(L, s2v(ra), imm, flip, result, tm));
         vmbreak;
       }
@@ -1521,7 +2264,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *imm = KB(i);
         TMS tm = (TMS)GETARG_C(i);
         int flip = GETARG_k(i);
-        StkId result = RA(pi);
+        StkId result = base + GETARG_A(pi);
         Protect(luaT_trybinassocTM(L, s2v(ra), imm, flip, result, tm));
         vmbreak;
       }
@@ -1586,6 +2329,8 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
       }
       vmcase(OP_JMP) {
         dojump(ci, i, 0);
+        if (GETARG_sJ(i) < 0)  /* backward jump? */
+          jitenter();
         vmbreak;
       }
       vmcase(OP_EQ) {
@@ -1597,11 +2342,13 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_LT) {
-        op_order(L, l_lti, LTnum, lessthanothers);
+       l_lt:
+        op_order(L, l_lti, LTnum, lessthanothers, OP_LTINT, OP_LTFLT);
         vmbreak;
       }
       vmcase(OP_LE) {
-        op_order(L, l_lei, LEnum, lessequalothers);
+       l_le:
+        op_order(L, l_lei, LEnum, lessequalothers, OP_LEINT, OP_LEFLT);
         vmbreak;
       }
       vmcase(OP_EQK) {
@@ -1779,12 +2526,16 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
             chgivalue(s2v(ra), count - 1);  /* update counter */
             idx = intop(+, idx, step);  /* add step to index */
             chgivalue(s2v(ra + 2), idx);  /* update control variable */
+            countloop(GETARG_Bx(i));
             pc -= GETARG_Bx(i);  /* jump back */
           }
         }
-        else if (floatforloop(ra))  /* float loop */
+        else if (floatforloop(ra)) {  /* float loop */
+          countloop(GETARG_Bx(i));
           pc -= GETARG_Bx(i);  /* jump back */
+        }
         updatetrap(ci);  /* allows a signal to break the loop */
+        jitenter();
         vmbreak;
       }
       vmcase(OP_FORPREP) {
@@ -1792,6 +2543,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         savestate(L, ci);  /* in case of errors */
         if (forprep(L, ra))
           pc += GETARG_Bx(i) + 1;  /* skip the loop */
+        jitenter();
         vmbreak;
       }
       vmcase(OP_TFORPREP) {
@@ -1809,7 +2561,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         /* create to-be-closed upvalue (if closing var. is not nil) */
         halfProtect(luaF_newtbcupval(L, ra + 2));
         pc += GETARG_Bx(i);  /* go to end of the loop */
-        i = *(pc++);  /* fetch next instruction */
+        fetchins();  /* fetch next instruction */
         lua_assert(GET_OPCODE(i) == OP_TFORCALL && ra == RA(i));
         goto l_tforcall;
       }
@@ -1822,21 +2574,29 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
            return will be the new value for the control variable.
         */
         StkId ra = RA(i);
-        setobjs2s(L, ra + 5, ra + 3);  /* copy the control variable */
-        setobjs2s(L, ra + 4, ra + 1);  /* copy state */
-        setobjs2s(L, ra + 3, ra);  /* copy function */
-        L->top.p = ra + 3 + 3;
-        ProtectNT(luaD_call(L, ra + 3, GETARG_C(i)));  /* do the call */
-        updatestack(ci);  /* stack may have changed */
-        i = *(pc++);  /* go to next instruction */
+        /* (with hooks, the iterator must be called) */
+        if (!L->hookmask && iterstep(L, ra, GETARG_C(i)))  /* ran inline? */
+          cachestat(G(L), LUA_CSITER);
+        else {
+          setobjs2s(L, ra + 5, ra + 3);  /* copy the control variable */
+          setobjs2s(L, ra + 4, ra + 1);  /* copy state */
+          setobjs2s(L, ra + 3, ra);  /* copy function */
+          L->top.p = ra + 3 + 3;
+          ProtectNT(luaD_call(L, ra + 3, GETARG_C(i)));  /* do the call */
+          updatestack(ci);  /* stack may have changed */
+        }
+        fetchins();  /* go to next instruction */
         lua_assert(GET_OPCODE(i) == OP_TFORLOOP && ra == RA(i));
         goto l_tforloop;
       }}
       vmcase(OP_TFORLOOP) {
        l_tforloop: {
         StkId ra = RA(i);
-        if (!ttisnil(s2v(ra + 3)))  /* continue loop? */
+        if (!ttisnil(s2v(ra + 3))) {  /* continue loop? */
+          countloop(GETARG_Bx(i));
           pc -= GETARG_Bx(i);  /* jump back */
+          jitenter();
+        }
         vmbreak;
       }}
       vmcase(OP_SETLIST) {
@@ -1855,6 +2615,18 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         }
         if (last > luaH_realasize(h))  /* needs more space? */
           luaH_resizearray(L, h, last);  /* preallocate it at once */
+#if LUA_USE_PACKEDARRAYS
+        if (ispacked(h)) {  /* fill it in order, so that it may stay packed */
+          int j;
+          last -= n;
+          for (j = 1; j <= n; j++) {
+            TValue *val = s2v(ra + j);
+            luaH_setint(L, h, last + j, val);
+            luaC_barrierback(L, obj2gco(h), val);
+          }
+          vmbreak;
+        }
+#endif
         for (; n > 0; n--) {
           TValue *val = s2v(ra + n);
           obj2arr(h, last, val);
@@ -1866,7 +2638,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
       vmcase(OP_CLOSURE) {
         StkId ra = RA(i);
         Proto *p = cl->p->p[GETARG_Bx(i)];
-        halfProtect(pushclosure(L, p, cl->upvals, base, ra));
+        halfProtect(getclosure(L, p, cl->upvals, base, ra));
         checkGC(L, ra + 1);
         vmbreak;
       }
@@ -1889,6 +2661,89 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         lua_assert(0);
         vmbreak;
       }
+      vmcase(OP_ADDIINT) {
+        TValue *v1 = vRB(i);
+        if (l_likely(ttisinteger(v1))) {
+          StkId ra = RA(i);
+          pc++; setivalue(s2v(ra), l_addi(L, ivalue(v1), GETARG_sC(i)));
+        }
+        else despecialize(l_addimm)
+        vmbreak;
+      }
+      vmcase(OP_ADDIFLT) {
+        TValue *v1 = vRB(i);
+        if (l_likely(ttisfloat(v1))) {
+          StkId ra = RA(i);
+          lua_Number fimm = cast_num(GETARG_sC(i));
+          pc++; setfltvalue(s2v(ra), luai_numadd(L, fltvalue(v1), fimm));
+        }
+        else despecialize(l_addimm)
+        vmbreak;
+      }
+      vmcase(OP_ADDKINT) {
+        op_arithKI(L, l_addi, l_addk);
+        vmbreak;
+      }
+      vmcase(OP_ADDKFLT) {
+        op_arithKF(L, luai_numadd, l_addk);
+        vmbreak;
+      }
+      vmcase(OP_SUBKINT) {
+        op_arithKI(L, l_subi, l_subk);
+        vmbreak;
+      }
+      vmcase(OP_SUBKFLT) {
+        op_arithKF(L, luai_numsub, l_subk);
+        vmbreak;
+      }
+      vmcase(OP_MULKINT) {
+        op_arithKI(L, l_muli, l_mulk);
+        vmbreak;
+      }
+      vmcase(OP_MULKFLT) {
+        op_arithKF(L, luai_nummul, l_mulk);
+        vmbreak;
+      }
+      vmcase(OP_ADDINT) {
+        op_arithII(L, l_addi, l_add);
+        vmbreak;
+      }
+      vmcase(OP_ADDFLT) {
+        op_arithFF(L, luai_numadd, l_add);
+        vmbreak;
+      }
+      vmcase(OP_SUBINT) {
+        op_arithII(L, l_subi, l_sub);
+        vmbreak;
+      }
+      vmcase(OP_SUBFLT) {
+        op_arithFF(L, luai_numsub, l_sub);
+        vmbreak;
+      }
+      vmcase(OP_MULINT) {
+        op_arithII(L, l_muli, l_mul);
+        vmbreak;
+      }
+      vmcase(OP_MULFLT) {
+        op_arithFF(L, luai_nummul, l_mul);
+        vmbreak;
+      }
+      vmcase(OP_LTINT) {
+        op_orderII(L, l_lti, l_lt);
+        vmbreak;
+      }
+      vmcase(OP_LTFLT) {
+        op_orderFF(L, luai_numlt, l_lt);
+        vmbreak;
+      }
+      vmcase(OP_LEINT) {
+        op_orderII(L, l_lei, l_le);
+        vmbreak;
+      }
+      vmcase(OP_LEFLT) {
+        op_orderFF(L, luai_numle, l_le);
+        vmbreak;
+      }
     }
   }
 }
@@ -86,10 +86,12 @@
 #include "lfunc.c"
 #include "lobject.c"
 #include "ltm.c"
+#include "ltrace.c"
 #include "lstring.c"
 #include "ltable.c"
 #include "ldo.c"
 #include "lvm.c"
+#include "ljit.c"
 #include "lapi.c"
 
 /* auxiliary library -- used by all */
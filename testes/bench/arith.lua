@@ -0,0 +1,79 @@
+-- $Id: testes/bench/arith.lua $
+-- See Copyright Notice in file all.lua
+
+-- Micro benchmark for numeric code, which exercises the quickening of
+-- arithmetic and order instructions. To measure the speedup, compare
+-- with an interpreter built with '-DLUA_USE_QUICKEN=0'.
+-- usage: lua arith.lua [iterations]
+
+local N = tonumber(arg and arg[1]) or 5000000
+
+
+local function bench (name, f, ...)
+  local stats = debug.cachestats
+  collectgarbage(); collectgarbage()
+  stats(true)   -- reset counters
+  local t0 = os.clock()
+  f(...)
+  local t = os.clock() - t0
+  local st = stats()
+  print(string.format("%-28s %8.3fs   quickened %6d  de-specialized %6d",
+        name, t, st.quicken, st.unquicken))
+end
+
+
+-- integer arithmetic (a linear congruential generator)
+local function intloop (n)
+  local x, s = 1, 0
+  for i = 1, n do
+    x = (x * 1103515245 + 12345) % 2147483648
+    if x < 1073741824 then s = s + 1 else s = s - 1 end
+  end
+  return s
+end
+
+
+-- float arithmetic (a lightly damped spring, with Euler steps)
+local function floatloop (n)
+  local x, v, dt, k, c = 1.0, 0.0, 0.001, 40.0, 0.0001
+  local maxx = 0.0
+  for i = 1, n do
+    local a = -k * x - c * v
+    v = v + a * dt
+    x = x + v * dt
+    if x > maxx then maxx = x end
+  end
+  return x, maxx
+end
+
+
+-- a simple n-body step over arrays of floats
+local function nbody (n)
+  local m = 8
+  local px, py, vx, vy = {}, {}, {}, {}
+  for j = 1, m do
+    px[j] = j * 1.5; py[j] = j * -0.5; vx[j] = 0.0; vy[j] = 0.0
+  end
+  for i = 1, n // (m * m) do
+    for j = 1, m do
+      local ax, ay = 0.0, 0.0
+      local x, y = px[j], py[j]
+      for l = 1, m do
+        local dx, dy = px[l] - x, py[l] - y
+        local d2 = dx * dx + dy * dy + 0.01
+        ax = ax + dx / d2; ay = ay + dy / d2
+      end
+      vx[j] = vx[j] + ax * 0.001; vy[j] = vy[j] + ay * 0.001
+    end
+    for j = 1, m do
+      px[j] = px[j] + vx[j] * 0.001; py[j] = py[j] + vy[j] * 0.001
+    end
+  end
+  return px[1]
+end
+
+
+print(_VERSION, "iterations: " .. N)
+bench("integer arithmetic", intloop, N)
+bench("float arithmetic", floatloop, N)
+bench("n-body step", nbody, N)
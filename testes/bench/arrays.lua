@@ -0,0 +1,65 @@
+-- $Id: testes/bench/arrays.lua $
+-- See Copyright Notice in file all.lua
+
+-- Micro benchmark for large arrays of numbers: memory used, time to
+-- fill, read, and update them, and time of full collections while they
+-- are alive. To measure packed arrays, compare with an interpreter built
+-- with '-DLUA_USE_PACKEDARRAYS=1'.
+-- usage: lua arrays.lua [size]
+
+local N = math.tointeger(arg and arg[1]) or 10000000
+
+
+local function bench (name, f, ...)
+  collectgarbage(); collectgarbage()
+  local t0 = os.clock()
+  local res = f(...)
+  local t = os.clock() - t0
+  print(string.format("%-16s %8.3fs   %6.2f ns/entry", name, t, t * 1e9 / N))
+  return res
+end
+
+
+local function fillint ()
+  local a = {}
+  for i = 1, N do a[i] = i end
+  return a
+end
+
+
+local function fillflt ()
+  local a = {}
+  for i = 1, N do a[#a + 1] = i * 0.5 end
+  return a
+end
+
+
+local function sum (a)
+  local s = 0
+  for i = 1, #a do s = s + a[i] end
+  return s
+end
+
+
+local function scale (a)
+  for i = 1, #a do a[i] = a[i] * 2 end
+end
+
+
+print(_VERSION)
+collectgarbage(); collectgarbage()
+local m = collectgarbage("count")
+local ia = bench("fill integers", fillint)
+local fa = bench("fill floats", fillflt)
+collectgarbage(); collectgarbage()
+print(string.format("%-16s %8.2f bytes/entry", "memory",
+      (collectgarbage("count") - m) * 1024 / (2 * N)))
+bench("sum integers", sum, ia)
+bench("sum floats", sum, fa)
+bench("scale floats", scale, fa)
+bench("full collection", function () collectgarbage() end)
+bench("ipairs", function ()
+  local s = 0
+  for _, v in ipairs(ia) do s = s + v end
+  return s
+end)
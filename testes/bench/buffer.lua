@@ -0,0 +1,94 @@
+-- $Id: testes/bench/buffer.lua $
+-- See Copyright Notice in file all.lua
+
+-- Micro benchmark for building strings piece by piece, as a template
+-- renderer does: concatenation with '..' in a loop, collecting the
+-- pieces in a table for 'table.concat', and a 'string.buffer'.
+-- usage: lua buffer.lua [number of pages]
+
+local N = math.tointeger(arg and arg[1]) or 2000
+
+local ROWS = 100    -- rows in each page
+
+
+local function bench (name, f)
+  collectgarbage(); collectgarbage()
+  local t0 = os.clock()
+  local len = f()
+  local t = os.clock() - t0
+  collectgarbage(); collectgarbage()
+  collectgarbage("stop")    -- measure everything allocated in a new run
+  local m0 = collectgarbage("count")
+  f()
+  local m = collectgarbage("count") - m0
+  collectgarbage("restart")
+  print(string.format("%-12s %8.3fs  %10.0fKB allocated  (%d bytes/page)",
+        name, t, m, len))
+end
+
+
+local function concat ()
+  local len
+  for p = 1, N do
+    local s = "<table>\n"
+    for i = 1, ROWS do
+      s = s .. "<tr><td>" .. i .. "</td><td>" .. "item" .. p .. "</td></tr>\n"
+    end
+    s = s .. "</table>\n"
+    len = #s
+  end
+  return len
+end
+
+
+local function tconcat ()
+  local len
+  for p = 1, N do
+    local t = {"<table>\n"}
+    for i = 1, ROWS do
+      t[#t + 1] = "<tr><td>"; t[#t + 1] = i
+      t[#t + 1] = "</td><td>"; t[#t + 1] = "item"; t[#t + 1] = p
+      t[#t + 1] = "</td></tr>\n"
+    end
+    t[#t + 1] = "</table>\n"
+    len = #table.concat(t)
+  end
+  return len
+end
+
+
+local function buffer ()
+  local len
+  local b = string.buffer()
+  for p = 1, N do
+    b:reset():append("<table>\n")
+    for i = 1, ROWS do
+      b:append("<tr><td>", i, "</td><td>", "item", p, "</td></tr>\n")
+    end
+    b:append("</table>\n")
+    len = #b:tostring()
+  end
+  return len
+end
+
+
+local function bufferf ()
+  local len
+  local b = string.buffer()
+  for p = 1, N do
+    b:reset():append("<table>\n")
+    for i = 1, ROWS do
+      b:appendf("<tr><td>%d</td><td>item%d</td></tr>\n", i, p)
+    end
+    b:append("</table>\n")
+    len = #b:tostring()
+  end
+  return len
+end
+
+
+print(_VERSION)
+bench("..", concat)
+bench("table.concat", tconcat)
+bench("append", buffer)
+bench("appendf", bufferf)
@@ -0,0 +1,77 @@
+-- $Id: testes/bench/dispatch.lua $
+-- See Copyright Notice in file all.lua
+
+-- Micro benchmark for the cost of instruction dispatch: loops made of
+-- many cheap instructions (moves, loads, tests, jumps, and upvalue and
+-- table accesses), where fetching and decoding instructions is a large
+-- part of the work. To measure the pre-decoded dispatch, compare with
+-- an interpreter built with '-DLUA_USE_PREDECODE=1'.
+-- usage: lua dispatch.lua [iterations]
+
+local N = tonumber(arg and arg[1]) or 10000000
+
+
+local function bench (name, f, ...)
+  collectgarbage(); collectgarbage()
+  local t0 = os.clock()
+  f(...)
+  local t = os.clock() - t0
+  print(string.format("%-28s %8.3fs   %6.2f ns/iteration",
+        name, t, t * 1e9 / N))
+end
+
+
+-- register moves and constant loads
+local function moves (n)
+  local a, b, c, d = 1, 2, 3, 4
+  for i = 1, n do
+    a, b, c, d = b, c, d, a
+    local x, y, z = true, false, nil
+    a, b = b, a
+  end
+  return a + b + c + d
+end
+
+
+-- tests and conditional jumps
+local function branches (n)
+  local s, t, f = 0, true, false
+  for i = 1, n do
+    if t then s = s + 1 end
+    if f then s = s - 1 end
+    if not f and t then s = s + 1 end
+    if s ~= 0 then s = s - 1 end
+  end
+  return s
+end
+
+
+-- upvalues and table fields
+local up = 0
+local function accesses (n)
+  local t = {0, 0, 0}
+  for i = 1, n do
+    up = up + 1
+    t[1] = t[2]
+    t[3] = up
+    t[2] = t[3]
+  end
+  return t[1]
+end
+
+
+-- nested loops with short bodies (many loop instructions)
+local function loops (n)
+  local s = 0
+  for i = 1, n // 8 do
+    for j = 1, 8 do s = s + j end
+  end
+  return s
+end
+
+
+print(_VERSION, "iterations: " .. N)
+bench("moves and loads", moves, N)
+bench("tests and jumps", branches, N)
+bench("upvalues and fields", accesses, N)
+bench("short loops", loops, N)
@@ -0,0 +1,113 @@
+-- $Id: testes/bench/hash.lua $
+-- See Copyright Notice in file all.lua
+
+-- Micro benchmark for the hash part of tables: insertions, successful
+-- and failed lookups, and traversals, with integer and string keys, for
+-- tables of several sizes. To measure the open-addressing hash part,
+-- compare with an interpreter built with '-DLUA_USE_SWISSHASH=1'.
+-- usage: lua hash.lua [size ...]
+
+local sizes = {}
+for i = 1, (arg and #arg or 0) do sizes[i] = math.tointeger(arg[i]) end
+if #sizes == 0 then sizes = {1000, 100000, 2000000} end
+
+
+local function bench (name, n, f, ...)
+  collectgarbage(); collectgarbage()
+  local t0 = os.clock()
+  local rounds = f(...)
+  local t = os.clock() - t0
+  print(string.format("%-16s %9d %8.3fs   %6.2f ns/op",
+        name, n, t, t * 1e9 / (n * rounds)))
+end
+
+
+-- how many times to repeat small workloads so that they take a while
+local function roundsfor (n)
+  return math.max(1, 10000000 // n)
+end
+
+
+-- integer keys scattered enough to stay out of the array part
+local function intkeys (n)
+  local k = {}
+  for i = 1, n do k[i] = i * 7919 + 1 end
+  return k
+end
+
+
+local function strkeys (n)
+  local k = {}
+  for i = 1, n do k[i] = "k" .. i end
+  return k
+end
+
+
+local function insert (keys)
+  local n = #keys
+  local r = roundsfor(n)
+  for _ = 1, r do
+    local t = {}
+    for i = 1, n do t[keys[i]] = i end
+  end
+  return r
+end
+
+
+local function lookup (t, keys)
+  local n = #keys
+  local r = roundsfor(n)
+  local s = 0
+  for _ = 1, r do
+    for i = 1, n do s = s + t[keys[i]] end
+  end
+  return r
+end
+
+
+local function miss (t, keys)
+  local n = #keys
+  local r = roundsfor(n)
+  local c = 0
+  for _ = 1, r do
+    for i = 1, n do
+      if t[keys[i]] then c = c + 1 end
+    end
+  end
+  assert(c == 0)
+  return r
+end
+
+
+local function traverse (t, n)
+  local r = roundsfor(n)
+  for _ = 1, r do
+    for k, v in next, t do end
+  end
+  return r
+end
+
+
+local function fill (keys)
+  local t = {}
+  for i = 1, #keys do t[keys[i]] = i end
+  return t
+end
+
+
+print(_VERSION)
+for _, n in ipairs(sizes) do
+  for _, kind in ipairs{"int", "string"} do
+    local gen = (kind == "int") and intkeys or strkeys
+    local keys = gen(n)
+    local other = gen(2 * n)
+    table.move(other, n + 1, 2 * n, 1)   -- keys not in 'keys'
+    table.move({}, 1, n, n + 1, other)   -- (keep only those)
+    local t = fill(keys)
+    bench(kind .. " insert", n, insert, keys)
+    bench(kind .. " lookup", n, lookup, t, keys)
+    bench(kind .. " miss", n, miss, t, other)
+    bench(kind .. " traverse", n, traverse, t, n)
+    keys, other, t = nil
+  end
+end
@@ -0,0 +1,92 @@
+-- $Id: testes/bench/oop.lua $
+-- See Copyright Notice in file all.lua
+
+-- Micro benchmark for OOP-style field accesses and method dispatch,
+-- which exercise the inline caches of OP_GETFIELD/OP_SETFIELD/OP_SELF.
+-- To measure the speedup, compare with an interpreter built with
+-- '-DLUA_USE_ICACHE=0'.
+-- usage: lua oop.lua [iterations]
+
+local N = tonumber(arg and arg[1]) or 2000000
+
+local Point = {}
+Point.__index = Point
+
+function Point.new (x, y)
+  return setmetatable({x = x, y = y, a = 0, b = 0, c = 0}, Point)
+end
+
+function Point:norm1 () return self.x + self.y end
+
+function Point:move (dx, dy)
+  self.x = self.x + dx
+  self.y = self.y + dy
+end
+
+
+-- a second class deriving from the first one (two-level '__index')
+local Point3 = setmetatable({}, {__index = Point})
+Point3.__index = Point3
+
+function Point3.new (x, y, z)
+  local p = Point.new(x, y); p.z = z
+  return setmetatable(p, Point3)
+end
+
+
+local function bench (name, f, ...)
+  local stats = debug.cachestats
+  collectgarbage(); collectgarbage()
+  stats(true)   -- reset counters
+  local t0 = os.clock()
+  f(...)
+  local t = os.clock() - t0
+  local st = stats()
+  local total = st.fieldhit + st.fieldmiss
+  print(string.format("%-28s %8.3fs   hits %10d  misses %8d  (%.1f%%)",
+        name, t, st.fieldhit, st.fieldmiss,
+        total > 0 and st.fieldhit * 100 / total or 0))
+end
+
+
+local function monomorphic (n)
+  local p = Point.new(1, 2)
+  local s = 0
+  for i = 1, n do
+    p:move(1, -1)
+    s = s + p:norm1()
+  end
+  return s
+end
+
+
+local function manyobjects (n)
+  local pts = {}
+  for i = 1, 100 do pts[i] = Point.new(i, -i) end
+  local s = 0
+  for i = 1, n // 100 do
+    for j = 1, 100 do
+      local p = pts[j]
+      p:move(1, 1)
+      s = s + p:norm1()
+    end
+  end
+  return s
+end
+
+
+local function polymorphic (n)
+  local pts = {Point.new(1, 2), Point3.new(1, 2, 3)}
+  local s = 0
+  for i = 1, n do
+    local p = pts[i % 2 + 1]
+    s = s + p:norm1()
+  end
+  return s
+end
+
+
+print(_VERSION, "iterations: " .. N)
+bench("monomorphic method calls", monomorphic, N)
+bench("many instances", manyobjects, N)
+bench("two classes (polymorphic)", polymorphic, N)
@@ -0,0 +1,89 @@
+-- $Id: testes/bench/pm.lua $
+-- See Copyright Notice in file all.lua
+
+-- Micro benchmark for pattern matching, as done when parsing logs: the
+-- same dozen patterns applied with 'string.find', 'string.match',
+-- 'string.gmatch', and 'string.gsub' to every line of a log. To
+-- measure the cache of compiled patterns, compare with an interpreter
+-- built with '-DLUAL_PATTCACHE=0'.
+-- usage: lua pm.lua [number of lines]
+
+local N = math.tointeger(arg and arg[1]) or 100000
+
+
+local levels = {"INFO", "WARN", "ERROR", "DEBUG"}
+local paths = {"/api/v2/users", "/static/app.js", "/login", "/api/v2/items"}
+
+local lines = {}
+for i = 1, N do
+  lines[i] = string.format(
+    "2024-%02d-%02d %02d:%02d:%02d [%s] %d.%d.%d.%d \"GET %s/%d HTTP/1.1\" "
+    .. "%d %d user=u%d latency=%dms",
+    i % 12 + 1, i % 28 + 1, i % 24, i % 60, (i * 7) % 60,
+    levels[i % #levels + 1], i % 256, (i * 3) % 256, (i * 7) % 256,
+    (i * 11) % 256, paths[i % #paths + 1], i, 200 + (i % 5) * 100,
+    i * 13 % 100000, i % 1000, i % 997)
+end
+
+
+local function bench (name, f)
+  collectgarbage(); collectgarbage()
+  local t0 = os.clock()
+  local n = f()
+  print(string.format("%-10s %8.3fs  (%d)", name, os.clock() - t0, n))
+end
+
+
+local function find ()
+  local n = 0
+  for i = 1, N do
+    local l = lines[i]
+    if l:find("%[ERROR%]") then n = n + 1 end
+    if l:find("\"GET /api/") then n = n + 1 end
+    if l:find("latency=%d%d%d+ms$") then n = n + 1 end
+  end
+  return n
+end
+
+
+local function match ()
+  local n = 0
+  for i = 1, N do
+    local l = lines[i]
+    local y, m, d = l:match("^(%d+)-(%d+)-(%d+)")
+    local level = l:match("%[(%u+)%]")
+    local ip = l:match("%d+%.%d+%.%d+%.%d+")
+    local path, status = l:match("\"%u+ ([^ ]+) [^\"]+\" (%d+)")
+    local user = l:match("user=(%w+)")
+    if y and level and ip and path and status and user then n = n + 1 end
+  end
+  return n
+end
+
+
+local function gmatch ()
+  local n = 0
+  for i = 1, N do
+    for k, v in lines[i]:gmatch("(%a+)=(%w+)") do n = n + 1 end
+  end
+  return n
+end
+
+
+local function gsub ()
+  local n = 0
+  for i = 1, N do
+    local l = lines[i]
+    local _, c = l:gsub("%d+%.%d+%.%d+%.%d+", "x.x.x.x")
+    local _, c2 = l:gsub("%s+", " ")
+    n = n + c + c2
+  end
+  return n
+end
+
+
+print(_VERSION)
+bench("find", find)
+bench("match", match)
+bench("gmatch", gmatch)
+bench("gsub", gsub)
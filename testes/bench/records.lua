@@ -0,0 +1,86 @@
+-- $Id: testes/bench/records.lua $
+-- See Copyright Notice in file all.lua
+
+-- Micro benchmark for record-like tables: memory used by many small
+-- records with string keys, and the time to build them, to read and
+-- write their fields, and to traverse them. To measure shapes, compare
+-- with an interpreter built with '-DLUA_USE_SHAPES=1'.
+-- usage: lua records.lua [count]
+
+local N = math.tointeger(arg and arg[1]) or 1000000
+
+
+local function bench (name, f, ...)
+  collectgarbage(); collectgarbage()
+  local t0 = os.clock()
+  f(...)
+  local t = os.clock() - t0
+  print(string.format("%-16s %8.3fs   %6.2f ns/record", name, t, t * 1e9 / N))
+end
+
+
+local function build3 ()
+  local l = {}
+  for i = 1, N do l[i] = {x = i, y = i, z = i} end
+  return l
+end
+
+
+local function build8 ()
+  local l = {}
+  for i = 1, N do
+    l[i] = {id = i, name = "n", x = i, y = i, z = i, w = i, vx = 0, vy = 0}
+  end
+  return l
+end
+
+
+local function incremental ()
+  local l = {}
+  for i = 1, N do
+    local o = {}
+    o.id = i; o.x = i; o.y = i; o.z = i
+    l[i] = o
+  end
+  return l
+end
+
+
+local function memory (name, f)
+  collectgarbage(); collectgarbage()
+  local m = collectgarbage("count")
+  local l = f()
+  collectgarbage(); collectgarbage()
+  local d = (collectgarbage("count") - m) * 1024
+  print(string.format("%-16s %8.1f bytes/record", name, d / N - 8))
+  return l
+end
+
+
+print(_VERSION)
+memory("mem 3 fields", build3)
+memory("mem 4 fields+", incremental)
+local l = memory("mem 8 fields", build8)
+
+bench("build 3 fields", build3)
+bench("build 8 fields", build8)
+bench("build 4 fields+", incremental)
+bench("read fields", function ()
+  local s = 0
+  for r = 1, 5 do
+    for i = 1, N do local o = l[i]; s = s + o.x + o.y + o.vx end
+  end
+end)
+bench("write fields", function ()
+  for r = 1, 5 do
+    for i = 1, N do local o = l[i]; o.x = r; o.vy = i end
+  end
+end)
+bench("miss fields", function ()
+  local c = 0
+  for i = 1, N do if l[i].missing then c = c + 1 end end
+  assert(c == 0)
+end)
+bench("traverse", function ()
+  for i = 1, N do for k, v in next, l[i] do end end
+end)
@@ -0,0 +1,63 @@
+-- $Id: testes/bench/rehash.lua $
+-- See Copyright Notice in file all.lua
+
+-- Tail-latency benchmark for tables growing their hash parts: times
+-- each single insertion of new keys into a growing table and reports
+-- the percentiles and the maximum of those times, with integer and
+-- string keys. (The collector is stopped during the insertions, so
+-- that only the table itself causes the latencies.) To measure the
+-- incremental rehash, compare with an interpreter built with
+-- '-DLUA_USE_INCREHASH=1'.
+-- usage: lua rehash.lua [size]
+
+local N = math.tointeger(arg and arg[1]) or 4000000
+
+local clock = os.clock
+
+
+-- integer keys scattered enough to stay out of the array part
+local function intkeys (n)
+  local k = {}
+  for i = 1, n do k[i] = i * 7919 + 1 end
+  return k
+end
+
+
+local function strkeys (n)
+  local k = {}
+  for i = 1, n do k[i] = "k" .. i end
+  return k
+end
+
+
+local function percentile (lat, p)
+  return lat[math.max(1, math.ceil(#lat * p))]
+end
+
+
+local function bench (name, keys)
+  local lat = {}
+  for i = 1, N do lat[i] = 0.0 end   -- preallocate the results
+  collectgarbage(); collectgarbage()
+  collectgarbage("stop")
+  local t = {}
+  local t0 = clock()
+  for i = 1, N do
+    local c = clock()
+    t[keys[i]] = i
+    lat[i] = clock() - c
+  end
+  local total = clock() - t0
+  collectgarbage("restart")
+  table.sort(lat)
+  local function us (x) return x * 1e6 end
+  print(string.format(
+        "%-8s %8.3fs  p50 %7.2fus  p99 %7.2fus  p99.99 %9.2fus  max %10.2fus",
+        name, total, us(percentile(lat, 0.5)), us(percentile(lat, 0.99)),
+        us(percentile(lat, 0.9999)), us(lat[N])))
+end
+
+
+print(_VERSION, N .. " insertions")
+bench("int", intkeys(N))
+bench("string", strkeys(N))
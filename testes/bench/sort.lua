@@ -0,0 +1,53 @@
+-- $Id: testes/bench/sort.lua $
+-- See Copyright Notice in file all.lua
+
+-- Micro benchmark for 'table.sort' on arrays of integers, floats, and
+-- strings, with several initial orders. Each case is sorted both with
+-- the default order (which can use the fast path for homogeneous
+-- arrays) and with an equivalent Lua comparator (which cannot).
+-- usage: lua sort.lua [size]
+
+local N = math.tointeger(arg and arg[1]) or 1000000
+
+
+local function lt (a, b) return a < b end
+
+
+local gens = {
+  int = function (i) return math.random(1 << 40) end,
+  float = function (i) return math.random() end,
+  string = function (i) return "k" .. math.random(N) end,
+}
+
+
+local orders = {
+  random = function (a) end,
+  sorted = function (a) table.sort(a) end,
+  reversed = function (a) table.sort(a, function (x, y) return x > y end) end,
+  few = function (a)
+    for i = 1, #a do a[i] = a[(i % 16) + 1] end
+  end,
+}
+
+
+local function bench (kind, order, cmp)
+  local a = {}
+  local gen = gens[kind]
+  for i = 1, N do a[i] = gen(i) end
+  orders[order](a)
+  collectgarbage(); collectgarbage()
+  local t0 = os.clock()
+  table.sort(a, cmp)
+  return os.clock() - t0
+end
+
+
+print(_VERSION)
+for _, kind in ipairs{"int", "float", "string"} do
+  for _, order in ipairs{"random", "sorted", "reversed", "few"} do
+    local fast = bench(kind, order, nil)
+    local slow = bench(kind, order, lt)
+    print(string.format("%-8s %-10s %8.3fs  %8.3fs (comparator)  %6.1fx",
+          kind, order, fast, slow, slow / fast))
+  end
+end
@@ -0,0 +1,106 @@
+-- $Id: testes/bench/strings.lua $
+-- See Copyright Notice in file all.lua
+
+-- Micro benchmark for string hashing: interning of short strings
+-- (both new strings and strings already in the string table), and
+-- lookups in tables keyed by strings of several typical shapes, such
+-- as field names of JSON records, UUIDs, and URLs. To measure the
+-- word-at-a-time hash, compare with an interpreter built with
+-- '-DLUA_USE_WORDHASH=1'.
+-- usage: lua strings.lua [number of keys]
+
+local N = math.tointeger(arg and arg[1]) or 200000
+
+
+local function bench (name, n, f, ...)
+  collectgarbage(); collectgarbage()
+  local t0 = os.clock()
+  local rounds = f(...)
+  local t = os.clock() - t0
+  print(string.format("%-24s %8.3fs   %6.2f ns/op",
+        name, t, t * 1e9 / (n * rounds)))
+end
+
+
+local fields = {"id", "name", "type", "value", "created_at", "updated_at",
+  "user_id", "email", "status", "tags", "description", "parent_id",
+  "is_active", "score", "metadata", "x", "y", "url", "title", "count"}
+
+local hex = "0123456789abcdef"
+local function uuid (i)
+  local t = {}
+  for j = 1, 32 do
+    local d = (i * 2654435761 + j * 40503) % 16
+    t[j] = hex:sub(d + 1, d + 1)
+  end
+  local s = table.concat(t)
+  return string.format("%s-%s-%s-%s-%s", s:sub(1, 8), s:sub(9, 12),
+                       s:sub(13, 16), s:sub(17, 20), s:sub(21, 32))
+end
+
+
+-- key generators
+local gens = {
+  field = function (i) return fields[i % #fields + 1] .. (i // #fields) end,
+  uuid = uuid,
+  url = function (i)
+    return string.format("https://example.com/api/v2/users/%d/items/%d"
+                         .. "?sort=desc&page=%d", i, i * 7, i % 100)
+  end,
+}
+
+
+-- all keys concatenated, so that 'sub' creates (interns) them again
+local function pack (keys)
+  local pos, lens = {}, {}
+  local p = 1
+  for i = 1, #keys do
+    pos[i] = p; lens[i] = #keys[i]; p = p + #keys[i]
+  end
+  return table.concat(keys), pos, lens
+end
+
+
+local function intern (buff, pos, lens, keep)
+  local n = #pos
+  local r = math.max(1, 2000000 // n)
+  local sub = string.sub
+  for _ = 1, r do
+    for i = 1, n do
+      local p = pos[i]
+      local s = sub(buff, p, p + lens[i] - 1)
+    end
+    if not keep then collectgarbage() end   -- make strings new again
+  end
+  return r
+end
+
+
+-- look up keys as they are read from the input, as a parser does
+local function lookup (t, buff, pos, lens)
+  local n = #pos
+  local r = math.max(1, 2000000 // n)
+  local sub = string.sub
+  local s = 0
+  for _ = 1, r do
+    for i = 1, n do
+      local p = pos[i]
+      s = s + t[sub(buff, p, p + lens[i] - 1)]
+    end
+  end
+  return r
+end
+
+
+print(_VERSION)
+for _, kind in ipairs{"field", "uuid", "url"} do
+  local keys = {}
+  for i = 1, N do keys[i] = gens[kind](i) end
+  local buff, pos, lens = pack(keys)
+  keys = nil
+  bench(kind .. " intern (new)", N, intern, buff, pos, lens, false)
+  local t = {}
+  for i = 1, N do t[buff:sub(pos[i], pos[i] + lens[i] - 1)] = i end
+  bench(kind .. " intern (old)", N, intern, buff, pos, lens, true)
+  bench(kind .. " lookup", N, lookup, t, buff, pos, lens)
+end
@@ -56,6 +56,27 @@ do
   assert(f() == f())
 end
 
+do   -- closures that cannot be distinguished may be reused
+  local debug = require"debug"
+  local function const () return function () return 10 end end
+  local function mk (x) return function () return x end end
+  debug.cachestats(true)
+  assert(const() == const())
+  assert(debug.cachestats().closure == 1)
+  local f1, f2 = mk(1), mk(2)   -- different variables
+  assert(f1 ~= f2 and f1() == 1 and f2() == 2)
+  local y = 0
+  local function get () return function () return y end end
+  local g = get()
+  assert(get() == g)   -- same variable
+  debug.upvaluejoin(g, 1, f1, 1)
+  assert(get() ~= g and g() == 1 and get()() == 0)
+  -- closures in loops capture a new variable in each iteration
+  local t = {}
+  for i = 1, 20 do t[i] = function () return i end end
+  for i = 1, 20 do assert(t[i]() == i and t[i] ~= t[i + 1]) end
+end
+
 
 -- testing closures with 'for' control variable
 a = {}
@@ -382,7 +382,7 @@ check(function ()
   a = a
 end,
   'LOADNIL',
-  'MOVE', 'MOVE', 'SETTABLE',
+  'MOVE', 'SETTABLE',   -- no code for 'a = b', as both are nil
   'MOVE', 'MOVE', 'MOVE', 'SETTABLE',
   'MOVE', 'MOVE', 'MOVE',
   -- no code for a = a
@@ -445,5 +445,91 @@ do   -- string constants
   assert(T.listk(f2)[1] == nil)
 end
 
+
+do   -- quickening
+  -- opcode of the instruction at 'pc', plus its quickened version
+  local function op (f, pc)
+    local c = T.listcode(f)[pc]
+    return string.match(c, "%u%w+"), string.match(c, "%[(%u+)%]$")
+  end
+
+  local function f (a, b) return a + b end
+  check(f, 'ADD', 'MMBIN', 'RETURN1', 'RETURN0')
+  assert(select(2, op(f, 1)) == nil)
+  assert(f(1, 2) == 3)
+  local o, q = op(f, 1)
+  assert(o == 'ADD' and (q == 'ADDINT' or q == nil))
+  if q then   -- interpreter quickens code?
+    assert(f(1.0, 2.0) == 3.0)   -- goes to generic and back to float
+    assert(select(2, op(f, 1)) == 'ADDFLT')
+    assert(f(1, 2.5) == 3.5)   -- mixed operands stay generic
+    assert(select(2, op(f, 1)) == nil)
+    assert(f("1", 2) == 3)
+    assert(select(2, op(f, 1)) == nil)
+
+    f = function (a) if a < 10.5 then return a * 2 end end
+    assert(f(1.0) == 2.0)
+    assert(select(2, op(f, 1)) == nil)    -- constant was put in a register
+    assert(select(2, op(f, 2)) == 'LTFLT')
+    assert(select(2, op(f, 4)) == 'MULKFLT')
+    assert(f(3) == 6 and select(2, op(f, 2)) == nil)  -- mixed: generic
+    assert(select(2, op(f, 4)) == 'MULKINT')
+
+    -- too many de-specializations stop the quickening of a function
+    f = function (a) return a + 1 end
+    for i = 1, 100 do f(i % 2 == 0 and i or i + 0.0) end
+    f(1)
+    assert(select(2, op(f, 1)) == nil)
+  end
+end
+
+
+do   -- peephole optimizations
+  -- compile function from source (as binary chunks do not keep the
+  -- number of removed instructions)
+  local function func (s) return assert(load("return " .. s))() end
+  local getinfo = require"debug".getinfo
+  local function removed (f)
+    local n = getinfo(f, "u").nremoved
+    assert(n == T.listcode(f).removed)
+    return n
+  end
+
+  -- unreachable code
+  local f = func"function (a) do return a end; local x = a + 1; print(x) end"
+  check(f, 'RETURN1', 'RETURN0')
+  assert(removed(f) == 5 and f(10) == 10)
+
+  -- jump to the next instruction
+  f = func"function (a) if a then a = 1 else end return a end"
+  check(f, 'TEST', 'JMP', 'LOADI', 'RETURN1', 'RETURN0')
+  assert(removed(f) == 1 and f(true) == 1 and f(false) == false)
+
+  -- loads of values already in their registers
+  f = func"function () local x, y = 0, 0; x = 0; y = x; return x + y end"
+  check(f, 'LOADI', 'LOADI', 'ADD', 'MMBIN', 'RETURN1', 'RETURN0')
+  assert(removed(f) == 2 and f() == 0)
+
+  -- values computed directly into their final registers
+  f = func"function (a, b, t) a, b = t.x, 1; return a, b end"
+  check(f, 'GETFIELD', 'LOADI', 'MOVE', 'MOVE', 'RETURN', 'RETURN0')
+  local a, b = f(nil, nil, {x = 10})
+  assert(removed(f) == 1 and a == 10 and b == 1)
+  -- ('a' still needed, but it already is in the register for the result)
+  f = func"function (a, b, t) a, b = t.x, a; return a, b end"
+  check(f, 'GETFIELD', 'MOVE', 'MOVE', 'MOVE', 'RETURN', 'RETURN0')
+  a, b = f(20, nil, {x = 10})
+  assert(removed(f) == 1 and a == 10 and b == 20)
+
+  -- instructions alone in their lines are kept (for line hooks)
+  f = func[[function ()
+    local x = 0
+    x = 0
+    return x
+  end]]
+  check(f, 'LOADI', 'LOADI', 'RETURN1', 'RETURN0')
+  assert(removed(f) == 0)
+end
+
 print 'OK'
 
@@ -937,6 +937,21 @@ do   -- a few more tests for comparison operators
 
 end
 
+
+do   -- resume a comparison quickened while it was suspended
+  local mt = {__lt = function (a, b)
+    coroutine.yield()
+    return a.x < b.x
+  end}
+  local function f (a, b)
+    if a < b then return "lt" else return "ge" end
+  end
+  local co = coroutine.wrap(f)
+  co(setmetatable({x = 1}, mt), setmetatable({x = 2}, mt))  -- yields
+  for i = 1, 10 do assert(f(1, 2) == "lt") end   -- quickens the 'LT'
+  assert(co() == "lt")
+end
+
 assert(run(function ()
              a.BB = print
              return a.BB
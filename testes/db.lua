@@ -601,6 +601,93 @@ end
 
 debug.sethook()
 
+
+do   -- errors and hooks in functions hot enough to be compiled
+  local function sum (t, n)
+    local s = 0
+    for i = 1, n do
+      s = s + t[i]
+    end
+    return s
+  end
+  local t = {10, 20, 30}
+  for _ = 1, 2000 do assert(sum(t, 3) == 60) end
+  local line = debug.getinfo(sum, "S").linedefined + 3
+  local st, msg = pcall(sum, t, 4)
+  assert(not st and string.find(msg, ":" .. line .. ":"))
+  local n = 0
+  debug.sethook(function (_, l) if l == line then n = n + 1 end end, "l")
+  assert(sum(t, 3) == 60)
+  debug.sethook()
+  assert(n == 3)
+
+  -- hook set in the middle of a hot loop
+  local cnt = 0
+  local function loop (n, k)
+    local s = 0
+    for i = 1, n do
+      if i == k then debug.sethook(function () cnt = cnt + 1 end, "", 1) end
+      s = s + i
+    end
+    return s
+  end
+  for _ = 1, 2000 do assert(loop(10, -1) == 55) end
+  assert(loop(1000, 500) == 500500)
+  debug.sethook()
+  assert(cnt > 1000)
+end
+
+
+if not debug.traces() then
+  (Message or print)("\n >>> no trace recording: skipping trace tests <<<\n")
+else   -- traces of hot loops
+  -- (loops running in native code are not counted)
+  local interp = (debug.cachestats().jit == 0)
+  debug.traces(true)   -- discard old traces
+  local function f (n)
+    local s = 0.0
+    for i = 1, n do s = s + i * 0.5 end
+    return s
+  end
+  local line = debug.getinfo(f, "S").linedefined + 2
+  assert(f(1000) == 250250.0)
+  local found = false
+  for _, s in ipairs(debug.traces()) do
+    if string.find(s, ":" .. line .. " ") then
+      found = true
+      assert(string.find(s, "complete\n"))
+      assert(string.find(s, "FORLOOP"))
+      assert(string.find(s, "; float integer"))   -- 'i * 0.5'
+    end
+  end
+  assert(found or not interp)
+  -- a loop that gets hot in its last iteration
+  debug.traces(true)   -- also restart counting
+  local function g ()
+    for i = 1, 1000 do
+      if #debug.traces() > 0 then return i end
+    end
+  end
+  local res = g()
+  local tr = debug.traces()
+  assert(not interp or (res and #tr == 1 and
+                        string.find(tr[1], "left the function\n")))
+  debug.traces(true)
+  assert(#debug.traces() == 0)
+  -- a full table of traces stops recording until it is discarded
+  local code = "local s = 0; for i = 1, 200 do s = s + i end; return s"
+  for i = 1, 100 do assert(load(code)() == 20100) end
+  local n = #debug.traces()
+  assert(not interp or (0 < n and n < 100))
+  assert(load(code)() == 20100)
+  assert(#debug.traces() == n)   -- no new traces
+  debug.traces(true)
+  assert(load(code)() == 20100)
+  assert(not interp or #debug.traces() == 1)
+  debug.traces(true)
+end
+
+
 local g, g1
 
 -- tests for tail calls
@@ -698,7 +785,7 @@ do  -- C-function names in traceback
 end
 
 
--- testing nparams, nups e isvararg
+-- testing nparams, nups, isvararg, and nremoved
 local t = debug.getinfo(print, "u")
 assert(t.isvararg == true and t.nparams == 0 and t.nups == 0)
 
@@ -718,6 +805,13 @@ assert(t.isvararg == true and t.nparams == 0 and t.nups == 0)
 t = debug.getinfo(string.gmatch("abc", "a"))   -- C closure
 assert(t.isvararg == true and t.nparams == 0 and t.nups > 0)
 
+-- instructions removed by the optimizer (counted only for functions
+-- compiled from source)
+assert(debug.getinfo(print, "u").nremoved == 0)
+t = debug.getinfo(load("return function (a) do return a end; a = 1 end")(),
+                  "u")
+assert(math.type(t.nremoved) == "integer" and t.nremoved >= 0)
+
 
 
 -- testing debugging of coroutines
@@ -1041,5 +1135,59 @@ do   -- tests for 'source' in binary dumps
          debug.getinfo(h).source == '=?')
 end
 
+print("testing table sizes and the largest tables")
+do
+  local asize, nodes, used, bytes = debug.tablesize({})
+  assert(asize == 0 and nodes == 0 and used == 0 and bytes > 0)
+  local empty = bytes
+  asize, nodes, used, bytes = debug.tablesize({1, 2, 3, x = 1, y = 2})
+  assert(asize == 3 and nodes >= 2 and used == 2 and bytes > empty)
+
+  collectgarbage()
+  local line = debug.getinfo(1, "l").currentline + 1
+  local big = {}
+  for i = 1, 100000 do big[i] = true end
+  local h = {}
+  for i = 1, 5000 do h["x" .. i] = i end
+  local l = debug.largesttables(20)
+  assert(#l <= 20 and l[1].table == big)
+  assert(l[1].asize >= 100000 and l[1].used == 0)
+  local found = false
+  for i, r in ipairs(l) do
+    assert(r.table ~= l)
+    assert(i == 1 or r.bytes <= l[i - 1].bytes)
+    assert(r.bytes == select(4, debug.tablesize(r.table)))
+    if r.table == h then
+      found = true
+      assert(r.used == 5000 and r.nodes >= 5000)
+    end
+  end
+  assert(found)
+  -- the site of a table is known only when the interpreter records it
+  assert(l[1].source == nil or
+         (l[1].source == debug.getinfo(1, "S").source and
+          l[1].line == line))
+  assert(#debug.largesttables(0) == 0)
+  assert(#debug.largesttables(1) == 1)
+  -- a large limit does not preallocate a large list
+  assert(#debug.largesttables(1 << 30) > 1)
+  assert(not pcall(debug.largesttables, -1))
+end
+
+
+do   print("testing the string table")
+  local n, size, avg, max = debug.stringtable()
+  assert(0 < n and n <= size and 1 <= avg and avg <= max)
+  local a = {}
+  for i = 1, 3 * size do a[i] = "str" .. i end
+  local n1, size1, avg1, max1 = debug.stringtable()
+  assert(n1 >= 3 * size and size1 > size and n1 <= size1)
+  assert(1 <= avg1 and avg1 <= max1 and max1 <= n1)
+  a = nil
+  collectgarbage()
+  assert(debug.stringtable() < n1)
+end
+
+
 print"OK"
 
@@ -475,6 +475,80 @@ assert(getmetatable(nil) == nil)
 debug.setmetatable(nil, {})
 
 
+do  print("testing inline caches for fields and methods")
+  local class = {}
+  class.__index = class
+  function class.get (self) return self.x end
+  local function new (x) return setmetatable({x = x}, class) end
+  local function run (objs)
+    local s = 0
+    for i = 1, #objs do s = s + objs[i]:get() end
+    return s
+  end
+  local objs = {}
+  for i = 1, 20 do objs[i] = new(i) end
+  assert(run(objs) == 210)
+  -- method shadowed by a field in one instance
+  objs[3].get = function (self) return 0 end
+  assert(run(objs) == 207)
+  objs[3].get = nil
+  assert(run(objs) == 210)
+  -- method redefined in the class
+  function class.get (self) return -self.x end
+  assert(run(objs) == -210)
+  -- '__index' changed to a function and then to another table
+  class.__index = function (t, k) return function () return 1 end end
+  assert(run(objs) == 20)
+  class.__index = {get = function (self) return self.x * 2 end}
+  assert(run(objs) == 420)
+  -- fields removed and tables resized between accesses
+  local function getx (t) return t.x end
+  local function setx (t, v) t.x = v end
+  local t = {x = 1, y = 2}
+  for i = 1, 3 do assert(getx(t) == 1) end
+  t.x = nil
+  assert(getx(t) == nil)
+  setx(t, 10)
+  for i = 1, 100 do t["k" .. i] = i end   -- force rehashes
+  assert(getx(t) == 10)
+  setx(t, 20); assert(t.x == 20 and getx(t) == 20)
+  -- same site used with strings, userdata-like values, and non tables
+  assert(("abc"):upper() == "ABC")
+  assert(not pcall(getx, 10))
+  assert(not pcall(setx, "abc", 1))
+  -- monomorphic sites hit the cache (if the build has caches)
+  debug.cachestats(true)   -- reset counters
+  for i = 1, 100 do run(objs) end
+  local st = debug.cachestats()
+  assert(st.fieldhit > st.fieldmiss or st.fieldhit + st.fieldmiss == 0)
+end
+
+
+do  print("testing inline caches for global variables")
+  local env = {x = 1}
+  local get = load("return x", "", "t", env)
+  local set = load("x = ...", "", "t", env)
+  for i = 1, 3 do assert(get() == 1) end
+  set(2); assert(env.x == 2 and get() == 2)
+  env.x = nil
+  assert(get() == nil)
+  set(3)
+  for i = 1, 100 do env["k" .. i] = i end   -- force rehashes
+  assert(get() == 3)
+  -- same sites with another '_ENV' and with an '__index' table
+  debug.setupvalue(get, 1, setmetatable({}, {__index = {x = 10}}))
+  assert(get() == 10)
+  debug.setupvalue(set, 1, debug.getupvalue(get, 1))
+  set(20); assert(get() == 20)
+  -- reads of globals hit the cache (if the build has caches)
+  local cachestats = debug.cachestats
+  cachestats(true)   -- reset counters
+  for i = 1, 100 do get() end
+  local st = cachestats()
+  assert(st.globalhit == 100 and st.globalmiss == 0 or
+         st.globalhit + st.globalmiss == 0)
+end
+
 -- loops in delegation
 a = {}; setmetatable(a, a); a.__index = a; a.__newindex = a
 assert(not pcall(function (a,b) return a[b] end, a, 10))
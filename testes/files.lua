@@ -696,6 +696,16 @@ do
 end
 
 
+do   -- writing string buffers
+  local f <close> = assert(io.tmpfile())
+  local b = string.buffer():append("alo", 10)
+  local long = string.buffer():append(string.rep("x", 5000))
+  assert(long:tostring() == string.rep("x", 5000))   -- now shared
+  assert(f:write(b, "|", string.buffer(), "|", long, b) == f)
+  f:seek("set")
+  assert(f:read("a") == "alo10||" .. string.rep("x", 5000) .. "alo10")
+end
+
 if not _soft then
   print("testing large files (> BUFSIZ)")
   io.output(file)
@@ -53,6 +53,21 @@ do
 end
 
 
+do   -- closures cached in old prototypes stay young
+  local debug = require"debug"
+  local function mk () return function () return 10 end end
+  collectgarbage()   -- make 'mk' and its prototypes old
+  local f = mk()
+  assert(not T or T.gcage(f) == "new")
+  debug.cachestats(true)
+  assert(mk() == f and debug.cachestats().closure == 1)
+  local w = setmetatable({f}, {__mode = "v"})
+  f = nil
+  collectgarbage("step")   -- the cache does not keep the closure alive
+  assert(w[1] == nil and mk()() == 10)
+end
+
+
 do   -- bug in 5.4.0
 -- When an object aged OLD1 is finalized, it is moved from the list
 -- 'finobj' to the *beginning* of the list 'allgc', but that part of the
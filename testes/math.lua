@@ -803,6 +803,70 @@ do
 end
 
 
+do  print("testing quickened arithmetic and comparisons")
+  -- each function runs with operands of changing types, so that its
+  -- instructions are specialized and de-specialized several times
+  local function arith (a, b)
+    return a + b, a - b, a * b, a + 1, a - 2, a + 3.5, a * 3, a * 0.5
+  end
+  local function order (a, b)
+    return a < b, a <= b, b < a, b <= a
+  end
+
+  local mt = {__add = function (a, b) return "add" end,
+              __sub = function (a, b) return "sub" end,
+              __mul = function (a, b) return "mul" end,
+              __lt = function (a, b) return true end,
+              __le = function (a, b) return false end}
+  local obj = setmetatable({}, mt)
+
+  local function checkarith (a, b)
+    local r = {arith(a, b)}
+    local e = {a + b, a - b, a * b, a + 1, a - 2, a + 3.5, a * 3, a * 0.5}
+    for i = 1, #e do
+      assert(eqT(r[i], e[i]) or (r[i] ~= r[i] and e[i] ~= e[i]))
+    end
+  end
+
+  local dump = string.dump(arith)
+  for _, v in ipairs{{1, 2}, {1.5, 2.5}, {3, 0.5}, {-0.0, 0.0},
+                     {maxint, 1}, {minint, -1}, {1/0, -1/0},
+                     {"10", 2}, {4, "0x10"}, {2^53, 1.0}} do
+    for i = 1, 3 do checkarith(v[1], v[2]) end
+  end
+  -- quickened code is dumped in its generic form
+  assert(string.dump(arith) == dump)
+
+  for _, v in ipairs{{1, 2}, {2.5, 1.5}, {1, 1.0}, {0/0, 1.0},
+                     {maxint, maxint + 0.0}, {minint, -2^63}, {3, 3}} do
+    for i = 1, 3 do
+      local a, b = v[1], v[2]
+      local r1, r2, r3, r4 = order(a, b)
+      assert(r1 == (a < b) and r2 == (a <= b) and
+             r3 == (b < a) and r4 == (b <= a))
+    end
+  end
+  assert(not pcall(order, 1, "2"))
+  assert(select(2, pcall(order, {}, 1)):find("compare"))
+
+  -- metamethods after quickening
+  assert(arith(1, 2) == 3 and arith(obj, 2) == "add" and arith(1, 2) == 3)
+  for i = 1, 3 do
+    assert(order(1, 2) == true and order(obj, obj) == true)
+    assert(select(2, order(obj, obj)) == false)
+  end
+
+  -- a loop whose accumulator changes type
+  local function sum (n, x)
+    local s = x
+    for i = 1, n do s = s + i end
+    return s
+  end
+  assert(eqT(sum(10, 0), 55) and eqT(sum(10, 0.0), 55.0))
+  assert(eqT(sum(10, 0), 55) and sum(0, "x") == "x")
+end
+
+
 print("testing 'math.random'")
 
 local random, max, min = math.random, math.max, math.min
@@ -11,6 +11,8 @@ end
 
 local function check (t, na, nh)
   if not T then return end
+  if T.swisshash then return end   -- (hash parts grow at other sizes)
+  if T.shapes then return end   -- (string keys may be in slots)
   local a, h = T.querytab(t)
   if a ~= na or h ~= nh then
     print(na, nh, a, h)
@@ -226,6 +228,38 @@ assert(#{nil, nil} == 0)
 assert(#{nil, nil, nil} == 0)
 assert(#{nil, nil, nil, nil} == 0)
 assert(#{1, 2, 3, nil, nil} == 3)
+
+
+do   -- size of sequences with a tail in the hash part
+  local function isborder (t, n)
+    return (n == 0 or t[n] ~= nil) and t[n + 1] == nil
+  end
+  local a = {}
+  for i = 1, 1000 do a["x" .. i] = i end   -- large hash part
+  for i = 1, 500 do a[#a + 1] = i; assert(#a == i) end
+  for i = 500, 1, -1 do assert(#a == i); a[i] = nil end
+  assert(#a == 0)
+  for i = 1, 300 do a[i] = i end
+  assert(#a == 300)
+  a[200] = nil   -- now, both 199 and 300 are borders
+  assert(isborder(a, #a))
+  for i = 301, 310 do a[i] = i; assert(isborder(a, #a)) end
+  for i = 310, 250, -7 do a[i] = nil; assert(isborder(a, #a)) end
+  for i = 1, 199 do a[i] = nil end
+  assert(#a == 0 or isborder(a, #a))
+
+  if T then   -- appending to a full array part grows it
+    local a = {1, 2, 3, 4, x = 1, y = 2, z = 3}
+    assert(T.querytab(a) == 4)
+    a[5] = 5
+    assert(T.querytab(a) == 8 and #a == 5)
+    -- an array part with holes may keep its size
+    local b = {1, 2, 3, 4, x = 1, y = 2, z = 3}
+    b[2] = nil
+    b[5] = 5
+    assert(T.querytab(b) == 4 and b[5] == 5 and isborder(b, #b))
+  end
+end
 print'+'
 
 
@@ -761,6 +795,98 @@ end
 assert(x == 5)
 
 
+do   print("testing 'next' run inline by generic 'for'")
+  local t = {10, 20, 30, x = 1, y = 2, [2.5] = 3, [true] = 4}
+  for i = 1, 100 do t["k" .. i] = i end
+  local debug = require"debug"
+  local keys = {}
+  local k = next(t)
+  while k ~= nil do keys[#keys + 1] = k; k = next(t, k) end
+  debug.cachestats(true)
+  local i = 0
+  for k, v in pairs(t) do
+    i = i + 1
+    assert(k == keys[i] and v == t[k])
+  end
+  assert(i == #keys)
+  -- every step (plus the last one) ran without calling 'next'
+  assert(debug.cachestats().iter == i + 1)
+
+  -- one or more than two variables
+  i = 0
+  for k in next, t do i = i + 1; assert(k == keys[i]) end
+  assert(i == #keys)
+  for k, v, w, z in pairs({10}) do
+    assert(k == 1 and v == 10 and w == nil and z == nil)
+  end
+  for k in pairs({}) do error("empty table") end
+
+  -- clearing fields during the traversal
+  i = 0
+  for k, v in pairs(t) do
+    t[k] = nil; i = i + 1
+    collectgarbage()   -- removed keys may become dead
+  end
+  assert(i == #keys and next(t) == nil)
+
+  -- starting from a given key
+  t = {1, 2, 3, 4}
+  i = 1
+  for k, v in next, t, 1 do i = i + 1; assert(k == i and v == i) end
+  assert(i == 4)
+
+  -- closing value is kept
+  local closed = 0
+  local c = setmetatable({}, {__close = function () closed = closed + 1 end})
+  i = 0
+  for k, v in next, t, nil, c do i = i + 1 end
+  assert(i == 4 and closed == 1)
+end
+
+
+do   print("testing 'ipairs' run inline by generic 'for'")
+  local debug = require"debug"
+  local t = {10, 20, 30, 40, 50, x = 1}
+  debug.cachestats(true)
+  local i = 0
+  for k, v in ipairs(t) do
+    i = i + 1
+    assert(k == i and v == i * 10)
+  end
+  assert(i == 5)
+  assert(debug.cachestats().iter == i + 1)
+
+  -- elements in the hash part and float values
+  t = {[1] = 1, [2] = 2.5, [3] = "x", [5] = 5}
+  i = 0
+  for k, v in ipairs(t) do i = i + 1; assert(v == t[k]) end
+  assert(i == 3)
+
+  -- one or more than two variables; changes during the traversal
+  i = 0
+  t = {1, 2, 3}
+  for k in ipairs(t) do i = i + 1; t[k + 1] = nil end
+  assert(i == 1)
+  for k, v, w in ipairs({10}) do assert(k == 1 and v == 10 and w == nil) end
+
+  -- metatable without '__index' does not matter
+  t = setmetatable({1, 2}, {__newindex = error})
+  i = 0
+  for k, v in ipairs(t) do i = i + 1 end
+  assert(i == 2)
+
+  -- '__index' is called for absent elements
+  t = setmetatable({1, 2}, {__index = function (_, k)
+                              if k <= 4 then return k end end})
+  i = 0
+  for k, v in ipairs(t) do i = i + 1; assert(v == k) end
+  assert(i == 4)
+
+  -- non-integer control variable
+  local f = ipairs({})
+  checkerror("number expected", function () for k in f, {}, "a" do end end)
+end
+
 
 -- testing __pairs and __ipairs metamethod
 a = {}
@@ -824,4 +950,257 @@ do
   
 end
 
+
+do   print("testing record-like tables (shapes)")
+  local function count (t)
+    local n = 0
+    for _ in pairs(t) do n = n + 1 end
+    return n
+  end
+
+  -- records built in different orders share no layout
+  local p1 = {x = 1, y = 2}
+  local p2 = {y = 20, x = 10}
+  local p3 = {}; p3.x = 100; p3.y = 200; p3.z = 300
+  assert(p1.x + p2.x + p3.x == 111 and p1.y + p2.y + p3.y == 222)
+  assert(p1.z == nil and p2.z == nil and p3.z == 300)
+  assert(count(p1) == 2 and count(p3) == 3)
+
+  -- mixing fields with other keys
+  local r = {1, 2, 3, a = "a", [2.5] = "f", [true] = "t"}
+  r.b = "b"; r[10] = 10; r[r] = r
+  assert(r[1] + r[2] + r[3] == 6 and r.a .. r.b == "ab")
+  assert(r[2.5] == "f" and r[true] == "t" and r[10] == 10 and r[r] == r)
+  assert(count(r) == 9)
+
+  -- removing fields while traversing
+  local t = {}
+  for i = 1, 20 do t["f" .. i] = i end
+  local sum = 0
+  for k, v in pairs(t) do
+    t[k] = nil
+    sum = sum + v
+  end
+  assert(sum == 210 and next(t) == nil)
+  t.f3 = 3    -- reuses the field
+  assert(t.f3 == 3 and count(t) == 1)
+
+  -- assigning to fields while traversing
+  t = {a = 1, b = 2, c = 3, d = 4}
+  for k, v in pairs(t) do t[k] = v * 10 end
+  assert(t.a + t.b + t.c + t.d == 100)
+
+  -- too many fields for a shape
+  t = {}
+  for i = 1, 100 do
+    t["k" .. i] = i
+    assert(t["k" .. i] == i and t["k" .. (i + 1)] == nil)
+  end
+  sum = 0
+  for k, v in pairs(t) do assert(t[k] == v); sum = sum + v end
+  assert(sum == 5050)
+
+  -- many records with the same prefix but different extensions
+  local list = {}
+  for i = 1, 50 do
+    local o = {name = i, kind = "k"}
+    o["extra" .. i] = i
+    list[i] = o
+  end
+  for i = 1, 50 do
+    local o = list[i]
+    assert(o.name == i and o.kind == "k" and o["extra" .. i] == i)
+    assert(o["extra" .. (i + 1)] == nil and count(o) == 3)
+  end
+
+  -- field access through inline caches, with different layouts
+  local function getx (o) return o.x end
+  local function setx (o, v) o.x = v end
+  local objs = {{x = 1}, {y = 0, x = 2}, {}, setmetatable({}, {__index = {x = 4}})}
+  objs[3].x = 3
+  for _ = 1, 3 do
+    for i, o in ipairs(objs) do
+      assert(getx(o) == i)
+      setx(o, i)
+    end
+  end
+  objs[1].x = nil; setx(objs[1], 5)
+  assert(getx(objs[1]) == 5 and count(objs[1]) == 1)
+
+  -- weak values in fields
+  t = setmetatable({}, {__mode = "v"})
+  t.a = {}; t.b = "str"; t.c = {}
+  local keep = t.c
+  collectgarbage()
+  assert(t.a == nil and t.b == "str" and t.c == keep)
+  t.a = 1
+  assert(count(t) == 3)
+
+  -- weak keys (strings are never collected)
+  t = setmetatable({}, {__mode = "k"})
+  t.a = {}; t[{}] = 1
+  collectgarbage()
+  assert(type(t.a) == "table" and count(t) == 1)
+
+  -- fields survive collections after their keys are gone elsewhere
+  list = {}
+  for i = 1, 100 do list[i] = {["key" .. i] = i} end
+  collectgarbage(); collectgarbage()
+  for i = 1, 100 do assert(list[i]["key" .. i] == i) end
+end
+
+
+do   print("testing arrays of numbers (packed arrays)")
+  local function check (t, n, v)   -- 't' has 'n' entries 't[i] == v(i)'
+    assert(#t == n)
+    for i = 1, n do assert(t[i] == v(i) and math.type(t[i]) == math.type(v(i))) end
+    local c = 0
+    for k, x in pairs(t) do c = c + 1; assert(x == v(k)) end
+    assert(c == n)
+  end
+  local function id (i) return i end
+  local function half (i) return i / 2 end
+
+  local a = {}
+  for i = 1, 1000 do a[i] = i end
+  check(a, 1000, id)
+  a[1000] = nil; a[999] = nil      -- removing from the end
+  check(a, 998, id)
+  a[999] = 999; a[1000] = 1000
+  check(a, 1000, id)
+
+  local f = {}
+  for i = 1, 1000 do f[#f + 1] = i / 2 end
+  check(f, 1000, half)
+  f[10] = 5     -- integer into an array of floats
+  assert(math.type(f[10]) == "integer" and f[11] == 5.5 and f[9] == 4.5)
+  f[10] = 5.0
+  check(f, 1000, half)
+
+  -- constructors
+  local c = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10}
+  check(c, 10, id)
+  c = {0.5, 1.0, 1.5, 2.0}
+  check(c, 4, half)
+  c = {1, 2.0, 3}
+  assert(math.type(c[1]) == "integer" and math.type(c[2]) == "float")
+  c = {1, nil, 3}
+  assert(c[1] == 1 and c[2] == nil and c[3] == 3)
+  c = {table.unpack(a)}
+  check(c, 1000, id)
+
+  -- holes and other types
+  local h = {}
+  for i = 1, 100 do h[i] = i end
+  h[50] = nil
+  assert(h[49] == 49 and h[50] == nil and h[51] == 51)
+  h[50] = "x"; h[60] = {}; h[70] = print
+  assert(h[50] == "x" and type(h[60]) == "table" and h[70] == print)
+  collectgarbage()
+  assert(type(h[60]) == "table")     -- collector sees the new values
+  for i = 1, 100 do h[i] = {} end
+  collectgarbage()
+  for i = 1, 100 do assert(type(h[i]) == "table") end
+
+  -- changing types while traversing
+  local t = {}
+  for i = 1, 100 do t[i] = i end
+  for k, v in ipairs(t) do t[k] = tostring(v) end
+  for i = 1, 100 do assert(t[i] == tostring(i)) end
+  t = {}
+  for i = 1, 100 do t[i] = i end
+  local n = 0
+  for k, v in pairs(t) do
+    n = n + 1
+    t[k] = nil
+  end
+  assert(n == 100 and next(t) == nil)
+
+  -- arrays built out of order
+  t = {}
+  for i = 100, 1, -1 do t[i] = i end
+  check(t, 100, id)
+  t = {}
+  for i = 1, 100, 2 do t[i] = i end
+  for i = 2, 100, 2 do t[i] = i end
+  check(t, 100, id)
+
+  -- '__newindex' is called only for absent entries
+  local log = {}
+  t = setmetatable({1, 2, 3}, {__newindex = function (t, k, v)
+    log[#log + 1] = k
+    rawset(t, k, v)
+  end})
+  t[2] = "two"; t[3] = 3.0; t[4] = 4; t[1] = nil; t[1] = 1
+  assert(#log == 2 and log[1] == 4 and log[2] == 1)
+  assert(t[1] == 1 and t[2] == "two" and t[3] == 3.0 and t[4] == 4)
+
+  -- table library
+  t = {}
+  for i = 1, 100 do t[i] = (i * 37) % 101 end
+  table.sort(t)
+  for i = 2, 100 do assert(t[i - 1] < t[i]) end
+  table.insert(t, 1, 0.5)
+  assert(t[1] == 0.5 and #t == 101)
+  assert(table.remove(t, 1) == 0.5 and #t == 100)
+
+  if T and T.packedarrays then   -- packed arrays need no tags
+    collectgarbage(); collectgarbage()
+    local m = collectgarbage("count")
+    a = table.move(a, 1, 1000, 1, {})
+    local used = (collectgarbage("count") - m) * 1024
+    assert(used < 1024 * 8 + 100)
+  end
+end
+
+
+do   print("testing hash parts growing incrementally")
+  -- (tables large enough to migrate their entries with LUA_USE_INCREHASH)
+  local N = 20000
+  local function key (i) return (i % 2 == 0) and "k" .. i or i * 3 + 0.5 end
+  local t = {}
+  for i = 1, N do
+    t[key(i)] = i
+    if i % 997 == 0 then   -- check everything from time to time
+      for j = 1, i do assert(t[key(j)] == j) end
+      assert(t[key(i + 1)] == nil)
+    end
+  end
+  -- removals and updates of entries in both vectors
+  for i = 1, N, 3 do t[key(i)] = nil end
+  for i = 2, N, 3 do t[key(i)] = -i end
+  for i = N + 1, 2 * N do t[key(i)] = i end    -- more growth
+  for i = 1, N, 3 do t[key(i)] = i end   -- removed keys come back
+  for i = 1, 2 * N do
+    local v = t[key(i)]
+    assert(v == ((i <= N and i % 3 == 2) and -i or i))
+  end
+  -- traversals see each key once
+  local seen, n = {}, 0
+  for k, v in pairs(t) do
+    assert(not seen[k]); seen[k] = true; n = n + 1
+  end
+  assert(n == 2 * N)
+  for k in pairs(t) do t[k] = nil end   -- clearing while traversing
+  assert(next(t) == nil)
+
+  -- weak tables
+  local w = setmetatable({}, {__mode = "v"})
+  local keep = {}
+  for i = 1, N do
+    local v = {}
+    w[key(i)] = v
+    if i % 2 == 0 then keep[i] = v end
+  end
+  collectgarbage(); collectgarbage()
+  n = 0
+  for k in pairs(w) do n = n + 1 end
+  assert(n == N // 2)
+  for i = 2, N, 2 do assert(w[key(i)] == keep[i]) end
+  w = setmetatable({}, {__mode = "k"})
+  for i = 1, N do w[{}] = i end
+  collectgarbage(); collectgarbage()
+  assert(next(w) == nil)
+end
+
 print"OK"
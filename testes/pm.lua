@@ -435,5 +435,101 @@ do   -- test reuse of original string in gsub
   assert(r == s and string.format("%p", s) ~= string.format("%p", r))
 end
 
+do  print("testing compiled patterns")
+  -- patterns are compiled when used again; results must not change
+  local function flush ()   -- a new locale empties the cache
+    os.setlocale(os.setlocale())
+  end
+  local function all (s, p, r, new)
+    local t = {}
+    local function run (f, ...)
+      if new then flush() end
+      local res = table.pack(pcall(f, ...))
+      for i = 1, res.n do t[#t + 1] = tostring(res[i]) end
+    end
+    run(string.find, s, p)
+    run(string.match, s, p)
+    run(string.gsub, s, p, r)
+    run(function ()
+      local res = {}
+      for a, b in string.gmatch(s, p) do
+        res[#res + 1] = tostring(a) .. "|" .. tostring(b)
+      end
+      return table.concat(res, " ")
+    end)
+    return table.concat(t, " ")
+  end
+  local cases = {
+    {"hello world from Lua", "(%w+) (%w+)"},
+    {"  key = value  ", "^%s*(%w+)%s*=%s*(%w+)%s*$"},
+    {"THE (quick) fox", "%f[%a]%a+%f[%A]"},
+    {"f(a(b)c) g(d)", "%b()"},
+    {"abcabc xyzxyz", "(%a%a%a)%1"},
+    {"a.b.c", "%."},
+    {"[x] [y]", "%[(.-)%]"},
+    {"aaa", "a-b"},
+    {"aaa", "^a?a?$"},
+    {"x = 10, y = 20", "()(%a)()"},
+    {"^caret^", "^^"},
+    {"1.5e10 and 2", "[%d.e]+"},
+    {"]]]", "[]]+"},
+    {"a\0b\0c", "%z"},
+    {"a\0b\0c", "[^%z]+"},
+    {"end", "d$"},
+    {"x$y", "$y"},
+    -- patterns that raise errors (or not) exactly as before
+    {"abc", "x["},
+    {"abc", "a["},
+    {"abc", "(a"},
+    {"abc", "x(a"},
+    {"abc", "a)"},
+    {"abc", "%1"},
+    {"abc", "(a)%2"},
+    {"abc", "a%"},
+    {"abc", "%ba"},
+    {"abc", "%f"},
+    {"abc", string.rep("(", 33) .. string.rep(")", 33)},
+    {string.rep("a", 300), string.rep("a?", 300) .. string.rep("a", 300)},
+  }
+  for _, c in ipairs(cases) do
+    local s, p = c[1], c[2]
+    local r = all(s, p, "<%0>", true)
+    assert(all(s, p, "<%0>") == r and all(s, p, "<%0>") == r)
+  end
+
+  -- many patterns, so that the cache is flushed
+  for i = 1, 300 do
+    local p = "(%d+)-" .. i
+    for _ = 1, 2 do
+      assert(string.match("x12-" .. i .. "y", p) == "12")
+    end
+  end
+
+  -- cache flushed while a compiled pattern is in use
+  local s = string.rep("a1 ", 10)
+  for _ = 1, 2 do
+    local r = string.gsub(s, "%a(%d)", function (d)
+      for i = 1, 100 do string.find("x", "x" .. i .. "+"); end
+      collectgarbage()
+      return d
+    end)
+    assert(r == string.rep("1 ", 10))
+  end
+  local t = {}
+  for _ = 1, 2 do t[#t + 1] = string.gmatch(s, "(%a)%d") end
+  for i = 1, 200 do string.find("x", "x" .. i .. "+"); string.find("x", "x" .. i .. "+") end
+  collectgarbage()
+  for i = 1, #t do
+    local n = 0
+    for a in t[i] do assert(a == "a"); n = n + 1 end
+    assert(n == 10)
+  end
+
+  -- a changed locale flushes the cache
+  assert(string.match("x", "%a") == "x" and string.match("x", "%a") == "x")
+  os.setlocale(os.setlocale())
+  assert(string.match("x", "%a") == "x")
+end
+
 print('OK')
 
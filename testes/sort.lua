@@ -33,13 +33,110 @@ do print "testing 'table.create'"
   t = table.create(0, 1024)
   memdiff = collectgarbage("count") * 1024 - m
   assert(memdiff > 1024 * 12)
-  assert(not T or select(2, T.querytab(t)) == 1024)
+  assert(not T or T.swisshash or select(2, T.querytab(t)) == 1024)
 
   checkerror("table overflow", table.create, (1<<31) + 1)
   checkerror("table overflow", table.create, 0, (1<<31) + 1)
 end
 
 
+do print "testing 'table.compact' and 'table.clear'"
+  local N = 10000
+  local function mem () collectgarbage(); return collectgarbage("count") end
+  local function fill (t)
+    for i = 1, N do t[i] = i; t[i + 0.5] = i end
+    return t
+  end
+  local t = fill({})
+  local m = mem()
+  for i = 11, N do t[i] = nil; t[i + 0.5] = nil end
+  assert(table.compact(t) == t)
+  assert(mem() < m - N * 16 / 1024)
+  for i = 1, 10 do assert(t[i] == i and t[i + 0.5] == i) end
+  local n = 0
+  for k, v in pairs(t) do n = n + 1 end
+  assert(n == 20)
+  assert(not T or (T.querytab(t) < 64 and select(2, T.querytab(t)) < 64))
+  assert(next(table.compact({})) == nil)
+
+  -- clear keeps the allocated space
+  t = fill({})
+  m = mem()
+  assert(table.clear(t) == t)
+  assert(next(t) == nil and #t == 0 and t[1] == nil and t[1.5] == nil)
+  fill(t)
+  assert(mem() < m + 16)    -- no reallocations (room for some noise)
+  for i = 1, N do assert(t[i] == i and t[i + 0.5] == i) end
+  t = setmetatable({x = 1, y = 2, 10, 20}, {__newindex = error})
+  table.clear(t)    -- no metamethods
+  assert(next(t) == nil)
+  rawset(t, "x", 3); assert(t.x == 3 and t.y == nil)
+
+  checkerror("table expected", table.compact, 1)
+  checkerror("table expected", table.clear)
+end
+
+
+do print "testing 'table.clone' and 'table.copyinto'"
+  local function eqT (a, b)
+    for k, v in pairs(a) do assert(rawequal(b[k], v)) end
+    for k, v in pairs(b) do assert(rawequal(a[k], v)) end
+  end
+  local function sample ()
+    local t = {10, 20, 30, nil, 50, x = 1, y = "y", [2.5] = true}
+    for i = 1, 100 do t["k" .. i] = i end
+    for i = 1, 100, 3 do t["k" .. i] = nil end   -- leave dead keys
+    for i = 1000, 1100 do t[i] = i end
+    t[t] = t
+    return t
+  end
+  local t = sample()
+  local mt = {__index = function (_, k) return k end}
+  setmetatable(t, mt)
+  local c = table.clone(t)
+  assert(c ~= t and getmetatable(c) == mt and c.none == "none")
+  eqT(t, c)
+  c.x = 2; c[1] = 0; c.new = 1   -- copies are independent
+  assert(t.x == 1 and t[1] == 10 and rawget(t, "new") == nil)
+  for i = 1, 200 do c[i + 0.5] = i end   -- clone can grow
+  for i = 1, 200 do assert(c[i + 0.5] == i) end
+
+  -- clones of metatables work as metatables
+  local m = table.clone({__index = {a = 1}})
+  assert(setmetatable({}, m).a == 1)
+
+  -- deep clones keep shared subtables and cycles
+  local sub = {1, 2, {3}}
+  t = {a = sub, b = sub, l = {}}
+  t.l.up = t
+  c = table.clone(t, true)
+  assert(c.a ~= sub and c.a == c.b and c.l.up == c and c.a[3][1] == 3)
+  assert(c.a[3] ~= sub[3])
+  c = table.clone(t)
+  assert(c.a == sub and c.l == t.l)
+
+  -- copy into tables empty or not
+  local d = table.copyinto({}, t)
+  eqT(d, t)
+  local src = sample()
+  d = {1, 2, 3, x = 10, z = 20}
+  assert(table.copyinto(d, src) == d)
+  assert(d.z == 20 and d[4] == nil and d[3] == 30 and d[1000] == 1000)
+  src.z = nil; src[4] = nil; d.z = nil; d[4] = nil
+  eqT(d, src)
+  d = table.create(100, 100)
+  table.copyinto(d, src)
+  eqT(d, src)
+  d = setmetatable({}, {__newindex = error})
+  table.copyinto(d, {1, 2, x = 3})   -- no metamethods
+  assert(rawget(d, 1) == 1 and rawget(d, "x") == 3)
+  table.copyinto(d, d)
+
+  checkerror("table expected", table.clone, 1)
+  checkerror("table expected", table.copyinto, {}, nil)
+end
+
+
 print "testing unpack"
 
 local unpack = table.unpack
@@ -329,6 +426,47 @@ table.sort(AA, function (x, y)
 
 _G.AA = nil
 
+
+do   -- sorting arrays of numbers or strings without calling '<'
+  local function lt (x, y) return x < y end
+  local function same (a, b)
+    assert(#a == #b)
+    for i = 1, #a do
+      assert(a[i] == b[i] and math.type(a[i]) == math.type(b[i]))
+    end
+  end
+  local function test (gen)
+    for _, n in ipairs{2, 7, 24, 25, 100, 129, 1000, 3000} do
+      local a, b = {}, {}
+      for i = 1, n do a[i] = gen(i, n); b[i] = a[i] end
+      table.sort(a); table.sort(b, lt)
+      same(a, b)
+    end
+  end
+  test(function (i, n) return math.random(n) end)           -- integers
+  test(function (i, n) return math.random(3) end)           -- duplicates
+  test(function (i, n) return i end)                        -- sorted
+  test(function (i, n) return n - i end)                    -- reversed
+  test(function (i, n) return math.abs(n // 2 - i) end)     -- organ pipe
+  test(function (i, n) return math.random(-4, 4) * math.mininteger end)
+  test(function (i, n) return math.random() - 0.5 end)      -- floats
+  test(function (i, n)
+    return ({-math.huge, math.huge, -0.0, 0.0, 1.5, -1.5})[math.random(6)]
+  end)
+  test(function (i, n) return tostring(math.random(n)) end) -- strings
+  test(function (i, n)
+    return string.rep("\0x", math.random(3)) .. string.rep("a", i % 50)
+  end)
+
+  -- mixed and NaN arrays still sort through the operator
+  a = {3, 1.5, 2, 0.5}
+  table.sort(a)
+  same(a, {0.5, 1.5, 2, 3})
+  a = {3, 0/0, 1}
+  table.sort(a)    -- no error; order is unspecified
+  checkerror("compare", table.sort, {1, "x", 2})
+end
+
 local tt = {__lt = function (a,b) return a.val < b.val end}
 a = {}
 for i=1,10 do  a[i] = {val=math.random(100)}; setmetatable(a[i], tt); end
@@ -540,6 +540,96 @@ else
   assert(y == x)
   local z = T.externstr(x)   -- external allocated long string
   assert(z == y)
+  -- long substrings of external strings
+  x = string.rep("abc", 200)
+  y = T.externstr(x)
+  assert(y:sub(4, 400) == x:sub(1, 397))
+end
+
+
+do print("testing long substrings")
+  local base = string.rep("0123456789", 1000)
+  local s = base:sub(11, 9990)    -- (may be a view into 'base')
+  assert(#s == 9980 and s == base:sub(1, 9980))
+  local s1 = s:sub(1001, 2000)          -- substring of a substring
+  assert(#s1 == 1000 and s1 == string.rep("0123456789", 100))
+  local t = {[s1] = true}
+  base = nil; s = nil
+  collectgarbage(); collectgarbage()
+  assert(t[string.rep("0123456789", 100)])
+  assert(s1:find("90") == 10 and s1:upper() == s1)
+  assert(s1 .. "x" == string.rep("0123456789", 100) .. "x")
+  assert(s1:sub(2, 1000) > s1 and s1 < s1:sub(2, 1000))
+  assert(s1:sub(1, 999) < s1 and not (s1 < s1:sub(1, 999)))
+  assert(s1:sub(1000) == "9" and s1:sub(1001) == "")
+  -- numerals in long substrings
+  local n = string.rep(" ", 300) .. "0x10  " .. string.rep("z", 300)
+  assert(n:sub(1, 306) + 1 == 17 and math.tointeger(n:sub(1, 306)) == 16)
+  assert(tonumber(n:sub(1, 307)) == nil)
+  n = string.rep("0", 250) .. "1.5" .. string.rep("z", 300)
+  assert(n:sub(1, 253) * 2 == 3.0)
+  -- with embedded zeros
+  n = string.rep("\0", 400) .. "end"
+  assert(#n:sub(2, 403) == 402 and n:sub(2, 403):sub(-3) == "end")
+  assert(tostring(n:sub(300)) == string.rep("\0", 101) .. "end")
+end
+
+
+do print("testing string buffers")
+  local b = string.buffer()
+  assert(#b == 0 and b:tostring() == "" and tostring(b) == "")
+  assert(b:append("abc", 12, "", 1.5, -7) == b)
+  assert(#b == 10 and b:tostring() == "abc121.5-7")
+  assert(b:appendf("<%d|%s|%5.1f|%q>", 10, "x", 2.25, "\n") == b)
+  assert(tostring(b) == "abc121.5-7<10|x|  2.2|\"\\\n\">")
+  b:reset():append("xy")
+  b:append(b, "-", b)    -- buffers as arguments, including itself
+  assert(b:tostring() == "xyxy-xyxy-")
+  assert(string.format("%s", b) == "xyxy-xyxy-")
+
+  -- errors keep what was already appended
+  checkerror("string expected, got table", b.append, b, "a", {})
+  checkerror("bad argument #4 .*number expected", b.appendf, b, "%d%d", 1, "x")
+  assert(b:tostring() == "xyxy-xyxy-a")
+  checkerror("invalid size", string.buffer, -1)
+  checkerror("invalid size", b.reserve, b, -1)
+  checkerror("string.buffer expected", b.append, "x")
+
+  -- long contents are shared with the result of 'tostring'
+  local big = string.rep("0123456789", 1000)
+  b = string.buffer(10):reserve(100):append(big)
+  local s = b:tostring()
+  assert(s == big and b:tostring() == s and #b == #big)
+  b:append("!")     -- buffer gets its own copy again
+  assert(s == big and b:tostring() == big .. "!")
+  b:reset()
+  assert(#b == 0 and s == big and b:tostring() == "")
+  b:append(s, s)
+  collectgarbage()
+  assert(b:tostring() == big .. big)
+
+  if T then   -- memory errors keep the contents of the buffer
+    for i = 0, 4 do
+      b = string.buffer():append(big)
+      T.alloccount(i)
+      local ok, s = pcall(b.tostring, b)
+      T.alloccount()
+      assert(not ok or s == big)
+      assert(#b == #big and b:tostring() == big)   -- now shared
+      T.alloccount(0)
+      ok = pcall(b.append, b, "!")   -- copying shared contents fails
+      T.alloccount()
+      assert(not ok and b:tostring() == big)
+      assert(b:append("!"):tostring() == big .. "!")
+    end
+  end
+
+  -- many small pieces
+  b = string.buffer()
+  for i = 1, 10000 do b:appendf("%d,", i):append(i, ";") end
+  local t = {}
+  for i = 1, 10000 do t[#t + 1] = i .. "," .. i .. ";" end
+  assert(b:tostring() == table.concat(t))
 end
 
 print('OK')